@@ -1,485 +1,3348 @@
-/* Contact Management System */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-
-#define MAX_CONTACTS 100         // Maximum number of contacts
-#define NAME_LENGTH 50           // Maximum length for name
-#define PHONE_LENGTH 15          // Maximum length for phone number
-#define EMAIL_LENGTH 50          // Maximum length for email
-#define FILENAME "contacts.txt"  // File to save and load contacts
-#define BATCH_FILENAME "batch_contacts.txt" // File for batch operations
-#define KEY 5                    // Encryption key for Caesar cipher
-
-// Structure to hold contact information
-typedef struct {
-    char name[NAME_LENGTH];
-    char phone[PHONE_LENGTH];
-    char email[EMAIL_LENGTH];
-} Contact;
-
-// Global array to store contacts and a counter
-Contact contactList[MAX_CONTACTS];
-int contactCount = 0;
-
-// Function prototypes
-void loadContactsFromFile();
-void saveContactsToFile();
-void addContact();
-void displayContacts();
-void searchContact();
-void deleteContact();
-void sortContacts();
-void validateInput(char *input, int length);
-int validateEmail(const char *email);
-int validatePhoneNumber(const char *phone);
-void clearInputBuffer();
-void displayMenu();
-void advancedSearch();
-void batchAddContacts();
-void encryptData(char *data);
-void decryptData(char *data);
-
-int main() {
-    int choice;
-
-    // Load contacts from file at the start
-    loadContactsFromFile();
-
-    while (1) {
-        displayMenu();
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clearInputBuffer(); // Clear newline character from input buffer
-
-        switch (choice) {
-            case 1:
-                addContact();
-                break;
-            case 2:
-                displayContacts();
-                break;
-            case 3:
-                break;
-            case 4:
-            case 5:
-                sortContacts();
-                break;
-            case 6:
-                break;
-            case 7:
-                batchAddContacts();
-                break;
-            case 8:
-                saveContactsToFile();
-                printf("Contacts saved to %s successfully.\n", FILENAME);
-                break;
-            case 9:
-                saveContactsToFile();
-                printf("Exiting program. Contacts saved to %s.\n", FILENAME);
-                exit(0);
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-    }
-    return 0;
-}
-
-/**
- * Display the main menu options to the user.
- */
-void displayMenu() {
-    printf("\n--- Contact Management System ---\n");
-    printf("1. Add New Contact\n");
-    printf("2. Display All Contacts\n");
-    printf("3. Search Contact\n");
-    printf("4. Delete Contact\n");
-    printf("5. Sort Contacts\n");
-    printf("6. Advanced Search\n");
-    printf("7. Batch Add Contacts\n");
-    printf("8. Save Contacts\n");
-    printf("9. Exit\n");
-}
-
-/**
- * Clear the input buffer to remove any leftover characters.
- */
-void clearInputBuffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF) {}
-}
-
-/**
- * Load contacts from the file into the contact list.
- * Decrypts sensitive data after loading.
- */
-void loadContactsFromFile() {
-    FILE *file = fopen(FILENAME, "r");
-    if (file == NULL) {
-        // File does not exist, no contacts to load
-        return;
-    }
-
-    while (fscanf(file, "%49[^,],%14[^,],%49[^\n]\n",
-                  contactList[contactCount].name,
-                  contactList[contactCount].phone,
-                  contactList[contactCount].email) != EOF) {
-        // Decrypt sensitive data
-        decryptData(contactList[contactCount].phone);
-        decryptData(contactList[contactCount].email);
-        contactCount++;
-    }
-
-    fclose(file);
-}
-
-/**
- * Save contacts from the contact list into the file.
- * Encrypts sensitive data before saving.
- */
-void saveContactsToFile() {
-    FILE *file = fopen(FILENAME, "w");
-    if (file == NULL) {
-        printf("Error opening file for writing.\n");
-        return;
-    }
-
-    for (int i = 0; i < contactCount; i++) {
-        // Encrypt sensitive data
-        encryptData(contactList[i].phone);
-        encryptData(contactList[i].email);
-
-        fprintf(file, "%s,%s,%s\n",
-                contactList[i].name,
-                contactList[i].phone,
-                contactList[i].email);
-
-        // Decrypt back after saving
-        decryptData(contactList[i].phone);
-        decryptData(contactList[i].email);
-    }
-
-    fclose(file);
-}
-
-/**
- * Add a new contact to the contact list.
- */
-void addContact() {
-    if (contactCount >= MAX_CONTACTS) {
-        printf("Contact list is full. Cannot add more contacts.\n");
-        return;
-    }
-
-    Contact newContact;
-
-    printf("Enter Name: ");
-    fgets(newContact.name, NAME_LENGTH, stdin);
-    validateInput(newContact.name, NAME_LENGTH);
-
-    printf("Enter Phone Number: ");
-    fgets(newContact.phone, PHONE_LENGTH, stdin);
-    validateInput(newContact.phone, PHONE_LENGTH);
-
-    if (!validatePhoneNumber(newContact.phone)) {
-        printf("Invalid phone number format.\n");
-        return;
-    }
-
-    printf("Enter Email: ");
-    fgets(newContact.email, EMAIL_LENGTH, stdin);
-    validateInput(newContact.email, EMAIL_LENGTH);
-
-    if (!validateEmail(newContact.email)) {
-        printf("Invalid email format.\n");
-        return;
-    }
-
-    contactList[contactCount++] = newContact;
-    printf("Contact added successfully.\n");
-}
-
-/**
- * Display all contacts in the contact list.
- */
-void displayContacts() {
-    if (contactCount == 0) {
-        printf("No contacts to display.\n");
-        return;
-    }
-
-    printf("\n--- Contact List ---\n");
-    for (int i = 0; i < contactCount; i++) {
-        printf("Contact %d:\n", i + 1);
-        printf(" Name: %s\n", contactList[i].name);
-        printf(" Phone: %s\n", contactList[i].phone);
-        printf(" Email: %s\n", contactList[i].email);
-    }
-}
-
-/**
- * Search for a contact by name, phone, or email.
- 
-void searchContact() {
-    char searchTerm[NAME_LENGTH];
-    int found = 0;
-
-    printf("Enter the term to search: ");
-    fgets(searchTerm, NAME_LENGTH, stdin);
-    validateInput(searchTerm, NAME_LENGTH);
-
-    for (int i = 0; i < contactCount; i++) {
-        if (strcasecmp(contactList[i].name, searchTerm) != NULL ||
-            strcasecmp(contactList[i].phone, searchTerm) != NULL ||
-            strcasecmp(contactList[i].email, searchTerm) != NULL) {
-            printf("Contact found:\n");
-            printf(" Name: %s\n", contactList[i].name);
-            printf(" Phone: %s\n", contactList[i].phone);
-            printf(" Email: %s\n", contactList[i].email);
-            found = 1;
-        }
-    }
-
-    if (!found) {
-        printf("No matching contacts found.\n");
-    }
-}
-*/
-/**
- * Delete a contact by name.
- */
-void deleteContact() {
-    char deleteName[NAME_LENGTH];
-    int found = 0;
-
-    printf("Enter the name of the contact to delete: ");
-    fgets(deleteName, NAME_LENGTH, stdin);
-    validateInput(deleteName, NAME_LENGTH);
-
-    for (int i = 0; i < contactCount; i++) {
-        if (strcasecmp(contactList[i].name, deleteName) == 0) {
-            // Shift contacts to fill the gap
-            for (int j = i; j < contactCount - 1; j++) {
-                contactList[j] = contactList[j + 1];
-            }
-            contactCount--;
-            printf("Contact deleted successfully.\n");
-            found = 1;
-            break;
-        }
-    }
-
-    if (!found) {
-        printf("Contact not found.\n");
-    }
-}
-
-/**
- * Sort contacts by name using bubble sort algorithm.
- */
-void sortContacts() {
-    if (contactCount < 2) {
-        printf("Not enough contacts to sort.\n");
-        return;
-    }
-
-    for (int i = 0; i < contactCount - 1; i++) {
-        for (int j = 0; j < contactCount - i - 1; j++) {
-            if (strcasecmp(contactList[j].name, contactList[j + 1].name) > 0) {
-                // Swap contacts
-                Contact temp = contactList[j];
-                contactList[j] = contactList[j + 1];
-                contactList[j + 1] = temp;
-            }
-        }
-    }
-
-    printf("Contacts sorted by name successfully.\n");
-}
-
-/**
- * Perform advanced search with options.
- */
-/**void advancedSearch() {
-    int choice;
-    char searchTerm[NAME_LENGTH];
-    int found = 0;
-
-    printf("\n--- Advanced Search ---\n");
-    printf("1. Search by Partial Name\n");
-    printf("2. Search by Phone Number\n");
-    printf("3. Search by Email\n");
-    printf("4. Search by Multiple Fields\n");
-    printf("Enter your choice: ");
-    scanf("%d", &choice);
-    clearInputBuffer();
-
-    switch (choice) {
-        case 1:
-            printf("Enter partial name to search: ");
-            fgets(searchTerm, NAME_LENGTH, stdin);
-            validateInput(searchTerm, NAME_LENGTH);
-            for (int i = 0; i < contactCount; i++) {
-                if (strcasestr(contactList[i].name, searchTerm) != NULL) {
-                    printf("Contact found:\n");
-                    printf(" Name: %s\n", contactList[i].name);
-                    printf(" Phone: %s\n", contactList[i].phone);
-                    printf(" Email: %s\n", contactList[i].email);
-                    found = 1;
-                }
-            }
-            break;
-        case 2:
-            printf("Enter phone number to search: ");
-            fgets(searchTerm, PHONE_LENGTH, stdin);
-            validateInput(searchTerm, PHONE_LENGTH);
-            for (int i = 0; i < contactCount; i++) {
-                if (strcasestr(contactList[i].phone, searchTerm) != NULL) {
-                    printf("Contact found:\n");
-                    printf(" Name: %s\n", contactList[i].name);
-                    printf(" Phone: %s\n", contactList[i].phone);
-                    printf(" Email: %s\n", contactList[i].email);
-                    found = 1;
-                }
-            }
-            break;
-        case 3:
-            printf("Enter email to search: ");
-            fgets(searchTerm, EMAIL_LENGTH, stdin);
-            validateInput(searchTerm, EMAIL_LENGTH);
-            for (int i = 0; i < contactCount; i++) {
-                if (strcasestr(contactList[i].email, searchTerm) != NULL) {
-                    printf("Contact found:\n");
-                    printf(" Name: %s\n", contactList[i].name);
-                    printf(" Phone: %s\n", contactList[i].phone);
-                    printf(" Email: %s\n", contactList[i].email);
-                    found = 1;
-                }
-            }
-            break;
-        case 4:
-            printf("Enter term to search in all fields: ");
-            fgets(searchTerm, NAME_LENGTH, stdin);
-            validateInput(searchTerm, NAME_LENGTH);
-            for (int i = 0; i < contactCount; i++) {
-                if (strcasestr(contactList[i].name, searchTerm) != NULL ||
-                    strcasestr(contactList[i].phone, searchTerm) != NULL ||
-                    strcasestr(contactList[i].email, searchTerm) != NULL) {
-                    printf("Contact found:\n");
-                    printf(" Name: %s\n", contactList[i].name);
-                    printf(" Phone: %s\n", contactList[i].phone);
-                    printf(" Email: %s\n", contactList[i].email);
-                    found = 1;
-                }
-            }
-            break;
-        default:
-            printf("Invalid choice.\n");
-            return;
-    }
-
-    if (!found) {
-        printf("No matching contacts found.\n");
-    }
-}
-**/
-/**
- * Batch add contacts from a formatted text file.
- */
-void batchAddContacts() {
-    FILE *file = fopen(BATCH_FILENAME, "r");
-    if (file == NULL) {
-        printf("Batch file %s not found.\n", BATCH_FILENAME);
-        return;
-    }
-
-    int addedCount = 0;
-    Contact tempContact;
-
-    while (fscanf(file, "%49[^,],%14[^,],%49[^\n]\n",
-                  tempContact.name,
-                  tempContact.phone,
-                  tempContact.email) != EOF) {
-        if (contactCount >= MAX_CONTACTS) {
-            printf("Contact list is full. Cannot add more contacts.\n");
-            break;
-        }
-
-        // Validate data
-        if (!validatePhoneNumber(tempContact.phone) || !validateEmail(tempContact.email)) {
-            printf("Invalid data for contact: %s. Skipping.\n", tempContact.name);
-            continue;
-        }
-
-        contactList[contactCount++] = tempContact;
-        addedCount++;
-    }
-
-    fclose(file);
-    printf("Batch add complete. %d contacts added.\n", addedCount);
-}
-
-/**
- * Validate and remove newline character from input string.
- */
-void validateInput(char *input, int length) {
-    size_t ln = strlen(input) - 1;
-    if (input[ln] == '\n') {
-        input[ln] = '\0';
-    } else {
-        // Clear the input buffer if input is too long
-        clearInputBuffer();
-    }
-}
-
-/**
- * Validate the email format.
- * Simple validation to check for presence of '@' and '.' characters.
- */
-int validateEmail(const char *email) {
-    const char *atSign = strchr(email, '@');
-    if (atSign == NULL) {
-        return 0;
-    }
-
-    const char *dot = strchr(atSign, '.');
-    if (dot == NULL) {
-        return 0;
-    }
-
-    return 1;
-}
-
-/**
- * Validate the phone number format.
- * Ensure it contains only digits and has acceptable length.
- */
-int validatePhoneNumber(const char *phone) {
-    int length = strlen(phone);
-    for (int i = 0; i < length; i++) {
-        if (!isdigit(phone[i]) && phone[i] != '+' && phone[i] != '-' && phone[i] != ' ') {
-            return 0;
-        }
-    }
-    return 1;
-}
-
-/**
- * Encrypt data using a simple Caesar cipher.
- */
-void encryptData(char *data) {
-    for (int i = 0; data[i] != '\0'; i++) {
-        data[i] += KEY;
-    }
-}
-
-/**
- * Decrypt data using a simple Caesar cipher.
- */
-void decryptData(char *data) {
-    for (int i = 0; data[i] != '\0'; i++) {
-        data[i] -= KEY;
-    }
-}
+/* Contact Management System */
+
+#define _GNU_SOURCE              // strcasestr, getline
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "contact_management.h"
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define INITIAL_CAPACITY 100     // Initial capacity of the contact list (grows on demand)
+#define FILENAME "contacts.txt"  // File to save and load contacts
+#define BATCH_FILENAME "batch_contacts.txt" // File for batch operations
+#define KEY_EXTENSION ".key"     // Raw 32-byte key of an encrypted file: its name with this extension
+#define KEY 5                    // Key of the legacy Caesar cipher, only used to read old files
+#define IMPORT_CHUNK_SIZE (4 << 20) // Bytes read per chunk by the batch importer
+#define IMPORT_QUEUE_DEPTH 8     // Chunks in flight between reader, parsers and commit stage
+#define IMPORT_MAX_WORKERS 16    // Upper bound on parse/validate worker threads
+#define SCAN_PADDING 32          // Readable bytes required past the end of a scanned buffer
+#define CIPHER_MAGIC "CNTSEAL1"  // First 8 bytes of an encrypted contacts file
+#define CIPHER_HEADER_LENGTH 32  // Magic, cipher id, block size, file nonce, reserved
+#define CIPHER_BLOCK_SIZE (1 << 20) // Plaintext bytes per authenticated block
+#define CIPHER_KEY_LENGTH 32
+#define CIPHER_NONCE_LENGTH 12
+#define CIPHER_TAG_LENGTH 16
+#define CONTACT_MAX_READERS 64   // Reader threads that can be registered per store at once
+#define CACHE_LINE 64            // Bytes per cache line; each reader slot gets one to itself
+#define DEDUP_THRESHOLD 0.85     // Match score from which two contacts are the same person
+#define DEDUP_PHONE_SUFFIX 7     // Trailing phone digits used as a blocking key
+#define DEDUP_MAX_BLOCK 64       // Blocks up to this size are compared pair by pair
+#define DEDUP_WINDOW 16          // Neighbours compared inside larger blocks
+#define COLUMN_PADDING (EMAIL_LENGTH + SCAN_PADDING) // Zero bytes after a column so filters can over-read
+
+// Authenticated cipher used to seal the contacts file, block by block
+typedef struct {
+    const char *name;
+    uint32_t id;             // Stored in the file header to pick the stage when loading
+    void (*seal)(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                 const uint8_t *in, size_t length, uint8_t *out, uint8_t *tag);
+    int (*open)(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                const uint8_t *in, size_t length, uint8_t *out, const uint8_t *tag);
+} CipherStage;
+
+// Hash index slot: key hash and position in the contact array (-1 if empty)
+typedef struct {
+    uint64_t hash;
+    int position;
+} IndexSlot;
+
+// Open-addressing hash table of contact positions
+typedef struct {
+    IndexSlot *slots;
+    size_t capacity;
+    size_t count;
+} HashIndex;
+
+// Immutable copy of the contacts and name index, shared with readers
+struct ContactSnapshot {
+    Contact *contacts;
+    int count;
+    HashIndex names;
+    uint64_t retireEpoch;    // Global epoch when it was replaced
+    struct ContactSnapshot *nextRetired;
+};
+
+// Per-thread reader registration; epoch is 0 while the reader is outside a snapshot
+// Aligned (and so padded) to a cache line, so readers never share one
+struct ContactReader {
+    _Alignas(CACHE_LINE) _Atomic uint64_t epoch;
+    atomic_int used;
+    ContactStore *store;
+};
+_Static_assert(sizeof(struct ContactReader) == CACHE_LINE, "reader slots must be exactly one cache line");
+
+// A growable array of contacts, its indexes and the file it is saved to
+struct ContactStore {
+    char *filename;
+    char *keyFilename;       // At-rest key of the file, next to it (see keyFilenameFor)
+    Contact *contacts;
+    int count;
+    int capacity;
+    HashIndex records;       // Whole-record hash, used to reject duplicates
+    HashIndex names;         // Case-folded name hash, used by lookup and delete
+
+    // Concurrent readers see published snapshots only (see contactStorePublish)
+    _Atomic(ContactSnapshot *) current;
+    _Atomic uint64_t globalEpoch;
+    ContactSnapshot *retired;    // Replaced snapshots waiting for readers to leave
+    pthread_mutex_t publishLock;
+    ContactReader readers[CONTACT_MAX_READERS];
+};
+
+#ifndef CONTACT_LIBRARY
+// Store used by the interactive menu
+static ContactStore *menuStore = NULL;
+#endif
+
+// Function prototypes
+void addContact();
+void displayContacts();
+void searchContact();
+void deleteContact();
+void sortContacts();
+void validateInput(char *input, int length);
+int validateEmail(const char *email);
+int validatePhoneNumber(const char *phone);
+void clearInputBuffer();
+void displayMenu();
+void advancedSearch();
+void batchAddContacts();
+void decryptData(char *data);
+static int loadCipherKey(const char *keyFilename, uint8_t key[CIPHER_KEY_LENGTH], int create);
+static char *openSealedContacts(const char *keyFilename, const uint8_t *data, size_t length, size_t *plainLength);
+int benchCipher(long megabytes);
+int benchSnapshots(int threads, double seconds);
+int benchDedup(int rows);
+int benchColumns(int rows);
+static int ensureContactCapacity(ContactStore *store, int needed);
+static uint64_t hashContact(const Contact *contact);
+static uint64_t hashName(const char *name);
+static int findContactRecord(const ContactStore *store, const Contact *contact, uint64_t hash);
+static int reserveIndex(HashIndex *index, size_t count);
+static void insertIndex(HashIndex *index, int position, uint64_t hash);
+static void rebuildContactIndexes(ContactStore *store);
+static int appendContact(ContactStore *store, const Contact *contact);
+static int appendHashedContact(ContactStore *store, const Contact *contact, uint64_t hash);
+void runBatchCommands(FILE *input);
+int benchValidation(long lines);
+static int copyField(char *dest, size_t capacity, const char *start, const char *end);
+
+#ifndef CONTACT_LIBRARY
+int main(int argc, char *argv[]) {
+    int choice;
+    ContactStatus status;
+
+    if (argc > 1 && strcmp(argv[1], "--bench-validate") == 0) {
+        return benchValidation(argc > 2 ? atol(argv[2]) : 1000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-cipher") == 0) {
+        return benchCipher(argc > 2 ? atol(argv[2]) : 256);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-snapshots") == 0) {
+        return benchSnapshots(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atof(argv[3]) : 1.0);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-dedup") == 0) {
+        return benchDedup(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-columns") == 0) {
+        return benchColumns(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+
+
+    // Load contacts from file at the start
+    menuStore = contactStoreOpen(FILENAME, &status);
+    if (menuStore == NULL) {
+        printf("Cannot open %s: %s.\n", FILENAME, contactStatusMessage(status));
+        return 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        FILE *input = stdin;
+        if (argc > 2 && strcmp(argv[2], "-") != 0) {
+            input = fopen(argv[2], "r");
+            if (input == NULL) {
+                printf("Cannot open command file %s.\n", argv[2]);
+                return 1;
+            }
+        }
+        runBatchCommands(input);
+        if (input != stdin) fclose(input);
+        contactStoreClose(menuStore);
+        return 0;
+    }
+
+    while (1) {
+        displayMenu();
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+        clearInputBuffer(); // Clear newline character from input buffer
+
+        switch (choice) {
+            case 1:
+                addContact();
+                break;
+            case 2:
+                displayContacts();
+                break;
+            case 3:
+                break;
+            case 4:
+            case 5:
+                sortContacts();
+                break;
+            case 6:
+                break;
+            case 7:
+                batchAddContacts();
+                break;
+            case 8:
+                status = contactStoreSave(menuStore);
+                if (status == CONTACT_OK) {
+                    printf("Contacts saved to %s successfully.\n", FILENAME);
+                } else {
+                    printf("Error saving %s: %s.\n", FILENAME, contactStatusMessage(status));
+                }
+                break;
+            case 9:
+                status = contactStoreSave(menuStore);
+                if (status != CONTACT_OK) {
+                    printf("Error saving %s: %s.\n", FILENAME, contactStatusMessage(status));
+                } else {
+                    printf("Exiting program. Contacts saved to %s.\n", FILENAME);
+                }
+                contactStoreClose(menuStore);
+                exit(0);
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    }
+    return 0;
+}
+#endif
+
+/**
+ * Copy one field of a scanned line, rejecting fields that do not fit.
+ */
+static int copyField(char *dest, size_t capacity, const char *start, const char *end) {
+    size_t length = (size_t)(end - start);
+    if (length >= capacity) {
+        return 0;
+    }
+    memcpy(dest, start, length);
+    dest[length] = '\0';
+    return 1;
+}
+
+/**
+ * Fields of one "name,phone,email" line as located by scanContactLine().
+ * Pointers refer into the scanned buffer; nothing is copied.
+ */
+typedef struct {
+    const char *name, *phone, *email;
+    size_t nameLength, phoneLength, emailLength;
+    const char *next;        // Start of the following line
+    int complete;            // Both commas were found
+    int phoneValid;          // Phone holds only digits, '+', '-' and spaces
+    int emailValid;          // Email has an '@' followed later by a '.'
+} LineFields;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+#define SCAN_WIDTH 32
+typedef __m256i ScanBlock;
+#define scanLoad(p) _mm256_loadu_si256((const __m256i *)(p))
+#define scanSplat(c) _mm256_set1_epi8((char)(c))
+#define scanEqual(a, b) _mm256_cmpeq_epi8((a), (b))
+#define scanGreater(a, b) _mm256_cmpgt_epi8((a), (b))
+#define scanOr(a, b) _mm256_or_si256((a), (b))
+#define scanAnd(a, b) _mm256_and_si256((a), (b))
+#define scanSub(a, b) _mm256_sub_epi8((a), (b))
+#define scanMask(a) ((uint64_t)(uint32_t)_mm256_movemask_epi8(a))
+#else
+#define SCAN_WIDTH 16
+typedef __m128i ScanBlock;
+#define scanLoad(p) _mm_loadu_si128((const __m128i *)(p))
+#define scanSplat(c) _mm_set1_epi8((char)(c))
+#define scanEqual(a, b) _mm_cmpeq_epi8((a), (b))
+#define scanGreater(a, b) _mm_cmpgt_epi8((a), (b))
+#define scanOr(a, b) _mm_or_si128((a), (b))
+#define scanAnd(a, b) _mm_and_si128((a), (b))
+#define scanSub(a, b) _mm_sub_epi8((a), (b))
+#define scanMask(a) ((uint64_t)(uint32_t)_mm_movemask_epi8(a))
+#endif
+
+/**
+ * Split and validate one line in a single vectorised pass.
+ * Each block yields bitmasks of delimiters and character classes; a small
+ * state machine walks the masks instead of the bytes. The buffer must have
+ * SCAN_PADDING readable bytes after limit.
+ */
+static void scanContactLine(const char *line, const char *limit, LineFields *out) {
+    const ScanBlock newline = scanSplat('\n'), comma = scanSplat(','), at = scanSplat('@');
+    const ScanBlock dot = scanSplat('.'), plus = scanSplat('+'), minus = scanSplat('-');
+    const ScanBlock space = scanSplat(' '), zero = scanSplat('0');
+    const ScanBlock belowZero = scanSplat(-1), aboveNine = scanSplat(10);
+    const uint64_t all = (1ULL << SCAN_WIDTH) - 1;
+
+    int stage = 0, seenAt = 0;
+    uint64_t fieldStart = 0;     // Bit where the current field starts in this block
+    const char *commas[2] = { NULL, NULL };
+    const char *end = limit;
+
+    out->phoneValid = 1;
+    out->emailValid = 0;
+
+    for (const char *p = line;; p += SCAN_WIDTH) {
+        ScanBlock block = scanLoad(p);
+        uint64_t endBits = scanMask(scanEqual(block, newline));
+        if (limit - p < SCAN_WIDTH) {
+            endBits |= 1ULL << (limit - p);
+        }
+        uint64_t live = endBits ? ((endBits & -endBits) - 1) : all;
+        uint64_t commaBits = scanMask(scanEqual(block, comma)) & live;
+
+        if (stage == 0 && commaBits) {
+            int bit = __builtin_ctzll(commaBits);
+            commas[0] = p + bit;
+            commaBits &= commaBits - 1;
+            fieldStart = (uint64_t)bit + 1;
+            stage = 1;
+        }
+        if (stage == 1) {
+            ScanBlock digits = scanSub(block, zero);
+            ScanBlock isPhone = scanOr(scanAnd(scanGreater(digits, belowZero), scanGreater(aboveNine, digits)),
+                                       scanOr(scanEqual(block, plus),
+                                              scanOr(scanEqual(block, minus), scanEqual(block, space))));
+            uint64_t badBits = ~scanMask(isPhone) & all;
+            uint64_t region = (all << fieldStart) & live;
+            if (commaBits) {
+                int bit = __builtin_ctzll(commaBits);
+                commas[1] = p + bit;
+                region &= (1ULL << bit) - 1;
+                fieldStart = (uint64_t)bit + 1;
+                stage = 2;
+            } else {
+                fieldStart = 0;
+            }
+            if (badBits & region) {
+                out->phoneValid = 0;
+            }
+        }
+        if (stage == 2) {
+            uint64_t region = (all << fieldStart) & live;
+            fieldStart = 0;
+            if (!seenAt) {
+                uint64_t atBits = scanMask(scanEqual(block, at)) & region;
+                if (atBits) {
+                    seenAt = 1;
+                    region &= ~((atBits & -atBits) - 1);
+                } else {
+                    region = 0;
+                }
+            }
+            if (seenAt && (scanMask(scanEqual(block, dot)) & region)) {
+                out->emailValid = 1;
+            }
+        }
+        if (endBits) {
+            end = p + __builtin_ctzll(endBits);
+            break;
+        }
+    }
+
+    out->next = end < limit ? end + 1 : limit;
+    if (end > line && end[-1] == '\r') {
+        end--;
+    }
+    out->complete = commas[1] != NULL;
+    out->name = line;
+    out->nameLength = (size_t)((commas[0] ? commas[0] : end) - line);
+    if (out->complete) {
+        out->phone = commas[0] + 1;
+        out->phoneLength = (size_t)(commas[1] - out->phone);
+        out->email = commas[1] + 1;
+        out->emailLength = end > out->email ? (size_t)(end - out->email) : 0;
+        // A stripped '\r' never matters for the masks: it is neither '.' nor '@'
+    } else {
+        out->phoneValid = out->emailValid = 0;
+    }
+}
+#endif
+
+#if !defined(CONTACT_LIBRARY) || (!defined(__AVX2__) && !defined(__SSE2__)) // Benchmark baseline or fallback
+/**
+ * Scalar reference implementation of scanContactLine(), used when no SIMD
+ * instruction set is available and as the baseline in --bench-validate.
+ */
+static void scanContactLineScalar(const char *line, const char *limit, LineFields *out) {
+    const char *commas[2] = { NULL, NULL };
+    const char *atSign = NULL;
+    const char *p = line;
+
+    out->phoneValid = 1;
+    out->emailValid = 0;
+    for (; p < limit && *p != '\n'; p++) {
+        char c = *p;
+        if (commas[1] != NULL) {
+            if (atSign == NULL) {
+                if (c == '@') atSign = p;
+            } else if (c == '.') {
+                out->emailValid = 1;
+            }
+        } else if (c == ',') {
+            commas[commas[0] != NULL] = p;
+        } else if (commas[0] != NULL &&
+                   !((unsigned)(c - '0') < 10 || c == '+' || c == '-' || c == ' ')) {
+            out->phoneValid = 0;
+        }
+    }
+
+    const char *end = p;
+    out->next = end < limit ? end + 1 : limit;
+    if (end > line && end[-1] == '\r') {
+        end--;
+    }
+    out->complete = commas[1] != NULL;
+    out->name = line;
+    out->nameLength = (size_t)((commas[0] ? commas[0] : end) - line);
+    if (out->complete) {
+        out->phone = commas[0] + 1;
+        out->phoneLength = (size_t)(commas[1] - out->phone);
+        out->email = commas[1] + 1;
+        out->emailLength = end > out->email ? (size_t)(end - out->email) : 0;
+    } else {
+        out->phoneValid = out->emailValid = 0;
+    }
+}
+#endif
+
+#if !defined(__AVX2__) && !defined(__SSE2__)
+#define scanContactLine scanContactLineScalar
+#endif
+
+#ifndef CONTACT_LIBRARY
+/**
+ * Display the main menu options to the user.
+ */
+void displayMenu() {
+    printf("\n--- Contact Management System ---\n");
+    printf("1. Add New Contact\n");
+    printf("2. Display All Contacts\n");
+    printf("3. Search Contact\n");
+    printf("4. Delete Contact\n");
+    printf("5. Sort Contacts\n");
+    printf("6. Advanced Search\n");
+    printf("7. Batch Add Contacts\n");
+    printf("8. Save Contacts\n");
+    printf("9. Exit\n");
+}
+
+/**
+ * Clear the input buffer to remove any leftover characters.
+ */
+void clearInputBuffer() {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF) {}
+}
+#endif
+
+/**
+ * Load a 32-bit little-endian word.
+ */
+static uint32_t load32le(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * Load a 64-bit little-endian word.
+ */
+static uint64_t load64le(const uint8_t *p) {
+    return (uint64_t)load32le(p) | (uint64_t)load32le(p + 4) << 32;
+}
+
+/**
+ * Store a 32-bit little-endian word.
+ */
+static void store32le(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * Store a 64-bit little-endian word.
+ */
+static void store64le(uint8_t *p, uint64_t v) {
+    store32le(p, (uint32_t)v);
+    store32le(p + 4, (uint32_t)(v >> 32));
+}
+
+#define CHACHA_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define CHACHA_QUARTER(a, b, c, d) \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 16); \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 12); \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 8);  \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 7);
+
+/**
+ * Set up the ChaCha20 input state (RFC 8439 section 2.3).
+ */
+static void chachaInit(uint32_t state[16], const uint8_t key[32], const uint8_t nonce[12], uint32_t counter) {
+    state[0] = 0x61707865; state[1] = 0x3320646e; state[2] = 0x79622d32; state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) state[4 + i] = load32le(key + 4 * i);
+    state[12] = counter;
+    for (int i = 0; i < 3; i++) state[13 + i] = load32le(nonce + 4 * i);
+}
+
+/**
+ * Produce one 64-byte ChaCha20 keystream block.
+ */
+static void chachaBlock(const uint32_t state[16], uint8_t out[64]) {
+    uint32_t x[16];
+    memcpy(x, state, sizeof(x));
+    for (int round = 0; round < 10; round++) {
+        CHACHA_QUARTER(x[0], x[4], x[8], x[12]);
+        CHACHA_QUARTER(x[1], x[5], x[9], x[13]);
+        CHACHA_QUARTER(x[2], x[6], x[10], x[14]);
+        CHACHA_QUARTER(x[3], x[7], x[11], x[15]);
+        CHACHA_QUARTER(x[0], x[5], x[10], x[15]);
+        CHACHA_QUARTER(x[1], x[6], x[11], x[12]);
+        CHACHA_QUARTER(x[2], x[7], x[8], x[13]);
+        CHACHA_QUARTER(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++) store32le(out + 4 * i, x[i] + state[i]);
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+#define CHACHA_LANES 8
+typedef __m256i ChachaVector;
+#define chachaSplat(v) _mm256_set1_epi32((int)(v))
+#define chachaAdd(a, b) _mm256_add_epi32((a), (b))
+#define chachaXor(a, b) _mm256_xor_si256((a), (b))
+#define chachaRotl(x, n) _mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), 32 - (n)))
+#define chachaRotl16(x) _mm256_shuffle_epi8((x), _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, \
+                                                                   2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13))
+#define chachaRotl8(x) _mm256_shuffle_epi8((x), _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, \
+                                                                  3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14))
+#define chachaLaneOffsets() _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+#define chachaUnpackLo32 _mm256_unpacklo_epi32
+#define chachaUnpackHi32 _mm256_unpackhi_epi32
+#define chachaUnpackLo64 _mm256_unpacklo_epi64
+#define chachaUnpackHi64 _mm256_unpackhi_epi64
+#else
+#define CHACHA_LANES 4
+typedef __m128i ChachaVector;
+#define chachaSplat(v) _mm_set1_epi32((int)(v))
+#define chachaAdd(a, b) _mm_add_epi32((a), (b))
+#define chachaXor(a, b) _mm_xor_si128((a), (b))
+#define chachaRotl(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+#define chachaRotl16(x) _mm_shufflehi_epi16(_mm_shufflelo_epi16((x), 0xb1), 0xb1)
+#define chachaRotl8(x) chachaRotl((x), 8)
+#define chachaLaneOffsets() _mm_setr_epi32(0, 1, 2, 3)
+#define chachaUnpackLo32 _mm_unpacklo_epi32
+#define chachaUnpackHi32 _mm_unpackhi_epi32
+#define chachaUnpackLo64 _mm_unpacklo_epi64
+#define chachaUnpackHi64 _mm_unpackhi_epi64
+#endif
+
+#define CHACHA_VQUARTER(a, b, c, d) \
+    a = chachaAdd(a, b); d = chachaXor(d, a); d = chachaRotl16(d);   \
+    c = chachaAdd(c, d); b = chachaXor(b, c); b = chachaRotl(b, 12); \
+    a = chachaAdd(a, b); d = chachaXor(d, a); d = chachaRotl8(d);    \
+    c = chachaAdd(c, d); b = chachaXor(b, c); b = chachaRotl(b, 7);
+
+/**
+ * XOR CHACHA_LANES consecutive 64-byte blocks with keystream in one go.
+ * Each vector holds one state word of every block (counter, counter+1, ...);
+ * the result is transposed back to block order with unpack instructions.
+ */
+static void chachaXorWide(const uint32_t state[16], const uint8_t *in, uint8_t *out) {
+    ChachaVector x[16], input[16];
+    for (int i = 0; i < 16; i++) input[i] = chachaSplat(state[i]);
+    input[12] = chachaAdd(input[12], chachaLaneOffsets());
+    for (int i = 0; i < 16; i++) x[i] = input[i];
+    for (int round = 0; round < 10; round++) {
+        CHACHA_VQUARTER(x[0], x[4], x[8], x[12]);
+        CHACHA_VQUARTER(x[1], x[5], x[9], x[13]);
+        CHACHA_VQUARTER(x[2], x[6], x[10], x[14]);
+        CHACHA_VQUARTER(x[3], x[7], x[11], x[15]);
+        CHACHA_VQUARTER(x[0], x[5], x[10], x[15]);
+        CHACHA_VQUARTER(x[1], x[6], x[11], x[12]);
+        CHACHA_VQUARTER(x[2], x[7], x[8], x[13]);
+        CHACHA_VQUARTER(x[3], x[4], x[9], x[14]);
+    }
+    // 4x4 transpose of each group of four words: rows[k] holds words
+    // 4g..4g+3 of block k (and of block k+4 in the upper half with AVX2)
+    ChachaVector rows[4][4];
+    for (int g = 0; g < 4; g++) {
+        ChachaVector a0 = chachaAdd(x[4 * g], input[4 * g]), a1 = chachaAdd(x[4 * g + 1], input[4 * g + 1]);
+        ChachaVector a2 = chachaAdd(x[4 * g + 2], input[4 * g + 2]), a3 = chachaAdd(x[4 * g + 3], input[4 * g + 3]);
+        ChachaVector t0 = chachaUnpackLo32(a0, a1), t1 = chachaUnpackLo32(a2, a3);
+        ChachaVector t2 = chachaUnpackHi32(a0, a1), t3 = chachaUnpackHi32(a2, a3);
+        rows[g][0] = chachaUnpackLo64(t0, t1);
+        rows[g][1] = chachaUnpackHi64(t0, t1);
+        rows[g][2] = chachaUnpackLo64(t2, t3);
+        rows[g][3] = chachaUnpackHi64(t2, t3);
+    }
+#if defined(__AVX2__)
+    for (int k = 0; k < 4; k++) {
+        for (int g = 0; g < 4; g += 2) {
+            __m256i low = _mm256_permute2x128_si256(rows[g][k], rows[g + 1][k], 0x20);
+            __m256i high = _mm256_permute2x128_si256(rows[g][k], rows[g + 1][k], 0x31);
+            const uint8_t *src = in + 64 * k + 16 * g;
+            uint8_t *dst = out + 64 * k + 16 * g;
+            _mm256_storeu_si256((__m256i *)dst, _mm256_xor_si256(low, _mm256_loadu_si256((const __m256i *)src)));
+            _mm256_storeu_si256((__m256i *)(dst + 256),
+                                _mm256_xor_si256(high, _mm256_loadu_si256((const __m256i *)(src + 256))));
+        }
+    }
+#else
+    for (int k = 0; k < 4; k++) {
+        for (int g = 0; g < 4; g++) {
+            const uint8_t *src = in + 64 * k + 16 * g;
+            _mm_storeu_si128((__m128i *)(out + 64 * k + 16 * g),
+                             _mm_xor_si128(rows[g][k], _mm_loadu_si128((const __m128i *)src)));
+        }
+    }
+#endif
+}
+#endif
+
+/**
+ * XOR data with the ChaCha20 keystream starting at the given block counter.
+ */
+static void chachaXorStream(const uint8_t key[32], const uint8_t nonce[12], uint32_t counter,
+                            const uint8_t *in, uint8_t *out, size_t length) {
+    uint32_t state[16];
+    chachaInit(state, key, nonce, counter);
+#if defined(__AVX2__) || defined(__SSE2__)
+    while (length >= 64 * CHACHA_LANES) {
+        chachaXorWide(state, in, out);
+        state[12] += CHACHA_LANES;
+        in += 64 * CHACHA_LANES;
+        out += 64 * CHACHA_LANES;
+        length -= 64 * CHACHA_LANES;
+    }
+#endif
+    uint8_t block[64];
+    while (length > 0) {
+        size_t n = length < 64 ? length : 64;
+        chachaBlock(state, block);
+        for (size_t i = 0; i < n; i++) out[i] = in[i] ^ block[i];
+        state[12]++;
+        in += n;
+        out += n;
+        length -= n;
+    }
+}
+
+// Poly1305 accumulator with 44/44/42-bit limbs (RFC 8439 section 2.5)
+typedef struct {
+    uint64_t r[3], h[3], pad[2];
+    uint8_t buffer[16];
+    size_t buffered;
+} Poly1305;
+
+static void poly1305Init(Poly1305 *st, const uint8_t key[32]) {
+    uint64_t t0 = load64le(key), t1 = load64le(key + 8);
+    st->r[0] = t0 & 0xffc0fffffffULL;
+    st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    st->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+    st->h[0] = st->h[1] = st->h[2] = 0;
+    st->pad[0] = load64le(key + 16);
+    st->pad[1] = load64le(key + 24);
+    st->buffered = 0;
+}
+
+static void poly1305Blocks(Poly1305 *st, const uint8_t *m, size_t length, uint64_t hibit) {
+    const uint64_t mask44 = 0xfffffffffffULL, mask42 = 0x3ffffffffffULL;
+    uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+    while (length >= 16) {
+        uint64_t t0 = load64le(m), t1 = load64le(m + 8);
+        h0 += t0 & mask44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & mask44;
+        h2 += ((t1 >> 24) & mask42) | hibit;
+        unsigned __int128 d0 = (unsigned __int128)h0 * r0 + (unsigned __int128)h1 * s2 + (unsigned __int128)h2 * s1;
+        unsigned __int128 d1 = (unsigned __int128)h0 * r1 + (unsigned __int128)h1 * r0 + (unsigned __int128)h2 * s2;
+        unsigned __int128 d2 = (unsigned __int128)h0 * r2 + (unsigned __int128)h1 * r1 + (unsigned __int128)h2 * r0;
+        uint64_t c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & mask44;
+        d1 += c; c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & mask44;
+        d2 += c; c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & mask42;
+        h0 += c * 5; c = h0 >> 44; h0 &= mask44;
+        h1 += c;
+        m += 16;
+        length -= 16;
+    }
+    st->h[0] = h0; st->h[1] = h1; st->h[2] = h2;
+}
+
+static void poly1305Update(Poly1305 *st, const uint8_t *m, size_t length) {
+    if (st->buffered) {
+        size_t n = 16 - st->buffered;
+        if (n > length) n = length;
+        memcpy(st->buffer + st->buffered, m, n);
+        st->buffered += n;
+        m += n;
+        length -= n;
+        if (st->buffered < 16) return;
+        poly1305Blocks(st, st->buffer, 16, 1ULL << 40);
+        st->buffered = 0;
+    }
+    size_t whole = length & ~(size_t)15;
+    poly1305Blocks(st, m, whole, 1ULL << 40);
+    memcpy(st->buffer, m + whole, length - whole);
+    st->buffered = length - whole;
+}
+
+// Zero padding up to the next 16-byte boundary, as the AEAD construction requires
+static void poly1305Pad(Poly1305 *st) {
+    static const uint8_t zeros[16];
+    if (st->buffered) poly1305Update(st, zeros, 16 - st->buffered);
+}
+
+static void poly1305Finish(Poly1305 *st, uint8_t tag[16]) {
+    const uint64_t mask44 = 0xfffffffffffULL, mask42 = 0x3ffffffffffULL;
+    if (st->buffered) {
+        st->buffer[st->buffered] = 1;
+        memset(st->buffer + st->buffered + 1, 0, 15 - st->buffered);
+        poly1305Blocks(st, st->buffer, 16, 0);
+    }
+    uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], c;
+    c = h1 >> 44; h1 &= mask44; h2 += c;
+    c = h2 >> 42; h2 &= mask42; h0 += c * 5;
+    c = h0 >> 44; h0 &= mask44; h1 += c;
+    c = h1 >> 44; h1 &= mask44; h2 += c;
+    c = h2 >> 42; h2 &= mask42; h0 += c * 5;
+    c = h0 >> 44; h0 &= mask44; h1 += c;
+
+    // Compute h - p and keep it if it did not underflow (constant time)
+    uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= mask44;
+    uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= mask44;
+    uint64_t g2 = h2 + c - (1ULL << 42);
+    c = (g2 >> 63) - 1;
+    h0 = (h0 & ~c) | (g0 & c);
+    h1 = (h1 & ~c) | (g1 & c);
+    h2 = (h2 & ~c) | (g2 & c);
+
+    uint64_t t0 = st->pad[0], t1 = st->pad[1];
+    h0 += t0 & mask44; c = h0 >> 44; h0 &= mask44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & mask44) + c; c = h1 >> 44; h1 &= mask44;
+    h2 += ((t1 >> 24) & mask42) + c; h2 &= mask42;
+    store64le(tag, h0 | (h1 << 44));
+    store64le(tag + 8, (h1 >> 20) | (h2 << 24));
+}
+
+/**
+ * Key Poly1305 with the first keystream block and absorb the padded aad
+ * (RFC 8439 section 2.8).
+ */
+static void chachaPolyStart(Poly1305 *mac, const uint8_t key[32], const uint8_t nonce[12],
+                            const uint8_t *aad, size_t aadLength) {
+    uint8_t oneTimeKey[64];
+    uint32_t state[16];
+    chachaInit(state, key, nonce, 0);
+    chachaBlock(state, oneTimeKey);
+    poly1305Init(mac, oneTimeKey);
+    poly1305Update(mac, aad, aadLength);
+    poly1305Pad(mac);
+}
+
+/**
+ * Pad the ciphertext, append both lengths and produce the tag.
+ */
+static void chachaPolyFinish(Poly1305 *mac, size_t aadLength, size_t length, uint8_t tag[16]) {
+    uint8_t lengths[16];
+    poly1305Pad(mac);
+    store64le(lengths, aadLength);
+    store64le(lengths + 8, length);
+    poly1305Update(mac, lengths, sizeof(lengths));
+    poly1305Finish(mac, tag);
+}
+
+// Bytes encrypted and then authenticated together, so the MAC reads
+// ciphertext that is still in L1 instead of making a second pass over memory
+#define CHACHA_POLY_CHUNK (16 * 1024)
+
+static void chachaPolySeal(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                           const uint8_t *in, size_t length, uint8_t *out, uint8_t *tag) {
+    Poly1305 mac;
+    chachaPolyStart(&mac, key, nonce, aad, aadLength);
+    for (size_t offset = 0; offset < length; offset += CHACHA_POLY_CHUNK) {
+        size_t n = length - offset < CHACHA_POLY_CHUNK ? length - offset : CHACHA_POLY_CHUNK;
+        chachaXorStream(key, nonce, (uint32_t)(1 + offset / 64), in + offset, out + offset, n);
+        poly1305Update(&mac, out + offset, n);
+    }
+    chachaPolyFinish(&mac, aadLength, length, tag);
+}
+
+static int chachaPolyOpen(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                          const uint8_t *in, size_t length, uint8_t *out, const uint8_t *tag) {
+    uint8_t expected[16];
+    uint8_t diff = 0;
+    Poly1305 mac;
+    chachaPolyStart(&mac, key, nonce, aad, aadLength);
+    poly1305Update(&mac, in, length);
+    chachaPolyFinish(&mac, aadLength, length, expected);
+    for (int i = 0; i < 16; i++) diff |= expected[i] ^ tag[i];
+    if (diff != 0) {
+        return 0;
+    }
+    chachaXorStream(key, nonce, 1, in, out, length);
+    return 1;
+}
+
+static const CipherStage chachaPolyStage = {
+    "ChaCha20-Poly1305", 1, chachaPolySeal, chachaPolyOpen
+};
+
+// Cipher stages the loader accepts, looked up by the id stored in the file header
+static const CipherStage *cipherStages[] = { &chachaPolyStage, NULL };
+
+/**
+ * Fill a buffer with bytes from the system random source.
+ */
+static int randomBytes(uint8_t *out, size_t length) {
+    FILE *source = fopen("/dev/urandom", "rb");
+    if (source == NULL) {
+        return 0;
+    }
+    size_t got = fread(out, 1, length, source);
+    fclose(source);
+    return got == length;
+}
+
+/**
+ * Name of the key file of a contacts file: the same path with its extension
+ * replaced by KEY_EXTENSION, so contacts.txt is sealed with contacts.key in
+ * the same directory. Returns a malloc'd string, or NULL when out of memory.
+ */
+static char *keyFilenameFor(const char *filename) {
+    const char *base = strrchr(filename, '/');
+    base = base != NULL ? base + 1 : filename;
+    const char *dot = strrchr(base, '.');
+    size_t stem = strlen(filename);
+    if (dot != NULL && dot > base && strcmp(dot, KEY_EXTENSION) != 0) {
+        stem = (size_t)(dot - filename); // A file named *.key keeps its name and gets *.key.key
+    }
+    char *keyFilename = malloc(stem + sizeof(KEY_EXTENSION));
+    if (keyFilename != NULL) {
+        memcpy(keyFilename, filename, stem);
+        memcpy(keyFilename + stem, KEY_EXTENSION, sizeof(KEY_EXTENSION));
+    }
+    return keyFilename;
+}
+
+/**
+ * Read the at-rest key from keyFilename, creating a random one if allowed.
+ */
+static int loadCipherKey(const char *keyFilename, uint8_t key[CIPHER_KEY_LENGTH], int create) {
+    FILE *file = fopen(keyFilename, "rb");
+    if (file != NULL) {
+        size_t got = fread(key, 1, CIPHER_KEY_LENGTH, file);
+        fclose(file);
+        return got == CIPHER_KEY_LENGTH;
+    }
+    if (!create || !randomBytes(key, CIPHER_KEY_LENGTH)) {
+        return 0;
+    }
+    int fd = open(keyFilename, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = write(fd, key, CIPHER_KEY_LENGTH) == CIPHER_KEY_LENGTH;
+    close(fd);
+    return ok;
+}
+
+/**
+ * Build the associated data that binds a block to its file and position,
+ * so blocks cannot be reordered, dropped or spliced between files.
+ */
+static size_t blockAssociatedData(const uint8_t header[CIPHER_HEADER_LENGTH], uint64_t index,
+                                  int final, uint8_t *aad) {
+    memcpy(aad, header, CIPHER_HEADER_LENGTH);
+    store64le(aad + CIPHER_HEADER_LENGTH, index);
+    aad[CIPHER_HEADER_LENGTH + 8] = (uint8_t)final;
+    return CIPHER_HEADER_LENGTH + 9;
+}
+
+/**
+ * Derive the nonce of one block from the per-file random nonce.
+ */
+static void blockNonce(const uint8_t header[CIPHER_HEADER_LENGTH], uint64_t index, uint8_t nonce[CIPHER_NONCE_LENGTH]) {
+    memcpy(nonce, header + 16, CIPHER_NONCE_LENGTH);
+    store64le(nonce + 4, load64le(nonce + 4) ^ index);
+}
+
+/**
+ * Streaming writer for the encrypted contacts file: buffers plaintext and
+ * seals it in CIPHER_BLOCK_SIZE blocks, each with its own tag.
+ */
+typedef struct {
+    FILE *file;
+    const CipherStage *stage;
+    uint8_t key[CIPHER_KEY_LENGTH];
+    uint8_t header[CIPHER_HEADER_LENGTH];
+    uint8_t *plain, *sealed;
+    size_t length;
+    uint64_t index;
+    int failed;
+} SealedWriter;
+
+static void sealedFlush(SealedWriter *writer, int final) {
+    uint8_t aad[CIPHER_HEADER_LENGTH + 9], nonce[CIPHER_NONCE_LENGTH], prefix[4], tag[CIPHER_TAG_LENGTH];
+    size_t aadLength = blockAssociatedData(writer->header, writer->index, final, aad);
+    blockNonce(writer->header, writer->index, nonce);
+    writer->stage->seal(writer->key, nonce, aad, aadLength, writer->plain, writer->length, writer->sealed, tag);
+    store32le(prefix, (uint32_t)writer->length);
+    if (fwrite(prefix, 1, 4, writer->file) != 4 ||
+        fwrite(writer->sealed, 1, writer->length, writer->file) != writer->length ||
+        fwrite(tag, 1, CIPHER_TAG_LENGTH, writer->file) != CIPHER_TAG_LENGTH) {
+        writer->failed = 1;
+    }
+    writer->index++;
+    writer->length = 0;
+}
+
+static void sealedWrite(SealedWriter *writer, const char *data, size_t length) {
+    while (length > 0) {
+        size_t n = CIPHER_BLOCK_SIZE - writer->length;
+        if (n > length) n = length;
+        memcpy(writer->plain + writer->length, data, n);
+        writer->length += n;
+        data += n;
+        length -= n;
+        if (writer->length == CIPHER_BLOCK_SIZE) {
+            sealedFlush(writer, 0);
+        }
+    }
+}
+
+/**
+ * Decrypt and authenticate a whole encrypted contacts file.
+ * Returns a malloc'd plaintext buffer with SCAN_PADDING spare bytes,
+ * or NULL if the file is damaged, truncated or the key is wrong.
+ */
+static char *openSealedContacts(const char *keyFilename, const uint8_t *data, size_t length, size_t *plainLength) {
+    if (length < CIPHER_HEADER_LENGTH || memcmp(data, CIPHER_MAGIC, 8) != 0) {
+        return NULL;
+    }
+    const CipherStage *stage = NULL;
+    for (int i = 0; cipherStages[i] != NULL; i++) {
+        if (cipherStages[i]->id == load32le(data + 8)) stage = cipherStages[i];
+    }
+    uint8_t key[CIPHER_KEY_LENGTH];
+    if (stage == NULL || !loadCipherKey(keyFilename, key, 0)) {
+        return NULL;
+    }
+
+    char *plain = malloc(length + SCAN_PADDING);
+    if (plain == NULL) {
+        return NULL;
+    }
+    const uint8_t *header = data, *p = data + CIPHER_HEADER_LENGTH, *end = data + length;
+    size_t produced = 0;
+    int sawFinal = 0;
+    for (uint64_t index = 0; !sawFinal; index++) {
+        if (end - p < 4) break;
+        size_t blockLength = load32le(p);
+        if (blockLength > CIPHER_BLOCK_SIZE || (size_t)(end - p - 4) < blockLength + CIPHER_TAG_LENGTH) break;
+        const uint8_t *cipherText = p + 4;
+        p = cipherText + blockLength + CIPHER_TAG_LENGTH;
+        int final = p == end;
+
+        uint8_t aad[CIPHER_HEADER_LENGTH + 9], nonce[CIPHER_NONCE_LENGTH];
+        size_t aadLength = blockAssociatedData(header, index, final, aad);
+        blockNonce(header, index, nonce);
+        if (!stage->open(key, nonce, aad, aadLength, cipherText, blockLength,
+                         (uint8_t *)plain + produced, cipherText + blockLength)) {
+            break;
+        }
+        produced += blockLength;
+        sawFinal = final;
+    }
+    if (!sawFinal) {
+        free(plain);
+        return NULL;
+    }
+    *plainLength = produced;
+    return plain;
+}
+
+/**
+ * Read a whole file into a buffer with SCAN_PADDING spare bytes.
+ * Returns NULL if the file cannot be read or memory runs out.
+ */
+static char *readWholeFile(FILE *file, size_t *lengthOut) {
+    size_t length = 0, capacity = 1 << 16;
+    char *buffer = malloc(capacity + SCAN_PADDING);
+    while (buffer != NULL) {
+        length += fread(buffer + length, 1, capacity - length, file);
+        if (length < capacity) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = realloc(buffer, capacity + SCAN_PADDING);
+        if (grown == NULL) {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+    *lengthOut = length;
+    return buffer;
+}
+
+/**
+ * Load contacts from the store's file into its contact list.
+ * Encrypted files are authenticated and decrypted block by block; files in
+ * the old Caesar format are still read so they can be migrated on save.
+ */
+static ContactStatus loadStoreFile(ContactStore *store) {
+    FILE *file = fopen(store->filename, "r");
+    if (file == NULL) {
+        // File does not exist, no contacts to load
+        return CONTACT_OK;
+    }
+
+    // Read the whole file so the SIMD line scanner can run over one buffer
+    size_t length;
+    char *buffer = readWholeFile(file, &length);
+    fclose(file);
+    if (buffer == NULL) {
+        return CONTACT_NO_MEMORY;
+    }
+
+    int legacy = length < CIPHER_HEADER_LENGTH || memcmp(buffer, CIPHER_MAGIC, 8) != 0;
+    if (!legacy) {
+        char *plain = openSealedContacts(store->keyFilename, (const uint8_t *)buffer, length, &length);
+        free(buffer);
+        if (plain == NULL) {
+            return CONTACT_AUTH_FAILED;
+        }
+        buffer = plain;
+    }
+
+    ContactStatus status = CONTACT_OK;
+    const char *cursor = buffer, *limit = buffer + length;
+    while (cursor < limit) {
+        LineFields fields;
+        Contact tempContact;
+        scanContactLine(cursor, limit, &fields);
+        cursor = fields.next;
+        if (!fields.complete ||
+            !copyField(tempContact.name, NAME_LENGTH, fields.name, fields.name + fields.nameLength) ||
+            !copyField(tempContact.phone, PHONE_LENGTH, fields.phone, fields.phone + fields.phoneLength) ||
+            !copyField(tempContact.email, EMAIL_LENGTH, fields.email, fields.email + fields.emailLength)) {
+            continue;
+        }
+        if (legacy) {
+            decryptData(tempContact.phone);
+            decryptData(tempContact.email);
+        }
+        if (appendContact(store, &tempContact) < 0) {
+            status = CONTACT_NO_MEMORY;
+            break;
+        }
+    }
+    free(buffer);
+    return status;
+}
+
+/**
+ * Open a contact store and load its file if it exists. An encrypted file is
+ * opened with the key file next to it (contacts.key for contacts.txt).
+ * Returns NULL and sets *status if the file cannot be read or authenticated.
+ */
+ContactStore *contactStoreOpen(const char *filename, ContactStatus *status) {
+    ContactStatus ignored;
+    if (status == NULL) status = &ignored;
+
+    // The reader slots need cache-line alignment, which calloc() does not promise
+    ContactStore *store = aligned_alloc(_Alignof(ContactStore), sizeof(ContactStore));
+    if (store != NULL) memset(store, 0, sizeof(ContactStore));
+    if (store == NULL || (store->filename = strdup(filename)) == NULL ||
+        (store->keyFilename = keyFilenameFor(filename)) == NULL) {
+        if (store != NULL) free(store->filename);
+        free(store);
+        *status = CONTACT_NO_MEMORY;
+        return NULL;
+    }
+    atomic_init(&store->current, NULL);
+    atomic_init(&store->globalEpoch, 1);
+    pthread_mutex_init(&store->publishLock, NULL);
+    *status = loadStoreFile(store);
+    if (*status != CONTACT_OK) {
+        contactStoreClose(store);
+        return NULL;
+    }
+    return store;
+}
+
+/**
+ * Free one snapshot and its copies of the contacts and index.
+ */
+static void freeSnapshot(ContactSnapshot *snapshot) {
+    if (snapshot != NULL) {
+        free(snapshot->contacts);
+        free(snapshot->names.slots);
+        free(snapshot);
+    }
+}
+
+/**
+ * Release a store and everything it owns. Does not save.
+ * All readers must have been unregistered.
+ */
+void contactStoreClose(ContactStore *store) {
+    if (store == NULL) {
+        return;
+    }
+    freeSnapshot(atomic_load(&store->current));
+    while (store->retired != NULL) {
+        ContactSnapshot *next = store->retired->nextRetired;
+        freeSnapshot(store->retired);
+        store->retired = next;
+    }
+    pthread_mutex_destroy(&store->publishLock);
+    free(store->contacts);
+    free(store->records.slots);
+    free(store->names.slots);
+    free(store->filename);
+    free(store->keyFilename);
+    free(store);
+}
+
+/**
+ * Save the store's contacts into its file.
+ * Records are serialised into a separate buffer and sealed with an
+ * authenticated cipher; the live records are never modified. The file is
+ * written under a temporary name and renamed so a failed save keeps the
+ * previous version.
+ */
+ContactStatus contactStoreSave(ContactStore *store) {
+    SealedWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.stage = &chachaPolyStage;
+    if (!loadCipherKey(store->keyFilename, writer.key, 1)) {
+        return CONTACT_IO_ERROR;
+    }
+    memcpy(writer.header, CIPHER_MAGIC, 8);
+    store32le(writer.header + 8, writer.stage->id);
+    store32le(writer.header + 12, CIPHER_BLOCK_SIZE);
+
+    size_t nameLength = strlen(store->filename);
+    char *tempName = malloc(nameLength + 5);
+    writer.plain = malloc(CIPHER_BLOCK_SIZE);
+    writer.sealed = malloc(CIPHER_BLOCK_SIZE);
+    if (tempName == NULL || writer.plain == NULL || writer.sealed == NULL) {
+        free(tempName);
+        free(writer.plain);
+        free(writer.sealed);
+        return CONTACT_NO_MEMORY;
+    }
+    memcpy(tempName, store->filename, nameLength);
+    memcpy(tempName + nameLength, ".tmp", 5);
+    writer.file = fopen(tempName, "wb");
+    if (writer.file == NULL || !randomBytes(writer.header + 16, CIPHER_NONCE_LENGTH)) {
+        if (writer.file) fclose(writer.file);
+        free(tempName);
+        free(writer.plain);
+        free(writer.sealed);
+        return CONTACT_IO_ERROR;
+    }
+
+    writer.failed = fwrite(writer.header, 1, CIPHER_HEADER_LENGTH, writer.file) != CIPHER_HEADER_LENGTH;
+    for (int i = 0; i < store->count; i++) {
+        char line[NAME_LENGTH + PHONE_LENGTH + EMAIL_LENGTH + 4];
+        int n = snprintf(line, sizeof(line), "%s,%s,%s\n",
+                         store->contacts[i].name,
+                         store->contacts[i].phone,
+                         store->contacts[i].email);
+        sealedWrite(&writer, line, (size_t)n);
+    }
+    sealedFlush(&writer, 1);
+
+    if (fclose(writer.file) != 0) {
+        writer.failed = 1;
+    }
+    ContactStatus status = CONTACT_OK;
+    if (writer.failed || rename(tempName, store->filename) != 0) {
+        remove(tempName);
+        status = CONTACT_IO_ERROR;
+    }
+    memset(writer.key, 0, sizeof(writer.key));
+    free(tempName);
+    free(writer.plain);
+    free(writer.sealed);
+    return status;
+}
+
+/**
+ * Copy a NUL-terminated string into a fixed field, rejecting overlong input.
+ */
+static int copyString(char *dest, size_t capacity, const char *src) {
+    return copyField(dest, capacity, src, src + strlen(src));
+}
+
+/**
+ * Validate and add one contact. Identical records are rejected.
+ */
+ContactStatus contactStoreAdd(ContactStore *store, const char *name, const char *phone, const char *email) {
+    Contact contact;
+    if (!copyString(contact.name, NAME_LENGTH, name) ||
+        !copyString(contact.phone, PHONE_LENGTH, phone) ||
+        !copyString(contact.email, EMAIL_LENGTH, email)) {
+        return CONTACT_TOO_LONG;
+    }
+    if (!validatePhoneNumber(contact.phone)) {
+        return CONTACT_INVALID_PHONE;
+    }
+    if (!validateEmail(contact.email)) {
+        return CONTACT_INVALID_EMAIL;
+    }
+    uint64_t hash = hashContact(&contact);
+    if (findContactRecord(store, &contact, hash) >= 0) {
+        return CONTACT_DUPLICATE;
+    }
+    return appendHashedContact(store, &contact, hash) < 0 ? CONTACT_NO_MEMORY : CONTACT_OK;
+}
+
+/**
+ * Find the position of the first contact whose name matches, ignoring case.
+ */
+static int findContactByName(const Contact *contacts, const HashIndex *index, const char *name) {
+    if (index->capacity == 0) {
+        return -1;
+    }
+    uint64_t hash = hashName(name);
+    int best = -1;
+    size_t mask = index->capacity - 1;
+    for (size_t i = hash & mask; index->slots[i].position >= 0; i = (i + 1) & mask) {
+        const IndexSlot *slot = &index->slots[i];
+        if (slot->hash == hash && (best < 0 || slot->position < best) &&
+            strcasecmp(contacts[slot->position].name, name) == 0) {
+            best = slot->position;
+        }
+    }
+    return best;
+}
+
+/**
+ * Look up a contact by name (case-insensitive). The pointer stays valid
+ * until the store is next modified.
+ */
+const Contact *contactStoreLookup(const ContactStore *store, const char *name) {
+    int position = findContactByName(store->contacts, &store->names, name);
+    return position < 0 ? NULL : &store->contacts[position];
+}
+
+/**
+ * Delete the first contact with the given name (case-insensitive).
+ */
+ContactStatus contactStoreDelete(ContactStore *store, const char *name) {
+    int position = findContactByName(store->contacts, &store->names, name);
+    if (position < 0) {
+        return CONTACT_NOT_FOUND;
+    }
+    // Shift contacts to fill the gap
+    memmove(&store->contacts[position], &store->contacts[position + 1],
+            (size_t)(store->count - position - 1) * sizeof(Contact));
+    store->count--;
+    rebuildContactIndexes(store);
+    return CONTACT_OK;
+}
+
+/**
+ * Call back for every contact whose chosen field contains term (case-insensitive).
+ * Returns the number of matches reported.
+ */
+static size_t searchContacts(const Contact *contacts, int count, ContactField field, const char *term,
+                             ContactCallback callback, void *context) {
+    size_t matches = 0;
+    for (int i = 0; i < count; i++) {
+        const Contact *contact = &contacts[i];
+        int match;
+        switch (field) {
+            case FIELD_NAME: match = strcasestr(contact->name, term) != NULL; break;
+            case FIELD_PHONE: match = strcasestr(contact->phone, term) != NULL; break;
+            case FIELD_EMAIL: match = strcasestr(contact->email, term) != NULL; break;
+            default:
+                match = strcasestr(contact->name, term) != NULL ||
+                        strcasestr(contact->phone, term) != NULL ||
+                        strcasestr(contact->email, term) != NULL;
+                break;
+        }
+        if (match) {
+            matches++;
+            if (callback != NULL && callback(contact, context)) {
+                break;
+            }
+        }
+    }
+    return matches;
+}
+
+size_t contactStoreSearch(const ContactStore *store, ContactField field, const char *term,
+                          ContactCallback callback, void *context) {
+    return searchContacts(store->contacts, store->count, field, term, callback, context);
+}
+
+/**
+ * Free retired snapshots that no registered reader can still be using.
+ * A reader announces the epoch it entered in; a snapshot retired at epoch E
+ * is only reachable by readers whose announced epoch is <= E.
+ * Called with publishLock held.
+ */
+static void reclaimSnapshots(ContactStore *store) {
+    uint64_t oldestActive = UINT64_MAX;
+    for (int i = 0; i < CONTACT_MAX_READERS; i++) {
+        uint64_t epoch = atomic_load(&store->readers[i].epoch);
+        if (epoch != 0 && epoch < oldestActive) {
+            oldestActive = epoch;
+        }
+    }
+    ContactSnapshot **link = &store->retired;
+    while (*link != NULL) {
+        ContactSnapshot *snapshot = *link;
+        if (snapshot->retireEpoch < oldestActive) {
+            *link = snapshot->nextRetired;
+            freeSnapshot(snapshot);
+        } else {
+            link = &snapshot->nextRetired;
+        }
+    }
+}
+
+/**
+ * Make every change since the last publish visible to readers at once.
+ * Writers batch adds, deletes and imports on the store and publish when the
+ * batch is complete; readers never wait for them. The previous snapshot is
+ * freed once no reader is inside it any more. Mutations and publishing
+ * must come from one writer thread at a time.
+ */
+ContactStatus contactStorePublish(ContactStore *store) {
+    ContactSnapshot *snapshot = calloc(1, sizeof(ContactSnapshot));
+    if (snapshot == NULL) {
+        return CONTACT_NO_MEMORY;
+    }
+    snapshot->count = store->count;
+    snapshot->names.capacity = store->names.capacity;
+    snapshot->names.count = store->names.count;
+    snapshot->contacts = malloc((size_t)(store->count ? store->count : 1) * sizeof(Contact));
+    snapshot->names.slots = store->names.capacity ? malloc(store->names.capacity * sizeof(IndexSlot)) : NULL;
+    if (snapshot->contacts == NULL || (store->names.capacity && snapshot->names.slots == NULL)) {
+        freeSnapshot(snapshot);
+        return CONTACT_NO_MEMORY;
+    }
+    memcpy(snapshot->contacts, store->contacts, (size_t)store->count * sizeof(Contact));
+    if (store->names.capacity) {
+        memcpy(snapshot->names.slots, store->names.slots, store->names.capacity * sizeof(IndexSlot));
+    }
+
+    pthread_mutex_lock(&store->publishLock);
+    ContactSnapshot *old = atomic_exchange(&store->current, snapshot);
+    if (old != NULL) {
+        old->retireEpoch = atomic_fetch_add(&store->globalEpoch, 1);
+        old->nextRetired = store->retired;
+        store->retired = old;
+    }
+    reclaimSnapshots(store);
+    pthread_mutex_unlock(&store->publishLock);
+    return CONTACT_OK;
+}
+
+/**
+ * Register the calling thread as a reader of the store.
+ * Returns NULL if CONTACT_MAX_READERS readers are already registered.
+ */
+ContactReader *contactReaderRegister(ContactStore *store) {
+    for (int i = 0; i < CONTACT_MAX_READERS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&store->readers[i].used, &expected, 1)) {
+            store->readers[i].store = store;
+            atomic_store(&store->readers[i].epoch, 0);
+            return &store->readers[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Give a reader slot back. The reader must not be inside a snapshot.
+ */
+void contactReaderUnregister(ContactReader *reader) {
+    atomic_store(&reader->epoch, 0);
+    atomic_store(&reader->used, 0);
+}
+
+/**
+ * Pin and return the latest published snapshot (NULL before the first
+ * publish). Lock-free: it never waits for writers. The snapshot stays valid
+ * until contactReaderExit().
+ */
+const ContactSnapshot *contactReaderEnter(ContactReader *reader) {
+    ContactStore *store = reader->store;
+    // Announce the epoch before reading the pointer; both are sequentially
+    // consistent so a publisher that swapped the pointer sees the announcement
+    atomic_store(&reader->epoch, atomic_load(&store->globalEpoch));
+    return atomic_load(&store->current);
+}
+
+/**
+ * Leave the snapshot returned by contactReaderEnter().
+ */
+void contactReaderExit(ContactReader *reader) {
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+/**
+ * Look up a contact by name (case-insensitive) in a snapshot.
+ */
+const Contact *contactSnapshotLookup(const ContactSnapshot *snapshot, const char *name) {
+    int position = findContactByName(snapshot->contacts, &snapshot->names, name);
+    return position < 0 ? NULL : &snapshot->contacts[position];
+}
+
+/**
+ * Search a snapshot the same way as contactStoreSearch().
+ */
+size_t contactSnapshotSearch(const ContactSnapshot *snapshot, ContactField field, const char *term,
+                             ContactCallback callback, void *context) {
+    return searchContacts(snapshot->contacts, snapshot->count, field, term, callback, context);
+}
+
+/**
+ * Number of contacts in a snapshot.
+ */
+int contactSnapshotCount(const ContactSnapshot *snapshot) {
+    return snapshot->count;
+}
+
+// Normalised copy of a contact used for duplicate matching
+typedef struct {
+    char name[NAME_LENGTH];      // Lower case, single spaces
+    char phone[PHONE_LENGTH];    // Digits only
+    char email[EMAIL_LENGTH];    // Lower case, no surrounding spaces
+} DedupRecord;
+
+// Blocking key: records are only compared with records sharing a key
+typedef struct {
+    uint64_t key;
+    uint32_t order;          // Sort key inside the block, so windows hold similar records
+    int position;
+} BlockEntry;
+
+/**
+ * Normalise a contact: digits of the phone (dropping the '+', '-' and
+ * spaces validatePhoneNumber accepts), lower-cased email and name.
+ */
+static void normaliseContact(const Contact *contact, DedupRecord *out) {
+    size_t n = 0;
+    int space = 1;
+    for (const char *p = contact->name; *p; p++) {
+        if (isspace((unsigned char)*p)) {
+            space = 1;
+            continue;
+        }
+        if (space && n > 0) out->name[n++] = ' ';
+        out->name[n++] = (char)tolower((unsigned char)*p);
+        space = 0;
+    }
+    out->name[n] = '\0';
+
+    n = 0;
+    for (const char *p = contact->phone; *p; p++) {
+        if (isdigit((unsigned char)*p)) out->phone[n++] = *p;
+    }
+    out->phone[n] = '\0';
+
+    const char *start = contact->email, *end = start + strlen(start);
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    for (n = 0; start + n < end; n++) out->email[n] = (char)tolower((unsigned char)start[n]);
+    out->email[n] = '\0';
+}
+
+/**
+ * Four-character Soundex code of a name, packed into an integer.
+ */
+static uint32_t soundexCode(const char *name) {
+    static const char codes[26] = { 0, 1, 2, 3, 0, 1, 2, 0, 0, 2, 2, 4, 5, 5, 0, 1, 2, 6, 2, 3, 0, 1, 0, 2, 0, 2 };
+    uint32_t code = 0;
+    int length = 0, last = -1;
+    for (const char *p = name; *p && length < 4; p++) {
+        if (*p < 'a' || *p > 'z') continue;
+        int digit = codes[*p - 'a'];
+        if (length == 0) {
+            code = (uint32_t)*p;
+            length = 1;
+        } else if (digit != 0 && digit != last) {
+            code = code * 8 + (uint32_t)digit;
+            length++;
+        }
+        if (*p != 'h' && *p != 'w') last = digit;
+    }
+    while (length++ < 4) code *= 8;
+    return code;
+}
+
+/**
+ * FNV-1a hash of a byte range, tagged with the kind of blocking key.
+ */
+static uint64_t blockKey(int kind, const char *start, size_t length) {
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)kind;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)start[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int compareBlockEntries(const void *a, const void *b) {
+    const BlockEntry *x = a, *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->order != y->order) return x->order < y->order ? -1 : 1;
+    return x->position - y->position;
+}
+
+/**
+ * Levenshtein distance between two short strings, computed only in the
+ * band of width limit around the diagonal. Returns limit + 1 as soon as
+ * the distance is known to exceed limit.
+ */
+static int editDistance(const char *a, const char *b, int limit) {
+    int lengthA = (int)strlen(a), lengthB = (int)strlen(b);
+    if (lengthA - lengthB > limit || lengthB - lengthA > limit) {
+        return limit + 1;
+    }
+    int row[EMAIL_LENGTH + 1];
+    for (int j = 0; j <= lengthB; j++) row[j] = j <= limit ? j : limit + 1;
+    for (int i = 1; i <= lengthA; i++) {
+        int low = i - limit > 1 ? i - limit : 1;
+        int high = i + limit < lengthB ? i + limit : lengthB;
+        int diagonal = row[low - 1];
+        row[low - 1] = low == 1 && i <= limit ? i : limit + 1;
+        int best = row[low - 1];
+        for (int j = low; j <= high; j++) {
+            int above = row[j];
+            int cell = diagonal + (a[i - 1] != b[j - 1]);
+            if (above + 1 < cell) cell = above + 1;
+            if (row[j - 1] + 1 < cell) cell = row[j - 1] + 1;
+            if (cell > limit) cell = limit + 1;
+            row[j] = cell;
+            diagonal = above;
+            if (cell < best) best = cell;
+        }
+        if (best > limit) {
+            return limit + 1;
+        }
+    }
+    return row[lengthB];
+}
+
+/**
+ * Similarity in [0, 1] derived from the edit distance, or 0 when it is
+ * certainly below minimum.
+ */
+static double similarity(const char *a, const char *b, double minimum) {
+    int longest = (int)strlen(a);
+    if ((int)strlen(b) > longest) longest = (int)strlen(b);
+    if (longest == 0) return 1.0;
+    if (minimum > 1.0) return 0.0;
+    int limit = minimum > 0 ? (int)((1.0 - minimum) * longest + 1e-9) : longest;
+    int distance = editDistance(a, b, limit);
+    return distance > limit ? 0.0 : 1.0 - (double)distance / longest;
+}
+
+/**
+ * Weighted match score of two normalised records, exact when it reaches
+ * DEDUP_THRESHOLD. Each field is only compared as far as it can still
+ * lift the total over the threshold; hopeless pairs score 0.
+ */
+static double matchScore(const DedupRecord *a, const DedupRecord *b) {
+    double phone;
+    size_t lengthA = strlen(a->phone), lengthB = strlen(b->phone);
+    if (strcmp(a->phone, b->phone) == 0) {
+        phone = 1.0;
+    } else if (lengthA >= DEDUP_PHONE_SUFFIX && lengthB >= DEDUP_PHONE_SUFFIX &&
+               strcmp(a->phone + lengthA - DEDUP_PHONE_SUFFIX, b->phone + lengthB - DEDUP_PHONE_SUFFIX) == 0) {
+        phone = 0.8; // Same local number, different country or area prefix
+    } else {
+        phone = similarity(a->phone, b->phone, (DEDUP_THRESHOLD - 0.7) / 0.3);
+    }
+    double email = strcmp(a->email, b->email) == 0 ? 1.0
+                 : similarity(a->email, b->email, (DEDUP_THRESHOLD - 0.4 - 0.3 * phone) / 0.3);
+    double name = similarity(a->name, b->name, (DEDUP_THRESHOLD - 0.3 * phone - 0.3 * email) / 0.4);
+    return name == 0.0 ? 0.0 : 0.4 * name + 0.3 * phone + 0.3 * email;
+}
+
+/**
+ * Union-find root with path halving.
+ */
+static int findRoot(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * Find clusters of near-duplicate contacts and optionally merge them.
+ *
+ * Each contact gets up to three blocking keys (last digits of the phone,
+ * email local part, Soundex of the name); only contacts sharing a key are
+ * scored, and large blocks are compared within a sliding window, so the
+ * work stays close to linear. Pairs scoring at least DEDUP_THRESHOLD are
+ * joined with union-find. The earliest contact of each cluster is kept.
+ *
+ * The callback sees every cluster before anything is removed. With merge
+ * set, the other members are then deleted. The number of clusters goes to
+ * *clusters; on CONTACT_NO_MEMORY nothing was reported or removed.
+ */
+ContactStatus contactStoreDedup(ContactStore *store, int merge, ContactClusterCallback callback, void *context,
+                                size_t *clusters) {
+    int n = store->count;
+    *clusters = 0;
+    if (n < 2) {
+        return CONTACT_OK;
+    }
+    DedupRecord *records = malloc((size_t)n * sizeof(DedupRecord));
+    BlockEntry *entries = malloc((size_t)n * 3 * sizeof(BlockEntry));
+    int *parent = malloc((size_t)n * sizeof(int));
+    if (records == NULL || entries == NULL || parent == NULL) {
+        free(records);
+        free(entries);
+        free(parent);
+        return CONTACT_NO_MEMORY;
+    }
+
+    size_t entryCount = 0;
+    for (int i = 0; i < n; i++) {
+        DedupRecord *r = &records[i];
+        normaliseContact(&store->contacts[i], r);
+        parent[i] = i;
+
+        size_t phoneLength = strlen(r->phone);
+        if (phoneLength >= DEDUP_PHONE_SUFFIX) {
+            entries[entryCount++] = (BlockEntry){ blockKey(1, r->phone + phoneLength - DEDUP_PHONE_SUFFIX,
+                                                           DEDUP_PHONE_SUFFIX), 0, i };
+        }
+        const char *at = strchr(r->email, '@');
+        if (at != NULL && at > r->email) {
+            entries[entryCount++] = (BlockEntry){ blockKey(2, r->email, (size_t)(at - r->email)), 0, i };
+        }
+        uint32_t soundex = soundexCode(r->name);
+        if (soundex != 0) {
+            // Soundex blocks get large; order them by the next letters of the name
+            uint32_t order = 0;
+            for (size_t k = 1, length = strlen(r->name); k < 5; k++) {
+                order = order << 8 | (k < length ? (unsigned char)r->name[k] : 0);
+            }
+            entries[entryCount++] = (BlockEntry){ blockKey(3, (const char *)&soundex, sizeof(soundex)), order, i };
+        }
+    }
+    qsort(entries, entryCount, sizeof(BlockEntry), compareBlockEntries);
+
+    for (size_t start = 0; start < entryCount;) {
+        size_t end = start + 1;
+        while (end < entryCount && entries[end].key == entries[start].key) end++;
+        // Small blocks are compared exhaustively, big ones in a sliding window
+        size_t window = end - start <= DEDUP_MAX_BLOCK ? end - start : DEDUP_WINDOW;
+        for (size_t i = start; i < end; i++) {
+            for (size_t j = i + 1; j < end && j <= i + window; j++) {
+                int a = entries[i].position, b = entries[j].position;
+                int rootA = findRoot(parent, a), rootB = findRoot(parent, b);
+                if (rootA != rootB && matchScore(&records[a], &records[b]) >= DEDUP_THRESHOLD) {
+                    // Keep the lowest position as root so it is the survivor
+                    if (rootA < rootB) parent[rootB] = rootA; else parent[rootA] = rootB;
+                }
+            }
+        }
+        start = end;
+    }
+    free(entries);
+    free(records);
+
+    // Group members by root: counting sort keeps list order inside clusters
+    for (int i = 0; i < n; i++) parent[i] = findRoot(parent, i);
+    int *offsets = calloc((size_t)n + 1, sizeof(int));
+    int *fill = malloc((size_t)n * sizeof(int));
+    int *members = malloc((size_t)n * sizeof(int));
+    const Contact **duplicates = malloc((size_t)n * sizeof(Contact *));
+    int ok = offsets != NULL && fill != NULL && members != NULL && duplicates != NULL;
+    if (ok) {
+        for (int i = 0; i < n; i++) offsets[parent[i] + 1]++;
+        for (int i = 0; i < n; i++) offsets[i + 1] += offsets[i];
+        memcpy(fill, offsets, (size_t)n * sizeof(int));
+        for (int i = 0; i < n; i++) members[fill[parent[i]]++] = i;
+
+        for (int root = 0; root < n; root++) {
+            int size = offsets[root + 1] - offsets[root];
+            if (size < 2) continue;
+            (*clusters)++;
+            for (int k = 1; k < size; k++) {
+                duplicates[k - 1] = &store->contacts[members[offsets[root] + k]];
+            }
+            if (callback != NULL) {
+                callback(&store->contacts[root], duplicates, size - 1, context);
+            }
+        }
+
+        if (merge && *clusters > 0) {
+            int kept = 0;
+            for (int i = 0; i < n; i++) {
+                if (parent[i] == i) store->contacts[kept++] = store->contacts[i];
+            }
+            store->count = kept;
+            rebuildContactIndexes(store);
+        }
+    }
+    free(offsets);
+    free(fill);
+    free(members);
+    free(duplicates);
+    free(parent);
+    return ok ? CONTACT_OK : CONTACT_NO_MEMORY;
+}
+
+// One contact field stored contiguously as length-prefixed values
+typedef struct {
+    uint32_t *offsets;       // Position of each value's length byte; count + 1 entries
+    uint8_t *data;           // Length byte then the bytes of each value, plus COLUMN_PADDING
+} ContactColumn;
+
+struct ContactColumns {
+    int count;
+    ContactColumn fields[3]; // Name, phone and email
+};
+
+// Marks hits[i] for every value of the column containing term, ignoring case
+typedef void (*ColumnFilter)(const ContactColumn *column, int count, const char *term, size_t termLength,
+                             uint8_t *hits);
+
+static const char *contactFieldValue(const Contact *contact, int field) {
+    return field == 0 ? contact->name : field == 1 ? contact->phone : contact->email;
+}
+
+/**
+ * Copy the store into one column per field. Like a snapshot, the columns
+ * do not follow later changes to the store; build them again after a batch
+ * of changes. Returns NULL if out of memory.
+ */
+ContactColumns *contactColumnsBuild(const ContactStore *store) {
+    ContactColumns *columns = calloc(1, sizeof(ContactColumns));
+    if (columns == NULL) {
+        return NULL;
+    }
+    columns->count = store->count;
+    for (int f = 0; f < 3; f++) {
+        ContactColumn *column = &columns->fields[f];
+        size_t size = 0;
+        for (int i = 0; i < store->count; i++) {
+            size += 1 + strlen(contactFieldValue(&store->contacts[i], f));
+        }
+        column->offsets = malloc(((size_t)store->count + 1) * sizeof(uint32_t));
+        column->data = malloc(size + COLUMN_PADDING);
+        if (column->offsets == NULL || column->data == NULL || size > UINT32_MAX) {
+            contactColumnsFree(columns);
+            return NULL;
+        }
+        size_t position = 0;
+        for (int i = 0; i < store->count; i++) {
+            const char *value = contactFieldValue(&store->contacts[i], f);
+            size_t length = strlen(value);
+            column->offsets[i] = (uint32_t)position;
+            column->data[position] = (uint8_t)length;
+            memcpy(column->data + position + 1, value, length);
+            position += 1 + length;
+        }
+        column->offsets[store->count] = (uint32_t)position;
+        memset(column->data + position, 0, COLUMN_PADDING);
+    }
+    return columns;
+}
+
+void contactColumnsFree(ContactColumns *columns) {
+    if (columns == NULL) {
+        return;
+    }
+    for (int f = 0; f < 3; f++) {
+        free(columns->fields[f].offsets);
+        free(columns->fields[f].data);
+    }
+    free(columns);
+}
+
+/**
+ * Reassemble the contact at a position of the columns.
+ */
+void contactColumnsGet(const ContactColumns *columns, int position, Contact *contact) {
+    char *fields[3] = { contact->name, contact->phone, contact->email };
+    for (int f = 0; f < 3; f++) {
+        const uint8_t *value = columns->fields[f].data + columns->fields[f].offsets[position];
+        memcpy(fields[f], value + 1, value[0]);
+        fields[f][value[0]] = '\0';
+    }
+}
+
+#if !defined(CONTACT_LIBRARY) || (!defined(__AVX2__) && !defined(__SSE2__)) // Benchmark baseline or fallback
+/**
+ * Filter a column one value at a time, comparing in place thanks to the
+ * length prefix.
+ */
+static void filterColumnScalar(const ContactColumn *column, int count, const char *term, size_t termLength,
+                               uint8_t *hits) {
+    int first = tolower((unsigned char)term[0]);
+    for (int i = 0; i < count; i++) {
+        const uint8_t *value = column->data + column->offsets[i];
+        for (size_t p = 1; p + termLength <= (size_t)value[0] + 1; p++) {
+            if (tolower(value[p]) == first && strncasecmp((const char *)value + p, term, termLength) == 0) {
+                hits[i] = 1;
+                break;
+            }
+        }
+    }
+}
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+/**
+ * Filter a column in one pass over its bytes. Every block is compared
+ * against the first and the last character of the term (both cases for
+ * letters); only positions where both agree are looked up in the offsets
+ * and verified. Hits never span two values because each candidate must
+ * fit inside the value it starts in.
+ */
+static void filterColumn(const ContactColumn *column, int count, const char *term, size_t termLength,
+                         uint8_t *hits) {
+    unsigned char first = (unsigned char)term[0], last = (unsigned char)term[termLength - 1];
+    // OR-ing 0x20 folds upper to lower case; only done for letters so other bytes stay exact
+    const ScanBlock firstFold = scanSplat(isalpha(first) ? 0x20 : 0);
+    const ScanBlock lastFold = scanSplat(isalpha(last) ? 0x20 : 0);
+    const ScanBlock firstWant = scanSplat(tolower(first));
+    const ScanBlock lastWant = scanSplat(tolower(last));
+    const uint8_t *data = column->data;
+    const uint32_t *offsets = column->offsets;
+    size_t size = offsets[count];
+    int record = 0;
+
+    for (size_t i = 0; i < size; i += SCAN_WIDTH) {
+        uint64_t mask = scanMask(scanAnd(scanEqual(scanOr(scanLoad(data + i), firstFold), firstWant),
+                                         scanEqual(scanOr(scanLoad(data + i + termLength - 1), lastFold),
+                                                   lastWant)));
+        while (mask != 0) {
+            size_t p = i + (size_t)__builtin_ctzll(mask);
+            mask &= mask - 1;
+            if (p >= size) {
+                break;
+            }
+            while (offsets[record + 1] <= p) record++;
+            size_t start = offsets[record] + 1, end = start + data[offsets[record]];
+            if (!hits[record] && p >= start && p + termLength <= end &&
+                strncasecmp((const char *)data + p, term, termLength) == 0) {
+                hits[record] = 1;
+            }
+        }
+    }
+}
+#else
+#define filterColumn filterColumnScalar
+#endif
+
+static size_t filterColumns(const ContactColumns *columns, ContactField field, const char *term, int *positions,
+                            ColumnFilter filter) {
+    size_t termLength = strlen(term);
+    uint8_t *hits = calloc((size_t)(columns->count ? columns->count : 1), 1);
+    if (hits == NULL) {
+        return 0;
+    }
+    for (int f = 0; f < 3; f++) {
+        if (field != FIELD_ANY && (int)field != FIELD_NAME + f) {
+            continue;
+        }
+        if (termLength == 0) {
+            memset(hits, 1, (size_t)columns->count);
+        } else if (termLength < EMAIL_LENGTH) {
+            filter(&columns->fields[f], columns->count, term, termLength, hits);
+        }
+    }
+    size_t matches = 0;
+    for (int i = 0; i < columns->count; i++) {
+        if (hits[i]) {
+            if (positions != NULL) positions[matches] = i;
+            matches++;
+        }
+    }
+    free(hits);
+    return matches;
+}
+
+/**
+ * Find the contacts whose field contains term, ignoring case, exactly as
+ * contactStoreSearch() does, but reading only the column(s) of that field.
+ * Matching positions are written in order to positions (room for every
+ * contact), which may be NULL to only count.
+ */
+size_t contactColumnsFilter(const ContactColumns *columns, ContactField field, const char *term, int *positions) {
+    return filterColumns(columns, field, term, positions, filterColumn);
+}
+
+/**
+ * Merge two sorted runs of contacts by name; stable like the old bubble sort.
+ */
+static void mergeContacts(Contact *contacts, Contact *scratch, int low, int middle, int high) {
+    int i = low, j = middle, k = low;
+    while (i < middle && j < high) {
+        if (strcasecmp(contacts[j].name, contacts[i].name) < 0) {
+            scratch[k++] = contacts[j++];
+        } else {
+            scratch[k++] = contacts[i++];
+        }
+    }
+    while (i < middle) scratch[k++] = contacts[i++];
+    while (j < high) scratch[k++] = contacts[j++];
+    memcpy(&contacts[low], &scratch[low], (size_t)(high - low) * sizeof(Contact));
+}
+
+/**
+ * Sort contacts by name (bottom-up merge sort, falling back to bubble sort
+ * if no scratch memory is available).
+ */
+void contactStoreSort(ContactStore *store) {
+    int n = store->count;
+    Contact *scratch = n > 1 ? malloc((size_t)n * sizeof(Contact)) : NULL;
+    if (scratch != NULL) {
+        for (int width = 1; width < n; width *= 2) {
+            for (int low = 0; low + width < n; low += 2 * width) {
+                int high = low + 2 * width < n ? low + 2 * width : n;
+                mergeContacts(store->contacts, scratch, low, low + width, high);
+            }
+        }
+        free(scratch);
+    } else {
+        for (int i = 0; i < n - 1; i++) {
+            for (int j = 0; j < n - i - 1; j++) {
+                if (strcasecmp(store->contacts[j].name, store->contacts[j + 1].name) > 0) {
+                    Contact temp = store->contacts[j];
+                    store->contacts[j] = store->contacts[j + 1];
+                    store->contacts[j + 1] = temp;
+                }
+            }
+        }
+    }
+    rebuildContactIndexes(store);
+}
+
+/**
+ * Number of contacts in the store.
+ */
+int contactStoreCount(const ContactStore *store) {
+    return store->count;
+}
+
+/**
+ * Start iterating over the store in list order.
+ */
+void contactStoreCursor(const ContactStore *store, ContactCursor *cursor) {
+    cursor->store = store;
+    cursor->position = 0;
+}
+
+/**
+ * Return the next contact, or NULL when the iteration is complete.
+ */
+const Contact *contactCursorNext(ContactCursor *cursor) {
+    if (cursor->position >= cursor->store->count) {
+        return NULL;
+    }
+    return &cursor->store->contacts[cursor->position++];
+}
+
+/**
+ * Describe a status code in words.
+ */
+const char *contactStatusMessage(ContactStatus status) {
+    switch (status) {
+        case CONTACT_OK: return "ok";
+        case CONTACT_NOT_FOUND: return "contact not found";
+        case CONTACT_DUPLICATE: return "contact already exists";
+        case CONTACT_INVALID_PHONE: return "invalid phone number format";
+        case CONTACT_INVALID_EMAIL: return "invalid email format";
+        case CONTACT_TOO_LONG: return "field too long";
+        case CONTACT_NO_MEMORY: return "out of memory";
+        case CONTACT_IO_ERROR: return "file error";
+        case CONTACT_AUTH_FAILED: return "file failed authentication or key is missing";
+        case CONTACT_OPEN_FAILED: return "cannot open file";
+    }
+    return "unknown error";
+}
+
+#ifndef CONTACT_LIBRARY
+/**
+ * Add a new contact to the contact list.
+ */
+void addContact() {
+    Contact newContact;
+
+    printf("Enter Name: ");
+    fgets(newContact.name, NAME_LENGTH, stdin);
+    validateInput(newContact.name, NAME_LENGTH);
+
+    printf("Enter Phone Number: ");
+    fgets(newContact.phone, PHONE_LENGTH, stdin);
+    validateInput(newContact.phone, PHONE_LENGTH);
+
+    if (!validatePhoneNumber(newContact.phone)) {
+        printf("Invalid phone number format.\n");
+        return;
+    }
+
+    printf("Enter Email: ");
+    fgets(newContact.email, EMAIL_LENGTH, stdin);
+    validateInput(newContact.email, EMAIL_LENGTH);
+
+    ContactStatus status = contactStoreAdd(menuStore, newContact.name, newContact.phone, newContact.email);
+    if (status == CONTACT_INVALID_EMAIL) {
+        printf("Invalid email format.\n");
+    } else if (status == CONTACT_DUPLICATE) {
+        printf("Contact already exists.\n");
+    } else if (status != CONTACT_OK) {
+        printf("Cannot add contact: %s.\n", contactStatusMessage(status));
+    } else {
+        printf("Contact added successfully.\n");
+    }
+}
+
+/**
+ * Display all contacts in the contact list.
+ */
+void displayContacts() {
+    if (contactStoreCount(menuStore) == 0) {
+        printf("No contacts to display.\n");
+        return;
+    }
+
+    printf("\n--- Contact List ---\n");
+    ContactCursor cursor;
+    const Contact *contact;
+    int number = 1;
+    contactStoreCursor(menuStore, &cursor);
+    while ((contact = contactCursorNext(&cursor)) != NULL) {
+        printf("Contact %d:\n", number++);
+        printf(" Name: %s\n", contact->name);
+        printf(" Phone: %s\n", contact->phone);
+        printf(" Email: %s\n", contact->email);
+    }
+}
+
+/**
+ * Search for a contact by name, phone, or email.
+ 
+void searchContact() {
+    char searchTerm[NAME_LENGTH];
+    int found = 0;
+
+    printf("Enter the term to search: ");
+    fgets(searchTerm, NAME_LENGTH, stdin);
+    validateInput(searchTerm, NAME_LENGTH);
+
+    for (int i = 0; i < contactCount; i++) {
+        if (strcasecmp(contactList[i].name, searchTerm) != NULL ||
+            strcasecmp(contactList[i].phone, searchTerm) != NULL ||
+            strcasecmp(contactList[i].email, searchTerm) != NULL) {
+            printf("Contact found:\n");
+            printf(" Name: %s\n", contactList[i].name);
+            printf(" Phone: %s\n", contactList[i].phone);
+            printf(" Email: %s\n", contactList[i].email);
+            found = 1;
+        }
+    }
+
+    if (!found) {
+        printf("No matching contacts found.\n");
+    }
+}
+*/
+/**
+ * Delete a contact by name.
+ */
+void deleteContact() {
+    char deleteName[NAME_LENGTH];
+
+    printf("Enter the name of the contact to delete: ");
+    fgets(deleteName, NAME_LENGTH, stdin);
+    validateInput(deleteName, NAME_LENGTH);
+
+    if (contactStoreDelete(menuStore, deleteName) == CONTACT_OK) {
+        printf("Contact deleted successfully.\n");
+    } else {
+        printf("Contact not found.\n");
+    }
+}
+
+/**
+ * Sort contacts by name.
+ */
+void sortContacts() {
+    if (contactStoreCount(menuStore) < 2) {
+        printf("Not enough contacts to sort.\n");
+        return;
+    }
+
+    contactStoreSort(menuStore);
+    printf("Contacts sorted by name successfully.\n");
+}
+#endif
+
+/**
+ * Perform advanced search with options.
+ */
+/**void advancedSearch() {
+    int choice;
+    char searchTerm[NAME_LENGTH];
+    int found = 0;
+
+    printf("\n--- Advanced Search ---\n");
+    printf("1. Search by Partial Name\n");
+    printf("2. Search by Phone Number\n");
+    printf("3. Search by Email\n");
+    printf("4. Search by Multiple Fields\n");
+    printf("Enter your choice: ");
+    scanf("%d", &choice);
+    clearInputBuffer();
+
+    switch (choice) {
+        case 1:
+            printf("Enter partial name to search: ");
+            fgets(searchTerm, NAME_LENGTH, stdin);
+            validateInput(searchTerm, NAME_LENGTH);
+            for (int i = 0; i < contactCount; i++) {
+                if (strcasestr(contactList[i].name, searchTerm) != NULL) {
+                    printf("Contact found:\n");
+                    printf(" Name: %s\n", contactList[i].name);
+                    printf(" Phone: %s\n", contactList[i].phone);
+                    printf(" Email: %s\n", contactList[i].email);
+                    found = 1;
+                }
+            }
+            break;
+        case 2:
+            printf("Enter phone number to search: ");
+            fgets(searchTerm, PHONE_LENGTH, stdin);
+            validateInput(searchTerm, PHONE_LENGTH);
+            for (int i = 0; i < contactCount; i++) {
+                if (strcasestr(contactList[i].phone, searchTerm) != NULL) {
+                    printf("Contact found:\n");
+                    printf(" Name: %s\n", contactList[i].name);
+                    printf(" Phone: %s\n", contactList[i].phone);
+                    printf(" Email: %s\n", contactList[i].email);
+                    found = 1;
+                }
+            }
+            break;
+        case 3:
+            printf("Enter email to search: ");
+            fgets(searchTerm, EMAIL_LENGTH, stdin);
+            validateInput(searchTerm, EMAIL_LENGTH);
+            for (int i = 0; i < contactCount; i++) {
+                if (strcasestr(contactList[i].email, searchTerm) != NULL) {
+                    printf("Contact found:\n");
+                    printf(" Name: %s\n", contactList[i].name);
+                    printf(" Phone: %s\n", contactList[i].phone);
+                    printf(" Email: %s\n", contactList[i].email);
+                    found = 1;
+                }
+            }
+            break;
+        case 4:
+            printf("Enter term to search in all fields: ");
+            fgets(searchTerm, NAME_LENGTH, stdin);
+            validateInput(searchTerm, NAME_LENGTH);
+            for (int i = 0; i < contactCount; i++) {
+                if (strcasestr(contactList[i].name, searchTerm) != NULL ||
+                    strcasestr(contactList[i].phone, searchTerm) != NULL ||
+                    strcasestr(contactList[i].email, searchTerm) != NULL) {
+                    printf("Contact found:\n");
+                    printf(" Name: %s\n", contactList[i].name);
+                    printf(" Phone: %s\n", contactList[i].phone);
+                    printf(" Email: %s\n", contactList[i].email);
+                    found = 1;
+                }
+            }
+            break;
+        default:
+            printf("Invalid choice.\n");
+            return;
+    }
+
+    if (!found) {
+        printf("No matching contacts found.\n");
+    }
+}
+**/
+/**
+ * One chunk of the batch file travelling through the import pipeline.
+ * The reader fills data, a worker parses it into rows, and the commit
+ * stage appends the rows in chunk order.
+ */
+typedef struct {
+    enum { CHUNK_EMPTY, CHUNK_READ, CHUNK_PARSING, CHUNK_PARSED } state;
+    size_t seq;              // Position of the chunk in the file
+    char *data;              // Raw bytes ending on a line boundary, plus SCAN_PADDING
+    size_t length;
+    size_t dataCapacity;
+    Contact *rows;           // Valid rows parsed from data
+    uint64_t *hashes;        // Record hash of each valid row
+    size_t rowCount;
+    size_t rowCapacity;
+    size_t lineCount;        // Non-empty lines seen, valid or not
+    size_t invalidCount;
+    char invalidNames[IMPORT_REPORT_INVALID][NAME_LENGTH];
+} ImportChunk;
+
+// Shared state of one batch import
+typedef struct {
+    FILE *file;
+    ImportChunk chunks[IMPORT_QUEUE_DEPTH];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t chunksRead;       // Chunks handed to the workers so far
+    int readerDone;          // Set once the reader reached end of file
+    int failed;              // Set on allocation or read failure, stops every stage
+    int readFailed;          // Set when the failure was an error reading the file
+    size_t bytesRead;
+} ImportPipeline;
+
+/**
+ * Return the current monotonic time in seconds.
+ */
+static double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Parse and validate every line of a chunk (runs on a worker thread).
+ * Lines use the same "name,phone,email" layout as the contacts file.
+ */
+static int parseImportChunk(ImportChunk *chunk) {
+    const char *cursor = chunk->data;
+    const char *limit = chunk->data + chunk->length;
+
+    chunk->rowCount = 0;
+    chunk->lineCount = 0;
+    chunk->invalidCount = 0;
+
+    while (cursor < limit) {
+        LineFields fields;
+        const char *line = cursor;
+        scanContactLine(line, limit, &fields);
+        cursor = fields.next;
+        if (fields.nameLength == 0 && !fields.complete) {
+            continue; // Blank line
+        }
+        chunk->lineCount++;
+
+        if (chunk->rowCount == chunk->rowCapacity) {
+            size_t newCapacity = chunk->rowCapacity ? chunk->rowCapacity * 2 : 4096;
+            Contact *rows = realloc(chunk->rows, newCapacity * sizeof(Contact));
+            uint64_t *hashes = realloc(chunk->hashes, newCapacity * sizeof(uint64_t));
+            if (rows) chunk->rows = rows;
+            if (hashes) chunk->hashes = hashes;
+            if (!rows || !hashes) {
+                return 0;
+            }
+            chunk->rowCapacity = newCapacity;
+        }
+
+        Contact *row = &chunk->rows[chunk->rowCount];
+        int valid = fields.complete && fields.phoneValid && fields.emailValid &&
+                    copyField(row->name, NAME_LENGTH, fields.name, fields.name + fields.nameLength) &&
+                    copyField(row->phone, PHONE_LENGTH, fields.phone, fields.phone + fields.phoneLength) &&
+                    copyField(row->email, EMAIL_LENGTH, fields.email, fields.email + fields.emailLength);
+
+        if (valid) {
+            chunk->hashes[chunk->rowCount++] = hashContact(row);
+        } else {
+            if (chunk->invalidCount < IMPORT_REPORT_INVALID) {
+                size_t length = fields.nameLength;
+                if (length >= NAME_LENGTH) length = NAME_LENGTH - 1;
+                memcpy(chunk->invalidNames[chunk->invalidCount], line, length);
+                chunk->invalidNames[chunk->invalidCount][length] = '\0';
+            }
+            chunk->invalidCount++;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Reader stage: fill free chunk slots with newline-terminated blocks of the file.
+ */
+static void *importReaderThread(void *arg) {
+    ImportPipeline *pipeline = arg;
+    char *carry = NULL;
+    size_t carryLength = 0;
+    int eof = 0;
+
+    for (size_t seq = 0; !eof; seq++) {
+        ImportChunk *chunk = &pipeline->chunks[seq % IMPORT_QUEUE_DEPTH];
+
+        pthread_mutex_lock(&pipeline->lock);
+        while (chunk->state != CHUNK_EMPTY && !pipeline->failed) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        int failed = pipeline->failed;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (failed) {
+            break;
+        }
+
+        // Start with the partial line left over from the previous block
+        size_t needed = carryLength + IMPORT_CHUNK_SIZE;
+        if (chunk->dataCapacity < needed) {
+            char *data = realloc(chunk->data, needed + SCAN_PADDING);
+            if (data == NULL) {
+                failed = 1;
+            } else {
+                chunk->data = data;
+                chunk->dataCapacity = needed;
+            }
+        }
+        size_t length = 0;
+        if (!failed) {
+            if (carryLength) memcpy(chunk->data, carry, carryLength);
+            length = carryLength;
+            size_t got = fread(chunk->data + length, 1, chunk->dataCapacity - length, pipeline->file);
+            length += got;
+            eof = got == 0 || feof(pipeline->file);
+            // A read error is not the end of the file: stop rather than import part of it silently
+            failed = ferror(pipeline->file);
+        }
+
+        // Cut at the last newline and keep the remainder for the next block
+        size_t cut = length;
+        if (!failed && !eof) {
+            // A line longer than the whole block leaves cut at 0 and is
+            // carried over into a larger block on the next round
+            while (cut > 0 && chunk->data[cut - 1] != '\n') cut--;
+        }
+        size_t remainder = length - cut;
+        if (!failed && remainder) {
+            char *newCarry = realloc(carry, remainder);
+            if (newCarry == NULL) {
+                failed = 1;
+            } else {
+                carry = newCarry;
+                memcpy(carry, chunk->data + cut, remainder);
+            }
+        }
+        carryLength = remainder;
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (failed) {
+            pipeline->failed = 1;
+            pipeline->readFailed = ferror(pipeline->file) != 0;
+        } else if (cut > 0) {
+            chunk->seq = pipeline->chunksRead++;
+            chunk->length = cut;
+            chunk->state = CHUNK_READ;
+            pipeline->bytesRead += cut;
+        } else {
+            // Nothing complete in this block; reuse the slot on the next round
+            seq--;
+        }
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+        if (failed) {
+            break;
+        }
+    }
+
+    free(carry);
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->readerDone = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Parse stage: pick up read chunks in any order and parse them.
+ */
+static void *importWorkerThread(void *arg) {
+    ImportPipeline *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        ImportChunk *chunk = NULL;
+        for (int i = 0; i < IMPORT_QUEUE_DEPTH; i++) {
+            if (pipeline->chunks[i].state == CHUNK_READ) {
+                chunk = &pipeline->chunks[i];
+                break;
+            }
+        }
+        if (chunk == NULL) {
+            if (pipeline->readerDone || pipeline->failed) {
+                break;
+            }
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+            continue;
+        }
+        chunk->state = CHUNK_PARSING;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        int ok = parseImportChunk(chunk);
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->state = CHUNK_PARSED;
+        if (!ok) {
+            pipeline->failed = 1;
+        }
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Batch add contacts from a formatted text file.
+ * The file is read in large chunks, parsed and validated on worker threads,
+ * and committed in file order so the result matches a sequential import.
+ * Returns CONTACT_OPEN_FAILED, with errno set, if the file cannot be opened.
+ */
+ContactStatus contactStoreImport(ContactStore *store, const char *filename, ContactImportStats *stats) {
+    ContactImportStats ignored;
+    if (stats == NULL) stats = &ignored;
+    memset(stats, 0, sizeof(*stats));
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return CONTACT_OPEN_FAILED; // errno still holds the reason
+    }
+    setvbuf(file, NULL, _IONBF, 0); // The reader does its own large reads
+
+    ImportPipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.file = file;
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workerCount = cpus > 1 ? (int)cpus - 1 : 1;
+    if (workerCount > IMPORT_MAX_WORKERS) workerCount = IMPORT_MAX_WORKERS;
+
+    double start = monotonicSeconds();
+    pthread_t reader;
+    pthread_t workers[IMPORT_MAX_WORKERS];
+    pthread_create(&reader, NULL, importReaderThread, &pipeline);
+    for (int i = 0; i < workerCount; i++) {
+        pthread_create(&workers[i], NULL, importWorkerThread, &pipeline);
+    }
+
+    // Commit stage: runs on the calling thread, strictly in chunk order
+    int outOfMemory = 0;
+    for (size_t seq = 0;; seq++) {
+        ImportChunk *chunk = &pipeline.chunks[seq % IMPORT_QUEUE_DEPTH];
+
+        pthread_mutex_lock(&pipeline.lock);
+        while (!pipeline.failed &&
+               !(chunk->state == CHUNK_PARSED && chunk->seq == seq) &&
+               !(pipeline.readerDone && seq >= pipeline.chunksRead)) {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+        }
+        int finished = pipeline.failed || (pipeline.readerDone && seq >= pipeline.chunksRead);
+        pthread_mutex_unlock(&pipeline.lock);
+        if (finished) {
+            break;
+        }
+
+        for (size_t i = 0; i < chunk->invalidCount && stats->invalid + i < IMPORT_REPORT_INVALID; i++) {
+            memcpy(stats->invalidNames[stats->invalid + i], chunk->invalidNames[i], NAME_LENGTH);
+        }
+        stats->invalid += chunk->invalidCount;
+        stats->lines += chunk->lineCount;
+
+        for (size_t i = 0; i < chunk->rowCount && !outOfMemory; i++) {
+            if (findContactRecord(store, &chunk->rows[i], chunk->hashes[i]) >= 0) {
+                stats->duplicates++;
+            } else if (appendHashedContact(store, &chunk->rows[i], chunk->hashes[i]) < 0) {
+                outOfMemory = 1;
+            } else {
+                stats->added++;
+            }
+        }
+
+        pthread_mutex_lock(&pipeline.lock);
+        chunk->state = CHUNK_EMPTY;
+        if (outOfMemory) {
+            pipeline.failed = 1;
+        }
+        pthread_cond_broadcast(&pipeline.changed);
+        pthread_mutex_unlock(&pipeline.lock);
+    }
+
+    pthread_join(reader, NULL);
+    for (int i = 0; i < workerCount; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    stats->seconds = monotonicSeconds() - start;
+    stats->bytes = pipeline.bytesRead;
+    stats->workers = workerCount;
+
+    for (int i = 0; i < IMPORT_QUEUE_DEPTH; i++) {
+        free(pipeline.chunks[i].data);
+        free(pipeline.chunks[i].rows);
+        free(pipeline.chunks[i].hashes);
+    }
+    pthread_cond_destroy(&pipeline.changed);
+    pthread_mutex_destroy(&pipeline.lock);
+    fclose(file);
+    if (pipeline.readFailed) {
+        return CONTACT_IO_ERROR;
+    }
+    return pipeline.failed ? CONTACT_NO_MEMORY : CONTACT_OK;
+}
+
+#ifndef CONTACT_LIBRARY
+/**
+ * Batch add contacts from BATCH_FILENAME and report what happened.
+ */
+void batchAddContacts() {
+    ContactImportStats stats;
+    ContactStatus status = contactStoreImport(menuStore, BATCH_FILENAME, &stats);
+    if (status == CONTACT_OPEN_FAILED) {
+        printf("Cannot open batch file %s: %s.\n", BATCH_FILENAME, strerror(errno));
+        return;
+    }
+
+    for (size_t i = 0; i < stats.invalid && i < IMPORT_REPORT_INVALID; i++) {
+        printf("Invalid data for contact: %s. Skipping.\n", stats.invalidNames[i]);
+    }
+    if (stats.invalid > IMPORT_REPORT_INVALID) {
+        printf("... %zu more invalid rows skipped.\n", stats.invalid - IMPORT_REPORT_INVALID);
+    }
+    if (status != CONTACT_OK) {
+        printf("Import of %s stopped early: %s.\n", BATCH_FILENAME, contactStatusMessage(status));
+    }
+
+    printf("Batch add complete. %zu contacts added.\n", stats.added);
+    printf("Rows: %zu read, %zu invalid, %zu duplicates\n", stats.lines, stats.invalid, stats.duplicates);
+    if (stats.seconds > 0) {
+        printf("Throughput: %.0f rows/s, %.1f MB/s over %.3f s (%d parse threads)\n",
+               stats.lines / stats.seconds, stats.bytes / stats.seconds / 1e6, stats.seconds, stats.workers);
+    }
+}
+
+/**
+ * Search callback for batch mode: print the contact as a CSV line.
+ */
+static int printContactLine(const Contact *contact, void *context) {
+    fprintf((FILE *)context, "%s,%s,%s\n", contact->name, contact->phone, contact->email);
+    return 0;
+}
+
+/**
+ * Dedup callback for batch mode: print the kept contact, then each
+ * duplicate indented below it.
+ */
+static int printDuplicateCluster(const Contact *kept, const Contact *const *duplicates, int count, void *context) {
+    printContactLine(kept, context);
+    for (int i = 0; i < count; i++) {
+        fputs("  ", context);
+        printContactLine(duplicates[i], context);
+    }
+    return 0;
+}
+
+/**
+ * Run store commands read from a file or stdin, one per line, in a single
+ * process. Each command prints its records, if any, followed by a line
+ * starting with "ok" or "error". Changes are only written by "save".
+ *
+ *   add NAME,PHONE,EMAIL   delete NAME      lookup NAME
+ *   search name|phone|email|any TERM        list        count
+ *   import [FILE]          sort             save
+ *   dedup report|merge
+ */
+void runBatchCommands(FILE *input) {
+    static char outputBuffer[1 << 16];
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &lineCapacity, input)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        char *argument = strchr(line, ' ');
+        if (argument != NULL) {
+            *argument++ = '\0';
+        } else {
+            argument = line + length;
+        }
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        ContactStatus status = CONTACT_OK;
+        if (strcmp(line, "add") == 0) {
+            char *phone = strchr(argument, ',');
+            char *email = phone ? strchr(phone + 1, ',') : NULL;
+            if (email == NULL) {
+                printf("error usage: add NAME,PHONE,EMAIL\n");
+                continue;
+            }
+            *phone++ = '\0';
+            *email++ = '\0';
+            status = contactStoreAdd(menuStore, argument, phone, email);
+        } else if (strcmp(line, "delete") == 0) {
+            status = contactStoreDelete(menuStore, argument);
+        } else if (strcmp(line, "lookup") == 0) {
+            const Contact *contact = contactStoreLookup(menuStore, argument);
+            if (contact != NULL) {
+                printContactLine(contact, stdout);
+            } else {
+                status = CONTACT_NOT_FOUND;
+            }
+        } else if (strcmp(line, "search") == 0) {
+            static const char *fieldNames[] = { "name", "phone", "email", "any" };
+            char *term = strchr(argument, ' ');
+            int field = 0;
+            for (int i = 0; term != NULL && i < 4; i++) {
+                if ((size_t)(term - argument) == strlen(fieldNames[i]) &&
+                    strncmp(argument, fieldNames[i], (size_t)(term - argument)) == 0) {
+                    field = FIELD_NAME + i;
+                }
+            }
+            if (field == 0) {
+                printf("error usage: search name|phone|email|any TERM\n");
+                continue;
+            }
+            size_t matches = contactStoreSearch(menuStore, (ContactField)field, term + 1, printContactLine, stdout);
+            printf("ok %zu\n", matches);
+            continue;
+        } else if (strcmp(line, "list") == 0) {
+            ContactCursor cursor;
+            const Contact *contact;
+            contactStoreCursor(menuStore, &cursor);
+            while ((contact = contactCursorNext(&cursor)) != NULL) {
+                printContactLine(contact, stdout);
+            }
+        } else if (strcmp(line, "count") == 0) {
+            printf("ok %d\n", contactStoreCount(menuStore));
+            continue;
+        } else if (strcmp(line, "import") == 0) {
+            ContactImportStats stats;
+            status = contactStoreImport(menuStore, *argument ? argument : BATCH_FILENAME, &stats);
+            if (status == CONTACT_OK) {
+                printf("ok %zu added %zu invalid %zu duplicates\n", stats.added, stats.invalid, stats.duplicates);
+                continue;
+            }
+        } else if (strcmp(line, "sort") == 0) {
+            contactStoreSort(menuStore);
+        } else if (strcmp(line, "save") == 0) {
+            status = contactStoreSave(menuStore);
+        } else if (strcmp(line, "dedup") == 0) {
+            int merge = strcmp(argument, "merge") == 0;
+            if (!merge && strcmp(argument, "report") != 0) {
+                printf("error usage: dedup report|merge\n");
+                continue;
+            }
+            size_t clusters;
+            status = contactStoreDedup(menuStore, merge, printDuplicateCluster, stdout, &clusters);
+            if (status == CONTACT_OK) {
+                printf("ok %zu\n", clusters);
+                continue;
+            }
+        } else {
+            printf("error unknown command %s\n", line);
+            continue;
+        }
+
+        if (status == CONTACT_OK) {
+            printf("ok\n");
+        } else {
+            printf("error %s\n", contactStatusMessage(status));
+        }
+    }
+    free(line);
+    fflush(stdout);
+}
+#endif
+
+#ifndef CONTACT_LIBRARY
+/**
+ * Validate and remove newline character from input string.
+ */
+void validateInput(char *input, int length) {
+    size_t ln = strlen(input) - 1;
+    if (input[ln] == '\n') {
+        input[ln] = '\0';
+    } else {
+        // Clear the input buffer if input is too long
+        clearInputBuffer();
+    }
+}
+#endif
+
+/**
+ * Validate the email format.
+ * Simple validation to check for presence of '@' and '.' characters.
+ */
+int validateEmail(const char *email) {
+    const char *atSign = strchr(email, '@');
+    if (atSign == NULL) {
+        return 0;
+    }
+
+    const char *dot = strchr(atSign, '.');
+    if (dot == NULL) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Validate the phone number format.
+ * Ensure it contains only digits and has acceptable length.
+ */
+int validatePhoneNumber(const char *phone) {
+    int length = strlen(phone);
+    for (int i = 0; i < length; i++) {
+        if (!isdigit(phone[i]) && phone[i] != '+' && phone[i] != '-' && phone[i] != ' ') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Decrypt data written by the old Caesar cipher format.
+ */
+void decryptData(char *data) {
+    for (int i = 0; data[i] != '\0'; i++) {
+        data[i] -= KEY;
+    }
+}
+
+/**
+ * Make room for at least the given number of contacts.
+ * Returns 1 on success, 0 if memory could not be allocated.
+ */
+static int ensureContactCapacity(ContactStore *store, int needed) {
+    if (needed <= store->capacity) {
+        return 1;
+    }
+    int newCapacity = store->capacity ? store->capacity : INITIAL_CAPACITY;
+    while (newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    Contact *grown = realloc(store->contacts, (size_t)newCapacity * sizeof(Contact));
+    if (grown == NULL) {
+        return 0;
+    }
+    store->contacts = grown;
+    store->capacity = newCapacity;
+    return 1;
+}
+
+/**
+ * Hash a whole contact record (FNV-1a over name, phone and email).
+ */
+static uint64_t hashContact(const Contact *contact) {
+    const char *fields[3] = { contact->name, contact->phone, contact->email };
+    uint64_t hash = 14695981039346656037ULL;
+    for (int f = 0; f < 3; f++) {
+        for (const unsigned char *p = (const unsigned char *)fields[f]; *p; p++) {
+            hash = (hash ^ *p) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ULL; // Field separator
+    }
+    return hash;
+}
+
+/**
+ * Hash a name case-insensitively, matching strcasecmp() equality.
+ */
+static uint64_t hashName(const char *name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash = (hash ^ (unsigned char)tolower(*p)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Look up an identical record in the record index.
+ * Returns its position in the store, or -1 if not present.
+ */
+static int findContactRecord(const ContactStore *store, const Contact *contact, uint64_t hash) {
+    const HashIndex *index = &store->records;
+    if (index->capacity == 0) {
+        return -1;
+    }
+    size_t mask = index->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const IndexSlot *slot = &index->slots[i];
+        if (slot->position < 0) {
+            return -1;
+        }
+        if (slot->hash == hash) {
+            const Contact *other = &store->contacts[slot->position];
+            if (strcmp(other->name, contact->name) == 0 &&
+                strcmp(other->phone, contact->phone) == 0 &&
+                strcmp(other->email, contact->email) == 0) {
+                return slot->position;
+            }
+        }
+    }
+}
+
+/**
+ * Grow a hash index so it can hold count positions and stay at most half full.
+ * Returns 0 if there is not enough memory; the index is left as it was.
+ */
+static int reserveIndex(HashIndex *index, size_t count) {
+    if (count * 2 <= index->capacity) {
+        return 1;
+    }
+    size_t newCapacity = index->capacity ? index->capacity : 256;
+    while (count * 2 > newCapacity) newCapacity *= 2;
+    IndexSlot *grown = malloc(newCapacity * sizeof(IndexSlot));
+    if (grown == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < newCapacity; i++) {
+        grown[i].position = -1;
+    }
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->slots[i].position >= 0) {
+            size_t j = index->slots[i].hash & (newCapacity - 1);
+            while (grown[j].position >= 0) j = (j + 1) & (newCapacity - 1);
+            grown[j] = index->slots[i];
+        }
+    }
+    free(index->slots);
+    index->slots = grown;
+    index->capacity = newCapacity;
+    return 1;
+}
+
+/**
+ * Add a position to a hash index that reserveIndex() has made room for.
+ */
+static void insertIndex(HashIndex *index, int position, uint64_t hash) {
+    size_t mask = index->capacity - 1;
+    size_t i = hash & mask;
+    while (index->slots[i].position >= 0) i = (i + 1) & mask;
+    index->slots[i].hash = hash;
+    index->slots[i].position = position;
+    index->count++;
+}
+
+/**
+ * Rebuild both indexes after contacts were moved (delete, sort, dedup).
+ * Never allocates: the store only shrank or was reordered, and every
+ * contact was given room in both indexes when it was appended.
+ */
+static void rebuildContactIndexes(ContactStore *store) {
+    HashIndex *indexes[2] = { &store->records, &store->names };
+    for (int k = 0; k < 2; k++) {
+        for (size_t i = 0; i < indexes[k]->capacity; i++) {
+            indexes[k]->slots[i].position = -1;
+        }
+        indexes[k]->count = 0;
+    }
+    for (int i = 0; i < store->count; i++) {
+        insertIndex(&store->records, i, hashContact(&store->contacts[i]));
+        insertIndex(&store->names, i, hashName(store->contacts[i].name));
+    }
+}
+
+/**
+ * Append a contact to the store and index it.
+ * Returns its position, or -1 if the list could not grow.
+ */
+static int appendContact(ContactStore *store, const Contact *contact) {
+    return appendHashedContact(store, contact, hashContact(contact));
+}
+
+/**
+ * Append a contact whose record hash is already known.
+ */
+static int appendHashedContact(ContactStore *store, const Contact *contact, uint64_t hash) {
+    // Grow everything first so a failure leaves the store unchanged
+    if (!ensureContactCapacity(store, store->count + 1) ||
+        !reserveIndex(&store->records, (size_t)store->count + 1) ||
+        !reserveIndex(&store->names, (size_t)store->count + 1)) {
+        return -1;
+    }
+    store->contacts[store->count] = *contact;
+    insertIndex(&store->records, store->count, hash);
+    insertIndex(&store->names, store->count, hashName(contact->name));
+    return store->count++;
+}
+
+#ifndef CONTACT_LIBRARY
+/**
+ * Micro-benchmark for the ingestion hot path: compares the original
+ * sscanf + validatePhoneNumber/validateEmail approach, the scalar line
+ * scanner and the SIMD line scanner on the same synthetic rows.
+ */
+int benchValidation(long lines) {
+    if (lines <= 0) {
+        lines = 1000000;
+    }
+    size_t capacity = (size_t)lines * 96;
+    char *buffer = malloc(capacity + SCAN_PADDING);
+    if (buffer == NULL) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    size_t length = 0;
+    srand(42);
+    for (long i = 0; i < lines; i++) {
+        int kind = rand() % 10;
+        length += (size_t)snprintf(buffer + length, capacity - length,
+                                   "Contact Person %ld,%s%07d,%s%ld@%s\n", i,
+                                   kind == 0 ? "55x-" : "+1 555-", rand() % 10000000,
+                                   "first.last", i, kind == 1 ? "localhost" : "example.com");
+    }
+    const char *limit = buffer + length;
+
+    double start = monotonicSeconds();
+    long sscanfValid = 0;
+    for (const char *p = buffer; p < limit;) {
+        const char *lineEnd = memchr(p, '\n', (size_t)(limit - p));
+        char line[256];
+        size_t lineLength = (size_t)((lineEnd ? lineEnd : limit) - p);
+        if (lineLength >= sizeof(line)) lineLength = sizeof(line) - 1;
+        memcpy(line, p, lineLength); // sscanf would strlen() the whole buffer
+        line[lineLength] = '\0';
+        Contact c;
+        if (sscanf(line, "%49[^,],%14[^,],%49[^\n]", c.name, c.phone, c.email) == 3 &&
+            validatePhoneNumber(c.phone) && validateEmail(c.email)) {
+            sscanfValid++;
+        }
+        p = lineEnd ? lineEnd + 1 : limit;
+    }
+    double sscanfTime = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    long scalarValid = 0;
+    for (const char *p = buffer; p < limit;) {
+        LineFields f;
+        scanContactLineScalar(p, limit, &f);
+        scalarValid += f.complete && f.phoneValid && f.emailValid;
+        p = f.next;
+    }
+    double scalarTime = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    long simdValid = 0;
+    for (const char *p = buffer; p < limit;) {
+        LineFields f;
+        scanContactLine(p, limit, &f);
+        simdValid += f.complete && f.phoneValid && f.emailValid;
+        p = f.next;
+    }
+    double simdTime = monotonicSeconds() - start;
+
+    // Both scanners must agree line by line, not just in total
+    long mismatches = 0;
+    for (const char *p = buffer; p < limit;) {
+        LineFields a, b;
+        scanContactLineScalar(p, limit, &a);
+        scanContactLine(p, limit, &b);
+        if (a.next != b.next || a.complete != b.complete || a.nameLength != b.nameLength ||
+            a.phoneValid != b.phoneValid || a.emailValid != b.emailValid ||
+            (a.complete && (a.phoneLength != b.phoneLength || a.emailLength != b.emailLength))) {
+            mismatches++;
+        }
+        p = a.next;
+    }
+
+    double mb = length / 1e6;
+    printf("%ld rows, %.1f MB, %d-byte SIMD blocks\n", lines, mb,
+#if defined(__AVX2__) || defined(__SSE2__)
+           SCAN_WIDTH
+#else
+           1
+#endif
+    );
+    printf("sscanf + validate: %8.1f MB/s  %ld valid\n", mb / sscanfTime, sscanfValid);
+    printf("scalar scanner:    %8.1f MB/s  %ld valid\n", mb / scalarTime, scalarValid);
+    printf("SIMD scanner:      %8.1f MB/s  %ld valid  (%.1fx vs sscanf, %.1fx vs scalar)\n",
+           mb / simdTime, simdValid, sscanfTime / simdTime, scalarTime / simdTime);
+    printf("Scanner mismatches: %ld\n", mismatches);
+
+    free(buffer);
+    return mismatches != 0 || simdValid != sscanfValid;
+}
+
+/**
+ * Check the cipher against the RFC 8439 AEAD test vector, then measure
+ * seal and open throughput over a large buffer.
+ */
+int benchCipher(long megabytes) {
+    static const char *plainText = "Ladies and Gentlemen of the class of '99: If I could offer you "
+                                   "only one tip for the future, sunscreen would be it.";
+    static const uint8_t nonce[12] = { 0x07, 0, 0, 0, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47 };
+    static const uint8_t aad[12] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+    static const uint8_t expectedTag[16] = { 0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+                                             0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91 };
+    static const uint8_t expectedStart[8] = { 0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb };
+    uint8_t key[32], out[128], tag[16];
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(0x80 + i);
+
+    size_t textLength = strlen(plainText);
+    chachaPolyStage.seal(key, nonce, aad, sizeof(aad), (const uint8_t *)plainText, textLength, out, tag);
+    int vectorOk = memcmp(tag, expectedTag, 16) == 0 && memcmp(out, expectedStart, 8) == 0;
+    printf("RFC 8439 test vector: %s\n", vectorOk ? "ok" : "FAILED");
+
+    if (megabytes <= 0) {
+        megabytes = 256;
+    }
+    size_t length = (size_t)megabytes << 20;
+    size_t blocks = (length + CIPHER_BLOCK_SIZE - 1) / CIPHER_BLOCK_SIZE;
+    uint8_t *plain = malloc(length), *sealed = malloc(length), *opened = malloc(length);
+    uint8_t *tags = malloc(blocks * CIPHER_TAG_LENGTH);
+    if (plain == NULL || sealed == NULL || opened == NULL || tags == NULL) {
+        printf("Out of memory.\n");
+        free(plain); free(sealed); free(opened); free(tags);
+        return 1;
+    }
+    // Touch every page up front so the timings measure the cipher, not page faults
+    for (size_t i = 0; i < length; i++) plain[i] = (uint8_t)(i * 131);
+    memset(sealed, 0, length);
+    memset(opened, 0, length);
+
+    double start = monotonicSeconds();
+    for (size_t b = 0; b < blocks; b++) {
+        size_t offset = b * CIPHER_BLOCK_SIZE;
+        size_t n = length - offset < CIPHER_BLOCK_SIZE ? length - offset : CIPHER_BLOCK_SIZE;
+        chachaPolyStage.seal(key, nonce, aad, sizeof(aad), plain + offset, n, sealed + offset,
+                             tags + b * CIPHER_TAG_LENGTH);
+    }
+    double sealTime = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    int authentic = 1;
+    for (size_t b = 0; b < blocks; b++) {
+        size_t offset = b * CIPHER_BLOCK_SIZE;
+        size_t n = length - offset < CIPHER_BLOCK_SIZE ? length - offset : CIPHER_BLOCK_SIZE;
+        authentic &= chachaPolyStage.open(key, nonce, aad, sizeof(aad), sealed + offset, n, opened + offset,
+                                          tags + b * CIPHER_TAG_LENGTH);
+    }
+    double openTime = monotonicSeconds() - start;
+    int roundTrip = authentic && memcmp(plain, opened, length) == 0;
+
+    printf("%s, %ld MB in %d KB blocks\n", chachaPolyStage.name, megabytes, CIPHER_BLOCK_SIZE >> 10);
+    printf("seal: %.2f GB/s\n", length / sealTime / 1e9);
+    printf("open: %.2f GB/s\n", length / openTime / 1e9);
+    printf("round trip: %s\n", roundTrip ? "ok" : "FAILED");
+
+    free(plain);
+    free(sealed);
+    free(opened);
+    free(tags);
+    return !(vectorOk && roundTrip);
+}
+
+// Shared state of the snapshot benchmark
+typedef struct {
+    ContactStore *store;
+    int contacts;            // Names "Person N" for N below this exist
+    atomic_int stop;
+    atomic_long lookups;
+    atomic_long misses;
+} SnapshotBench;
+
+static void *snapshotBenchReader(void *arg) {
+    SnapshotBench *bench = arg;
+    ContactReader *reader = contactReaderRegister(bench->store);
+    unsigned seed = (unsigned)(uintptr_t)&reader;
+    long lookups = 0, misses = 0;
+    char name[NAME_LENGTH];
+    while (!atomic_load_explicit(&bench->stop, memory_order_relaxed)) {
+        const ContactSnapshot *snapshot = contactReaderEnter(reader);
+        for (int i = 0; i < 256; i++) {
+            seed = seed * 1103515245u + 12345u;
+            snprintf(name, sizeof(name), "person %d", (int)((seed >> 8) % (unsigned)bench->contacts));
+            misses += contactSnapshotLookup(snapshot, name) == NULL;
+        }
+        contactReaderExit(reader);
+        lookups += 256;
+    }
+    contactReaderUnregister(reader);
+    atomic_fetch_add(&bench->lookups, lookups);
+    atomic_fetch_add(&bench->misses, misses);
+    return NULL;
+}
+
+/**
+ * Measure lookup throughput on snapshots with 1..threads readers while a
+ * writer keeps adding contacts in batches and publishing them.
+ */
+int benchSnapshots(int threads, double seconds) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = cpus > 0 ? (int)cpus : 1;
+    if (threads > CONTACT_MAX_READERS - 1) threads = CONTACT_MAX_READERS - 1;
+    if (seconds <= 0) seconds = 1.0;
+
+    ContactStore *store = contactStoreOpen("/dev/null", NULL);
+    if (store == NULL) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    SnapshotBench bench = { .store = store, .contacts = 200000 };
+    char name[NAME_LENGTH], phone[PHONE_LENGTH], email[EMAIL_LENGTH];
+    for (int i = 0; i < bench.contacts; i++) {
+        snprintf(name, sizeof(name), "Person %d", i);
+        snprintf(phone, sizeof(phone), "555-%07d", i);
+        snprintf(email, sizeof(email), "p%d@example.com", i);
+        contactStoreAdd(store, name, phone, email);
+    }
+    contactStorePublish(store);
+
+    printf("%d contacts, writer publishing 1000-contact batches\n", bench.contacts);
+    int failed = 0, extra = 0;
+    for (int t = 1; t <= threads; t *= 2) {
+        pthread_t readers[CONTACT_MAX_READERS];
+        atomic_store(&bench.stop, 0);
+        atomic_store(&bench.lookups, 0);
+        atomic_store(&bench.misses, 0);
+        for (int i = 0; i < t; i++) {
+            pthread_create(&readers[i], NULL, snapshotBenchReader, &bench);
+        }
+
+        // Writer: batch new contacts and publish them while readers run
+        int publishes = 0;
+        double start = monotonicSeconds();
+        while (monotonicSeconds() - start < seconds) {
+            for (int i = 0; i < 1000; i++, extra++) {
+                snprintf(name, sizeof(name), "Extra %d", extra);
+                contactStoreAdd(store, name, "555", "extra@example.com");
+            }
+            contactStorePublish(store);
+            publishes++;
+        }
+        atomic_store(&bench.stop, 1);
+        for (int i = 0; i < t; i++) {
+            pthread_join(readers[i], NULL);
+        }
+        double elapsed = monotonicSeconds() - start;
+        long lookups = atomic_load(&bench.lookups);
+        printf("%2d readers: %12.0f lookups/s  (%d publishes, %ld misses)\n",
+               t, lookups / elapsed, publishes, atomic_load(&bench.misses));
+        failed |= atomic_load(&bench.misses) != 0;
+        if (t < threads && t * 2 > threads) t = threads / 2; // Always finish with the full count
+    }
+    contactStoreClose(store);
+    return failed;
+}
+
+// Dedup benchmark: collects cluster sizes and checks them against the plant
+typedef struct {
+    long clusters;
+    long removed;
+    long wrong;              // Duplicates whose name does not match the planted record
+} DedupBench;
+
+static int countDuplicateCluster(const Contact *kept, const Contact *const *duplicates, int count, void *context) {
+    DedupBench *bench = context;
+    bench->clusters++;
+    bench->removed += count;
+    for (int i = 0; i < count; i++) {
+        bench->wrong += strcasecmp(kept->name + 1, duplicates[i]->name + 1) != 0;
+    }
+    return 0;
+}
+
+/**
+ * Fill a store with rows synthetic people, one in ten also entered a
+ * second time with a typo in the first letter of the name, an international
+ * phone prefix and a capitalised email. Times contactStoreDedup() for a few
+ * sizes to show the scaling and checks that exactly the planted copies are
+ * found.
+ */
+int benchDedup(int rows) {
+    static const char *syllables[] = { "an", "bel", "cor", "da", "el", "fin", "gar", "ho", "is", "jo",
+                                       "ka", "lin", "mar", "nor", "os", "pe", "ri", "sa", "tom", "vi" };
+    if (rows < 1000) rows = 1000;
+    int failed = 0;
+    printf("%-10s %10s %10s %10s %12s\n", "contacts", "clusters", "removed", "seconds", "ns/contact");
+    for (int size = rows / 8; size <= rows; size *= 2) {
+        ContactStore *store = contactStoreOpen("/dev/null", NULL);
+        if (store == NULL || !ensureContactCapacity(store, size + size / 10)) {
+            printf("Out of memory.\n");
+            contactStoreClose(store);
+            return 1;
+        }
+        char name[NAME_LENGTH], phone[PHONE_LENGTH], email[EMAIL_LENGTH];
+        unsigned seed = 12345;
+        long planted = 0;
+        for (int i = 0; i < size; i++) {
+            int length = 0;
+            for (int word = 0; word < 2; word++) {
+                for (int k = 0; k < 3; k++) {
+                    seed = seed * 1103515245u + 12345u;
+                    length += snprintf(name + length, sizeof(name) - length, "%s", syllables[(seed >> 16) % 20]);
+                }
+                if (word == 0) name[length++] = ' ';
+            }
+            snprintf(name + length, sizeof(name) - length, " %d", i);
+            name[0] = (char)toupper((unsigned char)name[0]);
+            unsigned scrambled = (unsigned)i * 2654435761u; // Unrelated people get unrelated numbers
+            snprintf(phone, sizeof(phone), "%010u", scrambled % 1000000000u);
+            snprintf(email, sizeof(email), "u%08x@example.com", scrambled);
+            contactStoreAdd(store, name, phone, email);
+            if (i % 10 == 0) {
+                name[0] = name[0] == 'Z' ? 'Y' : (char)(name[0] + 1);
+                snprintf(phone, sizeof(phone), "+1 %010u", scrambled % 1000000000u);
+                snprintf(email, sizeof(email), "U%08X@Example.com", scrambled);
+                contactStoreAdd(store, name, phone, email);
+                planted++;
+            }
+        }
+
+        DedupBench bench = { 0, 0, 0 };
+        int count = contactStoreCount(store);
+        double start = monotonicSeconds();
+        size_t clusters;
+        ContactStatus status = contactStoreDedup(store, 1, countDuplicateCluster, &bench, &clusters);
+        double elapsed = monotonicSeconds() - start;
+        printf("%-10d %10ld %10ld %10.3f %12.0f\n", count, bench.clusters, bench.removed, elapsed,
+               elapsed / count * 1e9);
+        failed |= status != CONTACT_OK || clusters != (size_t)bench.clusters;
+        failed |= bench.removed != planted || bench.wrong != 0 || contactStoreCount(store) != size;
+        contactStoreClose(store);
+    }
+    printf("planted duplicates recovered: %s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+/**
+ * Compare search throughput over the array of contacts with the columnar
+ * copy (scalar and SIMD filters) for each field, and check that all three
+ * find the same contacts.
+ */
+int benchColumns(int rows) {
+    static const struct { ContactField field; const char *label; const char *term; } cases[] = {
+        { FIELD_NAME, "name", "MAR" },
+        { FIELD_PHONE, "phone", "4242" },
+        { FIELD_EMAIL, "email", "u1f" },
+        { FIELD_ANY, "any", "42" },
+    };
+    static const char *syllables[] = { "an", "bel", "cor", "da", "el", "fin", "gar", "ho", "is", "jo",
+                                       "ka", "lin", "mar", "nor", "os", "pe", "ri", "sa", "tom", "vi" };
+    if (rows < 1) rows = 1;
+    ContactStore *store = contactStoreOpen("/dev/null", NULL);
+    if (store == NULL || !ensureContactCapacity(store, rows)) {
+        printf("Out of memory.\n");
+        contactStoreClose(store);
+        return 1;
+    }
+    char name[NAME_LENGTH], phone[PHONE_LENGTH], email[EMAIL_LENGTH];
+    unsigned seed = 12345;
+    for (int i = 0; i < rows; i++) {
+        int length = 0;
+        for (int k = 0; k < 4; k++) {
+            seed = seed * 1103515245u + 12345u;
+            length += snprintf(name + length, sizeof(name) - length, "%s", syllables[(seed >> 16) % 20]);
+            if (k == 1) name[length++] = ' ';
+        }
+        snprintf(name + length, sizeof(name) - length, " %d", i);
+        unsigned scrambled = (unsigned)i * 2654435761u;
+        snprintf(phone, sizeof(phone), "+1 %010u", scrambled % 1000000000u);
+        snprintf(email, sizeof(email), "u%08x@example.com", scrambled);
+        contactStoreAdd(store, name, phone, email);
+    }
+    ContactColumns *columns = contactColumnsBuild(store);
+    int *positions = malloc((size_t)rows * sizeof(int));
+    if (columns == NULL || positions == NULL) {
+        printf("Out of memory.\n");
+        contactColumnsFree(columns);
+        free(positions);
+        contactStoreClose(store);
+        return 1;
+    }
+
+    int count = contactStoreCount(store);
+    size_t columnBytes[3];
+    for (int f = 0; f < 3; f++) {
+        columnBytes[f] = columns->fields[f].offsets[count] + (size_t)(count + 1) * sizeof(uint32_t);
+    }
+    printf("%d contacts: %zu bytes per row as structs, %.1f name + %.1f phone + %.1f email in columns\n", count,
+           sizeof(Contact), (double)columnBytes[0] / count, (double)columnBytes[1] / count,
+           (double)columnBytes[2] / count);
+    printf("%-6s %-6s %9s %14s %14s %14s\n", "field", "term", "matches", "structs Mrow/s", "scalar Mrow/s",
+           "SIMD Mrow/s");
+
+    int failed = 0;
+    const int repeats = 5;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        size_t structMatches = 0, scalarMatches = 0, simdMatches = 0;
+        double start = monotonicSeconds();
+        for (int r = 0; r < repeats; r++) {
+            structMatches = contactStoreSearch(store, cases[c].field, cases[c].term, NULL, NULL);
+        }
+        double structTime = monotonicSeconds() - start;
+
+        start = monotonicSeconds();
+        for (int r = 0; r < repeats; r++) {
+            scalarMatches = filterColumns(columns, cases[c].field, cases[c].term, positions, filterColumnScalar);
+        }
+        double scalarTime = monotonicSeconds() - start;
+
+        start = monotonicSeconds();
+        for (int r = 0; r < repeats; r++) {
+            simdMatches = contactColumnsFilter(columns, cases[c].field, cases[c].term, positions);
+        }
+        double simdTime = monotonicSeconds() - start;
+
+        // The columns must return the same contacts in the same order
+        Contact contact;
+        size_t checked = 0;
+        ContactCursor cursor;
+        const Contact *expected;
+        contactStoreCursor(store, &cursor);
+        for (int i = 0; (expected = contactCursorNext(&cursor)) != NULL; i++) {
+            if (checked < simdMatches && positions[checked] == i) {
+                contactColumnsGet(columns, i, &contact);
+                failed |= memcmp(&contact.name, expected->name, strlen(expected->name) + 1) != 0;
+                checked++;
+            }
+        }
+        failed |= structMatches != scalarMatches || structMatches != simdMatches || checked != simdMatches;
+
+        double mrows = (double)count * repeats / 1e6;
+        printf("%-6s %-6s %9zu %14.1f %14.1f %14.1f\n", cases[c].label, cases[c].term, simdMatches,
+               mrows / structTime, mrows / scalarTime, mrows / simdTime);
+    }
+    printf("results agree: %s\n", failed ? "NO" : "yes");
+
+    free(positions);
+    contactColumnsFree(columns);
+    contactStoreClose(store);
+    return failed;
+}
+#endif
@@ -0,0 +1,115 @@
+/* Contact Management System - embeddable store API */
+
+#ifndef CONTACT_MANAGEMENT_H
+#define CONTACT_MANAGEMENT_H
+
+#include <stddef.h>
+
+#define NAME_LENGTH 50           // Maximum length for name
+#define PHONE_LENGTH 15          // Maximum length for phone number
+#define EMAIL_LENGTH 50          // Maximum length for email
+#define IMPORT_REPORT_INVALID 10 // Invalid rows reported by name before only counting them
+
+// Structure to hold contact information
+typedef struct {
+    char name[NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    char email[EMAIL_LENGTH];
+} Contact;
+
+// Opaque handle to a set of contacts backed by one contacts file (and the key file next to it)
+typedef struct ContactStore ContactStore;
+
+// Immutable published view of a store, read without locks
+typedef struct ContactSnapshot ContactSnapshot;
+
+// Column-wise copy of a store: one contiguous array per field, for scans
+typedef struct ContactColumns ContactColumns;
+
+// Registration of one reader thread with a store
+typedef struct ContactReader ContactReader;
+
+// Result of every store operation; contactStatusMessage() describes it
+typedef enum {
+    CONTACT_OK = 0,
+    CONTACT_NOT_FOUND,
+    CONTACT_DUPLICATE,
+    CONTACT_INVALID_PHONE,
+    CONTACT_INVALID_EMAIL,
+    CONTACT_TOO_LONG,
+    CONTACT_NO_MEMORY,
+    CONTACT_IO_ERROR,
+    CONTACT_AUTH_FAILED,
+    CONTACT_OPEN_FAILED      // The file could not be opened; errno says why
+} ContactStatus;
+
+// Fields a search can match against (same choices as Advanced Search)
+typedef enum {
+    FIELD_NAME = 1,
+    FIELD_PHONE,
+    FIELD_EMAIL,
+    FIELD_ANY
+} ContactField;
+
+// Called once per matching contact; return non-zero to stop early
+typedef int (*ContactCallback)(const Contact *contact, void *context);
+
+// Called once per duplicate cluster with the contact that is kept and the
+// contacts that a merge would remove; return value is ignored
+typedef int (*ContactClusterCallback)(const Contact *kept, const Contact *const *duplicates, int count,
+                                      void *context);
+
+// Position in a store for contactCursorNext(); invalidated by add/delete/sort
+typedef struct {
+    const ContactStore *store;
+    int position;
+} ContactCursor;
+
+// Counters filled in by contactStoreImport()
+typedef struct {
+    size_t lines;            // Non-empty lines read
+    size_t added;
+    size_t invalid;
+    size_t duplicates;
+    size_t bytes;
+    double seconds;
+    int workers;             // Parse threads used
+    char invalidNames[IMPORT_REPORT_INVALID][NAME_LENGTH];
+} ContactImportStats;
+
+ContactStore *contactStoreOpen(const char *filename, ContactStatus *status);
+ContactStatus contactStoreSave(ContactStore *store);
+void contactStoreClose(ContactStore *store);
+ContactStatus contactStoreAdd(ContactStore *store, const char *name, const char *phone, const char *email);
+ContactStatus contactStoreDelete(ContactStore *store, const char *name);
+const Contact *contactStoreLookup(const ContactStore *store, const char *name);
+size_t contactStoreSearch(const ContactStore *store, ContactField field, const char *term,
+                          ContactCallback callback, void *context);
+ContactStatus contactStoreImport(ContactStore *store, const char *filename, ContactImportStats *stats);
+void contactStoreSort(ContactStore *store);
+ContactStatus contactStoreDedup(ContactStore *store, int merge, ContactClusterCallback callback, void *context,
+                                size_t *clusters);
+int contactStoreCount(const ContactStore *store);
+void contactStoreCursor(const ContactStore *store, ContactCursor *cursor);
+const Contact *contactCursorNext(ContactCursor *cursor);
+const char *contactStatusMessage(ContactStatus status);
+
+// Concurrent read-mostly access: one writer mutates the store and publishes,
+// any number of registered readers look up in the latest snapshot
+ContactStatus contactStorePublish(ContactStore *store);
+ContactReader *contactReaderRegister(ContactStore *store);
+void contactReaderUnregister(ContactReader *reader);
+const ContactSnapshot *contactReaderEnter(ContactReader *reader);
+void contactReaderExit(ContactReader *reader);
+const Contact *contactSnapshotLookup(const ContactSnapshot *snapshot, const char *name);
+size_t contactSnapshotSearch(const ContactSnapshot *snapshot, ContactField field, const char *term,
+                             ContactCallback callback, void *context);
+int contactSnapshotCount(const ContactSnapshot *snapshot);
+
+// Scans over a columnar copy touch only the bytes of the searched field
+ContactColumns *contactColumnsBuild(const ContactStore *store);
+void contactColumnsFree(ContactColumns *columns);
+size_t contactColumnsFilter(const ContactColumns *columns, ContactField field, const char *term, int *positions);
+void contactColumnsGet(const ContactColumns *columns, int position, Contact *contact);
+
+#endif
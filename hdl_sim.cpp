@@ -0,0 +1,2182 @@
+// Headless simulator for Nand2Tetris HDL chips
+//
+// Parses CHIP/IN/OUT/PARTS definitions, flattens the part hierarchy down to
+// primitive gates (Nand, Not, And, Or, Xor, Mux, DFF), sorts the netlist into a
+// straight-line program and runs .tst scripts or .cmp tables against it.
+//
+//   hdl_sim SCRIPT.tst               run a test script (load, set, eval, output, ...)
+//   hdl_sim CHIP.hdl [TABLE.cmp]     describe the chip, or check it against a table
+//   hdl_sim --equiv CHIP.hdl OTHER   check two chips (OTHER.hdl or a built-in name) agree on every input
+//   hdl_sim --check-opt CHIP.hdl     check the optimised netlist against the flat one
+//   hdl_sim --bench-clock CHIP.hdl [CYCLES] [PROGRAM.hack]
+//                                    clock a chip with DFFs (a CPU runs the program), timing full
+//                                    re-evaluation against event-driven simulation
+//   hdl_sim --suite DIR...           check every NAME.cmp under the directories against NAME.hdl
+//                                    (or through NAME.tst), tests in parallel
+//
+// Simulation is bit-sliced: each wire holds one bit of 64 input vectors (128 with
+// SSE2, 256 with AVX2) and each gate is a single bitwise instruction, so tables
+// run that many rows per pass and chips of up to 32 input bits such as Xor16 are
+// checked exhaustively. Before simulation the netlist is optimised: constants
+// and identities are folded, Not(Nand) becomes And, repeated gates are merged,
+// gates no output depends on are dropped, and arrays of identical gates over
+// bus slices (the 16 Xors of Xor16) are lowered to single bus operations.
+// Scripts clock DFFs with tick and tock and are simulated event-driven: only
+// the gates downstream of a pin or DFF that changed are evaluated again.
+//
+// Part chips, and the chip a script loads, are looked up as NAME.hdl next to
+// the file that uses them, then among the built-in chips of projects 1 to 3
+// (And16, Add16, ALU, Register, RAM8, PC, ...); suite/Bit.tst loads the
+// built-in Bit that way.
+// A table is either the simulator's own |-separated output or tab-separated
+// columns such as alu.cmp; decimal values compare modulo 2^width, so -1 and
+// 65535 are the same 16-bit value.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ======================
+// Limits
+// ======================
+const int MAX_PIN_WIDTH = 64;      // Widest bus a pin may have (values are held in 64 bits)
+const int MAX_REPORTED = 10;       // Mismatches printed in full; later ones are only counted
+const int CONST_FALSE = 0;         // Wire holding false
+const int CONST_TRUE = 1;          // Wire holding true
+
+// Problem in an HDL file, test script or table, already prefixed with file:line
+struct HdlError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// Build an HdlError message from file, line and text
+static HdlError errorAt(const std::string &file, int line, const std::string &message) {
+  return HdlError(file + ":" + std::to_string(line) + ": " + message);
+}
+
+// Whole file as a string
+static std::string readFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw HdlError(path + ": cannot open");
+  std::ostringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+static bool endsWith(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool fileExists(const std::string &path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+// Directory part of a path, with its trailing slash ("" for a bare name)
+static std::string directoryOf(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+// ======================
+// Lexer (shared by .hdl and .tst files)
+// ======================
+struct Token {
+  enum Kind { IDENT, NUMBER, STRING, SYMBOL, END } kind;
+  std::string text;
+  int line;
+};
+
+// Split text into identifiers, numbers, "strings" and single-character symbols; ".." is one symbol
+// Comments (// and /* */) are skipped; inTst lets '-' and '%' join words (output-file, %B3.16.1)
+static std::vector<Token> tokenizeText(const std::string &text, const std::string &file, bool inTst) {
+  std::vector<Token> tokens;
+  int line = 1;
+  size_t i = 0;
+  while (i < text.size()) {
+    char c = text[i];
+    if (c == '\n') { line++; i++; continue; }
+    if (isspace((unsigned char)c)) { i++; continue; }
+    if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+      while (i < text.size() && text[i] != '\n') i++;
+      continue;
+    }
+    if (c == '/' && i + 1 < text.size() && text[i + 1] == '*') {
+      size_t end = text.find("*/", i + 2);
+      if (end == std::string::npos) throw errorAt(file, line, "unterminated comment");
+      for (size_t j = i; j < end; j++) line += text[j] == '\n';
+      i = end + 2;
+      continue;
+    }
+    int start = line;
+    if (c == '"') {
+      size_t end = text.find('"', i + 1);
+      if (end == std::string::npos) throw errorAt(file, line, "unterminated string");
+      tokens.push_back({Token::STRING, text.substr(i + 1, end - i - 1), start});
+      i = end + 1;
+    } else if (isalnum((unsigned char)c) || c == '_' || (inTst && (c == '%' || c == '-' || c == '.'))) {
+      size_t j = i;
+      bool number = isdigit((unsigned char)c) || c == '-';
+      while (j < text.size()) {
+        char d = text[j];
+        bool word = isalnum((unsigned char)d) || d == '_' || (inTst && (d == '%' || d == '-' || d == '.'));
+        if (!word || (!inTst && d == '.')) break;
+        number = number && (isdigit((unsigned char)d) || (j == i && d == '-'));
+        j++;
+      }
+      tokens.push_back({number && j > i + (c == '-') ? Token::NUMBER : Token::IDENT, text.substr(i, j - i), start});
+      i = j;
+    } else if (c == '.' && i + 1 < text.size() && text[i + 1] == '.') {
+      tokens.push_back({Token::SYMBOL, "..", start});
+      i += 2;
+    } else {
+      tokens.push_back({Token::SYMBOL, std::string(1, c), start});
+      i++;
+    }
+  }
+  tokens.push_back({Token::END, "", line});
+  return tokens;
+}
+
+// Cursor over a token vector with the expect/accept helpers both parsers use
+struct TokenCursor {
+  const std::vector<Token> &tokens;
+  const std::string &file;
+  size_t at = 0;
+
+  const Token &peek() const { return tokens[at]; }
+  bool accept(const std::string &text) {
+    if (tokens[at].kind == Token::END || tokens[at].text != text || tokens[at].kind == Token::STRING) return false;
+    at++;
+    return true;
+  }
+  void expect(const std::string &text) {
+    if (!accept(text)) throw errorAt(file, peek().line, "expected '" + text + "' but found " + describe(peek()));
+  }
+  std::string identifier() {
+    if (peek().kind != Token::IDENT) throw errorAt(file, peek().line, "expected a name but found " + describe(peek()));
+    return tokens[at++].text;
+  }
+  int number() {
+    const Token &token = peek();
+    if (token.kind != Token::NUMBER) throw errorAt(file, token.line, "expected a number but found " + describe(token));
+    errno = 0;
+    long long value = strtoll(token.text.c_str(), nullptr, 10);
+    if (errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+      throw errorAt(file, token.line, "number " + token.text + " is out of range");
+    }
+    at++;
+    return (int)value;
+  }
+  static std::string describe(const Token &token) {
+    return token.kind == Token::END ? "the end of the file" : "'" + token.text + "'";
+  }
+};
+
+// ======================
+// Chip definitions
+// ======================
+// Primitive gates every chip is flattened into; BUF only exists until aliases are resolved
+// A DFF is a gate too until sortNetlist() moves it to Netlist::flops
+enum GateOp { OP_NAND, OP_AND, OP_OR, OP_XOR, OP_NOT, OP_MUX, OP_DFF, OP_BUF };
+
+struct PinDecl {
+  std::string name;
+  int width;
+};
+
+// One side of a connection: name, name[i] or name[lo..hi]; lo < 0 means the whole signal
+struct PinRef {
+  std::string name;
+  int lo = -1, hi = -1;
+};
+
+struct Connection {
+  PinRef inner, outer;  // Pin of the part = signal of the enclosing chip
+  int line;
+};
+
+struct PartDecl {
+  std::string chip;
+  std::vector<Connection> connections;
+  int line;
+};
+
+struct ChipDef {
+  std::string name, file;
+  int line = 1;  // Of the CHIP keyword
+  std::vector<PinDecl> inputs, outputs;
+  std::vector<PartDecl> parts;
+  int primitive = -1;  // GateOp of a primitive gate, else -1
+
+  const PinDecl *findPin(const std::string &pin, bool *isInput) const {
+    for (const PinDecl &decl : inputs) {
+      if (decl.name == pin) { *isInput = true; return &decl; }
+    }
+    for (const PinDecl &decl : outputs) {
+      if (decl.name == pin) { *isInput = false; return &decl; }
+    }
+    return nullptr;
+  }
+};
+
+// pin, pin[i] or pin[lo..hi]
+static PinRef parseRef(TokenCursor &cursor) {
+  PinRef ref;
+  ref.name = cursor.identifier();
+  if (cursor.accept("[")) {
+    ref.lo = ref.hi = cursor.number();
+    if (cursor.accept("..")) ref.hi = cursor.number();
+    cursor.expect("]");
+    if (ref.hi < ref.lo) throw errorAt(cursor.file, cursor.peek().line, "sub-bus " + ref.name + " runs backwards");
+  }
+  return ref;
+}
+
+// IN a, b[16];  (the keyword has been read)
+static void parsePinList(TokenCursor &cursor, std::vector<PinDecl> &pins) {
+  if (cursor.accept(";")) return;
+  do {
+    PinDecl pin{cursor.identifier(), 1};
+    if (cursor.accept("[")) {
+      pin.width = cursor.number();
+      cursor.expect("]");
+    }
+    if (pin.width < 1 || pin.width > MAX_PIN_WIDTH) {
+      throw errorAt(cursor.file, cursor.peek().line, "pin " + pin.name + " must be 1 to 64 bits wide");
+    }
+    pins.push_back(pin);
+  } while (cursor.accept(","));
+  cursor.expect(";");
+}
+
+// Parse one CHIP definition; BUILTIN chips keep only their interface and name the builtin to use
+static std::unique_ptr<ChipDef> parseChip(const std::string &text, const std::string &file, std::string *builtin) {
+  std::vector<Token> tokens = tokenizeText(text, file, false);
+  TokenCursor cursor{tokens, file};
+  auto chip = std::make_unique<ChipDef>();
+  chip->file = file;
+  chip->line = cursor.peek().line;
+  cursor.expect("CHIP");
+  chip->name = cursor.identifier();
+  cursor.expect("{");
+  while (!cursor.accept("}")) {
+    if (cursor.accept("IN")) {
+      parsePinList(cursor, chip->inputs);
+    } else if (cursor.accept("OUT")) {
+      parsePinList(cursor, chip->outputs);
+    } else if (cursor.accept("BUILTIN")) {
+      *builtin = cursor.identifier();
+      cursor.expect(";");
+    } else if (cursor.accept("CLOCKED")) {  // Which pins are clocked follows from the DFFs, so the list is only read
+      std::vector<PinDecl> clocked;
+      parsePinList(cursor, clocked);
+    } else if (cursor.accept("PARTS")) {
+      cursor.expect(":");
+      while (cursor.peek().kind == Token::IDENT) {
+        PartDecl part;
+        part.line = cursor.peek().line;
+        part.chip = cursor.identifier();
+        cursor.expect("(");
+        if (!cursor.accept(")")) {
+          do {
+            Connection connection;
+            connection.line = cursor.peek().line;
+            connection.inner = parseRef(cursor);
+            cursor.expect("=");
+            connection.outer = parseRef(cursor);
+            part.connections.push_back(connection);
+          } while (cursor.accept(","));
+          cursor.expect(")");
+        }
+        cursor.expect(";");
+        chip->parts.push_back(part);
+      }
+    } else {
+      throw errorAt(file, cursor.peek().line, "expected IN, OUT, PARTS or '}' but found " +
+                    TokenCursor::describe(cursor.peek()));
+    }
+  }
+  return chip;
+}
+
+// ======================
+// Built-in chips
+// ======================
+// Primitive gates with their pins, in GateOp order
+struct PrimitiveDecl {
+  const char *name;
+  std::vector<const char *> inputs;
+};
+static const PrimitiveDecl PRIMITIVES[] = {
+  {"Nand", {"a", "b"}}, {"And", {"a", "b"}}, {"Or", {"a", "b"}}, {"Xor", {"a", "b"}},
+  {"Not", {"in"}}, {"Mux", {"a", "b", "sel"}}, {"DFF", {"in"}},
+};
+
+// n copies of a part line with every '#' replaced by the copy's index
+static std::string repeatPart(int n, const std::string &line) {
+  std::string parts;
+  for (int i = 0; i < n; i++) {
+    std::string copy = line;
+    for (size_t at; (at = copy.find('#')) != std::string::npos;) copy.replace(at, 1, std::to_string(i));
+    parts += copy + "\n";
+  }
+  return parts;
+}
+
+// HDL source of a built-in chip of projects 1 to 3 (above the primitive gates), or "" when there is none
+static std::string builtinSource(const std::string &name) {
+  if (name == "DMux") {
+    return "CHIP DMux { IN in, sel; OUT a, b; PARTS: Not(in=sel, out=nsel); And(a=in, b=nsel, out=a);"
+           " And(a=in, b=sel, out=b); }";
+  }
+  if (name == "Not16") return "CHIP Not16 { IN in[16]; OUT out[16]; PARTS:\n" + repeatPart(16, "Not(in=in[#], out=out[#]);") + "}";
+  if (name == "And16" || name == "Or16") {
+    std::string gate = name.substr(0, name.size() - 2);
+    return "CHIP " + name + " { IN a[16], b[16]; OUT out[16]; PARTS:\n" +
+           repeatPart(16, gate + "(a=a[#], b=b[#], out=out[#]);") + "}";
+  }
+  if (name == "Mux16") {
+    return "CHIP Mux16 { IN a[16], b[16], sel; OUT out[16]; PARTS:\n" +
+           repeatPart(16, "Mux(a=a[#], b=b[#], sel=sel, out=out[#]);") + "}";
+  }
+  if (name == "Or8Way") {
+    return "CHIP Or8Way { IN in[8]; OUT out; PARTS: Or(a=in[0], b=in[1], out=o1); Or(a=in[2], b=in[3], out=o2);"
+           " Or(a=in[4], b=in[5], out=o3); Or(a=in[6], b=in[7], out=o4); Or(a=o1, b=o2, out=o5);"
+           " Or(a=o3, b=o4, out=o6); Or(a=o5, b=o6, out=out); }";
+  }
+  if (name == "Mux4Way16") {
+    return "CHIP Mux4Way16 { IN a[16], b[16], c[16], d[16], sel[2]; OUT out[16]; PARTS:"
+           " Mux16(a=a, b=b, sel=sel[0], out=ab); Mux16(a=c, b=d, sel=sel[0], out=cd);"
+           " Mux16(a=ab, b=cd, sel=sel[1], out=out); }";
+  }
+  if (name == "Mux8Way16") {
+    return "CHIP Mux8Way16 { IN a[16], b[16], c[16], d[16], e[16], f[16], g[16], h[16], sel[3]; OUT out[16];"
+           " PARTS: Mux4Way16(a=a, b=b, c=c, d=d, sel=sel[0..1], out=abcd);"
+           " Mux4Way16(a=e, b=f, c=g, d=h, sel=sel[0..1], out=efgh); Mux16(a=abcd, b=efgh, sel=sel[2], out=out); }";
+  }
+  if (name == "DMux4Way") {
+    return "CHIP DMux4Way { IN in, sel[2]; OUT a, b, c, d; PARTS: DMux(in=in, sel=sel[1], a=ab, b=cd);"
+           " DMux(in=ab, sel=sel[0], a=a, b=b); DMux(in=cd, sel=sel[0], a=c, b=d); }";
+  }
+  if (name == "DMux8Way") {
+    return "CHIP DMux8Way { IN in, sel[3]; OUT a, b, c, d, e, f, g, h; PARTS: DMux(in=in, sel=sel[2], a=abcd, b=efgh);"
+           " DMux4Way(in=abcd, sel=sel[0..1], a=a, b=b, c=c, d=d); DMux4Way(in=efgh, sel=sel[0..1], a=e, b=f, c=g, d=h); }";
+  }
+  if (name == "HalfAdder") {
+    return "CHIP HalfAdder { IN a, b; OUT sum, carry; PARTS: Xor(a=a, b=b, out=sum); And(a=a, b=b, out=carry); }";
+  }
+  if (name == "FullAdder") {
+    return "CHIP FullAdder { IN a, b, c; OUT sum, carry; PARTS: HalfAdder(a=a, b=b, sum=s1, carry=c1);"
+           " HalfAdder(a=s1, b=c, sum=sum, carry=c2); Or(a=c1, b=c2, out=carry); }";
+  }
+  if (name == "Add16") {
+    return "CHIP Add16 { IN a[16], b[16]; OUT out[16]; PARTS:\n"
+           "HalfAdder(a=a[0], b=b[0], sum=out[0], carry=c0);\n" +
+           repeatPart(15, "FullAdder(a=a[#+1], b=b[#+1], c=c#, sum=out[#+1], carry=c#+1);") + "}";
+  }
+  if (name == "Inc16") return "CHIP Inc16 { IN in[16]; OUT out[16]; PARTS: Add16(a=in, b[0]=true, out=out); }";
+  if (name == "ALU") {
+    return "CHIP ALU { IN x[16], y[16], zx, nx, zy, ny, f, no; OUT out[16], zr, ng; PARTS:"
+           " Mux16(a=x, b=false, sel=zx, out=x1); Not16(in=x1, out=notx1); Mux16(a=x1, b=notx1, sel=nx, out=x2);"
+           " Mux16(a=y, b=false, sel=zy, out=y1); Not16(in=y1, out=noty1); Mux16(a=y1, b=noty1, sel=ny, out=y2);"
+           " And16(a=x2, b=y2, out=xandy); Add16(a=x2, b=y2, out=xplusy); Mux16(a=xandy, b=xplusy, sel=f, out=o1);"
+           " Not16(in=o1, out=noto1);"
+           " Mux16(a=o1, b=noto1, sel=no, out=out, out[15]=ng, out[0..7]=low, out[8..15]=high);"
+           " Or8Way(in=low, out=orlow); Or8Way(in=high, out=orhigh); Or(a=orlow, b=orhigh, out=nz);"
+           " Not(in=nz, out=zr); }";
+  }
+  if (name == "Bit") {
+    return "CHIP Bit { IN in, load; OUT out; PARTS: Mux(a=q, b=in, sel=load, out=d); DFF(in=d, out=q, out=out); }";
+  }
+  if (name == "Register" || name == "ARegister" || name == "DRegister") {
+    return "CHIP " + name + " { IN in[16], load; OUT out[16]; PARTS:\n" +
+           repeatPart(16, "Bit(in=in[#], load=load, out=out[#]);") + "}";
+  }
+  if (name == "PC") {
+    return "CHIP PC { IN in[16], load, inc, reset; OUT out[16]; PARTS: Inc16(in=q, out=next);"
+           " Mux16(a=q, b=next, sel=inc, out=o1); Mux16(a=o1, b=in, sel=load, out=o2);"
+           " Mux16(a=o2, b=false, sel=reset, out=o3); Register(in=o3, load=true, out=q, out=out); }";
+  }
+  // RAMn: eight (RAM16K: four) of the next smaller memory, picked by the high address bits
+  static const char *const RAMS[] = {"RAM8", "RAM64", "RAM512", "RAM4K", "RAM16K"};
+  for (int k = 0; k < 5; k++) {
+    if (name != RAMS[k]) continue;
+    int bits = k < 4 ? 3 * (k + 1) : 14, ways = k < 4 ? 8 : 4, low = bits - (k < 4 ? 3 : 2);
+    std::string sel = k == 0 ? "address" : "address[" + std::to_string(low) + ".." + std::to_string(bits - 1) + "]";
+    std::string part = k == 0 ? "Register(in=in, load=l#, out=r#);" :
+                       std::string(RAMS[k - 1]) + "(in=in, load=l#, address=address[0.." + std::to_string(low - 1) + "], out=r#);";
+    std::string loads, registers;
+    for (int w = 0; w < ways; w++) {
+      loads += std::string(", ") + "abcdefgh"[w] + "=l" + std::to_string(w);
+      registers += std::string(", ") + "abcdefgh"[w] + "=r" + std::to_string(w);
+    }
+    std::string way = std::to_string(ways) + "Way";
+    return "CHIP " + name + " { IN in[16], load, address[" + std::to_string(bits) + "]; OUT out[16]; PARTS:\n"
+           "DMux" + way + "(in=load, sel=" + sel + loads + ");\n" + repeatPart(ways, part) +
+           "Mux" + way + "16(sel=" + sel + registers + ", out=out); }";
+  }
+  return "";
+}
+
+// Replace "#+1" and similar in repeatPart() output: indices like "15+1" become "16"
+static std::string foldIndices(std::string text) {
+  for (size_t at = 0; (at = text.find("+1", at)) != std::string::npos;) {
+    size_t start = at;
+    while (start > 0 && isdigit((unsigned char)text[start - 1])) start--;
+    if (start == at) { at += 2; continue; }
+    std::string folded = std::to_string(std::stoi(text.substr(start, at - start)) + 1);
+    text.replace(start, at + 2 - start, folded);
+    at = start + folded.size();
+  }
+  return text;
+}
+
+// ======================
+// Chip library: finds definitions by name and caches them
+// ======================
+class ChipLibrary {
+ public:
+  explicit ChipLibrary(const std::string &directory) : directory_(directory) {}
+
+  // Load the chip defined in a file (the top-level chip)
+  const ChipDef &loadFile(const std::string &path) {
+    std::string builtin;
+    std::unique_ptr<ChipDef> chip = parseChip(readFile(path), path, &builtin);
+    if (!builtin.empty()) return byName(builtin);
+    std::string name = chip->name;
+    chips_[name] = std::move(chip);
+    return *chips_[name];
+  }
+
+  // Definition of a part: NAME.hdl in the directory, else a built-in chip
+  const ChipDef &byName(const std::string &name) {
+    auto found = chips_.find(name);
+    if (found != chips_.end()) return *found->second;
+    std::string path = directory_ + name + ".hdl";
+    std::ifstream probe(path);
+    std::unique_ptr<ChipDef> chip;
+    std::string builtin;
+    if (probe) chip = parseChip(readFile(path), path, &builtin);
+    if (!chip || !builtin.empty()) chip = builtinChip(builtin.empty() ? name : builtin);
+    if (!chip) throw HdlError("no chip named " + name + " (looked for " + path + " and the built-in chips)");
+    if (chip->name != name && builtin.empty()) throw HdlError(path + ": defines " + chip->name + ", not " + name);
+    ChipDef &stored = *chip;
+    chips_[name] = std::move(chip);
+    return stored;
+  }
+
+ private:
+  static std::unique_ptr<ChipDef> builtinChip(const std::string &name) {
+    for (size_t op = 0; op < sizeof(PRIMITIVES) / sizeof(PRIMITIVES[0]); op++) {
+      if (name != PRIMITIVES[op].name) continue;
+      auto chip = std::make_unique<ChipDef>();
+      chip->name = name;
+      chip->file = "<builtin>";
+      for (const char *pin : PRIMITIVES[op].inputs) chip->inputs.push_back({pin, 1});
+      chip->outputs.push_back({"out", 1});
+      chip->primitive = (int)op;
+      return chip;
+    }
+    std::string source = builtinSource(name);
+    std::string builtin;
+    return source.empty() ? nullptr : parseChip(foldIndices(source), "<builtin " + name + ">", &builtin);
+  }
+
+  std::string directory_;
+  std::map<std::string, std::unique_ptr<ChipDef>> chips_;
+};
+
+// ======================
+// Flattening: the part hierarchy becomes one list of primitive gates over numbered wires
+// ======================
+struct Gate {
+  int op;
+  int out;
+  int in[3];
+};
+
+// Run of count identical gates: out + i = op(in[0] + i * stride[0], ...) for i < count; a stride is 1 for
+// consecutive bits of a bus and 0 for one wire shared by the whole run (the sel of a Mux16)
+struct BusGate {
+  int op;
+  int out, count;
+  int in[3], stride[3];
+};
+
+// Part or connection a gate was flattened from, for errors found once the netlist is built
+struct GateSource {
+  const std::string *file;  // ChipDef::file, owned by the ChipLibrary
+  int line;
+  int depth;                // Of the chip instance that made the gate; 0 for the top-level chip
+};
+
+struct Netlist {
+  int wireCount = 2;                       // Wires 0 and 1 are the constants false and true
+  std::vector<Gate> gates;                 // Topologically sorted after buildNetlist()
+  std::vector<BusGate> program;            // The gates as runs, in evaluation order
+  std::vector<Gate> flops;                 // DFFs: out holds the bit stored, in[0] is what the next tick stores
+  std::vector<PinDecl> inputs, outputs;    // Pins of the top-level chip
+  std::map<std::string, std::vector<int>> pins;  // Wire of each bit of each top-level pin, bit 0 first
+  std::vector<std::string> wireNames;      // Hierarchical name of each wire, for error messages
+};
+
+class Flattener {
+ public:
+  Flattener(ChipLibrary &library, Netlist &netlist) : library_(library), netlist_(netlist) {}
+
+  // Fresh wire named name
+  int newWire(const std::string &name) {
+    netlist_.wireNames.push_back(name);
+    drivers_.push_back(-1);
+    return netlist_.wireCount++;
+  }
+
+  // Declaration of each gate in the netlist, in the same order; valid while the ChipLibrary is
+  const std::vector<GateSource> &sources() const { return sources_; }
+
+  // Instantiate chip, declared at file:line, with its input wires; returns the wire of every output bit
+  std::map<std::string, std::vector<int>> instantiate(const ChipDef &chip, const std::map<std::string, std::vector<int>> &inputs,
+                                                      const std::string &path, int depth, const std::string &file, int line) {
+    if (depth > 64) throw HdlError(chip.file + ": chip " + chip.name + " contains itself");
+    std::map<std::string, std::vector<int>> outputs;
+    if (chip.primitive >= 0) {
+      Gate gate{chip.primitive, newWire(path + ".out"), {CONST_FALSE, CONST_FALSE, CONST_FALSE}};
+      for (size_t i = 0; i < chip.inputs.size(); i++) gate.in[i] = inputs.at(chip.inputs[i].name)[0];
+      addGate(gate, file, line, depth);
+      outputs["out"] = {gate.out};
+      return outputs;
+    }
+
+    // Signals of this chip: its pins, then internal pins as the parts' outputs define them
+    std::map<std::string, std::vector<int>> signals = inputs;
+    std::map<std::string, int> internal;  // Line of the connection that declares each internal pin
+    for (const PinDecl &pin : chip.outputs) {
+      std::vector<int> &wires = signals[pin.name];
+      for (int b = 0; b < pin.width; b++) wires.push_back(newWire(path + "." + pin.name + bitSuffix(pin.width, b)));
+    }
+    for (const PartDecl &part : chip.parts) {
+      const ChipDef &def = library_.byName(part.chip);
+      for (const Connection &connection : part.connections) {
+        bool isInput;
+        const PinDecl *pin = def.findPin(connection.inner.name, &isInput);
+        if (!pin) throw errorAt(chip.file, connection.line, part.chip + " has no pin named " + connection.inner.name);
+        if (isInput || signals.count(connection.outer.name) || isConstant(connection.outer.name)) continue;
+        if (connection.outer.lo >= 0) {
+          throw errorAt(chip.file, connection.line, "sub-bus of internal pin " + connection.outer.name + " cannot be assigned");
+        }
+        int width = refWidth(connection.inner, *pin, chip.file, connection.line);
+        std::vector<int> &wires = signals[connection.outer.name];
+        for (int b = 0; b < width; b++) wires.push_back(newWire(path + "." + connection.outer.name + bitSuffix(width, b)));
+        internal[connection.outer.name] = connection.line;
+      }
+    }
+
+    for (size_t p = 0; p < chip.parts.size(); p++) {
+      const PartDecl &part = chip.parts[p];
+      const ChipDef &def = library_.byName(part.chip);
+      std::map<std::string, std::vector<int>> partInputs;
+      for (const PinDecl &pin : def.inputs) partInputs[pin.name].assign(pin.width, CONST_FALSE);  // Unconnected: false
+      std::vector<const Connection *> outputConnections;
+      for (const Connection &connection : part.connections) {
+        bool isInput;
+        const PinDecl *pin = def.findPin(connection.inner.name, &isInput);
+        int width = refWidth(connection.inner, *pin, chip.file, connection.line);
+        if (!isInput) {
+          outputConnections.push_back(&connection);
+          continue;
+        }
+        std::vector<int> source = outerWires(signals, internal, connection.outer, width, chip.file, connection.line);
+        int lo = connection.inner.lo < 0 ? 0 : connection.inner.lo;
+        for (int b = 0; b < width; b++) partInputs[pin->name][lo + b] = source[b];
+      }
+      std::string partPath = path + "." + part.chip + "[" + std::to_string(p) + "]";
+      std::map<std::string, std::vector<int>> partOutputs = instantiate(def, partInputs, partPath, depth + 1, chip.file, part.line);
+      for (const Connection *connection : outputConnections) {
+        bool isInput;
+        const PinDecl *pin = def.findPin(connection->inner.name, &isInput);
+        int width = refWidth(connection->inner, *pin, chip.file, connection->line);
+        bool outerIsInput = false;
+        if (isConstant(connection->outer.name) || (chip.findPin(connection->outer.name, &outerIsInput) && outerIsInput)) {
+          throw errorAt(chip.file, connection->line, "cannot assign to " + connection->outer.name);
+        }
+        std::vector<int> targets = outerWires(signals, internal, connection->outer, width, chip.file, connection->line);
+        int lo = connection->inner.lo < 0 ? 0 : connection->inner.lo;
+        for (int b = 0; b < width; b++) {
+          Gate buffer{OP_BUF, targets[b], {partOutputs[pin->name][lo + b], CONST_FALSE, CONST_FALSE}};
+          if (drivers_[targets[b]] >= 0) {
+            throw errorAt(chip.file, connection->line, netlist_.wireNames[targets[b]] + " has more than one driver");
+          }
+          addGate(buffer, chip.file, connection->line, depth);
+        }
+      }
+    }
+
+    for (auto &entry : internal) {
+      for (int wire : signals[entry.first]) {
+        if (drivers_[wire] < 0) throw errorAt(chip.file, entry.second, "internal pin " + entry.first + " is never assigned");
+      }
+    }
+    for (const PinDecl &pin : chip.outputs) {
+      outputs[pin.name] = signals[pin.name];
+      for (int wire : outputs[pin.name]) {
+        if (drivers_[wire] >= 0) continue;  // An unassigned output reads as false
+        addGate({OP_BUF, wire, {CONST_FALSE, CONST_FALSE, CONST_FALSE}}, file, line, depth);
+      }
+    }
+    return outputs;
+  }
+
+ private:
+  static bool isConstant(const std::string &name) { return name == "true" || name == "false"; }
+
+  static std::string bitSuffix(int width, int bit) { return width > 1 ? "[" + std::to_string(bit) + "]" : ""; }
+
+  void drive(int wire, int gate) { drivers_[wire] = gate; }
+
+  // Append a gate made, in the chip instance at depth, by the part or connection declared at file:line
+  void addGate(const Gate &gate, const std::string &file, int line, int depth) {
+    drive(gate.out, (int)netlist_.gates.size());
+    netlist_.gates.push_back(gate);
+    sources_.push_back({&file, line, depth});
+  }
+
+  // Bits a part pin reference covers, checked against the pin
+  static int refWidth(const PinRef &ref, const PinDecl &pin, const std::string &file, int line) {
+    if (ref.lo < 0) return pin.width;
+    if (ref.hi >= pin.width) throw errorAt(file, line, "pin " + pin.name + " has no bit " + std::to_string(ref.hi));
+    return ref.hi - ref.lo + 1;
+  }
+
+  // Wires of the enclosing chip's signal a connection names, width bits of them
+  std::vector<int> outerWires(std::map<std::string, std::vector<int>> &signals, std::map<std::string, int> &internal,
+                              const PinRef &ref, int width, const std::string &file, int line) {
+    if (isConstant(ref.name)) return std::vector<int>(width, ref.name == "true" ? CONST_TRUE : CONST_FALSE);
+    auto found = signals.find(ref.name);
+    if (found == signals.end()) throw errorAt(file, line, ref.name + " is neither a pin nor assigned by any part");
+    if (ref.lo >= 0 && internal.count(ref.name)) {
+      throw errorAt(file, line, "sub-bus of internal pin " + ref.name + " cannot be used");
+    }
+    const std::vector<int> &wires = found->second;
+    int lo = ref.lo < 0 ? 0 : ref.lo, hi = ref.lo < 0 ? (int)wires.size() - 1 : ref.hi;
+    if (hi >= (int)wires.size()) throw errorAt(file, line, ref.name + " has no bit " + std::to_string(hi));
+    if (hi - lo + 1 != width) {
+      throw errorAt(file, line, "width mismatch: " + std::to_string(width) + " bits connected to " +
+                    std::to_string(hi - lo + 1) + " bits of " + ref.name);
+    }
+    return std::vector<int>(wires.begin() + lo, wires.begin() + hi + 1);
+  }
+
+  ChipLibrary &library_;
+  Netlist &netlist_;
+  std::vector<int> drivers_ = {-1, -1};  // Gate driving each wire, -1 for none (the constants and top inputs)
+  std::vector<GateSource> sources_;      // Declaration of each gate in netlist_.gates
+};
+
+static int gateArity(int op) {
+  return op == OP_MUX ? 3 : op == OP_NOT || op == OP_DFF ? 1 : 2;
+}
+
+// Error for a netlist whose gates, buffers included, form a loop not broken by a DFF. Walking back from a gate that
+// cannot be ordered always through its first such input ends up going round one loop; of the gates on it, the one
+// made in the outermost chip is reported, since the connections there are the ones that close the loop
+static HdlError loopError(const Netlist &netlist, const std::vector<GateSource> &sources) {
+  const std::vector<Gate> &gates = netlist.gates;
+  std::vector<int> producer(netlist.wireCount, -1), pending(gates.size(), 0);
+  std::vector<std::vector<int>> readers(netlist.wireCount);
+  auto arity = [](const Gate &gate) { return gate.op == OP_BUF ? 1 : gate.op == OP_DFF ? 0 : gateArity(gate.op); };
+  for (size_t g = 0; g < gates.size(); g++) {
+    if (gates[g].op != OP_DFF) producer[gates[g].out] = (int)g;
+  }
+  for (size_t g = 0; g < gates.size(); g++) {
+    for (int i = 0; i < arity(gates[g]); i++) {
+      if (producer[gates[g].in[i]] < 0) continue;
+      pending[g]++;
+      readers[gates[g].in[i]].push_back((int)g);
+    }
+  }
+  std::vector<int> ready;
+  for (size_t g = 0; g < gates.size(); g++) {
+    if (pending[g] == 0) ready.push_back((int)g);
+  }
+  while (!ready.empty()) {
+    int g = ready.back();
+    ready.pop_back();
+    for (int reader : readers[gates[g].out]) {
+      if (--pending[reader] == 0) ready.push_back(reader);
+    }
+  }
+  auto previous = [&](int g) {  // First input of a gate left over that is made by another left over gate
+    for (int i = 0;; i++) {
+      int p = producer[gates[g].in[i]];
+      if (p >= 0 && pending[p] > 0) return p;
+    }
+  };
+  int g = (int)(std::find_if(pending.begin(), pending.end(), [](int n) { return n > 0; }) - pending.begin());
+  for (size_t step = 0; step < gates.size(); step++) g = previous(g);  // Now on the loop
+  int reported = g;
+  for (int h = previous(g); h != g; h = previous(h)) {
+    if (sources[h].depth < sources[reported].depth) reported = h;
+  }
+  return errorAt(*sources[reported].file, sources[reported].line,
+                 "combinational loop through " + netlist.wireNames[gates[reported].out]);
+}
+
+// Replace every buffer by its source, move the DFFs to netlist.flops and order the remaining gates so each comes
+// after the gates it reads; a DFF's output counts as an input, so loops through DFFs are allowed
+// sources holds the declaration of each gate, for loopError()
+static void sortNetlist(Netlist &netlist, const std::vector<GateSource> &sources) {
+  std::vector<int> alias(netlist.wireCount);
+  for (int w = 0; w < netlist.wireCount; w++) alias[w] = w;
+  for (const Gate &gate : netlist.gates) {
+    if (gate.op == OP_BUF) alias[gate.out] = gate.in[0];
+  }
+  auto resolve = [&](int wire) {
+    int root = wire;
+    for (int steps = 0; alias[root] != root; steps++) {
+      root = alias[root];
+      if (steps > netlist.wireCount) throw loopError(netlist, sources);
+    }
+    while (alias[wire] != root) {  // Path compression
+      int next = alias[wire];
+      alias[wire] = root;
+      wire = next;
+    }
+    return root;
+  };
+  std::vector<Gate> gates;
+  for (Gate gate : netlist.gates) {
+    if (gate.op == OP_BUF) continue;
+    for (int &in : gate.in) in = resolve(in);
+    (gate.op == OP_DFF ? netlist.flops : gates).push_back(gate);
+  }
+  for (auto &pin : netlist.pins) {
+    for (int &wire : pin.second) wire = resolve(wire);
+  }
+
+  // Kahn's algorithm over wires: a gate is ready once every input wire is computed
+  std::vector<int> producer(netlist.wireCount, -1), pending(gates.size(), 0);
+  std::vector<std::vector<int>> readers(netlist.wireCount);
+  for (size_t g = 0; g < gates.size(); g++) producer[gates[g].out] = (int)g;
+  for (size_t g = 0; g < gates.size(); g++) {
+    for (int i = 0; i < gateArity(gates[g].op); i++) {
+      if (producer[gates[g].in[i]] < 0) continue;
+      pending[g]++;
+      readers[gates[g].in[i]].push_back((int)g);
+    }
+  }
+  std::vector<Gate> sorted;
+  std::vector<int> ready;
+  for (size_t g = 0; g < gates.size(); g++) {
+    if (pending[g] == 0) ready.push_back((int)g);
+  }
+  while (!ready.empty()) {
+    int g = ready.back();
+    ready.pop_back();
+    sorted.push_back(gates[g]);
+    for (int reader : readers[gates[g].out]) {
+      if (--pending[reader] == 0) ready.push_back(reader);
+    }
+  }
+  if (sorted.size() != gates.size()) throw loopError(netlist, sources);
+  netlist.gates.swap(sorted);
+}
+
+// ======================
+// Optimisation: constant propagation, dead-wire elimination and lowering of gate arrays to bus operations
+// ======================
+// Simplify a gate whose inputs are constants, repeated or each other's negation; returns the wire (or constant)
+// that carries its value, or -1 to keep the gate, possibly rewritten (Xor with true becomes Not, Not of Nand And)
+// inverse[w] is x when w = Not(x); producer[w] indexes kept, the gates already kept
+static int foldGate(Gate &gate, const std::vector<int> &inverse, const std::vector<int> &producer,
+                    const std::vector<Gate> &kept) {
+  for (;;) {
+    int a = gate.in[0], b = gate.in[1], sel = gate.in[2];
+    bool complementary = gate.op != OP_NOT && gate.op != OP_MUX && (inverse[a] == b || inverse[b] == a);
+    switch (gate.op) {
+      case OP_NOT:
+        if (a <= CONST_TRUE) return CONST_TRUE - a;
+        if (inverse[a] >= 0) return inverse[a];
+        if (producer[a] >= 0 && (kept[producer[a]].op == OP_NAND || kept[producer[a]].op == OP_AND)) {
+          const Gate &inner = kept[producer[a]];  // The Nand is dropped as dead unless something else reads it
+          gate = {inner.op == OP_NAND ? OP_AND : OP_NAND, gate.out, {inner.in[0], inner.in[1], CONST_FALSE}};
+        }
+        return -1;
+      case OP_AND: case OP_NAND: {
+        bool negated = gate.op == OP_NAND;
+        if (a == CONST_FALSE || b == CONST_FALSE || complementary) return negated ? CONST_TRUE : CONST_FALSE;
+        int same = a == CONST_TRUE ? b : b == CONST_TRUE || a == b ? a : -1;  // And(x, true) and And(x, x) are x
+        if (same < 0) return -1;
+        if (!negated) return same;
+        gate = {OP_NOT, gate.out, {same, CONST_FALSE, CONST_FALSE}};
+        continue;
+      }
+      case OP_OR:
+        if (a == CONST_TRUE || b == CONST_TRUE || complementary) return CONST_TRUE;
+        if (a == CONST_FALSE || a == b) return b;
+        if (b == CONST_FALSE) return a;
+        return -1;
+      case OP_XOR:
+        if (a == b) return CONST_FALSE;
+        if (complementary) return CONST_TRUE;
+        if (a == CONST_FALSE) return b;
+        if (b == CONST_FALSE) return a;
+        if (a != CONST_TRUE && b != CONST_TRUE) return -1;
+        gate = {OP_NOT, gate.out, {a == CONST_TRUE ? b : a, CONST_FALSE, CONST_FALSE}};
+        continue;
+      default:  // OP_MUX: a when sel is false, b when it is true
+        if (sel == CONST_FALSE || a == b) return a;
+        if (sel == CONST_TRUE) return b;
+        if (a == CONST_FALSE && b == CONST_TRUE) return sel;
+        if (a == CONST_TRUE && b == CONST_FALSE) {
+          gate = {OP_NOT, gate.out, {sel, CONST_FALSE, CONST_FALSE}};
+        } else if (a == CONST_FALSE) {
+          gate = {OP_AND, gate.out, {b, sel, CONST_FALSE}};
+        } else if (b == CONST_TRUE) {
+          gate = {OP_OR, gate.out, {a, sel, CONST_FALSE}};
+        } else {
+          return -1;
+        }
+        continue;
+    }
+  }
+}
+
+// Fold constants and identities and merge gates computing the same thing, in topological order; a gate that
+// disappears is replaced by the wire carrying its value in every reader and pin
+static void propagateConstants(Netlist &netlist) {
+  std::vector<int> alias(netlist.wireCount), inverse(netlist.wireCount, -1), producer(netlist.wireCount, -1);
+  for (int w = 0; w < netlist.wireCount; w++) alias[w] = w;
+  std::map<std::vector<int>, int> seen;  // Op and inputs of every kept gate -> its output
+  std::vector<Gate> kept;
+  for (Gate gate : netlist.gates) {
+    for (int i = 0; i < gateArity(gate.op); i++) gate.in[i] = alias[gate.in[i]];
+    int value = foldGate(gate, inverse, producer, kept);
+    std::vector<int> key = {gate.op, gate.in[0], gateArity(gate.op) > 1 ? gate.in[1] : 0, gateArity(gate.op) > 2 ? gate.in[2] : 0};
+    if (value < 0 && gate.op != OP_MUX && key[1] > key[2] && gateArity(gate.op) == 2) std::swap(key[1], key[2]);
+    if (value < 0 && seen.count(key)) value = seen[key];
+    if (value >= 0) {
+      alias[gate.out] = value;
+      continue;
+    }
+    seen[key] = gate.out;
+    if (gate.op == OP_NOT) inverse[gate.out] = gate.in[0];
+    producer[gate.out] = (int)kept.size();
+    kept.push_back(gate);
+  }
+  for (auto &pin : netlist.pins) {
+    for (int &wire : pin.second) wire = alias[wire];
+  }
+  for (Gate &flop : netlist.flops) flop.in[0] = alias[flop.in[0]];
+  netlist.gates.swap(kept);
+}
+
+// Drop the gates and DFFs no output pin depends on, now or after some ticks
+static void eliminateDeadWires(Netlist &netlist) {
+  std::vector<int> producer(netlist.wireCount, -1);  // Gate index, or gates.size() + flop index
+  for (size_t g = 0; g < netlist.gates.size(); g++) producer[netlist.gates[g].out] = (int)g;
+  for (size_t f = 0; f < netlist.flops.size(); f++) producer[netlist.flops[f].out] = (int)(netlist.gates.size() + f);
+  std::vector<char> live(netlist.wireCount, 0);
+  std::vector<int> work;
+  for (const PinDecl &pin : netlist.outputs) {
+    for (int wire : netlist.pins[pin.name]) work.push_back(wire);
+  }
+  while (!work.empty()) {
+    int wire = work.back();
+    work.pop_back();
+    if (live[wire]) continue;
+    live[wire] = 1;
+    if (producer[wire] < 0) continue;
+    size_t p = (size_t)producer[wire];
+    const Gate &gate = p < netlist.gates.size() ? netlist.gates[p] : netlist.flops[p - netlist.gates.size()];
+    for (int i = 0; i < gateArity(gate.op); i++) work.push_back(gate.in[i]);
+  }
+  auto dead = [&](const Gate &gate) { return !live[gate.out]; };
+  netlist.gates.erase(std::remove_if(netlist.gates.begin(), netlist.gates.end(), dead), netlist.gates.end());
+  netlist.flops.erase(std::remove_if(netlist.flops.begin(), netlist.flops.end(), dead), netlist.flops.end());
+}
+
+// Build netlist.program: gates of the same level and op whose inputs step through consecutive wires (or stay on
+// one wire) become one run, and wires are renumbered so that each run's outputs are consecutive too; Xor16 turns
+// into a single 16-gate Xor run. With group false every gate is a run of its own (the unoptimised reference)
+static void lowerToBuses(Netlist &netlist, bool group) {
+  std::vector<int> level(netlist.wireCount, 0);
+  for (const Gate &gate : netlist.gates) {
+    for (int i = 0; i < gateArity(gate.op); i++) level[gate.out] = std::max(level[gate.out], level[gate.in[i]] + 1);
+  }
+  std::vector<size_t> order(netlist.gates.size());
+  for (size_t g = 0; g < order.size(); g++) order[g] = g;
+  if (group) {
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+      const Gate &a = netlist.gates[x], &b = netlist.gates[y];
+      return level[a.out] != level[b.out] ? level[a.out] < level[b.out] : a.op < b.op;
+    });
+  }
+
+  std::vector<int> renamed(netlist.wireCount, -1);
+  int next = 2;
+  renamed[CONST_FALSE] = CONST_FALSE;
+  renamed[CONST_TRUE] = CONST_TRUE;
+  for (const PinDecl &pin : netlist.inputs) {
+    for (int wire : netlist.pins[pin.name]) {
+      if (renamed[wire] < 0) renamed[wire] = next++;
+    }
+  }
+  for (const Gate &flop : netlist.flops) renamed[flop.out] = next++;  // The bits of a Register end up consecutive
+
+  // Partition one (level, op) bucket at a time into runs, then give the runs' outputs consecutive numbers
+  // A run of one gate may still pick either stride for each input, so it is filed under every next-input it allows
+  std::vector<BusGate> program;
+  std::vector<std::vector<size_t>> members;  // Gates of each run of the current bucket
+  for (size_t first = 0; first < order.size();) {
+    size_t last = first;
+    const Gate &head = netlist.gates[order[first]];
+    while (last < order.size() && netlist.gates[order[last]].op == head.op &&
+           level[netlist.gates[order[last]].out] == level[head.out] && (group || last == first)) {
+      last++;
+    }
+    int arity = gateArity(head.op);
+    auto inputsOf = [&](size_t g) {  // Earlier levels are numbered already
+      const Gate &gate = netlist.gates[g];
+      return std::vector<int>{renamed[gate.in[0]], arity > 1 ? renamed[gate.in[1]] : 0,
+                              arity > 2 ? renamed[gate.in[2]] : 0};
+    };
+    std::sort(order.begin() + first, order.begin() + last,
+              [&](size_t x, size_t y) { return inputsOf(x) < inputsOf(y); });
+    std::vector<BusGate> runs;
+    members.clear();
+    std::map<std::vector<int>, size_t> open;  // Inputs a gate needs to extend a run -> the run
+    for (size_t k = first; k < last; k++) {
+      std::vector<int> in = inputsOf(order[k]);
+      auto found = open.find(in);
+      size_t r = found == open.end() ? runs.size() : found->second;
+      bool extends = found != open.end();
+      for (int i = 0; extends && runs[r].count > 1 && i < arity; i++) {  // Entries left by a run's first gate can be stale
+        extends = in[i] == runs[r].in[i] + runs[r].count * runs[r].stride[i];
+      }
+      if (extends && runs[r].count == 1) {  // Second gate: the strides are now fixed
+        for (int i = 0; i < arity; i++) runs[r].stride[i] = in[i] - runs[r].in[i];
+      }
+      if (!extends) {
+        r = runs.size();
+        runs.push_back({head.op, -1, 0, {in[0], in[1], in[2]}, {0, 0, 0}});
+        members.emplace_back();
+      }
+      runs[r].count++;
+      members[r].push_back(order[k]);
+      if (runs[r].count == 1) {
+        for (int mask = 1; mask < (1 << arity); mask++) {  // Not all strides 0: that would be a repeated gate
+          std::vector<int> candidate(3, 0);
+          for (int i = 0; i < arity; i++) candidate[i] = in[i] + ((mask >> i) & 1);
+          open[candidate] = r;
+        }
+      } else {
+        std::vector<int> want(3, 0);
+        for (int i = 0; i < arity; i++) want[i] = runs[r].in[i] + runs[r].count * runs[r].stride[i];
+        open[want] = r;
+      }
+    }
+    for (size_t r = 0; r < runs.size(); r++) {  // Number the outputs run by run
+      runs[r].out = next;
+      for (size_t g : members[r]) renamed[netlist.gates[g].out] = next++;
+      program.push_back(runs[r]);
+    }
+    first = last;
+  }
+
+  std::vector<Gate> gates;
+  for (const BusGate &run : program) {
+    for (int i = 0; i < run.count; i++) {
+      gates.push_back({run.op, run.out + i, {run.in[0] + i * run.stride[0], run.in[1] + i * run.stride[1],
+                                             run.in[2] + i * run.stride[2]}});
+    }
+  }
+  std::vector<std::string> names(next);
+  for (int w = 0; w < netlist.wireCount; w++) {
+    if (renamed[w] >= 0) names[renamed[w]] = netlist.wireNames[w];
+  }
+  for (auto &pin : netlist.pins) {
+    for (int &wire : pin.second) wire = renamed[wire];
+  }
+  for (Gate &flop : netlist.flops) flop = {OP_DFF, renamed[flop.out], {renamed[flop.in[0]], CONST_FALSE, CONST_FALSE}};
+  netlist.gates.swap(gates);
+  netlist.program.swap(program);
+  netlist.wireNames.swap(names);
+  netlist.wireCount = next;
+}
+
+// Parse a chip file and everything it uses into a sorted netlist of primitive gates, optimised unless
+// optimise is false; *flatGates receives the gate count before optimisation
+// A name without ".hdl" is looked up like a part: NAME.hdl in its directory, else a built-in chip
+// (hdl_sim --equiv MyAlu.hdl ALU)
+static Netlist buildNetlist(const std::string &path, bool optimise = true, size_t *flatGates = nullptr) {
+  std::string directory = directoryOf(path);
+  ChipLibrary library(directory);
+  const ChipDef &top = endsWith(path, ".hdl") ? library.loadFile(path) : library.byName(path.substr(directory.size()));
+  Netlist netlist;
+  netlist.wireNames = {"false", "true"};
+  netlist.inputs = top.inputs;
+  netlist.outputs = top.outputs;
+  Flattener flattener(library, netlist);
+  std::map<std::string, std::vector<int>> inputs;
+  for (const PinDecl &pin : top.inputs) {
+    for (int b = 0; b < pin.width; b++) {
+      inputs[pin.name].push_back(flattener.newWire(top.name + "." + pin.name + (pin.width > 1 ? "[" + std::to_string(b) + "]" : "")));
+    }
+  }
+  netlist.pins = flattener.instantiate(top, inputs, top.name, 0, top.file, top.line);
+  for (auto &pin : inputs) netlist.pins[pin.first] = pin.second;
+  sortNetlist(netlist, flattener.sources());
+  if (flatGates) *flatGates = netlist.gates.size();
+  if (optimise) {
+    propagateConstants(netlist);
+    eliminateDeadWires(netlist);
+  }
+  lowerToBuses(netlist, optimise);
+  return netlist;
+}
+
+// ======================
+// Simulation: bit-sliced, every wire holds one bit of LANES independent input vectors and every gate is one
+// bitwise instruction over all of them
+// ======================
+#if defined(__AVX2__)
+const int WORD_GROUPS = 4;   // 64-lane groups per word: one AVX2 register
+#elif defined(__SSE2__)
+const int WORD_GROUPS = 2;   // One SSE2 register
+#else
+const int WORD_GROUPS = 1;
+#endif
+const int LANES = 64 * WORD_GROUPS;  // Input vectors evaluated per pass over the netlist
+typedef uint64_t Word __attribute__((vector_size(WORD_GROUPS * sizeof(uint64_t))));
+
+// Word with every group set to bits
+static Word splat(uint64_t bits) {
+  Word word;
+  for (int g = 0; g < WORD_GROUPS; g++) word[g] = bits;
+  return word;
+}
+
+static bool laneBit(const Word &word, int lane) {
+  return (word[lane / 64] >> (lane % 64)) & 1;
+}
+
+// Bit `bit` of values[0..count) gathered into one word, lane i from values[i]; lanes past count are 0
+static Word packLanes(const uint64_t *values, int count, int bit) {
+  Word word = splat(0);
+  for (int lane = 0; lane < count; lane++) word[lane / 64] |= ((values[lane] >> bit) & 1) << (lane % 64);
+  return word;
+}
+
+// Word with lanes 0..count-1 set
+static Word firstLanes(int count) {
+  Word word;
+  for (int g = 0; g < WORD_GROUPS; g++) {
+    int bits = count - g * 64;
+    word[g] = bits >= 64 ? ~0ULL : bits <= 0 ? 0 : (1ULL << bits) - 1;
+  }
+  return word;
+}
+
+// Lowest lane set in a word, or -1
+static int firstLane(const Word &word) {
+  for (int g = 0; g < WORD_GROUPS; g++) {
+    if (word[g]) return g * 64 + __builtin_ctzll(word[g]);
+  }
+  return -1;
+}
+
+static bool anyLane(const Word &word) {
+  uint64_t any = 0;
+  for (int g = 0; g < WORD_GROUPS; g++) any |= word[g];
+  return any != 0;
+}
+
+// Runs the netlist's program over all lanes; DFFs hold their bit between tick() and tock()
+// Full re-evaluation runs every gate on each eval(). Event-driven simulation compares each value written with the
+// old one and queues only the runs reading a wire that changed, level by level, so a clock cycle costs the fan-out
+// cone of what changed; tables and equivalence checks change every input per pass and use full re-evaluation
+class Simulator {
+ public:
+  explicit Simulator(const Netlist &netlist, bool eventDriven = false)
+      : netlist_(netlist), values_(netlist.wireCount, splat(0)), stored_(netlist.flops.size(), splat(0)),
+        eventDriven_(eventDriven) {
+    values_[CONST_TRUE] = splat(~0ULL);
+    if (eventDriven) indexReaders();
+  }
+
+  const PinDecl *findPin(const std::string &name) const {
+    for (const PinDecl &pin : netlist_.inputs) if (pin.name == name) return &pin;
+    for (const PinDecl &pin : netlist_.outputs) if (pin.name == name) return &pin;
+    return nullptr;
+  }
+
+  bool isInput(const std::string &name) const {
+    for (const PinDecl &pin : netlist_.inputs) if (pin.name == name) return true;
+    return false;
+  }
+
+  const std::vector<int> &wires(const std::string &pin) const { return netlist_.pins.at(pin); }
+
+  // Every lane of a wire; writing through this bypasses change detection, so only full re-evaluation may
+  Word &wire(int index) { return values_[index]; }
+
+  // Set a pin to the same value in every lane
+  void set(const std::string &pin, uint64_t value) {
+    const std::vector<int> &bits = wires(pin);
+    for (size_t b = 0; b < bits.size(); b++) drive(bits[b], splat((value >> b) & 1 ? ~0ULL : 0));
+  }
+
+  // Set a pin to values[lane] in lanes 0..count-1 (and to 0 in the rest)
+  void setLanes(const std::string &pin, const uint64_t *values, int count) {
+    const std::vector<int> &bits = wires(pin);
+    for (size_t b = 0; b < bits.size(); b++) drive(bits[b], packLanes(values, count, (int)b));
+  }
+
+  uint64_t get(const std::string &pin, int lane = 0) const {
+    const std::vector<int> &bits = wires(pin);
+    uint64_t value = 0;
+    for (size_t b = 0; b < bits.size(); b++) value |= (uint64_t)laneBit(values_[bits[b]], lane) << b;
+    return value;
+  }
+
+  // Bring every gate up to date with the inputs; each run is one loop of bitwise operations
+  void eval() {
+    Word *v = values_.data();
+    if (!eventDriven_) {
+      for (const BusGate &run : netlist_.program) evalRun(run, v + run.out);
+      evaluated_ += (long)netlist_.gates.size();
+      return;
+    }
+    // The program is in topological (level) order, so one forward scan of the queue also sees every
+    // run that evaluating an earlier one queues
+    for (size_t k = firstQueued_; k < queued_.size(); k++) {
+      for (uint64_t bits; (bits = queued_[k]) != 0;) {
+        queued_[k] = bits & (bits - 1);
+        const BusGate &run = netlist_.program[k * 64 + __builtin_ctzll(bits)];
+        evaluated_ += run.count;
+        evalRun(run, scratch_.data());
+        for (int i = 0; i < run.count; i++) {
+          if (!anyLane(v[run.out + i] ^ scratch_[i])) continue;
+          v[run.out + i] = scratch_[i];
+          schedule(run.out + i);
+        }
+      }
+    }
+    firstQueued_ = queued_.size();
+  }
+
+  // Rising clock edge: settle the logic, then every DFF samples its input (event-driven: every DFF whose input
+  // changed since it last sampled; the others would store what they already hold)
+  void tick() {
+    eval();
+    if (!eventDriven_) {
+      for (size_t f = 0; f < netlist_.flops.size(); f++) stored_[f] = values_[netlist_.flops[f].in[0]];
+      return;
+    }
+    for (int f : sampling_) {
+      stored_[f] = values_[netlist_.flops[f].in[0]];
+      flopQueued_[f] = 0;
+    }
+    sampled_.insert(sampled_.end(), sampling_.begin(), sampling_.end());
+    sampling_.clear();
+  }
+
+  // Falling clock edge: the DFFs show what they sampled and the logic settles again
+  void tock() {
+    if (!eventDriven_) {
+      for (size_t f = 0; f < netlist_.flops.size(); f++) values_[netlist_.flops[f].out] = stored_[f];
+    }
+    for (int f : sampled_) drive(netlist_.flops[f].out, stored_[f]);
+    sampled_.clear();
+    eval();
+  }
+
+  // Gate evaluations so far (a run of 16 gates counts 16)
+  long evaluated() const { return evaluated_; }
+
+ private:
+  // Compute a run's outputs into out[0 .. run.count)
+  void evalRun(const BusGate &run, Word *out) {
+    const Word *v = values_.data();
+    const Word *a = v + run.in[0], *b = v + run.in[1], *sel = v + run.in[2];
+    int sa = run.stride[0], sb = run.stride[1], ss = run.stride[2];
+    switch (run.op) {
+      case OP_NAND: for (int i = 0; i < run.count; i++) out[i] = ~(a[i * sa] & b[i * sb]); break;
+      case OP_AND: for (int i = 0; i < run.count; i++) out[i] = a[i * sa] & b[i * sb]; break;
+      case OP_OR: for (int i = 0; i < run.count; i++) out[i] = a[i * sa] | b[i * sb]; break;
+      case OP_XOR: for (int i = 0; i < run.count; i++) out[i] = a[i * sa] ^ b[i * sb]; break;
+      case OP_NOT: for (int i = 0; i < run.count; i++) out[i] = ~a[i * sa]; break;
+      default:  // OP_MUX
+        for (int i = 0; i < run.count; i++) out[i] = (a[i * sa] & ~sel[i * ss]) | (b[i * sb] & sel[i * ss]);
+        break;
+    }
+  }
+
+  // Write a source wire (input pin or DFF output), queueing its readers when the value changes
+  void drive(int wire, const Word &value) {
+    if (eventDriven_ && anyLane(values_[wire] ^ value)) schedule(wire);
+    values_[wire] = value;
+  }
+
+  // Queue the runs reading a wire, and the DFFs sampling it on the next tick (readers past the program's runs)
+  void schedule(int wire) {
+    int runs = (int)netlist_.program.size();
+    for (int k = readerStart_[wire]; k < readerStart_[wire + 1]; k++) {
+      int r = readers_[k];
+      if (r < runs) {
+        queued_[r / 64] |= 1ULL << (r % 64);
+        firstQueued_ = std::min(firstQueued_, (size_t)(r / 64));
+      } else if (!flopQueued_[r - runs]) {
+        flopQueued_[r - runs] = 1;
+        sampling_.push_back(r - runs);
+      }
+    }
+  }
+
+  // The runs and DFFs reading each wire, and a first eval() that evaluates everything
+  void indexReaders() {
+    const std::vector<BusGate> &program = netlist_.program;
+    std::vector<std::vector<int>> readers(netlist_.wireCount);
+    for (size_t r = 0; r < program.size(); r++) {
+      const BusGate &run = program[r];
+      for (int k = 0; k < gateArity(run.op); k++) {
+        for (int i = 0; i < run.count; i++) {
+          int wire = run.in[k] + i * run.stride[k];
+          if (readers[wire].empty() || readers[wire].back() != (int)r) readers[wire].push_back((int)r);
+        }
+      }
+      if (run.count > (int)scratch_.size()) scratch_.resize(run.count);
+    }
+    for (size_t f = 0; f < netlist_.flops.size(); f++) readers[netlist_.flops[f].in[0]].push_back((int)(program.size() + f));
+    readerStart_.assign(netlist_.wireCount + 1, 0);
+    for (int w = 0; w < netlist_.wireCount; w++) {
+      readerStart_[w + 1] = readerStart_[w] + (int)readers[w].size();
+      readers_.insert(readers_.end(), readers[w].begin(), readers[w].end());
+    }
+    queued_.assign((program.size() + 63) / 64, 0);
+    for (size_t r = 0; r < program.size(); r++) queued_[r / 64] |= 1ULL << (r % 64);
+    firstQueued_ = 0;
+    flopQueued_.assign(netlist_.flops.size(), 1);
+    for (size_t f = 0; f < netlist_.flops.size(); f++) sampling_.push_back((int)f);
+  }
+
+  const Netlist &netlist_;
+  std::vector<Word> values_;
+  std::vector<Word> stored_;                 // What each DFF sampled on the last tick
+  bool eventDriven_;
+  long evaluated_ = 0;
+  std::vector<int> readerStart_, readers_;   // Runs reading wire w: readers_[readerStart_[w] .. readerStart_[w + 1])
+  std::vector<uint64_t> queued_;             // Activity queue: one bit per run, in program (level) order
+  size_t firstQueued_ = 0;                   // Words of queued_ before this one are clear
+  std::vector<char> flopQueued_;             // Per DFF: in sampling_
+  std::vector<int> sampling_, sampled_;      // DFFs to sample on the next tick, DFFs sampled on the last one
+  std::vector<Word> scratch_;                // New outputs of the run being evaluated
+};
+
+// Low width bits of value
+static uint64_t truncateTo(int width, uint64_t value) {
+  return width >= 64 ? value : value & ((1ULL << width) - 1);
+}
+
+// Parse a value in a table or script: %B0101, %X1F, %D-3 or a plain (possibly negative) decimal
+// A plain value of exactly width 0/1 digits on a bus reads as binary, as in the simulator's own .cmp files
+static bool parseValue(const std::string &text, int width, uint64_t *value) {
+  std::string digits = text;
+  int base = 10;
+  if (digits.size() > 2 && digits[0] == '%') {
+    base = digits[1] == 'B' ? 2 : digits[1] == 'X' ? 16 : digits[1] == 'D' ? 10 : 0;
+    if (!base) return false;
+    digits = digits.substr(2);
+  } else if (width > 1 && (int)digits.size() == width && digits.find_first_not_of("01") == std::string::npos) {
+    base = 2;
+  }
+  if (digits.empty()) return false;
+  size_t used = 0;
+  try {
+    *value = base == 10 ? (uint64_t)std::stoll(digits, &used, 10) : std::stoull(digits, &used, base);
+  } catch (const std::exception &) {
+    return false;
+  }
+  *value = truncateTo(width, *value);
+  return used == digits.size();
+}
+
+// ======================
+// Test scripts (.tst)
+// ======================
+// One column of an output-list: name%B3.16.1 is binary, left pad 3, 16 characters, right pad 1
+// time%S1.4.1 is the clock: "3+" after the fourth tick, "4" after the tock that follows
+struct OutputColumn {
+  std::string pin;
+  char format = 'B';
+  int padLeft = 1, length = 1, padRight = 1;
+};
+
+static OutputColumn parseOutputColumn(const std::string &spec, const Simulator &simulator, const std::string &file, int line) {
+  OutputColumn column;
+  size_t percent = spec.find('%');
+  column.pin = spec.substr(0, percent);
+  const PinDecl *pin = simulator.findPin(column.pin);
+  if (!pin && column.pin != "time") throw errorAt(file, line, "the chip has no pin named " + column.pin);
+  column.length = pin ? pin->width : 4;
+  if (percent != std::string::npos) {
+    int left, length, right;
+    if (spec.size() < percent + 2 || sscanf(spec.c_str() + percent + 2, "%d.%d.%d", &left, &length, &right) != 3) {
+      throw errorAt(file, line, "bad output format " + spec);
+    }
+    column.format = spec[percent + 1];
+    if (std::string(pin ? "BDX" : "S").find(column.format) == std::string::npos) {
+      throw errorAt(file, line, "bad output format " + spec);
+    }
+    column.padLeft = left;
+    column.length = length;
+    column.padRight = right;
+  }
+  return column;
+}
+
+// Text of a value in a column: binary digits, signed decimal or hex, right-aligned to the column length
+static std::string formatValue(const OutputColumn &column, int width, uint64_t value) {
+  std::string text;
+  if (column.format == 'B') {
+    for (int b = column.length - 1; b >= 0; b--) text += b < 64 && (value >> b) & 1 ? '1' : '0';
+  } else if (column.format == 'X') {
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%0*llX", column.length, (unsigned long long)value);
+    text = buffer;
+  } else {
+    bool negative = width >= 16 && width < 64 && (value >> (width - 1)) & 1;  // Narrower buses (address[3]) are unsigned
+    long long signedValue = negative ? (long long)(value - (1ULL << width)) : (long long)value;
+    text = std::to_string(signedValue);
+    if ((int)text.size() < column.length) text.insert(0, column.length - text.size(), ' ');
+  }
+  return text;
+}
+
+// One cell of a table line, in place
+struct CellView {
+  const char *begin, *end;
+};
+
+// Cells of the table line [begin, end): the trimmed fields between '|' characters, or the whitespace-separated
+// fields of a tab-separated table; cells is cleared first
+static void splitCellViews(const char *begin, const char *end, std::vector<CellView> &cells) {
+  cells.clear();
+  const char *bar = (const char *)memchr(begin, '|', end - begin);
+  if (!bar) {
+    auto blank = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' || c == '\n'; };
+    for (const char *p = begin; p < end;) {
+      while (p < end && blank(*p)) p++;
+      const char *start = p;
+      while (p < end && !blank(*p)) p++;
+      if (p > start) cells.push_back({start, p});
+    }
+    return;
+  }
+  for (const char *start = bar + 1, *next; (next = (const char *)memchr(start, '|', end - start)); start = next + 1) {
+    const char *first = start, *last = next;
+    while (first < last && (*first == ' ' || *first == '\t')) first++;
+    while (last > first && (last[-1] == ' ' || last[-1] == '\t')) last--;
+    cells.push_back({first, last});
+  }
+}
+
+static std::vector<std::string> splitCells(const std::string &line) {
+  std::vector<CellView> views;
+  splitCellViews(line.data(), line.data() + line.size(), views);
+  std::vector<std::string> cells;
+  for (const CellView &cell : views) cells.emplace_back(cell.begin, cell.end);
+  return cells;
+}
+
+// Whether an output cell matches the expected one; '*' characters in the expected cell match anything
+static bool cellMatches(const std::string &actual, const std::string &expected) {
+  if (actual.size() != expected.size()) return expected.find_first_not_of('*') == std::string::npos && !expected.empty();
+  for (size_t i = 0; i < actual.size(); i++) {
+    if (expected[i] != '*' && expected[i] != actual[i]) return false;
+  }
+  return true;
+}
+
+class ScriptRunner {
+ public:
+  // With a log, mismatches are appended to it instead of printed, and echo is silent (suites run scripts in parallel)
+  explicit ScriptRunner(const std::string &path, std::string *log = nullptr)
+      : path_(path), directory_(directoryOf(path)), log_(log) {}
+
+  // Run the script; returns the number of output lines that differ from the compare-to file
+  int run() {
+    std::vector<Token> tokens = tokenizeText(readFile(path_), path_, true);
+    TokenCursor cursor{tokens, path_};
+    runCommands(cursor, false);
+    if (output_.is_open()) output_.close();
+    return mismatches_;
+  }
+
+  int linesCompared() const { return compared_; }
+
+ private:
+  // Commands up to the end of the script, or to the '}' closing a repeat block
+  void runCommands(TokenCursor &cursor, bool inBlock) {
+    while (cursor.peek().kind != Token::END) {
+      if (inBlock && cursor.accept("}")) return;
+      const Token &command = cursor.peek();
+      std::string name = cursor.identifier();
+      int line = command.line;
+      if (name == "load") {
+        std::string file = cursor.identifier();
+        std::string stem = endsWith(file, ".hdl") ? file.substr(0, file.size() - 4) : file;
+        std::string hdl = directory_ + stem + ".hdl";  // Next to the script, else a built-in chip of that name
+        netlist_ = std::make_unique<Netlist>(buildNetlist(fileExists(hdl) ? hdl : directory_ + stem));
+        simulator_ = std::make_unique<Simulator>(*netlist_, true);  // Scripts change a pin or two per step
+        time_ = 0;
+        ticked_ = false;
+      } else if (name == "output-file") {
+        std::string file = cursor.identifier();
+        output_.open(directory_ + file);
+        if (!output_) throw errorAt(path_, line, "cannot write " + file);
+      } else if (name == "compare-to") {
+        std::istringstream lines(readFile(directory_ + cursor.identifier()));
+        for (std::string text; std::getline(lines, text);) {
+          if (!text.empty() && text.back() == '\r') text.pop_back();
+          if (!text.empty()) expected_.push_back(text);
+        }
+      } else if (name == "output-list") {
+        requireChip(line);
+        columns_.clear();
+        while (cursor.peek().kind == Token::IDENT) columns_.push_back(parseOutputColumn(cursor.identifier(), *simulator_, path_, line));
+        writeLine(headerLine(), line);
+      } else if (name == "set") {
+        requireChip(line);
+        std::string pin = cursor.identifier();
+        std::string text = cursor.peek().text;
+        cursor.at++;
+        const PinDecl *decl = simulator_->findPin(pin);
+        uint64_t value;
+        if (!decl || !simulator_->isInput(pin)) throw errorAt(path_, line, pin + " is not an input of the chip");
+        if (!parseValue(text, decl->width, &value)) throw errorAt(path_, line, "bad value " + text);
+        simulator_->set(pin, value);
+      } else if (name == "eval") {
+        requireChip(line);
+        simulator_->eval();
+      } else if (name == "output") {
+        requireChip(line);
+        writeLine(valueLine(), line);
+      } else if (name == "echo") {
+        if (cursor.peek().kind == Token::STRING) {
+          const std::string &text = cursor.tokens[cursor.at++].text;
+          if (!log_) printf("%s\n", text.c_str());
+        }
+      } else if (name == "clear-echo") {
+        // Nothing to clear without a GUI
+      } else if (name == "repeat") {
+        int count = cursor.number();
+        cursor.expect("{");
+        size_t body = cursor.at;
+        for (int i = 0; i < count; i++) {
+          cursor.at = body;
+          runCommands(cursor, true);
+        }
+        continue;
+      } else if (name == "tick") {
+        requireChip(line);
+        simulator_->tick();
+        ticked_ = true;
+      } else if (name == "tock") {
+        requireChip(line);
+        simulator_->tock();
+        time_ += ticked_;
+        ticked_ = false;
+      } else {
+        throw errorAt(path_, line, "unknown command " + name);
+      }
+      if (!cursor.accept(",") && !cursor.accept(";") && !cursor.accept("!")) {
+        throw errorAt(path_, cursor.peek().line, "expected ',' or ';' after " + name);
+      }
+    }
+    if (inBlock) throw errorAt(path_, cursor.peek().line, "repeat block is not closed");
+  }
+
+  void requireChip(int line) {
+    if (!simulator_) throw errorAt(path_, line, "no chip loaded");
+  }
+
+  std::string headerLine() const {
+    std::string text = "|";
+    for (const OutputColumn &column : columns_) {
+      int width = column.padLeft + column.length + column.padRight;
+      std::string name = column.pin.substr(0, width);
+      int left = (width - (int)name.size()) / 2;
+      text += std::string(left, ' ') + name + std::string(width - left - name.size(), ' ') + "|";
+    }
+    return text;
+  }
+
+  std::string valueLine() const {
+    std::string text = "|";
+    for (const OutputColumn &column : columns_) {
+      const PinDecl *pin = simulator_->findPin(column.pin);
+      std::string value;
+      if (pin) {
+        value = formatValue(column, pin->width, simulator_->get(column.pin));
+      } else {  // The clock, left-aligned
+        value = std::to_string(time_) + (ticked_ ? "+" : "");
+        if ((int)value.size() < column.length) value.append(column.length - value.size(), ' ');
+      }
+      text += std::string(column.padLeft, ' ') + value + std::string(column.padRight, ' ') + "|";
+    }
+    return text;
+  }
+
+  // Write an output line and compare it, cell by cell, with the same line of the compare-to file
+  void writeLine(const std::string &text, int line) {
+    if (output_.is_open()) output_ << text << "\n";
+    if (expected_.empty()) return;
+    size_t row = compared_++;
+    if (row >= expected_.size()) {
+      report(line, "output line " + std::to_string(row + 1) + " is past the end of the compare file");
+      return;
+    }
+    std::vector<std::string> actual = splitCells(text), expected = splitCells(expected_[row]);
+    bool same = actual.size() == expected.size();
+    for (size_t c = 0; same && c < actual.size(); c++) same = cellMatches(actual[c], expected[c]);
+    if (!same) report(line, "comparison failure at line " + std::to_string(row + 1) + "\n  expected " + expected_[row] +
+                      "\n  got      " + text);
+  }
+
+  void report(int line, const std::string &message) {
+    if (mismatches_++ >= MAX_REPORTED) return;
+    std::string text = path_ + ":" + std::to_string(line) + ": " + message + "\n";
+    if (log_) {
+      *log_ += text;
+    } else {
+      fputs(text.c_str(), stderr);
+    }
+  }
+
+  std::string path_, directory_;
+  std::string *log_;
+  std::unique_ptr<Netlist> netlist_;
+  std::unique_ptr<Simulator> simulator_;
+  std::vector<OutputColumn> columns_;
+  std::vector<std::string> expected_;
+  std::ofstream output_;
+  int compared_ = 0, mismatches_ = 0;
+  int time_ = 0;         // Clock cycles completed
+  bool ticked_ = false;  // Between a tick and its tock
+};
+
+// ======================
+// Tables: drive the input columns, compare the output columns
+// ======================
+const size_t MIN_SLICE_BYTES = 64 * 1024;  // Tables are split across threads in slices of at least this much text
+
+// A file mapped read-only into memory (read into a string when it cannot be mapped)
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw HdlError(path + ": cannot open");
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+      void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = (const char *)data;
+        size_ = (size_t)info.st_size;
+        madvise(data, size_, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+    if (!data_) {
+      copy_ = readFile(path);
+      data_ = copy_.data();
+      size_ = copy_.size();
+    }
+  }
+  ~MappedFile() {
+    if (copy_.empty() && size_) munmap((void *)data_, size_);
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *begin() const { return data_; }
+  const char *end() const { return data_ + size_; }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  std::string copy_;
+};
+
+// parseValue() on a cell in place; plain decimals, nearly every cell of a table, are parsed without a copy
+static bool parseCell(const CellView &cell, int width, uint64_t *value) {
+  const char *p = cell.begin + (cell.begin < cell.end && *cell.begin == '-');
+  if (p == cell.end || cell.end - p > 18 || (width > 1 && cell.end - cell.begin == width)) {  // Maybe binary
+    return parseValue(std::string(cell.begin, cell.end), width, value);
+  }
+  uint64_t magnitude = 0;
+  for (; p < cell.end; p++) {
+    if (*p < '0' || *p > '9') return parseValue(std::string(cell.begin, cell.end), width, value);
+    magnitude = magnitude * 10 + (uint64_t)(*p - '0');
+  }
+  *value = truncateTo(width, *cell.begin == '-' ? 0 - magnitude : magnitude);
+  return true;
+}
+
+// The rows of one slice of a table, column by column, and what checking them found
+struct TableSlice {
+  const char *begin, *end;                         // Text of the slice: whole lines
+  std::vector<std::vector<uint64_t>> values;       // Per column: each row's value modulo 2^width (-1 is all ones)
+  std::vector<std::vector<uint64_t>> wildcards;    // Per column: 1 where an output cell is all '*'
+  std::vector<int> lines;                          // Per row: line within the slice, from 1
+  int lineCount = 0;                               // Lines in the slice
+  int firstLine = 0;                               // Line of the table before the slice's first line
+  long firstRow = 0;                               // Rows of the table before the slice's first row
+  int errorLine = 0;                               // First problem parsing the slice, at a line within it
+  std::string error;
+  long mismatches = 0;
+  std::vector<std::string> reported;              // The slice's first MAX_REPORTED mismatches
+};
+
+// What checking a whole table found
+struct TableResult {
+  long rows = 0, mismatches = 0;
+  double readMs = 0, simulateMs = 0;
+  int threads = 1;
+  std::vector<std::string> reported;  // The first MAX_REPORTED mismatches, in row order
+};
+
+// A column of a table: the pin it names, its width, whether it is an input
+struct TableColumn {
+  std::string name;
+  int width;
+  bool input;
+};
+
+// Parse the rows of a slice into its column vectors, stopping at the first bad line
+static void parseSlice(TableSlice &slice, const std::vector<TableColumn> &columns) {
+  slice.values.assign(columns.size(), {});
+  slice.wildcards.assign(columns.size(), {});
+  std::vector<CellView> cells;
+  for (const char *line = slice.begin; line < slice.end;) {
+    const char *end = (const char *)memchr(line, '\n', slice.end - line);
+    if (!end) end = slice.end;
+    slice.lineCount++;
+    splitCellViews(line, end, cells);
+    line = end + 1;
+    if (cells.empty()) continue;
+    if (cells.size() != columns.size()) {
+      slice.errorLine = slice.lineCount;
+      slice.error = "expected " + std::to_string(columns.size()) + " columns";
+      return;
+    }
+    slice.lines.push_back(slice.lineCount);
+    for (size_t c = 0; c < columns.size(); c++) {
+      const CellView &cell = cells[c];
+      bool wildcard = !columns[c].input && cell.begin < cell.end && *cell.begin == '*' &&
+                      std::all_of(cell.begin, cell.end, [](char x) { return x == '*'; });
+      uint64_t value = 0;
+      if (!wildcard && !parseCell(cell, columns[c].width, &value)) {
+        slice.errorLine = slice.lineCount;
+        slice.error = "bad value " + std::string(cell.begin, cell.end);
+        return;
+      }
+      slice.values[c].push_back(value);
+      slice.wildcards[c].push_back(wildcard);
+    }
+  }
+}
+
+// Simulate a parsed slice LANES rows per pass and record the rows whose outputs differ, each with the columns that
+// differ and the inputs of the row
+static void simulateSlice(TableSlice &slice, const Netlist &netlist, const std::vector<TableColumn> &columns,
+                          const std::string &path) {
+  Simulator simulator(netlist);
+  OutputColumn decimal;
+  decimal.format = 'D';
+  for (size_t first = 0; first < slice.lines.size(); first += LANES) {
+    int count = (int)std::min<size_t>(LANES, slice.lines.size() - first);
+    for (size_t c = 0; c < columns.size(); c++) {
+      if (columns[c].input) simulator.setLanes(columns[c].name, &slice.values[c][first], count);
+    }
+    simulator.eval();
+    Word wrong = splat(0);  // Lanes where some output differs
+    for (size_t c = 0; c < columns.size(); c++) {
+      if (columns[c].input) continue;
+      const std::vector<int> &bits = simulator.wires(columns[c].name);
+      Word checked = ~packLanes(&slice.wildcards[c][first], count, 0);
+      for (size_t b = 0; b < bits.size(); b++) {
+        wrong |= (simulator.wire(bits[b]) ^ packLanes(&slice.values[c][first], count, (int)b)) & checked;
+      }
+    }
+    wrong &= firstLanes(count);
+    for (int lane; (lane = firstLane(wrong)) >= 0; wrong[lane / 64] &= ~(1ULL << (lane % 64))) {
+      if (slice.mismatches++ >= MAX_REPORTED) continue;
+      size_t row = first + lane;
+      std::string differences, inputs;
+      for (size_t c = 0; c < columns.size(); c++) {
+        const TableColumn &column = columns[c];
+        uint64_t actual = simulator.get(column.name, lane), expected = slice.values[c][row];
+        if (column.input) {
+          inputs += " " + column.name + "=" + formatValue(decimal, column.width, expected);
+        } else if (!slice.wildcards[c][row] && actual != expected) {
+          differences += std::string(differences.empty() ? " " : ", ") + column.name + " (column " + std::to_string(c + 1) +
+                         ") is " + formatValue(decimal, column.width, actual) + ", expected " +
+                         formatValue(decimal, column.width, expected);
+        }
+      }
+      slice.reported.push_back(path + ":" + std::to_string(slice.firstLine + slice.lines[row]) + ": row " +
+                               std::to_string(slice.firstRow + row + 1) + ":" + differences + ";" + inputs);
+    }
+  }
+}
+
+// Run work(0) .. work(count - 1) on count threads (the last on this one) and wait for them all
+template <typename Work>
+static void runParallel(int count, Work work) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i + 1 < count; i++) threads.emplace_back(work, i);
+  if (count > 0) work(count - 1);
+  for (std::thread &thread : threads) thread.join();
+}
+
+static int hardwareThreads() {
+  return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// The columns a table's header names, checked against the chip's pins
+static std::vector<TableColumn> tableColumns(const Netlist &netlist, const std::vector<std::string> &header,
+                                             const std::string &path, int line) {
+  std::vector<TableColumn> columns;
+  for (const std::string &name : header) {
+    const PinDecl *pin = nullptr;
+    bool input = false;
+    for (const PinDecl &decl : netlist.inputs) if (decl.name == name) pin = &decl, input = true;
+    for (const PinDecl &decl : netlist.outputs) if (decl.name == name) pin = &decl;
+    if (!pin) throw errorAt(path, line, "the chip has no pin named " + name);
+    columns.push_back({name, pin->width, input});
+  }
+  return columns;
+}
+
+// Check a chip against a table whose header names its pins, on up to maxThreads threads
+// The file is mapped and cut into slices of whole lines, one per thread; each thread parses its slice into
+// column vectors, then simulates it LANES rows per pass and compares all outputs of a pass at once
+static TableResult checkTable(const Netlist &netlist, const std::string &path, int maxThreads) {
+  if (!netlist.flops.empty()) throw HdlError(path + ": the chip is clocked; check it with a .tst script");
+  auto start = std::chrono::steady_clock::now();
+  MappedFile file(path);
+  const char *body = file.begin();
+  int headerLine = 0;
+  std::vector<CellView> cells;
+  while (body < file.end() && cells.empty()) {
+    const char *end = (const char *)memchr(body, '\n', file.end() - body);
+    if (!end) end = file.end();
+    headerLine++;
+    splitCellViews(body, end, cells);
+    body = end < file.end() ? end + 1 : end;
+  }
+  if (cells.empty()) throw errorAt(path, headerLine, "no header line");
+  std::vector<std::string> header;
+  for (const CellView &cell : cells) header.emplace_back(cell.begin, cell.end);
+  std::vector<TableColumn> columns = tableColumns(netlist, header, path, headerLine);
+
+  TableResult result;
+  size_t bytes = file.end() - body;
+  result.threads = (int)std::max<size_t>(1, std::min<size_t>(maxThreads, bytes / MIN_SLICE_BYTES));
+  std::vector<TableSlice> slices(result.threads);
+  const char *rows = body;
+  for (int i = 0; i < result.threads; i++) {  // Each slice ends after the newline that follows its share of the text
+    const char *cut = std::max(body, rows + bytes * (i + 1) / result.threads);
+    const char *newline = cut < file.end() ? (const char *)memchr(cut, '\n', file.end() - cut) : nullptr;
+    slices[i].begin = body;
+    slices[i].end = i + 1 < result.threads && newline ? newline + 1 : file.end();
+    body = slices[i].end;
+  }
+  runParallel(result.threads, [&](int i) { parseSlice(slices[i], columns); });
+  int line = headerLine;
+  for (TableSlice &slice : slices) {
+    if (!slice.error.empty()) throw errorAt(path, line + slice.errorLine, slice.error);
+    slice.firstLine = line;
+    slice.firstRow = result.rows;
+    line += slice.lineCount;
+    result.rows += (long)slice.lines.size();
+  }
+  result.readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  runParallel(result.threads, [&](int i) { simulateSlice(slices[i], netlist, columns, path); });
+  for (const TableSlice &slice : slices) {
+    result.mismatches += slice.mismatches;
+    for (const std::string &text : slice.reported) {
+      if ((int)result.reported.size() < MAX_REPORTED) result.reported.push_back(text);
+    }
+  }
+  result.simulateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+// ======================
+// Equivalence: two chips with the same pins must agree on every input
+// ======================
+const int EXHAUSTIVE_MAX_BITS = 32;  // Input bits enumerated exhaustively; wider chips get random vectors
+const int RANDOM_PASSES = 1 << 18;   // Passes of LANES random vectors each for wider chips
+
+// Compare two netlists on all 2^n inputs (n input bits), or on random inputs when n is above
+// EXHAUSTIVE_MAX_BITS; prints the first counterexample and returns whether they agree
+static bool checkEquivalence(const Netlist &left, const Netlist &right, const std::string &leftName,
+                             const std::string &rightName) {
+  auto samePins = [](const std::vector<PinDecl> &a, const std::vector<PinDecl> &b) {
+    if (a.size() != b.size()) return false;
+    for (const PinDecl &pin : a) {
+      bool found = false;
+      for (const PinDecl &other : b) found = found || (other.name == pin.name && other.width == pin.width);
+      if (!found) return false;
+    }
+    return true;
+  };
+  if (!samePins(left.inputs, right.inputs) || !samePins(left.outputs, right.outputs)) {
+    throw HdlError(leftName + " and " + rightName + " do not have the same pins");
+  }
+  if (!left.flops.empty() || !right.flops.empty()) {
+    throw HdlError("only combinational chips can be checked for equivalence; " +
+                   (left.flops.empty() ? rightName : leftName) + " has DFFs");
+  }
+  Simulator a(left), b(right);
+  std::vector<int> leftInputs, rightInputs, leftOutputs, rightOutputs;  // Wires of every input and output bit
+  for (const PinDecl &pin : left.inputs) {
+    leftInputs.insert(leftInputs.end(), a.wires(pin.name).begin(), a.wires(pin.name).end());
+    rightInputs.insert(rightInputs.end(), b.wires(pin.name).begin(), b.wires(pin.name).end());
+  }
+  for (const PinDecl &pin : left.outputs) {
+    leftOutputs.insert(leftOutputs.end(), a.wires(pin.name).begin(), a.wires(pin.name).end());
+    rightOutputs.insert(rightOutputs.end(), b.wires(pin.name).begin(), b.wires(pin.name).end());
+  }
+
+  // Exhaustive: vector number pass * LANES + lane; its low bits come from fixed lane patterns, the rest from pass
+  int bits = (int)leftInputs.size(), laneBits = __builtin_ctz(LANES);
+  bool exhaustive = bits <= EXHAUSTIVE_MAX_BITS;
+  uint64_t passes = !exhaustive ? RANDOM_PASSES : bits <= laneBits ? 1 : 1ULL << (bits - laneBits);
+  std::vector<Word> patterns(laneBits);
+  for (int k = 0; k < laneBits; k++) {
+    std::vector<uint64_t> lanes(LANES);
+    for (int lane = 0; lane < LANES; lane++) lanes[lane] = (uint64_t)lane >> k;
+    patterns[k] = packLanes(lanes.data(), LANES, 0);
+  }
+  uint64_t random = 0x9E3779B97F4A7C15ULL;  // xorshift64 state for the random vectors
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; exhaustive && k < bits && k < laneBits; k++) a.wire(leftInputs[k]) = b.wire(rightInputs[k]) = patterns[k];
+  for (uint64_t pass = 0; pass < passes; pass++) {
+    if (exhaustive) {  // Only the pass-counter bits that changed (every one on the first pass)
+      for (uint64_t flipped = pass ^ (pass - 1); flipped; flipped &= flipped - 1) {
+        int k = laneBits + __builtin_ctzll(flipped);
+        if (k >= bits) break;
+        a.wire(leftInputs[k]) = b.wire(rightInputs[k]) = splat((pass >> (k - laneBits)) & 1 ? ~0ULL : 0);
+      }
+    } else {
+      for (int k = 0; k < bits; k++) {
+        Word word;
+        for (int g = 0; g < WORD_GROUPS; g++) {
+          random ^= random << 13, random ^= random >> 7, random ^= random << 17;
+          word[g] = random;
+        }
+        a.wire(leftInputs[k]) = b.wire(rightInputs[k]) = word;
+      }
+    }
+    a.eval();
+    b.eval();
+    Word differ = splat(0);
+    for (size_t o = 0; o < leftOutputs.size(); o++) differ |= a.wire(leftOutputs[o]) ^ b.wire(rightOutputs[o]);
+    if (!anyLane(differ)) continue;
+
+    int lane = firstLane(differ);
+    OutputColumn column;
+    column.format = 'D';
+    std::string inputs, outputs;
+    for (const PinDecl &pin : left.inputs) inputs += " " + pin.name + "=" + formatValue(column, pin.width, a.get(pin.name, lane));
+    for (const PinDecl &pin : left.outputs) {
+      uint64_t x = a.get(pin.name, lane), y = b.get(pin.name, lane);
+      if (x != y) outputs += " " + pin.name + "=" + formatValue(column, pin.width, x) + " vs " + formatValue(column, pin.width, y);
+    }
+    printf("%s and %s differ at%s:%s\n", leftName.c_str(), rightName.c_str(), inputs.c_str(), outputs.c_str());
+    return false;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double vectors = (double)passes * LANES;
+  if (exhaustive && bits < laneBits) vectors = (double)(1ULL << bits);
+  printf("%s and %s agree on %s%.0f input vectors (%d input bits) in %.3f s: %.1f million vectors/s, %d lanes per pass\n",
+         leftName.c_str(), rightName.c_str(), exhaustive ? "all " : "", vectors, bits, seconds,
+         (double)passes * LANES / seconds / 1e6, LANES);
+  return true;
+}
+
+// ======================
+// Clocked benchmark: full re-evaluation against event-driven simulation over many clock cycles
+// ======================
+const long BENCH_CYCLES = 10000;  // Default clock cycles
+const int MEMORY_WORDS = 32768;   // Data memory of a CPU run (RAM16K, screen and keyboard)
+
+// Whether a chip has the CPU's pins, so that it can run a program
+static bool isCpu(const Netlist &netlist) {
+  auto has = [](const std::vector<PinDecl> &pins, const char *name, int width) {
+    for (const PinDecl &pin : pins) if (pin.name == name && pin.width == width) return true;
+    return false;
+  };
+  return has(netlist.inputs, "inM", 16) && has(netlist.inputs, "instruction", 16) && has(netlist.inputs, "reset", 1) &&
+         has(netlist.outputs, "outM", 16) && has(netlist.outputs, "writeM", 1) && has(netlist.outputs, "addressM", 15) &&
+         has(netlist.outputs, "pc", 15);
+}
+
+// Words of a .hack file, one 16-digit binary instruction per line
+static std::vector<uint64_t> readProgram(const std::string &path) {
+  std::istringstream lines(readFile(path));
+  std::vector<uint64_t> rom;
+  int line = 0;
+  for (std::string text; std::getline(lines, text);) {
+    line++;
+    std::vector<std::string> cells = splitCells(text);
+    if (cells.empty()) continue;
+    uint64_t word;
+    if (cells.size() != 1 || cells[0].size() != 16 || !parseValue(cells[0], 16, &word)) {
+      throw errorAt(path, line, "expected a 16-bit binary instruction");
+    }
+    rom.push_back(word);
+  }
+  return rom;
+}
+
+// Clock simulator through cycles cycles and record every output pin after each one in trace; the inputs come from
+// stimulus (one value per input pin per cycle), or for a CPU from rom at pc and a data memory at addressM
+// Returns the milliseconds taken
+static double runClocked(Simulator &simulator, const Netlist &netlist, long cycles, const std::vector<uint64_t> &stimulus,
+                         const std::vector<uint64_t> &rom, std::vector<uint64_t> &trace) {
+  std::vector<uint64_t> memory(rom.empty() ? 0 : MEMORY_WORDS);
+  auto start = std::chrono::steady_clock::now();
+  for (long cycle = 0; cycle < cycles; cycle++) {
+    if (rom.empty()) {
+      for (size_t p = 0; p < netlist.inputs.size(); p++) {
+        simulator.set(netlist.inputs[p].name, stimulus[cycle * netlist.inputs.size() + p]);
+      }
+      simulator.tick();
+    } else {  // Fetch at pc, then read (and on writeM write) memory at addressM before the clock edge
+      uint64_t pc = simulator.get("pc");
+      simulator.set("instruction", pc < rom.size() ? rom[pc] : 0);
+      simulator.eval();
+      simulator.set("inM", memory[simulator.get("addressM")]);
+      simulator.tick();
+      if (simulator.get("writeM")) memory[simulator.get("addressM")] = simulator.get("outM");
+    }
+    simulator.tock();
+    for (const PinDecl &pin : netlist.outputs) trace.push_back(simulator.get(pin.name));
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Run a clocked chip both ways on the same inputs: random ones (each pin changes with probability 1/4 per cycle) or,
+// for a CPU given a program, the program; returns whether the outputs agreed on every cycle
+static bool benchClocked(const Netlist &netlist, const std::string &name, long cycles, const std::string &programPath) {
+  std::vector<uint64_t> rom, stimulus;
+  if (!programPath.empty()) {
+    if (!isCpu(netlist)) throw HdlError(name + " does not have the pins of the CPU, so it cannot run " + programPath);
+    rom = readProgram(programPath);
+  } else {
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    std::vector<uint64_t> current(netlist.inputs.size(), 0);
+    for (long cycle = 0; cycle < cycles; cycle++) {
+      for (size_t p = 0; p < netlist.inputs.size(); p++) {
+        random ^= random << 13, random ^= random >> 7, random ^= random << 17;
+        if (random % 4 == 0) current[p] = truncateTo(netlist.inputs[p].width, random >> 2);
+        stimulus.push_back(current[p]);
+      }
+    }
+  }
+  Simulator full(netlist), events(netlist, true);
+  std::vector<uint64_t> fullTrace, eventTrace;
+  double fullMs = runClocked(full, netlist, cycles, stimulus, rom, fullTrace);
+  double eventMs = runClocked(events, netlist, cycles, stimulus, rom, eventTrace);
+
+  printf("%s: %ld clock cycles of %s, %zu gates and %zu DFFs\n", name.c_str(), cycles,
+         rom.empty() ? "random inputs" : programPath.c_str(), netlist.gates.size(), netlist.flops.size());
+  printf("  full re-evaluation %10.2f ms  %10.0f cycles/s  %ld gate evaluations\n", fullMs, cycles / fullMs * 1e3,
+         full.evaluated());
+  printf("  event-driven       %10.2f ms  %10.0f cycles/s  %ld gate evaluations (%.1f%%), %.2fx\n", eventMs,
+         cycles / eventMs * 1e3, events.evaluated(), 100.0 * events.evaluated() / std::max(1L, full.evaluated()),
+         fullMs / eventMs);
+  size_t outputs = netlist.outputs.size();
+  for (size_t k = 0; k < fullTrace.size(); k++) {
+    if (fullTrace[k] == eventTrace[k]) continue;
+    const PinDecl &pin = netlist.outputs[k % outputs];
+    printf("  the two differ after cycle %zu: %s is %llu with full re-evaluation and %llu event-driven\n", k / outputs + 1,
+           pin.name.c_str(), (unsigned long long)fullTrace[k], (unsigned long long)eventTrace[k]);
+    return false;
+  }
+  printf("  outputs agree on every cycle\n");
+  return true;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ======================
+// Suites: every table under some directories, tests in parallel
+// ======================
+// One test of a suite: NAME.cmp checked against NAME.hdl as a table when the chip is combinational and the header
+// names only its pins, else through NAME.tst
+struct SuiteTest {
+  std::string cmp;
+  const char *status = "SKIP";  // PASS, FAIL or SKIP (nothing to check the table with)
+  std::string summary;          // How it was checked and what was found
+  std::string report;           // Mismatches or the error, one per line
+};
+
+// Whether a table can be checked directly: the first non-empty line names only pins of the chip
+static bool headerNamesPins(const Netlist &netlist, const std::string &path) {
+  std::ifstream in(path);
+  std::vector<std::string> header;
+  for (std::string text; header.empty() && std::getline(in, text);) header = splitCells(text);
+  for (const std::string &name : header) {
+    bool found = false;
+    for (const PinDecl &pin : netlist.inputs) found = found || pin.name == name;
+    for (const PinDecl &pin : netlist.outputs) found = found || pin.name == name;
+    if (!found) return false;
+  }
+  return !header.empty();
+}
+
+static void runSuiteTest(SuiteTest &test) {
+  std::string stem = test.cmp.substr(0, test.cmp.size() - 4), hdl = stem + ".hdl", tst = stem + ".tst";
+  auto start = std::chrono::steady_clock::now();
+  char timing[32];
+  try {
+    std::unique_ptr<Netlist> netlist;
+    if (fileExists(hdl)) netlist = std::make_unique<Netlist>(buildNetlist(hdl));
+    if (netlist && netlist->flops.empty() && headerNamesPins(*netlist, test.cmp)) {
+      TableResult result = checkTable(*netlist, test.cmp, 1);
+      for (const std::string &text : result.reported) test.report += text + "\n";
+      test.status = result.mismatches ? "FAIL" : "PASS";
+      test.summary = "table, " + std::to_string(result.rows) + " rows";
+      if (result.mismatches) test.summary += ", " + std::to_string(result.mismatches) + " differ";
+    } else if (fileExists(tst)) {
+      ScriptRunner runner(tst, &test.report);
+      int mismatches = runner.run();
+      test.status = mismatches ? "FAIL" : "PASS";
+      test.summary = "script, " + std::to_string(runner.linesCompared()) + " lines";
+      if (mismatches) test.summary += ", " + std::to_string(mismatches) + " differ";
+    } else {
+      test.summary = "no " + hdl + " or " + tst;
+      return;
+    }
+  } catch (const HdlError &error) {
+    test.status = "FAIL";
+    test.summary = "error";
+    test.report = std::string(error.what()) + "\n";
+  }
+  snprintf(timing, sizeof(timing), ", %.2f ms", millisecondsSince(start));
+  test.summary += timing;
+}
+
+// Run every NAME.cmp found under the given directories (or given directly), up to one test per hardware thread at
+// a time; prints one line per test in path order and returns how many failed
+static int runSuite(const std::vector<std::string> &paths) {
+  std::vector<SuiteTest> tests;
+  for (const std::string &path : paths) {
+    if (!std::filesystem::is_directory(path)) {
+      tests.emplace_back();
+      tests.back().cmp = path;
+      continue;
+    }
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+      if (!entry.is_regular_file() || entry.path().extension() != ".cmp") continue;
+      tests.emplace_back();
+      tests.back().cmp = entry.path().string();
+    }
+  }
+  std::sort(tests.begin(), tests.end(), [](const SuiteTest &a, const SuiteTest &b) { return a.cmp < b.cmp; });
+  auto start = std::chrono::steady_clock::now();
+  int threads = std::max(1, std::min(hardwareThreads(), (int)tests.size()));
+  std::atomic<size_t> next(0);
+  runParallel(threads, [&](int) {
+    for (size_t t; (t = next++) < tests.size();) runSuiteTest(tests[t]);
+  });
+  int failed = 0, skipped = 0;
+  for (const SuiteTest &test : tests) {
+    printf("%s  %s (%s)\n", test.status, test.cmp.c_str(), test.summary.c_str());
+    std::istringstream lines(test.report);
+    for (std::string text; std::getline(lines, text);) printf("      %s\n", text.c_str());
+    failed += test.status[0] == 'F';
+    skipped += test.status[0] == 'S';
+  }
+  printf("%zu tests: %zu passed, %d failed, %d skipped in %.2f s on %d thread%s\n", tests.size(),
+         tests.size() - failed - skipped, failed, skipped, millisecondsSince(start) / 1e3, threads, threads == 1 ? "" : "s");
+  return failed;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s SCRIPT.tst | CHIP.hdl [TABLE.cmp] | --equiv CHIP.hdl OTHER.hdl|BUILTIN | --check-opt CHIP.hdl"
+                    " | --bench-clock CHIP.hdl|BUILTIN [CYCLES] [PROGRAM.hack] | --suite DIR|TABLE.cmp...\n", argv[0]);
+    return 2;
+  }
+  try {
+    auto start = std::chrono::steady_clock::now();
+    std::string path = argv[1];
+    if (path == "--equiv" && argc > 3) {
+      Netlist left = buildNetlist(argv[2]), right = buildNetlist(argv[3]);
+      return checkEquivalence(left, right, argv[2], argv[3]) ? 0 : 1;
+    }
+    if (endsWith(path, ".tst")) {
+      ScriptRunner runner(path);
+      int mismatches = runner.run();
+      printf("%s: %d output lines compared, %d mismatches (%.2f ms)\n", path.c_str(), runner.linesCompared(),
+             mismatches, millisecondsSince(start));
+      return mismatches ? 1 : 0;
+    }
+    if (path == "--check-opt" && argc > 2) {  // The optimised program against the flat gate list
+      Netlist plain = buildNetlist(argv[2], false), optimised = buildNetlist(argv[2]);
+      return checkEquivalence(plain, optimised, std::string(argv[2]) + " as written", "optimised") ? 0 : 1;
+    }
+    if (path == "--suite" && argc > 2) return runSuite(std::vector<std::string>(argv + 2, argv + argc)) ? 1 : 0;
+    if (path == "--bench-clock" && argc > 2) {
+      long cycles = argc > 3 ? atol(argv[3]) : BENCH_CYCLES;
+      if (cycles < 1) throw HdlError("the number of cycles must be positive");
+      return benchClocked(buildNetlist(argv[2]), argv[2], cycles, argc > 4 ? argv[4] : "") ? 0 : 1;
+    }
+    size_t flatGates;
+    Netlist netlist = buildNetlist(path, true, &flatGates);
+    double built = millisecondsSince(start);
+    printf("%s: %zu gates flattened, %zu after optimisation in %zu bus operations over %d wires, %zu DFFs, built in %.2f ms\n",
+           path.c_str(), flatGates, netlist.gates.size(), netlist.program.size(), netlist.wireCount, netlist.flops.size(), built);
+    if (argc < 3) return 0;
+    TableResult result = checkTable(netlist, argv[2], hardwareThreads());
+    for (const std::string &text : result.reported) fprintf(stderr, "%s\n", text.c_str());
+    printf("%s: %ld rows checked, %ld mismatches (%.2f ms reading, %.3f ms simulating %d rows per pass, %d thread%s)\n",
+           argv[2], result.rows, result.mismatches, result.readMs, result.simulateMs, LANES, result.threads, result.threads == 1 ? "" : "s");
+    return result.mismatches ? 1 : 0;
+  } catch (const HdlError &error) {
+    fprintf(stderr, "%s\n", error.what());
+    return 2;
+  }
+}
@@ -1,27 +1,907 @@
+/* Streaming integer statistics
+ *
+ *   lab_2 [--threads N] [FILE]
+ *   lab_2 --check               compare the block kernels with a scalar reference
+ *
+ * Reads integers separated by whitespace from FILE or standard input until the
+ * end of input or the first token that is not an integer, then prints their
+ * sum, average, product, min, max, variance and standard deviation. Memory use
+ * is constant: the input is read in fixed-size chunks, so gigabyte files are
+ * handled in one pass.
+ *
+ * A reader thread cuts the input into chunks at whitespace, worker threads parse
+ * and reduce the chunks in any order, and the main thread merges the partial
+ * results in input order, so the result is the same for any thread count.
+ * Within a chunk, values are parsed into blocks; blocks whose values all fit in
+ * 32 bits are reduced with SSE2/AVX2 kernels. The sum is exact (128 bits), the
+ * product is exact while it fits in 128 bits and is then kept as a mantissa
+ * and binary exponent, and the variance merges per-block sums of squared
+ * deviations with Chan's formula rather than summing squares.
+ */
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define CHUNK_SIZE (4 << 20)     // Bytes per chunk handed to a worker
+#define QUEUE_DEPTH 8            // Chunks in flight between reader, workers and merge
+#define MAX_WORKERS 16           // Upper bound on parse/reduce worker threads
+#define BLOCK_VALUES 4096        // Values parsed before a block is reduced
+#define RENORMALIZE_STEPS 30     // 31-bit factors multiplied into a double before rescaling
+#define TOKEN_LENGTH 24          // Characters of an offending token kept for the message
+
+// Product of the values: exact while it fits, mantissa * 2^exponent after that
+typedef struct {
+    int zero;                    // A zero was read, the product is exactly 0
+    int exact;                   // magnitude holds |product| exactly
+    unsigned __int128 magnitude;
+    double mantissa;             // |product| = mantissa * 2^exponent once not exact
+    int64_t exponent;
+} Product;
+
+// Partial statistics of a run of consecutive values
+typedef struct {
+    uint64_t count;
+    __int128 sum;
+    int64_t min, max;
+    long double m2;              // Sum of squared deviations from the mean
+    uint64_t negatives;          // Sign of the product
+    Product product;
+} Stats;
+
+// One chunk of input travelling from the reader through a worker to the merge
+typedef struct {
+    enum { CHUNK_EMPTY, CHUNK_READ, CHUNK_PARSING, CHUNK_PARSED } state;
+    size_t seq;                  // Position of the chunk in the input
+    char *data;                  // Bytes ending at whitespace, plus a '\0' sentinel
+    size_t length;
+    uint64_t offset;             // Input offset of data[0]
+    Stats stats;
+    int stopped;                 // Parsing ended at a token that is not an integer
+    uint64_t stopOffset;
+    char stopToken[TOKEN_LENGTH];
+} Chunk;
+
+// Input side of the reader: the partial token carried between chunks
+typedef struct {
+    int fd;
+    int interactive;             // Terminal input: hand over each line as it arrives
+    int eof;
+    int error;                   // errno of a failed read
+    char *carry;
+    size_t carryLength;
+    uint64_t offset;
+} Reader;
+
+// Shared state of the reader, the workers and the merge
+typedef struct {
+    Reader *reader;
+    Chunk chunks[QUEUE_DEPTH];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t chunksRead;           // Chunks handed to the workers so far
+    int readerDone;
+    int finished;                // Merge saw the end of the integers, stops every stage
+} Pipeline;
+
+static unsigned char spaceTable[256];
+
+// ======================
+// Product
+// ======================
+
+/**
+ * Switch a product from its exact to its mantissa and exponent form.
+ */
+static void productToFloat(Product *product) {
+    if (!product->exact) return;
+    int exponent;
+    product->mantissa = frexp((double)product->magnitude, &exponent);
+    product->exponent = exponent;
+    product->exact = 0;
+}
+
+/**
+ * Bring the mantissa back into [0.5, 1) after a run of multiplications.
+ */
+static void productRenormalize(Product *product) {
+    int exponent;
+    product->mantissa = frexp(product->mantissa, &exponent);
+    product->exponent += exponent;
+}
+
+/**
+ * Multiply one non-zero magnitude into a product.
+ */
+static void productMultiply(Product *product, uint64_t magnitude) {
+    if (product->exact) {
+        unsigned __int128 result;
+        if (!__builtin_mul_overflow(product->magnitude, magnitude, &result)) {
+            product->magnitude = result;
+            return;
+        }
+        productToFloat(product);
+    }
+    product->mantissa *= (double)magnitude;
+    productRenormalize(product);
+}
+
+/**
+ * Multiply the product of another run into a product.
+ */
+static void productMerge(Product *product, const Product *other) {
+    if (product->zero || other->zero) {
+        product->zero = 1;
+        return;
+    }
+    unsigned __int128 result;
+    if (product->exact && other->exact && !__builtin_mul_overflow(product->magnitude, other->magnitude, &result)) {
+        product->magnitude = result;
+        return;
+    }
+    Product factor = *other;
+    productToFloat(product);
+    productToFloat(&factor);
+    product->mantissa *= factor.mantissa;
+    product->exponent += factor.exponent;
+    productRenormalize(product);
+}
+
+// ======================
+// Block reduction
+// ======================
+
+static void statsInit(Stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->min = INT64_MAX;
+    stats->max = INT64_MIN;
+    stats->product.exact = 1;
+    stats->product.magnitude = 1;
+}
+
+/**
+ * Append the statistics of the run that follows a run.
+ * Means come from the exact sums; the squared deviations combine as
+ * m2 = m2a + m2b + delta^2 * na * nb / n (Chan et al.).
+ */
+static void statsMerge(Stats *stats, const Stats *next) {
+    if (next->count == 0) return;
+    if (stats->count == 0) {
+        *stats = *next;
+        return;
+    }
+    long double delta = (long double)next->sum / next->count - (long double)stats->sum / stats->count;
+    long double count = (long double)stats->count + next->count;
+    stats->m2 += next->m2 + delta * delta * ((long double)stats->count * next->count / count);
+    stats->count += next->count;
+    stats->sum += next->sum;
+    if (next->min < stats->min) stats->min = next->min;
+    if (next->max > stats->max) stats->max = next->max;
+    stats->negatives += next->negatives;
+    productMerge(&stats->product, &next->product);
+}
+
+/**
+ * Sum, min, max, sign and zero count of a block of 32-bit values.
+ * Sums are exact: a block of BLOCK_VALUES 32-bit values cannot overflow 64 bits.
+ */
+static void reduceNarrow(const int32_t *values, size_t count, Stats *stats, uint64_t *zeros) {
+    int64_t sum = 0;
+    int32_t min = INT32_MAX, max = INT32_MIN;
+    uint64_t negatives = 0, zeroCount = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i vmin = _mm256_set1_epi32(INT32_MAX), vmax = _mm256_set1_epi32(INT32_MIN);
+    __m256i vsum = _mm256_setzero_si256(), vneg = _mm256_setzero_si256(), vzero = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(values + i));
+        vmin = _mm256_min_epi32(vmin, x);
+        vmax = _mm256_max_epi32(vmax, x);
+        vneg = _mm256_sub_epi32(vneg, _mm256_cmpgt_epi32(zero, x));
+        vzero = _mm256_sub_epi32(vzero, _mm256_cmpeq_epi32(zero, x));
+        vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+        vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    }
+    int32_t lanes[8];
+    int64_t sums[4];
+    _mm256_storeu_si256((__m256i *)sums, vsum);
+    sum = sums[0] + sums[1] + sums[2] + sums[3];
+    _mm256_storeu_si256((__m256i *)lanes, vmin);
+    for (int lane = 0; lane < 8; lane++) if (lanes[lane] < min) min = lanes[lane];
+    _mm256_storeu_si256((__m256i *)lanes, vmax);
+    for (int lane = 0; lane < 8; lane++) if (lanes[lane] > max) max = lanes[lane];
+    _mm256_storeu_si256((__m256i *)lanes, vneg);
+    for (int lane = 0; lane < 8; lane++) negatives += (uint32_t)lanes[lane];
+    _mm256_storeu_si256((__m256i *)lanes, vzero);
+    for (int lane = 0; lane < 8; lane++) zeroCount += (uint32_t)lanes[lane];
+#elif defined(__SSE2__)
+    // SSE2 has no 32-bit min/max or sign extension; both are built from compares
+    __m128i vmin = _mm_set1_epi32(INT32_MAX), vmax = _mm_set1_epi32(INT32_MIN);
+    __m128i vsum = _mm_setzero_si128(), vneg = _mm_setzero_si128(), vzero = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128i below = _mm_cmpgt_epi32(vmin, x), above = _mm_cmpgt_epi32(x, vmax);
+        vmin = _mm_or_si128(_mm_and_si128(below, x), _mm_andnot_si128(below, vmin));
+        vmax = _mm_or_si128(_mm_and_si128(above, x), _mm_andnot_si128(above, vmax));
+        __m128i sign = _mm_cmpgt_epi32(zero, x);
+        vneg = _mm_sub_epi32(vneg, sign);
+        vzero = _mm_sub_epi32(vzero, _mm_cmpeq_epi32(zero, x));
+        vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(x, sign));
+        vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(x, sign));
+    }
+    int32_t lanes[4];
+    int64_t sums[2];
+    _mm_storeu_si128((__m128i *)sums, vsum);
+    sum = sums[0] + sums[1];
+    _mm_storeu_si128((__m128i *)lanes, vmin);
+    for (int lane = 0; lane < 4; lane++) if (lanes[lane] < min) min = lanes[lane];
+    _mm_storeu_si128((__m128i *)lanes, vmax);
+    for (int lane = 0; lane < 4; lane++) if (lanes[lane] > max) max = lanes[lane];
+    _mm_storeu_si128((__m128i *)lanes, vneg);
+    for (int lane = 0; lane < 4; lane++) negatives += (uint32_t)lanes[lane];
+    _mm_storeu_si128((__m128i *)lanes, vzero);
+    for (int lane = 0; lane < 4; lane++) zeroCount += (uint32_t)lanes[lane];
+#endif
+    for (; i < count; i++) {
+        int32_t x = values[i];
+        sum += x;
+        if (x < min) min = x;
+        if (x > max) max = x;
+        negatives += x < 0;
+        zeroCount += x == 0;
+    }
+    stats->count = count;
+    stats->sum = sum;
+    stats->min = min;
+    stats->max = max;
+    stats->negatives = negatives;
+    *zeros = zeroCount;
+}
+
+/**
+ * Sum of squared deviations of a block of 32-bit values from their mean.
+ */
+static double deviationNarrow(const int32_t *values, size_t count, double mean) {
+    double m2 = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256d vmean = _mm256_set1_pd(mean);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    for (; i + 8 <= count; i += 8) {
+        __m256d d0 = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(values + i))), vmean);
+        __m256d d1 = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(values + i + 4))), vmean);
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+    }
+    double sums[4];
+    _mm256_storeu_pd(sums, _mm256_add_pd(acc0, acc1));
+    m2 = sums[0] + sums[1] + sums[2] + sums[3];
+#elif defined(__SSE2__)
+    const __m128d vmean = _mm_set1_pd(mean);
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128d d0 = _mm_sub_pd(_mm_cvtepi32_pd(x), vmean);
+        __m128d d1 = _mm_sub_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(x, 0x0E)), vmean);
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+    }
+    double sums[2];
+    _mm_storeu_pd(sums, _mm_add_pd(acc0, acc1));
+    m2 = sums[0] + sums[1];
+#endif
+    for (; i < count; i++) {
+        double d = values[i] - mean;
+        m2 += d * d;
+    }
+    return m2;
+}
+
+/**
+ * Multiply a block of non-zero 32-bit values into a product in float form.
+ * Each lane multiplies RENORMALIZE_STEPS factors below 2^31 into a double
+ * (at most 2^930) before the lanes are rescaled with frexp.
+ */
+static void productNarrow(const int32_t *values, size_t count, Product *product) {
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+#define PRODUCT_LANES 8
+    const __m256d signBit = _mm256_set1_pd(-0.0);
+    __m256d acc0 = _mm256_set1_pd(1.0), acc1 = _mm256_set1_pd(1.0);
+#else
+#define PRODUCT_LANES 4
+    const __m128d signBit = _mm_set1_pd(-0.0);
+    __m128d acc0 = _mm_set1_pd(1.0), acc1 = _mm_set1_pd(1.0);
+#endif
+    // Lanes start at 1 so that a tail too short for the vector loop folds in nothing
+    double lanes[PRODUCT_LANES];
+    for (int lane = 0; lane < PRODUCT_LANES; lane++) lanes[lane] = 1.0;
+    while (i + PRODUCT_LANES <= count) {
+        size_t stop = i + (size_t)PRODUCT_LANES * RENORMALIZE_STEPS;
+        if (stop > count) stop = count;
+        for (; i + PRODUCT_LANES <= stop; i += PRODUCT_LANES) {
+#if defined(__AVX2__)
+            __m256d x0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(values + i)));
+            __m256d x1 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(values + i + 4)));
+            acc0 = _mm256_mul_pd(acc0, _mm256_andnot_pd(signBit, x0));
+            acc1 = _mm256_mul_pd(acc1, _mm256_andnot_pd(signBit, x1));
+#else
+            __m128i x = _mm_loadu_si128((const __m128i *)(values + i));
+            acc0 = _mm_mul_pd(acc0, _mm_andnot_pd(signBit, _mm_cvtepi32_pd(x)));
+            acc1 = _mm_mul_pd(acc1, _mm_andnot_pd(signBit, _mm_cvtepi32_pd(_mm_shuffle_epi32(x, 0x0E))));
+#endif
+        }
+#if defined(__AVX2__)
+        _mm256_storeu_pd(lanes, acc0);
+        _mm256_storeu_pd(lanes + 4, acc1);
+#else
+        _mm_storeu_pd(lanes, acc0);
+        _mm_storeu_pd(lanes + 2, acc1);
+#endif
+        for (int lane = 0; lane < PRODUCT_LANES; lane++) {
+            int exponent;
+            lanes[lane] = frexp(lanes[lane], &exponent);
+            product->exponent += exponent;
+        }
+#if defined(__AVX2__)
+        acc0 = _mm256_loadu_pd(lanes);
+        acc1 = _mm256_loadu_pd(lanes + 4);
+#else
+        acc0 = _mm_loadu_pd(lanes);
+        acc1 = _mm_loadu_pd(lanes + 2);
+#endif
+    }
+    // Lanes are in [0.5, 1), so their product stays far from underflow
+    for (int lane = 0; lane < PRODUCT_LANES; lane++) product->mantissa *= lanes[lane];
+    productRenormalize(product);
+#undef PRODUCT_LANES
+#endif
+    for (; i < count; i++) productMultiply(product, values[i] < 0 ? -(int64_t)values[i] : values[i]);
+}
+
+/**
+ * Reduce one block of parsed values and append it to the statistics of a chunk.
+ */
+static void reduceBlock(const int64_t *wide, const int32_t *narrow, size_t count, int isWide, Stats *stats) {
+    if (count == 0) return;
+    Stats block;
+    statsInit(&block);
+    uint64_t zeros = 0;
+    if (isWide) {
+        for (size_t i = 0; i < count; i++) {
+            int64_t x = wide[i];
+            block.sum += x;
+            if (x < block.min) block.min = x;
+            if (x > block.max) block.max = x;
+            block.negatives += x < 0;
+            zeros += x == 0;
+        }
+        block.count = count;
+    } else {
+        reduceNarrow(narrow, count, &block, &zeros);
+    }
+
+    double mean = (double)((long double)block.sum / count);
+    if (isWide) {
+        for (size_t i = 0; i < count; i++) {
+            double d = (double)wide[i] - mean;
+            block.m2 += d * d;
+        }
+    } else {
+        block.m2 = deviationNarrow(narrow, count, mean);
+    }
+
+    // The product stays exact as long as it can, then goes to the vector kernel
+    if (zeros) {
+        block.product.zero = 1;
+    } else {
+        size_t i = 0;
+        for (; i < count && block.product.exact; i++) {
+            productMultiply(&block.product, wide[i] < 0 ? -(uint64_t)wide[i] : (uint64_t)wide[i]);
+        }
+        if (isWide) {
+            for (; i < count; i++) productMultiply(&block.product, wide[i] < 0 ? -(uint64_t)wide[i] : (uint64_t)wide[i]);
+        } else {
+            productNarrow(narrow + i, count - i, &block.product);
+        }
+    }
+    statsMerge(stats, &block);
+}
+
+// ======================
+// Parsing
+// ======================
+
+/**
+ * Record where parsing of a chunk ended on something that is not an integer.
+ */
+static void stopChunk(Chunk *chunk, const char *token) {
+    size_t length = 0;
+    while (length + 1 < TOKEN_LENGTH && token[length] && !spaceTable[(unsigned char)token[length]]) length++;
+    memcpy(chunk->stopToken, token, length);
+    chunk->stopToken[length] = '\0';
+    chunk->stopOffset = chunk->offset + (uint64_t)(token - chunk->data);
+    chunk->stopped = 1;
+}
+
+/**
+ * Parse the integers of a chunk and reduce them block by block (runs on a worker).
+ * Like scanf("%d"), a token is an optional sign and digits; anything else, or
+ * a value outside 64 bits, ends the input. The '\0' after the data stops
+ * every inner loop without bounds checks.
+ */
+static void parseChunk(Chunk *chunk) {
+    int64_t wide[BLOCK_VALUES];
+    int32_t narrow[BLOCK_VALUES];
+    const char *p = chunk->data;
+    const char *end = chunk->data + chunk->length;
+
+    statsInit(&chunk->stats);
+    chunk->stopped = 0;
+    while (!chunk->stopped) {
+        size_t count = 0;
+        int isWide = 0;
+        while (count < BLOCK_VALUES) {
+            while (spaceTable[(unsigned char)*p]) p++;
+            if (p >= end) break;
+            const char *token = p;
+            int negative = *p == '-';
+            p += *p == '-' || *p == '+';
+            unsigned digit = (unsigned char)*p - '0';
+            if (digit > 9) {
+                stopChunk(chunk, token);
+                break;
+            }
+            const char *digits = p;
+            uint64_t value = 0;
+            do {
+                value = value * 10 + digit;
+                digit = (unsigned char)*++p - '0';
+            } while (digit <= 9 && p - digits < 19);
+            // A 20th digit may still fit in 64 bits; a 21st never does
+            int overflow = 0;
+            if (digit <= 9) {
+                overflow = value > (UINT64_MAX - digit) / 10;
+                value = value * 10 + digit;
+                overflow |= (unsigned)((unsigned char)*++p - '0') <= 9;
+            }
+            if (overflow || value > (negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX)) {
+                stopChunk(chunk, token);
+                break;
+            }
+            int64_t x = negative ? (int64_t)(0 - value) : (int64_t)value;
+            wide[count] = x;
+            narrow[count] = (int32_t)x;
+            isWide |= x != (int32_t)x;
+            count++;
+        }
+        reduceBlock(wide, narrow, count, isWide, &chunk->stats);
+        if (count < BLOCK_VALUES) break;
+    }
+}
+
+// ======================
+// Reading
+// ======================
+
+static int isSpace(char c) {
+    return spaceTable[(unsigned char)c];
+}
+
+/**
+ * Fill a chunk with the carried partial token and new input, cut after the last
+ * whitespace so no token is split. Returns 0 once the input is exhausted.
+ */
+static int readChunk(Reader *reader, Chunk *chunk) {
+    size_t length = reader->carryLength;
+    memcpy(chunk->data, reader->carry, length);
+    chunk->offset = reader->offset;
+    for (;;) {
+        while (length < CHUNK_SIZE && !reader->eof) {
+            ssize_t got = read(reader->fd, chunk->data + length, CHUNK_SIZE - length);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                reader->error = got < 0 ? errno : 0;
+                reader->eof = 1;
+                break;
+            }
+            length += (size_t)got;
+            if (reader->interactive) break;
+        }
+        size_t cut = length;
+        if (!reader->eof) {
+            while (cut > 0 && !isSpace(chunk->data[cut - 1])) cut--;
+            // A token as long as the whole chunk is not an integer anyway; split it
+            if (cut == 0 && length == CHUNK_SIZE) cut = length;
+        }
+        if (cut == 0 && !reader->eof) continue;
+        reader->carryLength = length - cut;
+        memcpy(reader->carry, chunk->data + cut, reader->carryLength);
+        reader->offset += cut;
+        chunk->length = cut;
+        chunk->data[cut] = '\0';
+        return cut > 0;
+    }
+}
+
+/**
+ * Reader stage: fill free chunk slots in order.
+ */
+static void *readerThread(void *arg) {
+    Pipeline *pipeline = arg;
+    for (size_t seq = 0;; seq++) {
+        Chunk *chunk = &pipeline->chunks[seq % QUEUE_DEPTH];
+
+        pthread_mutex_lock(&pipeline->lock);
+        while (chunk->state != CHUNK_EMPTY && !pipeline->finished) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        int finished = pipeline->finished;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (finished || !readChunk(pipeline->reader, chunk)) {
+            break;
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->seq = pipeline->chunksRead++;
+        chunk->state = CHUNK_READ;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->readerDone = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
 
-int main() {
-    int nums[100], count = 0, sum = 0, product = 1;
-    float average;
-    int min, max;
-
-    printf("Enter integers separated by spaces (at least three): ");
-    while (scanf("%d", &nums[count]) == 1) count++; // Read input until non-integer
-    
-    sum = nums[0];
-    product = nums[0];
-    min = nums[0];
-    max = nums[0];
-
-    for (int i = 1; i < count; i++) {
-        sum += nums[i];
-        product *= nums[i];
-        min = (nums[i] < min) ? nums[i] : min;
-        max = (nums[i] > max) ? nums[i] : max;
-    }
-
-    average = (float)sum / count;
-    
-    printf("Sum: %d\nAverage: %.2f\nProduct: %d\nMin: %d\nMax: %d\n", sum, average, product, min, max);
+/**
+ * Worker stage: pick up read chunks in any order, parse and reduce them.
+ */
+static void *workerThread(void *arg) {
+    Pipeline *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        Chunk *chunk = NULL;
+        for (int i = 0; i < QUEUE_DEPTH; i++) {
+            if (pipeline->chunks[i].state == CHUNK_READ) {
+                chunk = &pipeline->chunks[i];
+                break;
+            }
+        }
+        if (chunk == NULL) {
+            if (pipeline->readerDone || pipeline->finished) {
+                break;
+            }
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+            continue;
+        }
+        chunk->state = CHUNK_PARSING;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        parseChunk(chunk);
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->state = CHUNK_PARSED;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Read and reduce the whole input. Chunks are merged strictly in input order,
+ * up to and including the one where the integers end.
+ * Terminal input is handled on the calling thread, a line at a time, so that
+ * a non-integer ends the input without waiting for more.
+ */
+static int collectStats(Reader *reader, int workerCount, Stats *total, Chunk *stop) {
+    Pipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.reader = reader;
+    int chunkCount = reader->interactive ? 1 : QUEUE_DEPTH;
+    for (int i = 0; i < chunkCount; i++) {
+        pipeline.chunks[i].data = malloc(CHUNK_SIZE + 1);
+        if (pipeline.chunks[i].data == NULL) {
+            for (int j = 0; j < i; j++) free(pipeline.chunks[j].data);
+            return 0;
+        }
+    }
+    statsInit(total);
+    stop->stopped = 0;
+
+    if (reader->interactive) {
+        Chunk *chunk = &pipeline.chunks[0];
+        while (!stop->stopped && readChunk(reader, chunk)) {
+            parseChunk(chunk);
+            statsMerge(total, &chunk->stats);
+            if (chunk->stopped) *stop = *chunk;
+        }
+        free(chunk->data);
+        return 1;
+    }
+
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+    pthread_t readerId;
+    pthread_t workers[MAX_WORKERS];
+    pthread_create(&readerId, NULL, readerThread, &pipeline);
+    for (int i = 0; i < workerCount; i++) {
+        pthread_create(&workers[i], NULL, workerThread, &pipeline);
+    }
+
+    // Merge stage: runs on the calling thread, strictly in chunk order
+    for (size_t seq = 0;; seq++) {
+        Chunk *chunk = &pipeline.chunks[seq % QUEUE_DEPTH];
+
+        pthread_mutex_lock(&pipeline.lock);
+        while (!(chunk->state == CHUNK_PARSED && chunk->seq == seq) &&
+               !(pipeline.readerDone && seq >= pipeline.chunksRead)) {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+        }
+        int finished = pipeline.readerDone && seq >= pipeline.chunksRead;
+        pthread_mutex_unlock(&pipeline.lock);
+        if (finished) {
+            break;
+        }
+
+        statsMerge(total, &chunk->stats);
+        int stopped = chunk->stopped;
+        if (stopped) {
+            stop->stopped = 1;
+            stop->stopOffset = chunk->stopOffset;
+            memcpy(stop->stopToken, chunk->stopToken, TOKEN_LENGTH);
+        }
+
+        pthread_mutex_lock(&pipeline.lock);
+        chunk->state = CHUNK_EMPTY;
+        pipeline.finished = stopped;
+        pthread_cond_broadcast(&pipeline.changed);
+        pthread_mutex_unlock(&pipeline.lock);
+        if (stopped) {
+            break;
+        }
+    }
+
+    pthread_join(readerId, NULL);
+    for (int i = 0; i < workerCount; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.changed);
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        free(pipeline.chunks[i].data);
+    }
+    return 1;
+}
+
+// ======================
+// Output
+// ======================
+
+/**
+ * Format a 128-bit integer in decimal.
+ */
+static const char *formatInt128(char *buffer, size_t size, unsigned __int128 magnitude, int negative) {
+    char *p = buffer + size;
+    *--p = '\0';
+    do {
+        *--p = (char)('0' + (int)(magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude);
+    if (negative) *--p = '-';
+    return p;
+}
+
+static void printProduct(const Stats *stats) {
+    const Product *product = &stats->product;
+    int negative = stats->negatives & 1;
+    char buffer[48];
+    if (product->zero) {
+        printf("Product: 0\n");
+    } else if (product->exact) {
+        printf("Product: %s\n", formatInt128(buffer, sizeof(buffer), product->magnitude, negative));
+    } else {
+        // Too wide for 128 bits: print it in scientific notation from its logarithm
+        long double log10Value = (log2l(product->mantissa) + product->exponent) * log10l(2.0L);
+        long double exponent = floorl(log10Value);
+        long double mantissa = powl(10.0L, log10Value - exponent);
+        if (mantissa >= 9.9999995L) {
+            mantissa /= 10;
+            exponent += 1;
+        }
+        printf("Product: %s%.6Lfe+%.0Lf (log10 |product| = %.6Lf)\n", negative ? "-" : "", mantissa, exponent,
+               log10Value);
+    }
+}
+
+static void printStats(const Stats *stats) {
+    char buffer[48];
+    long double average = (long double)stats->sum / stats->count;
+    long double variance = stats->m2 / stats->count;
+    printf("Sum: %s\n", formatInt128(buffer, sizeof(buffer), stats->sum < 0 ? -(unsigned __int128)stats->sum
+                                                                             : (unsigned __int128)stats->sum,
+                                     stats->sum < 0));
+    printf("Average: %.2Lf\n", average);
+    printProduct(stats);
+    printf("Min: %lld\nMax: %lld\n", (long long)stats->min, (long long)stats->max);
+    printf("Variance: %.2Lf\nStd dev: %.2Lf\n", variance, sqrtl(variance));
+    printf("Count: %llu\n", (unsigned long long)stats->count);
+}
+
+// ======================
+// Check mode
+// ======================
+
+/**
+ * Reduce text as one chunk and compare it with a value-by-value reference:
+ * exact sum, min, max and product, or the product's log10 summed in long
+ * double once it no longer fits. Returns 1 when they agree.
+ */
+static int checkCase(const char *name, const char *text) {
+    Chunk chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.length = strlen(text);
+    chunk.data = malloc(chunk.length + 1);
+    if (chunk.data == NULL) return 0;
+    memcpy(chunk.data, text, chunk.length + 1);
+    parseChunk(&chunk);
+    free(chunk.data);
+
+    __int128 sum = 0;
+    int64_t min = INT64_MAX, max = INT64_MIN;
+    uint64_t count = 0, negatives = 0;
+    int zero = 0, exact = 1;
+    unsigned __int128 magnitude = 1;
+    long double log10Product = 0;
+    for (const char *p = text; *p;) {
+        char *end;
+        long long x = strtoll(p, &end, 10);
+        if (end == p) break;
+        p = end;
+        count++;
+        sum += x;
+        if (x < min) min = x;
+        if (x > max) max = x;
+        negatives += x < 0;
+        zero |= x == 0;
+        uint64_t factor = x < 0 ? -(uint64_t)x : (uint64_t)x;
+        if (exact && __builtin_mul_overflow(magnitude, factor, &magnitude)) exact = 0;
+        if (x) log10Product += log10l((long double)factor);
+    }
+
+    const Stats *stats = &chunk.stats;
+    const Product *product = &stats->product;
+    int ok = stats->count == count && stats->sum == sum && stats->min == min && stats->max == max &&
+             stats->negatives == negatives && product->zero == zero;
+    if (ok && !zero && exact) {
+        ok = product->exact && product->magnitude == magnitude;
+    } else if (ok && !zero) {
+        long double got = (log2l(product->mantissa) + product->exponent) * log10l(2.0L);
+        ok = !product->exact && isfinite(got) && fabsl(got - log10Product) <= 1e-9L * (1 + fabsl(log10Product));
+    }
+    printf("%-4s %s\n", ok ? "ok" : "FAIL", name);
+    return ok;
+}
+
+/**
+ * Run the block kernels over products that leave the exact range with every
+ * tail length, values around 32 bits, zeros and blocks larger than BLOCK_VALUES.
+ */
+static int runChecks(void) {
+    size_t size = 16 * BLOCK_VALUES * 12;
+    char *text = malloc(size), name[96];
+    if (text == NULL) return 1;
+    int failed = 0;
+
+    for (int n = 1; n <= 48; n++) {
+        size_t used = 0;
+        for (int i = 1; i <= n; i++) used += (size_t)snprintf(text + used, size - used, "%d ", i);
+        snprintf(name, sizeof(name), "1 .. %d", n);
+        failed += !checkCase(name, text);
+    }
+    const long long edges[] = { INT32_MAX, INT32_MIN, -3, (long long)INT32_MAX + 1, INT64_MAX };
+    for (int e = 0; e < (int)(sizeof(edges) / sizeof(edges[0])); e++) {
+        for (int n = 1; n <= 96; n++) {
+            size_t used = 0;
+            for (int i = 0; i < n; i++) used += (size_t)snprintf(text + used, size - used, "%lld ", edges[e]);
+            snprintf(name, sizeof(name), "%d x %lld", n, edges[e]);
+            failed += !checkCase(name, text);
+        }
+    }
+    srand(49);
+    for (int round = 0; round < 8; round++) {
+        size_t used = 0;
+        int n = BLOCK_VALUES * (1 + round) + round * 7;
+        for (int i = 0; i < n; i++) {
+            int x = rand() % 2001 - 1000;
+            if (x == 0 && round != 3) x = 7;
+            used += (size_t)snprintf(text + used, size - used, "%d\n", x);
+        }
+        snprintf(name, sizeof(name), "%d random values%s", n, round == 3 ? " with zeros" : "");
+        failed += !checkCase(name, text);
+    }
+    free(text);
+    printf("%d check%s failed\n", failed, failed == 1 ? "" : "s");
+    return failed != 0;
+}
+
+int main(int argc, char **argv) {
+    for (const char *c = " \t\n\v\f\r"; *c; c++) spaceTable[(unsigned char)*c] = 1;
+    if (argc == 2 && strcmp(argv[1], "--check") == 0) {
+        return runChecks();
+    }
+
+    const char *path = NULL;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workerCount = cpus > 1 ? (int)cpus - 1 : 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            workerCount = atoi(argv[++i]);
+        } else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [--threads N] [FILE]\n       %s --check\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (workerCount < 1) workerCount = 1;
+    if (workerCount > MAX_WORKERS) workerCount = MAX_WORKERS;
+
+    Reader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (reader.fd < 0) {
+        perror(path);
+        return 1;
+    }
+    reader.interactive = isatty(reader.fd);
+    reader.carry = malloc(CHUNK_SIZE);
+    if (reader.carry == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (reader.interactive) {
+        printf("Enter integers separated by spaces (at least three): ");
+        fflush(stdout);
+    }
+
+    Stats stats;
+    Chunk stop;
+    if (!collectStats(&reader, workerCount, &stats, &stop)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    free(reader.carry);
+    if (path) close(reader.fd);
+
+    if (reader.error) {
+        fprintf(stderr, "%s: %s\n", path ? path : "stdin", strerror(reader.error));
+        return 1;
+    }
+    if (stop.stopped && !reader.interactive) {
+        fprintf(stderr, "Stopped at byte %llu: \"%s\" is not a 64-bit integer\n",
+                (unsigned long long)stop.stopOffset, stop.stopToken);
+    }
+    if (stats.count == 0) {
+        printf("No integers read.\n");
+        return 1;
+    }
+    printStats(&stats);
     return 0;
-}
\ No newline at end of file
+}
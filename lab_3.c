@@ -1,54 +1,724 @@
+/* Grocery pricing engine
+ *
+ *   lab_3                                            price items interactively
+ *   lab_3 --batch [--threads N] [--discount PCT] FILE...   total order files
+ *
+ * Every product category is a row of CATEGORIES: whether it is priced per kg
+ * or per unit, and an optional bulk discount. Money is held in integer cents
+ * and quantities in thousandths (grams, or thousandths of a unit), so every
+ * total is exact and the same on every run.
+ *
+ * A line item costs quantity * price rounded half up to the cent, less the
+ * category's bulk discount (also rounded per line). The order discount is
+ * taken off the subtotal, rounded half up to the cent.
+ *
+ * An order file has one line item per line: CATEGORY QUANTITY PRICE, separated
+ * by spaces, tabs or commas, with CATEGORY given as its code or name. Blank
+ * lines and lines starting with '#' are skipped, and invalid lines (including
+ * any line too long for a chunk) are reported and left out. Files are read in
+ * chunks by a reader thread and priced by worker threads. Integer sums do not
+ * depend on the order they are taken in, so the totals are the same for any
+ * thread count.
+ */
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define CHUNK_SIZE (4 << 20)     // Bytes per chunk handed to a worker
+#define QUEUE_DEPTH 8            // Chunks in flight between reader, workers and merge
+#define MAX_WORKERS 16           // Upper bound on pricing worker threads
+#define REPORT_INVALID 10        // Invalid lines reported per file before only counting them
+#define QUANTITY_SCALE 1000      // Quantities are held in thousandths of a kg or unit
+#define PERCENT_SCALE 10000      // Percentages are held in hundredths of a percent
+#define TOKEN_LENGTH 64          // Longest interactive input token
+
+typedef enum { PRICE_PER_KG, PRICE_PER_UNIT } PricingUnit;
+
+// One product category and how it is priced
+typedef struct {
+    int code;                    // Number typed at the prompt or given in an order file
+    const char *name;
+    PricingUnit unit;
+    int64_t bulkMinimum;         // Quantity (thousandths) from which the bulk discount applies
+    int bulkPercent;             // Bulk discount in hundredths of a percent, 0 for none
+} Category;
+
+static const Category CATEGORIES[] = {
+    { 1, "Fruits",     PRICE_PER_KG,   0, 0 },
+    { 2, "Vegetables", PRICE_PER_KG,   0, 0 },
+    { 3, "Dairy",      PRICE_PER_UNIT, 0, 0 },
+    { 4, "Canned",     PRICE_PER_UNIT, 0, 0 },
+};
+#define CATEGORY_COUNT ((int)(sizeof(CATEGORIES) / sizeof(CATEGORIES[0])))
+
+// Why an order line was left out
+typedef enum {
+    LINE_OK = 0,
+    LINE_BAD_CATEGORY,
+    LINE_BAD_QUANTITY,
+    LINE_FRACTIONAL_UNITS,
+    LINE_BAD_PRICE,
+    LINE_EXTRA_FIELDS,
+    LINE_TOO_LONG
+} LineStatus;
+
+static const char *const LINE_STATUS_MESSAGES[] = {
+    "ok",
+    "unknown product category",
+    "quantity is not a non-negative number",
+    "items priced per unit need a whole quantity",
+    "price is not a non-negative amount",
+    "more than three fields",
+    "line does not fit in a chunk (4 MiB)",
+};
+
+// Quantities and amounts summed over the line items of one category
+typedef struct {
+    uint64_t items;
+    __int128 quantity;           // Thousandths
+    __int128 cents;
+} CategoryTotal;
+
+// Totals of a run of order lines
+typedef struct {
+    uint64_t lines;              // Lines seen, including blank and comment lines
+    CategoryTotal categories[CATEGORY_COUNT];
+    uint64_t invalid;
+    uint64_t invalidLines[REPORT_INVALID]; // Line numbers, relative to the run
+    LineStatus invalidStatus[REPORT_INVALID];
+} OrderTotals;
+
+// One chunk of an order file travelling from the reader through a worker to the merge
+typedef struct {
+    enum { CHUNK_EMPTY, CHUNK_READ, CHUNK_PRICING, CHUNK_PRICED } state;
+    size_t seq;                  // Position of the chunk in the file
+    char *data;                  // Whole lines
+    size_t length;
+    int tooLong;                 // Stands for one line longer than CHUNK_SIZE, which was skipped unread
+    OrderTotals totals;
+} Chunk;
+
+// Shared state of the reader, the workers and the merge for one file
+typedef struct {
+    int fd;
+    Chunk chunks[QUEUE_DEPTH];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t chunksRead;           // Chunks handed to the workers so far
+    int readerDone;
+    int readError;               // errno of a failed read
+    uint64_t bytesRead;
+} Pipeline;
+
+/**
+ * Return the current monotonic time in seconds.
+ */
+static double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ======================
+// Fixed-point arithmetic
+// ======================
+
+/**
+ * Parse a non-negative decimal into an integer scaled by 10^decimals.
+ * Digits past the kept ones round half up. Returns the first character after
+ * the number, or NULL when there is no number or it does not fit.
+ */
+static const char *parseFixed(const char *p, int decimals, int64_t *value) {
+    int64_t scale = 1;
+    for (int i = 0; i < decimals; i++) scale *= 10;
+
+    int64_t whole = 0;
+    int digits = 0;
+    while ((unsigned)(*p - '0') <= 9) {
+        if (whole > (INT64_MAX / scale - 1) / 10) return NULL;
+        whole = whole * 10 + (*p++ - '0');
+        digits++;
+    }
+    int64_t fraction = 0;
+    int kept = 0, roundUp = 0;
+    if (*p == '.') {
+        p++;
+        for (; (unsigned)(*p - '0') <= 9; p++, digits++) {
+            if (kept < decimals) {
+                fraction = fraction * 10 + (*p - '0');
+                kept++;
+            } else if (kept == decimals) {
+                roundUp = *p >= '5';
+                kept++;
+            }
+        }
+    }
+    if (digits == 0) return NULL;
+    for (; kept < decimals; kept++) fraction *= 10;
+    *value = whole * scale + fraction + roundUp;
+    return p;
+}
+
+/**
+ * Divide a non-negative amount, rounding half up.
+ */
+static __int128 divideRounded(__int128 amount, int64_t divisor) {
+    return (amount + divisor / 2) / divisor;
+}
+
+/**
+ * Cost in cents of one line item, after the category's bulk discount.
+ */
+static __int128 lineCost(const Category *category, int64_t quantity, int64_t price) {
+    __int128 cost = divideRounded((__int128)quantity * price, QUANTITY_SCALE);
+    if (category->bulkPercent && quantity >= category->bulkMinimum) {
+        cost -= divideRounded(cost * category->bulkPercent, PERCENT_SCALE);
+    }
+    return cost;
+}
+
+/**
+ * Format a signed amount held in units of 10^-decimals.
+ */
+static const char *formatFixed(char *buffer, size_t size, __int128 amount, int decimals) {
+    unsigned __int128 magnitude = amount < 0 ? -(unsigned __int128)amount : (unsigned __int128)amount;
+    char *p = buffer + size;
+    *--p = '\0';
+    for (int digit = 0; digit < decimals || magnitude || digit <= decimals; digit++) {
+        if (digit == decimals && decimals) *--p = '.';
+        *--p = (char)('0' + (int)(magnitude % 10));
+        magnitude /= 10;
+    }
+    if (amount < 0) *--p = '-';
+    return p;
+}
+
+static const char *unitName(const Category *category) {
+    return category->unit == PRICE_PER_KG ? "kg" : "units";
+}
+
+// ======================
+// Order lines
+// ======================
+
+static int isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+/**
+ * Find a category by its code or, ignoring case, its name.
+ */
+static int findCategory(const char *token, size_t length) {
+    if (length > 0 && length < 10 && (unsigned)(token[0] - '1') <= 8) {
+        int code = 0;
+        for (size_t i = 0; i < length; i++) {
+            if ((unsigned)(token[i] - '0') > 9) return -1;
+            code = code * 10 + (token[i] - '0');
+        }
+        for (int i = 0; i < CATEGORY_COUNT; i++) {
+            if (CATEGORIES[i].code == code) return i;
+        }
+        return -1;
+    }
+    for (int i = 0; i < CATEGORY_COUNT; i++) {
+        if (strncasecmp(token, CATEGORIES[i].name, length) == 0 && CATEGORIES[i].name[length] == '\0') return i;
+    }
+    return -1;
+}
+
+/**
+ * Parse one line item. line ends before its '\n' and the byte at end is not
+ * part of a number, so the number parsers stop there.
+ */
+static LineStatus parseOrderLine(const char *p, const char *end, int *category, int64_t *quantity,
+                                 int64_t *price) {
+    while (p < end && isSeparator(*p)) p++;
+    const char *token = p;
+    while (p < end && !isSeparator(*p)) p++;
+    if ((*category = findCategory(token, (size_t)(p - token))) < 0) return LINE_BAD_CATEGORY;
+
+    while (p < end && isSeparator(*p)) p++;
+    const char *next = parseFixed(p, 3, quantity);
+    if (next == NULL || next > end || (next < end && !isSeparator(*next))) return LINE_BAD_QUANTITY;
+    if (CATEGORIES[*category].unit == PRICE_PER_UNIT && *quantity % QUANTITY_SCALE) return LINE_FRACTIONAL_UNITS;
+    p = next;
 
-int main() {
-    int product_type;
-    float total_cost = 0, price, weight, quantity, discount;
+    while (p < end && isSeparator(*p)) p++;
+    next = parseFixed(p, 2, price);
+    if (next == NULL || next > end || (next < end && !isSeparator(*next))) return LINE_BAD_PRICE;
+    p = next;
+
+    while (p < end && isSeparator(*p)) p++;
+    return p == end ? LINE_OK : LINE_EXTRA_FIELDS;
+}
+
+/**
+ * Price every line of a chunk (runs on a worker thread).
+ */
+static void priceChunk(Chunk *chunk) {
+    OrderTotals *totals = &chunk->totals;
+    const char *p = chunk->data;
+    const char *limit = chunk->data + chunk->length;
+
+    memset(totals, 0, sizeof(*totals));
+    if (chunk->tooLong) {
+        totals->lines = totals->invalid = 1;
+        totals->invalidLines[0] = 1;
+        totals->invalidStatus[0] = LINE_TOO_LONG;
+        return;
+    }
+    while (p < limit) {
+        const char *end = memchr(p, '\n', (size_t)(limit - p));
+        if (end == NULL) end = limit;
+        const char *next = end + 1;
+        totals->lines++;
 
+        const char *first = p;
+        while (first < end && isSeparator(*first)) first++;
+        if (first == end || *first == '#') {
+            p = next;
+            continue;
+        }
+
+        int category;
+        int64_t quantity, price;
+        LineStatus status = parseOrderLine(p, end, &category, &quantity, &price);
+        if (status == LINE_OK) {
+            CategoryTotal *total = &totals->categories[category];
+            total->items++;
+            total->quantity += quantity;
+            total->cents += lineCost(&CATEGORIES[category], quantity, price);
+        } else {
+            if (totals->invalid < REPORT_INVALID) {
+                totals->invalidLines[totals->invalid] = totals->lines;
+                totals->invalidStatus[totals->invalid] = status;
+            }
+            totals->invalid++;
+        }
+        p = next;
+    }
+}
+
+/**
+ * Append the totals of the run that follows a run, renumbering its invalid lines.
+ */
+static void mergeTotals(OrderTotals *totals, const OrderTotals *next) {
+    for (uint64_t i = 0; i < next->invalid && totals->invalid + i < REPORT_INVALID; i++) {
+        totals->invalidLines[totals->invalid + i] = totals->lines + next->invalidLines[i];
+        totals->invalidStatus[totals->invalid + i] = next->invalidStatus[i];
+    }
+    totals->invalid += next->invalid;
+    totals->lines += next->lines;
+    for (int i = 0; i < CATEGORY_COUNT; i++) {
+        totals->categories[i].items += next->categories[i].items;
+        totals->categories[i].quantity += next->categories[i].quantity;
+        totals->categories[i].cents += next->categories[i].cents;
+    }
+}
+
+// ======================
+// Batch pipeline
+// ======================
+
+/**
+ * Read and drop the rest of a line that filled a whole chunk, using buffer
+ * as scratch space. What follows its newline becomes the carry. Returns the
+ * bytes dropped, newline included; sets *eof when the file ends first.
+ */
+static size_t skipLongLine(Pipeline *pipeline, char *buffer, char *carry, size_t *carryLength, int *eof) {
+    size_t skipped = 0;
+    *carryLength = 0;
     while (1) {
-        printf("Enter product type code (1-Fruits, 2-Vegetables, 3-Dairy, 4-Canned, 0 to Exit): ");
-        scanf("%d", &product_type);
-
-        if (product_type == 0) break;
-
-        switch (product_type) {
-            case 1:
-                printf("Enter weight (kg): ");
-                scanf("%f", &weight);
-                printf("Enter price per kg: ");
-                scanf("%f", &price);
-                total_cost += weight * price;
-                break;
-            case 2:
-                printf("Enter weight (kg): ");
-                scanf("%f", &weight);
-                printf("Enter price per kg: ");
-                scanf("%f", &price);
-                total_cost += weight * price;
+        ssize_t got = read(pipeline->fd, buffer, CHUNK_SIZE);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            if (got < 0) pipeline->readError = errno;
+            *eof = 1;
+            return skipped;
+        }
+        const char *newline = memchr(buffer, '\n', (size_t)got);
+        if (newline != NULL) {
+            size_t used = (size_t)(newline + 1 - buffer);
+            *carryLength = (size_t)got - used;
+            memcpy(carry, newline + 1, *carryLength);
+            return skipped + used;
+        }
+        skipped += (size_t)got;
+    }
+}
+
+/**
+ * Reader stage: fill free chunk slots with whole lines of the file.
+ * The data buffer is one byte longer than CHUNK_SIZE, with room for the
+ * '\n' that ends a last line without one.
+ */
+static void *readerThread(void *arg) {
+    Pipeline *pipeline = arg;
+    char *carry = malloc(CHUNK_SIZE);
+    size_t carryLength = 0;
+    int eof = carry == NULL;
+    if (carry == NULL) pipeline->readError = ENOMEM;
+
+    for (size_t seq = 0; !eof; seq++) {
+        Chunk *chunk = &pipeline->chunks[seq % QUEUE_DEPTH];
+
+        pthread_mutex_lock(&pipeline->lock);
+        while (chunk->state != CHUNK_EMPTY) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+
+        // Start with the partial line left over from the previous chunk
+        size_t length = carryLength;
+        memcpy(chunk->data, carry, carryLength);
+        while (length < CHUNK_SIZE) {
+            ssize_t got = read(pipeline->fd, chunk->data + length, CHUNK_SIZE - length);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                if (got < 0) pipeline->readError = errno;
+                eof = 1;
                 break;
-            case 3:
-                printf("Enter quantity: ");
-                scanf("%f", &quantity);
-                printf("Enter price per item: ");
-                scanf("%f", &price);
-                total_cost += quantity * price;
+            }
+            length += (size_t)got;
+        }
+
+        // Cut at the last newline and keep the remainder for the next chunk;
+        // a line longer than a whole chunk is skipped and passed on as one
+        // invalid line
+        size_t cut = length, bytes;
+        if (!eof) {
+            while (cut > 0 && chunk->data[cut - 1] != '\n') cut--;
+        }
+        chunk->tooLong = cut == 0 && !eof;
+        if (chunk->tooLong) {
+            bytes = length + skipLongLine(pipeline, chunk->data, carry, &carryLength, &eof);
+        } else {
+            carryLength = length - cut;
+            memcpy(carry, chunk->data + cut, carryLength);
+            chunk->data[cut] = '\n';
+            if (cut == 0) {
                 break;
-            case 4:
-                printf("Enter quantity: ");
-                scanf("%f", &quantity);
-                printf("Enter price per item: ");
-                scanf("%f", &price);
-                total_cost += quantity * price;
+            }
+            bytes = cut;
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->seq = pipeline->chunksRead++;
+        chunk->length = chunk->tooLong ? 0 : cut;
+        chunk->state = CHUNK_READ;
+        pipeline->bytesRead += bytes;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+
+    free(carry);
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->readerDone = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Worker stage: pick up read chunks in any order and price them.
+ */
+static void *workerThread(void *arg) {
+    Pipeline *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        Chunk *chunk = NULL;
+        for (int i = 0; i < QUEUE_DEPTH; i++) {
+            if (pipeline->chunks[i].state == CHUNK_READ) {
+                chunk = &pipeline->chunks[i];
                 break;
-            default:
-                printf("Invalid product type!\n");
+            }
+        }
+        if (chunk == NULL) {
+            if (pipeline->readerDone) {
                 break;
+            }
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+            continue;
         }
+        chunk->state = CHUNK_PRICING;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        priceChunk(chunk);
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->state = CHUNK_PRICED;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Total one order file. Chunks are merged in file order so that invalid lines
+ * are reported with their line numbers. Returns 0 (with errno) if the file
+ * cannot be read.
+ */
+static int totalOrderFile(const char *path, int workerCount, OrderTotals *totals, uint64_t *bytes) {
+    Pipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    memset(totals, 0, sizeof(*totals));
+    pipeline.fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (pipeline.fd < 0) {
+        return 0;
+    }
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        pipeline.chunks[i].data = malloc(CHUNK_SIZE + 1);
+        if (pipeline.chunks[i].data == NULL) {
+            for (int j = 0; j < i; j++) free(pipeline.chunks[j].data);
+            if (pipeline.fd != STDIN_FILENO) close(pipeline.fd);
+            errno = ENOMEM;
+            return 0;
+        }
+    }
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    pthread_t reader;
+    pthread_t workers[MAX_WORKERS];
+    pthread_create(&reader, NULL, readerThread, &pipeline);
+    for (int i = 0; i < workerCount; i++) {
+        pthread_create(&workers[i], NULL, workerThread, &pipeline);
+    }
+
+    // Merge stage: runs on the calling thread, strictly in chunk order
+    for (size_t seq = 0;; seq++) {
+        Chunk *chunk = &pipeline.chunks[seq % QUEUE_DEPTH];
+
+        pthread_mutex_lock(&pipeline.lock);
+        while (!(chunk->state == CHUNK_PRICED && chunk->seq == seq) &&
+               !(pipeline.readerDone && seq >= pipeline.chunksRead)) {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+        }
+        int finished = pipeline.readerDone && seq >= pipeline.chunksRead;
+        pthread_mutex_unlock(&pipeline.lock);
+        if (finished) {
+            break;
+        }
+
+        mergeTotals(totals, &chunk->totals);
+
+        pthread_mutex_lock(&pipeline.lock);
+        chunk->state = CHUNK_EMPTY;
+        pthread_cond_broadcast(&pipeline.changed);
+        pthread_mutex_unlock(&pipeline.lock);
+    }
+
+    pthread_join(reader, NULL);
+    for (int i = 0; i < workerCount; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.changed);
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        free(pipeline.chunks[i].data);
+    }
+    if (pipeline.fd != STDIN_FILENO) close(pipeline.fd);
+    *bytes = pipeline.bytesRead;
+    errno = pipeline.readError;
+    return pipeline.readError == 0;
+}
+
+/**
+ * Print the per-category totals, the discount and the total of an order.
+ */
+static void printOrder(const char *title, const OrderTotals *totals, int discount) {
+    char quantity[64], cents[64];
+    __int128 subtotal = 0;
+    uint64_t items = 0;
+    printf("%s\n", title);
+    for (int i = 0; i < CATEGORY_COUNT; i++) {
+        const CategoryTotal *total = &totals->categories[i];
+        printf("  %-12s %10llu items %18s %-5s %18s\n", CATEGORIES[i].name, (unsigned long long)total->items,
+               CATEGORIES[i].unit == PRICE_PER_KG ? formatFixed(quantity, sizeof(quantity), total->quantity, 3)
+                                                  : formatFixed(quantity, sizeof(quantity),
+                                                                total->quantity / QUANTITY_SCALE, 0),
+               unitName(&CATEGORIES[i]),
+               formatFixed(cents, sizeof(cents), total->cents, 2));
+        subtotal += total->cents;
+        items += total->items;
+    }
+    __int128 off = divideRounded(subtotal * discount, PERCENT_SCALE);
+    printf("  %-12s %10llu items %43s\n", "Subtotal", (unsigned long long)items,
+           formatFixed(cents, sizeof(cents), subtotal, 2));
+    if (discount) {
+        char percent[32];
+        char label[48];
+        snprintf(label, sizeof(label), "Discount %s%%", formatFixed(percent, sizeof(percent), discount, 2));
+        printf("  %-29s %43s\n", label, formatFixed(cents, sizeof(cents), -off, 2));
     }
+    printf("  %-29s %43s\n", "Total", formatFixed(cents, sizeof(cents), subtotal - off, 2));
+}
 
-    printf("Enter discount percentage (0 if none): ");
-    scanf("%f", &discount);
-    total_cost = (discount > 0) ? total_cost * (1 - discount / 100) : total_cost;
+static int runBatch(int fileCount, char **files, int workerCount, int discount) {
+    OrderTotals all;
+    memset(&all, 0, sizeof(all));
+    int failed = 0, totalled = 0;
+    uint64_t allBytes = 0;
+    double start = monotonicSeconds();
 
-    printf("Final cost after discount: %.2f\n", total_cost);
+    for (int f = 0; f < fileCount; f++) {
+        OrderTotals totals;
+        uint64_t bytes = 0;
+        if (!totalOrderFile(files[f], workerCount, &totals, &bytes)) {
+            fprintf(stderr, "%s: %s\n", files[f], strerror(errno));
+            failed = 1;
+            continue;
+        }
+        for (uint64_t i = 0; i < totals.invalid && i < REPORT_INVALID; i++) {
+            fprintf(stderr, "%s:%llu: %s\n", files[f], (unsigned long long)totals.invalidLines[i],
+                    LINE_STATUS_MESSAGES[totals.invalidStatus[i]]);
+        }
+        if (totals.invalid > REPORT_INVALID) {
+            fprintf(stderr, "%s: %llu more invalid lines\n", files[f],
+                    (unsigned long long)(totals.invalid - REPORT_INVALID));
+        }
+        char title[512];
+        snprintf(title, sizeof(title), "%s: %llu lines, %llu invalid", files[f], (unsigned long long)totals.lines,
+                 (unsigned long long)totals.invalid);
+        printOrder(title, &totals, discount);
+        mergeTotals(&all, &totals);
+        allBytes += bytes;
+        totalled++;
+    }
+    if (totalled > 1) {
+        char title[128];
+        snprintf(title, sizeof(title), "All %d files: %llu lines, %llu invalid", totalled,
+                 (unsigned long long)all.lines, (unsigned long long)all.invalid);
+        printOrder(title, &all, discount);
+    }
+
+    double seconds = monotonicSeconds() - start;
+    fprintf(stderr, "Priced %llu lines (%.1f MB) in %.3f s, %.1f MB/s, %d worker%s\n",
+            (unsigned long long)all.lines, allBytes / 1e6, seconds, allBytes / 1e6 / (seconds > 0 ? seconds : 1e-9),
+            workerCount, workerCount == 1 ? "" : "s");
+    return failed;
+}
+
+// ======================
+// Interactive entry
+// ======================
+
+/**
+ * Read the next whitespace-separated token from stdin, like scanf does.
+ * Returns 0 at end of input.
+ */
+static int readToken(char *token, size_t size) {
+    int c;
+    while ((c = getchar()) != EOF && isspace(c)) {
+    }
+    if (c == EOF) return 0;
+    size_t length = 0;
+    do {
+        if (length + 1 < size) token[length++] = (char)c;
+    } while ((c = getchar()) != EOF && !isspace(c));
+    token[length] = '\0';
+    return 1;
+}
+
+/**
+ * Prompt until a number from 0 to maximum, a multiple of step, is entered.
+ * Values are scaled by 10^decimals. Returns 0 at end of input.
+ */
+static int promptFixed(const char *prompt, int decimals, int64_t maximum, int64_t step, int64_t *value) {
+    char token[TOKEN_LENGTH];
+    while (1) {
+        printf("%s", prompt);
+        fflush(stdout);
+        if (!readToken(token, sizeof(token))) return 0;
+        const char *end = parseFixed(token, decimals, value);
+        if (end && *end == '\0' && *value <= maximum && *value % step == 0) return 1;
+        printf("Invalid number!\n");
+    }
+}
+
+static int runInteractive() {
+    char prompt[256] = "Enter product type code (";
+    for (int i = 0; i < CATEGORY_COUNT; i++) {
+        size_t used = strlen(prompt);
+        snprintf(prompt + used, sizeof(prompt) - used, "%d-%s, ", CATEGORIES[i].code, CATEGORIES[i].name);
+    }
+    strncat(prompt, "0 to Exit): ", sizeof(prompt) - strlen(prompt) - 1);
+
+    __int128 totalCents = 0;
+    char token[TOKEN_LENGTH];
+    while (1) {
+        printf("%s", prompt);
+        fflush(stdout);
+        if (!readToken(token, sizeof(token)) || strcmp(token, "0") == 0) break;
+
+        int index = findCategory(token, strlen(token));
+        if (index < 0) {
+            printf("Invalid product type!\n");
+            continue;
+        }
+        const Category *category = &CATEGORIES[index];
+        int64_t quantity, price;
+        int perKg = category->unit == PRICE_PER_KG;
+        if (!promptFixed(perKg ? "Enter weight (kg): " : "Enter quantity: ", 3, INT64_MAX,
+                         perKg ? 1 : QUANTITY_SCALE, &quantity) ||
+            !promptFixed(perKg ? "Enter price per kg: " : "Enter price per item: ", 2, INT64_MAX, 1, &price)) {
+            break;
+        }
+        totalCents += lineCost(category, quantity, price);
+    }
+
+    int64_t discount = 0;
+    if (!promptFixed("Enter discount percentage (0 if none): ", 2, 100 * 100, 1, &discount)) discount = 0;
+    totalCents -= divideRounded(totalCents * discount, PERCENT_SCALE);
+
+    char cents[64];
+    printf("Final cost after discount: %s\n", formatFixed(cents, sizeof(cents), totalCents, 2));
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char **argv) {
+    if (argc == 1) {
+        return runInteractive();
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workerCount = cpus > 1 ? (int)cpus - 1 : 1;
+    int64_t discount = 0;
+    int batch = 0, fileStart = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            workerCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--discount") == 0 && i + 1 < argc) {
+            const char *end = parseFixed(argv[++i], 2, &discount);
+            if (end == NULL || *end || discount > 100 * 100) {
+                fprintf(stderr, "Discount must be a percentage from 0 to 100, not %s\n", argv[i]);
+                return 2;
+            }
+        } else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+            fileStart = i;
+            break;
+        } else {
+            fileStart = -1;
+            break;
+        }
+    }
+    if (!batch || fileStart < 0 || fileStart == argc) {
+        fprintf(stderr, "usage: %s\n       %s --batch [--threads N] [--discount PCT] FILE...\n", argv[0], argv[0]);
+        return 2;
+    }
+    if (workerCount < 1) workerCount = 1;
+    if (workerCount > MAX_WORKERS) workerCount = MAX_WORKERS;
+    return runBatch(argc - fileStart, argv + fileStart, workerCount, (int)discount);
+}
@@ -1,208 +1,2886 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <math.h>
-
-// Custom implementation of strndup
-char *my_strndup(const char *str, size_t n) {
-    char *result;
-    size_t len = strlen(str);
-    if (len > n) len = n;
-    result = malloc(len + 1);
-    if (!result) return NULL;
-    result[len] = '\0';
-    return memcpy(result, str, len);
-}
-
-// Define the structure for an expression node
-typedef struct Expr {
-    enum { NUMBER, IDENT, FUNC_CALL, OP, NEG } type;  // Type of expression
-    union {
-        double number;  // If the expression is a number, store it here
-        char *ident;    // If the expression is an identifier, store its name here
-        struct { struct Expr *left, *right; char op; } op;  // If it's an operation, store the operator and its operands
-        struct { char *fname; struct Expr *arg; } func_call;  // If it's a function call, store the function name and argument
-    };
-} Expr;
-
-// Define the structure for a token node (linked list of tokens)
-typedef struct Token {
-    enum { TOKEN_NUMBER, TOKEN_IDENT, TOKEN_OP, TOKEN_LPAR, TOKEN_RPAR, TOKEN_FUNC } type;  // Type of token
-    union {
-        double number;  // If the token is a number, store it here
-        char *ident;    // If the token is an identifier, store its name here
-        char op;        // If the token is an operator, store it here
-    };
-    struct Token *next;  // Pointer to the next token in the list
-} Token;
-
-// Function prototypes
-Token *tokenize(const char *input);  // Tokenizes the input string
-Expr *parse_expr(Token **tokens);  // Parses the token list into an expression tree
-Expr *parse_term(Token **tokens);  // Parses terms (handles * and /)
-Expr *parse_factor(Token **tokens);  // Parses factors (handles numbers, identifiers, parentheses)
-double eval(Expr *expr);  // Evaluates the expression tree
-void free_expr(Expr *expr);  // Frees the memory used by the expression tree
-void free_tokens(Token *tokens);  // Frees the memory used by the token list
-
-// Lexer Implementation: Tokenizes the input string into a linked list of tokens
-Token *tokenize(const char *input) {
-    Token *head = NULL, **current = &head;  // Initialize the token list
-    while (*input) {  // Iterate over the input string
-        while (isspace(*input)) input++;  // Skip whitespace
-        Token *token = (Token *)malloc(sizeof(Token));  // Allocate memory for a new token
-        token->next = NULL;
-        if (isdigit(*input) || (*input == '.' && isdigit(input[1]))) {  // Handle numbers
-            token->type = TOKEN_NUMBER;
-            token->number = strtod(input, (char **)&input);  // Convert string to double
-        } else if (isalpha(*input)) {  // Handle identifiers
-            const char *start = input;
-            while (isalnum(*input)) input++;  // Read the entire identifier
-            size_t len = input - start;
-            token->type = TOKEN_IDENT;
-            token->ident = my_strndup(start, len);  // Copy the identifier into the token
-        } else if (strchr("+-*/^", *input)) {  // Handle operators
-            token->type = TOKEN_OP;
-            token->op = *input++;
-        } else if (*input == '(') {  // Handle left parentheses
-            token->type = TOKEN_LPAR;
-            input++;
-        } else if (*input == ')') {  // Handle right parentheses
-            token->type = TOKEN_RPAR;
-            input++;
-        } else {  // Handle invalid input
-            free(token);  // Free the allocated memory for the invalid token
-            while (head) {  // Free all previously allocated tokens
-                Token *next = head->next;
-                free(head);
-                head = next;
-            }
-            return NULL;
-        }
-        *current = token;  // Add the token to the list
-        current = &token->next;
-    }
-    return head;  // Return the head of the token list
-}
-
-// Parse a factor (numbers, identifiers, parentheses, or function calls)
-Expr *parse_factor(Token **tokens) {
-    Token *token = *tokens;  // Get the current token
-    Expr *result;
-    if (token->type == TOKEN_NUMBER) {  // Handle numbers
-        result = (Expr *)malloc(sizeof(Expr));  // Allocate memory for the expression node
-        result->type = NUMBER;
-        result->number = token->number;  // Store the number in the expression node
-        *tokens = token->next;  // Move to the next token
-    } else if (token->type == TOKEN_LPAR) {  // Handle parentheses
-        *tokens = token->next;  // Skip the left parenthesis
-        result = parse_expr(tokens);  // Parse the expression inside the parentheses
-        if ((*tokens)->type != TOKEN_RPAR) {
-            fprintf(stderr, "Expected closing parenthesis\n");
-            exit(1);
-        }
-        *tokens = (*tokens)->next;  // Skip the right parenthesis
-    } else {
-        fprintf(stderr, "Unexpected token\n");
-        exit(1);
-    }
-    return result;
-}
-
-// Parse terms (factors separated by * or /)
-Expr *parse_term(Token **tokens) {
-    Expr *result = parse_factor(tokens);  // Parse the first factor
-    while (*tokens && (*tokens)->type == TOKEN_OP && ((*tokens)->op == '*' || (*tokens)->op == '/')) {
-        Token *token = *tokens;
-        Expr *new_result = (Expr *)malloc(sizeof(Expr));  // Allocate memory for the new expression node
-        new_result->type = OP;  // Set the node type to operation
-        new_result->op.op = token->op;  // Store the operator
-        new_result->op.left = result;  // The left operand is the current result
-        *tokens = token->next;
-        new_result->op.right = parse_factor(tokens);  // Parse the right operand (next factor)
-        result = new_result;  // Update the result to the new expression
-    }
-    return result;
-}
-
-// Parse expressions (terms separated by + or -)
-Expr *parse_expr(Token **tokens) {
-    Expr *result = parse_term(tokens);  // Parse the first term
-    while (*tokens && (*tokens)->type == TOKEN_OP && ((*tokens)->op == '+' || (*tokens)->op == '-')) {
-        Token *token = *tokens;
-        Expr *new_result = (Expr *)malloc(sizeof(Expr));  // Allocate memory for the new expression node
-        new_result->type = OP;  // Set the node type to operation
-        new_result->op.op = token->op;  // Store the operator
-        new_result->op.left = result;  // The left operand is the current result
-        *tokens = token->next;
-        new_result->op.right = parse_term(tokens);  // Parse the right operand (next term)
-        result = new_result;  // Update the result to the new expression
-    }
-    return result;
-}
-
-// Evaluate the expression tree
-double eval(Expr *expr) {
-    switch (expr->type) {
-        case NUMBER: return expr->number;  // Return the number if it's a number node
-        case OP: {
-            double left = eval(expr->op.left);  // Evaluate the left operand
-            double right = eval(expr->op.right);  // Evaluate the right operand
-            switch (expr->op.op) {  // Perform the operation based on the operator
-                case '+': return left + right;
-                case '-': return left - right;
-                case '*': return left * right;
-                case '/': return left / right;
-                case '^': return pow(left, right);  // Handle exponentiation
-                default: fprintf(stderr, "Unknown operator\n"); exit(1);
-            }
-        }
-        default: fprintf(stderr, "Unknown expression type\n"); exit(1);
-    }
-}
-
-// Free the memory used by the expression tree
-void free_expr(Expr *expr) {
-    if (expr->type == OP) {
-        free_expr(expr->op.left);  // Free the left operand
-        free_expr(expr->op.right);  // Free the right operand
-    }
-    free(expr);  // Free the expression node itself
-}
-
-// Free the memory used by the token list
-void free_tokens(Token *tokens) {
-    while (tokens) {
-        Token *next = tokens->next;
-        if (tokens->type == TOKEN_IDENT) {
-            free(tokens->ident);  // Free the identifier name
-        }
-        free(tokens);  // Free the token
-        tokens = next;
-    }
-}
-
-// Entry point of the program
-int main() {
-    char input[256];  // Buffer for the input string
-    printf("Enter an expression: ");
-    fgets(input, sizeof(input), stdin);  // Read input from the user
-
-    Token *tokens = tokenize(input);  // Tokenize the input
-    if (!tokens) {
-        fprintf(stderr, "Error tokenizing input.\n");
-        return 1;
-    }
-
-    Token *token_list = tokens;
-    Expr *expr = parse_expr(&token_list);  // Parse the token list into an expression tree
-    double result = eval(expr);  // Evaluate the expression tree
-
-    printf("Result: %f\n", result);  // Print the result
-
-    free_expr(expr);  // Free the memory used by the expression tree
-    free_tokens(tokens);  // Free the memory used by the token list
-
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#include <sys/mman.h>
+#endif
+
+// Block of memory handed out by an Arena, newest block first
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;  // Previously filled block
+    size_t size;              // Usable bytes in data
+    size_t used;              // Bytes already handed out
+    max_align_t data[];       // Storage, aligned for any node type
+} ArenaBlock;
+
+// Bump allocator: nodes of one expression are carved out of a few blocks and released together
+typedef struct {
+    ArenaBlock *head;         // Block currently being filled
+} Arena;
+
+#define ARENA_BLOCK_SIZE 4096  // Bytes in the first block; later blocks double
+
+// Allocate size bytes from the arena, growing it by a new block when full
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);  // Keep every allocation aligned
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = block ? block->size * 2 : ARENA_BLOCK_SIZE;
+        while (block_size < size) block_size *= 2;
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (!block) return NULL;
+        block->next = arena->head;
+        block->size = block_size;
+        block->used = 0;
+        arena->head = block;
+    }
+    void *result = (char *)block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+// Release everything allocated since the last reset, keeping the newest (largest) block for reuse
+void arena_reset(Arena *arena) {
+    if (!arena->head) return;
+    ArenaBlock *older = arena->head->next;
+    while (older) {
+        ArenaBlock *next = older->next;
+        free(older);
+        older = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+}
+
+// Free all memory owned by the arena
+void arena_free(Arena *arena) {
+    arena_reset(arena);
+    free(arena->head);
+    arena->head = NULL;
+}
+
+// Copy at most n characters of str into the arena as a NUL-terminated string
+char *arena_strndup(Arena *arena, const char *str, size_t n) {
+    size_t len = strnlen(str, n);
+    char *result = arena_alloc(arena, len + 1);
+    if (!result) return NULL;
+    result[len] = '\0';
+    return memcpy(result, str, len);
+}
+
+// Define the structure for an expression node
+typedef struct Expr {
+    enum { NUMBER, IDENT, FUNC_CALL, OP, NEG } type;  // Type of expression
+    int position;  // Byte offset of the node's token in the input, for diagnostics
+    union {
+        double number;  // If the expression is a number, store it here
+        struct { char *ident; int slot; };  // If the expression is an identifier, store its name and bound input slot here
+        struct { struct Expr *left, *right; char op; } op;  // If it's an operation, store the operator and its operands
+        struct { char *fname; struct Expr *arg, *arg2; int function; } func_call;  // If it's a function call, store the function, its name and arguments (arg2 for two-argument functions)
+    };
+    int uses;  // Parents referring to this node; above 1 only in the DAG built by optimize()
+    int height;  // Stack levels the recursive passes need for the parser-built subtree here, kept under MAX_NESTING
+} Expr;
+
+// Define the structure for a token (tokens are stored back to back in a TokenArray)
+typedef struct Token {
+    enum { TOKEN_NUMBER, TOKEN_IDENT, TOKEN_OP, TOKEN_LPAR, TOKEN_RPAR, TOKEN_FUNC, TOKEN_COMMA, TOKEN_END } type;  // Type of token
+    union {
+        double number;  // If the token is a number, store it here
+        char *ident;    // If the token is an identifier or function name, store it here (in the arena)
+        char op;        // If the token is an operator, store it here
+    };
+    int position;       // Byte offset of the token in the input
+} Token;
+
+// Growable vector of tokens, always terminated by a TOKEN_END token; reused across expressions
+typedef struct {
+    Token *items;     // Contiguous tokens
+    size_t count;     // Tokens in use, including the TOKEN_END
+    size_t capacity;  // Tokens allocated
+} TokenArray;
+
+#define MAX_DIAGNOSTICS 8  // Errors kept per formula; later ones are only counted
+#define MAX_VARIABLES 64  // Input columns a formula can refer to
+#define MAX_NESTING 2000  // Parentheses, calls and right operands a formula can nest, so the recursive passes fit on a stack
+#define BATCH_BLOCK 256    // Rows run_batch() pushes through each instruction at a time
+
+// One problem found in a formula
+typedef struct {
+    int position;      // Byte offset in the input
+    char message[96];
+} Diagnostic;
+
+// Problems found while tokenizing, parsing and binding one formula
+typedef struct {
+    Diagnostic items[MAX_DIAGNOSTICS];
+    int count;         // Problems found, including those beyond MAX_DIAGNOSTICS
+} Diagnostics;
+
+// Names of the inputs a formula is evaluated with; a variable's slot is its index here
+typedef struct {
+    const char *names[MAX_VARIABLES];  // Column names, usually from a CSV header
+    int count;                         // Names in use
+} Bindings;
+
+// Function prototypes
+int tokenize(const char *input, TokenArray *tokens, Arena *arena, Diagnostics *errors);  // Tokenizes the input string
+int find_function(const char *name);  // Looks up a built-in function by name
+Expr *parse(const char *input, TokenArray *tokens, Arena *arena, Diagnostics *errors);  // Tokenizes and parses a formula
+Expr *parse_expr(const Token **tokens, Arena *arena, Diagnostics *errors);  // Parses the token array into an expression tree
+Expr *parse_term(const Token **tokens, Arena *arena, Diagnostics *errors);  // Parses terms (handles * and /)
+Expr *parse_power(const Token **tokens, Arena *arena, Diagnostics *errors);  // Parses powers (handles ^, right-associative)
+Expr *parse_factor(const Token **tokens, Arena *arena, Diagnostics *errors);  // Parses factors (handles numbers, identifiers, parentheses)
+int bind_variables(Expr *expr, const Bindings *bindings, Diagnostics *errors);  // Resolves identifiers to input slots
+void print_diagnostics(FILE *file, const char *input, const Diagnostics *errors);  // Shows errors under the input
+int evaluate_formula(const char *input, const Bindings *bindings, const double *vars, double *result,
+                     Diagnostics *errors);  // Parses and evaluates one formula
+double eval(Expr *expr, const double *vars);  // Evaluates the expression tree
+Expr *optimize(Expr *expr, Arena *arena);  // Folds constants and shares repeated subexpressions
+int bench_vm(const char *input, long iterations);  // Times eval() against the bytecode VM
+int bench_batch(const char *input, long rows);  // Times per-row evaluation against run_batch()
+int bench_optimize(const char *input, long iterations);  // Times a formula before and after optimize()
+int bench_functions(long rows);  // Times the vector kernels of the built-in functions against libm
+int bench_jit(const char *input, long iterations);  // Times a formula as native code against eval() and the VM
+int check_jit(void);  // Compares the native code of a set of formulas with eval()
+int evaluate_columns(const char *input, FILE *data, int gradient);  // Applies a formula to every row of a CSV file
+int bench_gradient(const char *input, long iterations);  // Times run_gradient() against finite differences
+int bench_fuzz(long trees, int depth, unsigned seed);  // Times each phase on random formulas and cross-checks backends
+int evaluate_stream(FILE *input, FILE *output, int worker_count);  // Evaluates one expression per line, in parallel
+void free_tokens(TokenArray *tokens);  // Frees the memory used by the token array
+
+// Built-in functions callable from formulas; the parser resolves names to these indices
+enum { FN_SIN, FN_COS, FN_TAN, FN_EXP, FN_LOG, FN_SQRT, FN_ABS, FN_FLOOR, FN_CEIL, FN_MIN, FN_MAX, FN_POW };
+
+// One built-in function
+typedef struct {
+    const char *name;
+    int arity;                                                // Number of arguments, 1 or 2
+    double (*scalar)(double, double);                         // Used by eval(), run() and constant folding
+    void (*block)(double *restrict a, const double *restrict b);  // a[i] = f(a[i], b[i]) over BATCH_BLOCK rows, or NULL
+    int ulps;                                                 // Largest difference of block from scalar
+    void (*partials)(double x, double y, double value, double *dx, double *dy);  // df/dx and df/dy at (x, y) = value
+} Function;
+
+#define ROUND_MAGIC 0x1.8p52  // x + ROUND_MAGIC - ROUND_MAGIC rounds x to an integer; the low bits of the sum hold it
+
+// Reinterpret a double as its bits and back; compilers turn these into plain register moves
+static inline unsigned long long double_bits(double x) { unsigned long long b; memcpy(&b, &x, sizeof(b)); return b; }
+static inline double bits_double(unsigned long long b) { double x; memcpy(&x, &b, sizeof(x)); return x; }
+
+// Scalar implementations: libm, so eval() and run() stay the reference
+static double call_sin(double x, double y) { (void)y; return sin(x); }
+static double call_cos(double x, double y) { (void)y; return cos(x); }
+static double call_tan(double x, double y) { (void)y; return tan(x); }
+static double call_exp(double x, double y) { (void)y; return exp(x); }
+static double call_log(double x, double y) { (void)y; return log(x); }
+static double call_sqrt(double x, double y) { (void)y; return sqrt(x); }
+static double call_abs(double x, double y) { (void)y; return fabs(x); }
+static double call_floor(double x, double y) { (void)y; return floor(x); }
+static double call_ceil(double x, double y) { (void)y; return ceil(x); }
+static double call_min(double x, double y) { return x < y ? x : y; }  // Same as minsd: a NaN argument gives y
+static double call_max(double x, double y) { return x > y ? x : y; }
+static double call_pow(double x, double y) { return pow(x, y); }
+
+// Partial derivatives, for run_gradient(); value is f(x, y), already computed
+static void partials_sin(double x, double y, double value, double *dx, double *dy) { (void)y; (void)value; *dx = cos(x); *dy = 0; }
+static void partials_cos(double x, double y, double value, double *dx, double *dy) { (void)y; (void)value; *dx = -sin(x); *dy = 0; }
+static void partials_tan(double x, double y, double value, double *dx, double *dy) { (void)x; (void)y; *dx = 1 + value * value; *dy = 0; }
+static void partials_exp(double x, double y, double value, double *dx, double *dy) { (void)x; (void)y; *dx = value; *dy = 0; }
+static void partials_log(double x, double y, double value, double *dx, double *dy) { (void)y; (void)value; *dx = 1 / x; *dy = 0; }
+static void partials_sqrt(double x, double y, double value, double *dx, double *dy) { (void)x; (void)y; *dx = 0.5 / value; *dy = 0; }
+static void partials_abs(double x, double y, double value, double *dx, double *dy) {
+    (void)y;
+    (void)value;
+    *dx = x > 0 ? 1 : x < 0 ? -1 : 0;  // 0 at the kink, like a subgradient
+    *dy = 0;
+}
+static void partials_step(double x, double y, double value, double *dx, double *dy) { (void)x; (void)y; (void)value; *dx = *dy = 0; }
+static void partials_min(double x, double y, double value, double *dx, double *dy) { (void)value; *dx = x < y; *dy = !(x < y); }
+static void partials_max(double x, double y, double value, double *dx, double *dy) { (void)value; *dx = x > y; *dy = !(x > y); }
+static void partials_pow(double x, double y, double value, double *dx, double *dy) {
+    *dx = y == 0 ? 0 : y * pow(x, y - 1);
+    *dy = x > 0 ? value * log(x) : x == 0 && y > 0 ? 0 : NAN;  // Only used when the exponent varies
+}
+
+// Block implementations: branch-free loops over BATCH_BLOCK rows that the compiler vectorises
+// sqrt, abs, min and max give the same bits as the scalar versions; exp, log, sin and cos are within 2 ulp of libm
+// and hand the rare inputs outside their range (huge, subnormal, infinite, NaN) to libm
+static void block_sqrt(double *restrict a, const double *restrict b) {
+    (void)b;
+#if defined(__SSE2__)
+    for (size_t i = 0; i < BATCH_BLOCK; i += 2) _mm_storeu_pd(a + i, _mm_sqrt_pd(_mm_loadu_pd(a + i)));  // sqrt() may set errno, so it would not vectorise
+#else
+    for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = sqrt(a[i]);
+#endif
+}
+
+static void block_abs(double *restrict a, const double *restrict b) {
+    (void)b;
+    for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = fabs(a[i]);
+}
+
+static void block_min(double *restrict a, const double *restrict b) {
+    for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] < b[i] ? a[i] : b[i];
+}
+
+static void block_max(double *restrict a, const double *restrict b) {
+    for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] > b[i] ? a[i] : b[i];
+}
+
+// e^x = 2^n * e^r with n = round(x / ln 2), |r| <= ln 2 / 2 and the series of e^r to degree 12
+static void block_exp(double *restrict a, const double *restrict b) {
+    double in[BATCH_BLOCK];
+    (void)b;
+    memcpy(in, a, sizeof(in));
+    for (size_t i = 0; i < BATCH_BLOCK; i++) {
+        double x = in[i];
+        double t = x * 1.44269504088896338700e+00 + ROUND_MAGIC;
+        double n = t - ROUND_MAGIC;
+        double r = (x - n * 6.93147180369123816490e-01) - n * 1.90821492927058770002e-10;  // ln 2 in two parts
+        double p = 1.0 / 479001600;
+        p = p * r + 1.0 / 39916800;
+        p = p * r + 1.0 / 3628800;
+        p = p * r + 1.0 / 362880;
+        p = p * r + 1.0 / 40320;
+        p = p * r + 1.0 / 5040;
+        p = p * r + 1.0 / 720;
+        p = p * r + 1.0 / 120;
+        p = p * r + 1.0 / 24;
+        p = p * r + 1.0 / 6;
+        p = p * r + 0.5;
+        p = p * r * r + r;
+        a[i] = bits_double(double_bits(1.0 + p) + (double_bits(t) << 52));  // Add n to the exponent
+    }
+    for (size_t i = 0; i < BATCH_BLOCK; i++) {
+        if (!(fabs(in[i]) <= 708)) a[i] = exp(in[i]);  // Overflow, underflow and NaN
+    }
+}
+
+#if defined(__AVX2__)
+// log x = e ln 2 + log m with 2^e m = x, m in [sqrt(1/2), sqrt(2)); log m = 2 atanh(s), s = (m - 1) / (m + 1)
+static void block_log(double *restrict a, const double *restrict b) {
+    double in[BATCH_BLOCK];
+    (void)b;
+    memcpy(in, a, sizeof(in));
+    for (size_t i = 0; i < BATCH_BLOCK; i++) {
+        unsigned long long bits = double_bits(in[i]);
+        unsigned long long big = ((bits & 0x000FFFFFFFFFFFFFULL) + (0x0010000000000000ULL - 0x0006A09E667F3BCDULL)) >> 52;  // Mantissa above sqrt(2)
+        double m = bits_double((bits & 0x000FFFFFFFFFFFFFULL) | ((0x3FFULL - big) << 52));
+        double e = bits_double(((bits >> 52) + big) | 0x4330000000000000ULL) - (0x1p52 + 1023);
+        double f = m - 1;
+        double s = f / (2 + f);
+        double z = s * s;
+        double r = 2.0 / 23;
+        r = r * z + 2.0 / 21;
+        r = r * z + 2.0 / 19;
+        r = r * z + 2.0 / 17;
+        r = r * z + 2.0 / 15;
+        r = r * z + 2.0 / 13;
+        r = r * z + 2.0 / 11;
+        r = r * z + 2.0 / 9;
+        r = r * z + 2.0 / 7;
+        r = r * z + 2.0 / 5;
+        r = r * z + 2.0 / 3;
+        r = r * z;
+        double hfsq = 0.5 * f * f;
+        a[i] = e * 6.93147180369123816490e-01 - ((hfsq - (s * (hfsq + r) + e * 1.90821492927058770002e-10)) - f);
+    }
+    for (size_t i = 0; i < BATCH_BLOCK; i++) {
+        if (!(in[i] >= 0x1p-1022 && in[i] <= 0x1.fffffffffffffp1023)) a[i] = log(in[i]);  // Zero, negative, subnormal, inf, NaN
+    }
+}
+#endif
+
+// sin (quadrant 0) or cos (quadrant 1): x = k pi/2 + y with pi/2 in four parts, then the series of sin y or cos y
+static void block_sincos(double *restrict a, unsigned long long quadrant, double (*fallback)(double)) {
+    double in[BATCH_BLOCK];
+    memcpy(in, a, sizeof(in));
+    for (size_t i = 0; i < BATCH_BLOCK; i++) {
+        double x = in[i];
+        double t = x * 6.36619772367581382433e-01 + ROUND_MAGIC;
+        double k = t - ROUND_MAGIC;
+        double y = x - k * 1.57079632673412561417e+00;  // Exact while |k| < 2^20
+        y = y - k * 6.07710050630396597660e-11;
+        y = y - k * 2.02226624871116645580e-21;
+        y = y - k * 8.47842766036889956997e-32;
+        double z = y * y;
+        double s = -1.0 / 121645100408832000.0;
+        s = s * z + 1.0 / 355687428096000.0;
+        s = s * z - 1.0 / 1307674368000.0;
+        s = s * z + 1.0 / 6227020800.0;
+        s = s * z - 1.0 / 39916800.0;
+        s = s * z + 1.0 / 362880.0;
+        s = s * z - 1.0 / 5040.0;
+        s = s * z + 1.0 / 120.0;
+        s = s * z - 1.0 / 6.0;
+        s = y + y * z * s;
+        double c = 1.0 / 2432902008176640000.0;
+        c = c * z - 1.0 / 6402373705728000.0;
+        c = c * z + 1.0 / 20922789888000.0;
+        c = c * z - 1.0 / 87178291200.0;
+        c = c * z + 1.0 / 479001600.0;
+        c = c * z - 1.0 / 3628800.0;
+        c = c * z + 1.0 / 40320.0;
+        c = c * z - 1.0 / 720.0;
+        c = c * z + 1.0 / 24.0;
+        c = 1.0 - 0.5 * z + z * z * c;
+        unsigned long long q = double_bits(t) + quadrant;  // Low bits of t hold k
+        unsigned long long odd = 0 - (q & 1);              // Odd quadrants take the cosine series
+        a[i] = bits_double(((double_bits(s) & ~odd) | (double_bits(c) & odd)) ^ ((q & 2) << 62));
+    }
+    for (size_t i = 0; i < BATCH_BLOCK; i++) {
+        if (!(fabs(in[i]) <= 0x1p19)) a[i] = fallback(in[i]);  // Large arguments need the full reduction
+    }
+}
+
+static void block_sin(double *restrict a, const double *restrict b) { (void)b; block_sincos(a, 0, sin); }
+static void block_cos(double *restrict a, const double *restrict b) { (void)b; block_sincos(a, 1, cos); }
+
+// Registry, in FN_* order
+static const Function functions[] = {
+    { "sin", 1, call_sin, block_sin, 2, partials_sin },
+    { "cos", 1, call_cos, block_cos, 2, partials_cos },
+    { "tan", 1, call_tan, NULL, 0, partials_tan },
+    { "exp", 1, call_exp, block_exp, 2, partials_exp },
+#if defined(__AVX2__)
+    { "log", 1, call_log, block_log, 1, partials_log },
+#else
+    { "log", 1, call_log, NULL, 0, partials_log },  // glibc's log beats the kernel with only two lanes
+#endif
+    { "sqrt", 1, call_sqrt, block_sqrt, 0, partials_sqrt },
+    { "abs", 1, call_abs, block_abs, 0, partials_abs },
+    { "floor", 1, call_floor, NULL, 0, partials_step },
+    { "ceil", 1, call_ceil, NULL, 0, partials_step },
+    { "min", 2, call_min, block_min, 0, partials_min },
+    { "max", 2, call_max, block_max, 0, partials_max },
+    { "pow", 2, call_pow, NULL, 0, partials_pow },
+};
+
+// Index of the built-in function with this name, or -1
+int find_function(const char *name) {
+    for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+        if (strcmp(functions[i].name, name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// Record a problem at a byte offset of the input
+static void report(Diagnostics *errors, int position, const char *format, ...) {
+    if (errors->count > 0 && errors->count <= MAX_DIAGNOSTICS && errors->items[errors->count - 1].position == position) {
+        return;  // One error per place: the first explains it, the rest are knock-on effects
+    }
+    if (errors->count < MAX_DIAGNOSTICS) {
+        Diagnostic *diagnostic = &errors->items[errors->count];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(diagnostic->message, sizeof(diagnostic->message), format, args);
+        va_end(args);
+        diagnostic->position = position;
+    }
+    errors->count++;
+}
+
+// Print each error with a caret under its column of the input
+void print_diagnostics(FILE *file, const char *input, const Diagnostics *errors) {
+    int length = (int)strcspn(input, "\r\n");
+    fprintf(file, "%.*s\n", length, input);
+    for (int i = 0; i < errors->count && i < MAX_DIAGNOSTICS; i++) {
+        const Diagnostic *diagnostic = &errors->items[i];
+        fprintf(file, "%*s^ column %d: %s\n", diagnostic->position, "", diagnostic->position + 1, diagnostic->message);
+    }
+    if (errors->count > MAX_DIAGNOSTICS) fprintf(file, "and %d more errors\n", errors->count - MAX_DIAGNOSTICS);
+}
+
+// Append a token to the array, doubling its storage when full
+static Token *push_token(TokenArray *tokens) {
+    if (tokens->count == tokens->capacity) {
+        size_t capacity = tokens->capacity ? tokens->capacity * 2 : 64;
+        Token *items = realloc(tokens->items, capacity * sizeof(Token));
+        if (!items) return NULL;
+        tokens->items = items;
+        tokens->capacity = capacity;
+    }
+    return &tokens->items[tokens->count++];
+}
+
+// Lexer Implementation: Tokenizes the input string into a flat token array ending in TOKEN_END
+// Characters that start no token are reported and skipped; returns 0 only when out of memory
+// Identifiers are copied into the arena
+int tokenize(const char *input, TokenArray *tokens, Arena *arena, Diagnostics *errors) {
+    const char *start_of_input = input;
+    tokens->count = 0;  // Reuse the storage of the previous expression
+    while (*input) {  // Iterate over the input string
+        while (isspace(*input)) input++;  // Skip whitespace
+        if (!*input) break;  // Only trailing whitespace was left
+        Token *token = push_token(tokens);  // Claim the next slot of the array
+        if (!token) {
+            report(errors, (int)(input - start_of_input), "out of memory");
+            return 0;
+        }
+        token->position = (int)(input - start_of_input);
+        if (isdigit(*input) || (*input == '.' && isdigit(input[1]))) {  // Handle numbers
+            token->type = TOKEN_NUMBER;
+            token->number = strtod(input, (char **)&input);  // Convert string to double
+        } else if (isalpha(*input)) {  // Handle identifiers
+            const char *start = input;
+            while (isalnum(*input)) input++;  // Read the entire identifier
+            size_t len = input - start;
+            const char *next = input;
+            while (isspace(*next)) next++;
+            token->type = *next == '(' ? TOKEN_FUNC : TOKEN_IDENT;  // A name followed by '(' is a function call
+            token->ident = arena_strndup(arena, start, len);  // Copy the identifier into the arena
+            if (!token->ident) {
+                report(errors, token->position, "out of memory");
+                return 0;
+            }
+        } else if (strchr("+-*/^", *input)) {  // Handle operators
+            token->type = TOKEN_OP;
+            token->op = *input++;
+        } else if (*input == '(') {  // Handle left parentheses
+            token->type = TOKEN_LPAR;
+            input++;
+        } else if (*input == ')') {  // Handle right parentheses
+            token->type = TOKEN_RPAR;
+            input++;
+        } else if (*input == ',') {  // Handle argument separators
+            token->type = TOKEN_COMMA;
+            input++;
+        } else {  // Handle invalid input
+            report(errors, token->position, isprint((unsigned char)*input) ? "unexpected character '%c'" : "unexpected byte 0x%02x",
+                   (unsigned char)*input);
+            tokens->count--;  // Give the slot back
+            input++;
+        }
+    }
+    Token *end = push_token(tokens);  // Terminate the array so the parser never runs off the end
+    if (!end) {
+        report(errors, (int)(input - start_of_input), "out of memory");
+        return 0;
+    }
+    end->type = TOKEN_END;
+    end->position = (int)(input - start_of_input);
+    return 1;
+}
+
+// Allocate a parser node for the token at position; NULL (with a diagnostic) when out of memory
+static Expr *new_node(Arena *arena, Diagnostics *errors, int type, int position) {
+    Expr *node = (Expr *)arena_alloc(arena, sizeof(Expr));
+    if (!node) {
+        report(errors, position, "out of memory");
+        return NULL;
+    }
+    node->type = type;
+    node->position = position;
+    node->uses = 1;  // Parser-built trees are never shared
+    node->height = 1;
+    return node;
+}
+
+// Set the height of a node over its operands (b may be NULL), reporting once when the tree grows past MAX_NESTING;
+// the passes walk the left operand of an operator in a loop, so only its right operand adds a level and a flat chain
+// such as 1+1+...+1 stays at height 2 however long it is
+static void set_height(Expr *node, const Expr *a, const Expr *b, Diagnostics *errors) {
+    if (node->type == OP) node->height = a->height > b->height + 1 ? a->height : b->height + 1;
+    else node->height = (b && b->height > a->height ? b->height : a->height) + 1;
+    if (node->height > MAX_NESTING && a->height <= MAX_NESTING && (!b || b->height <= MAX_NESTING)) {
+        report(errors, node->position, "formula nests deeper than %d levels", MAX_NESTING);
+    }
+}
+
+// Check the parser's own recursion stays under MAX_NESTING before it starts: each open parenthesis or call, and each
+// '^' in a run of powers still being parsed, costs a level; returns 0 (with a diagnostic) when a formula goes deeper
+static int check_nesting(const Token *token, Diagnostics *errors) {
+    int powers[MAX_NESTING + 2];  // '^' in the current run of powers at each open group; groups never pass depth
+    int groups = 0, depth = 0;
+    powers[0] = 0;
+    for (; token->type != TOKEN_END; token++) {
+        if (token->type == TOKEN_LPAR || token->type == TOKEN_FUNC) {
+            if (token->type == TOKEN_FUNC) token++;  // A call's name is always followed by its '('
+            powers[++groups] = 0;
+            depth++;
+        } else if (token->type == TOKEN_RPAR) {
+            if (groups == 0) continue;  // Stray, reported by the parser
+            depth -= 1 + powers[groups--];
+        } else if (token->type == TOKEN_OP && token->op == '^') {
+            powers[groups]++;
+            depth++;
+        } else if (token->type == TOKEN_OP || token->type == TOKEN_COMMA) {
+            depth -= powers[groups];  // Any other operator ends the run
+            powers[groups] = 0;
+        }
+        if (depth > MAX_NESTING) {
+            report(errors, token->position, "formula nests deeper than %d levels", MAX_NESTING);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Stand-in for an operand that could not be parsed, so parsing can go on and find later errors
+static Expr *placeholder(Arena *arena, Diagnostics *errors, int position) {
+    Expr *node = new_node(arena, errors, NUMBER, position);
+    if (node) node->number = NAN;
+    return node;
+}
+
+// Describe a token for diagnostics
+static const char *describe_token(const Token *token, char *buffer, size_t size) {
+    switch (token->type) {
+        case TOKEN_NUMBER: snprintf(buffer, size, "number %g", token->number); break;
+        case TOKEN_IDENT: case TOKEN_FUNC: snprintf(buffer, size, "'%s'", token->ident); break;
+        case TOKEN_OP: snprintf(buffer, size, "'%c'", token->op); break;
+        case TOKEN_LPAR: return "'('";
+        case TOKEN_RPAR: return "')'";
+        case TOKEN_COMMA: return "','";
+        default: return "end of input";
+    }
+    return buffer;
+}
+
+// Expect a ')' closing the '(' at open; reports and carries on as if it were there when it is missing
+static void expect_closing(const Token **tokens, Diagnostics *errors, int open) {
+    if ((*tokens)->type == TOKEN_RPAR) {
+        *tokens = *tokens + 1;
+        return;
+    }
+    char buffer[64];
+    report(errors, (*tokens)->position, "expected ')' to close '(' at column %d, found %s", open + 1,
+           describe_token(*tokens, buffer, sizeof(buffer)));
+}
+
+// Parse a factor (numbers, identifiers, parentheses, or function calls)
+// A missing operand is reported and replaced by a placeholder without consuming the token, so that "1+*2" gives
+// one error and ")" or "," are left for the caller; NULL only when out of memory
+Expr *parse_factor(const Token **tokens, Arena *arena, Diagnostics *errors) {
+    const Token *token = *tokens;  // Get the current token
+    Expr *result;
+    if (token->type == TOKEN_NUMBER) {  // Handle numbers
+        result = new_node(arena, errors, NUMBER, token->position);  // Allocate the expression node from the arena
+        if (!result) return NULL;
+        result->number = token->number;  // Store the number in the expression node
+        *tokens = token + 1;  // Move to the next token
+    } else if (token->type == TOKEN_IDENT) {  // Handle variables
+        result = new_node(arena, errors, IDENT, token->position);
+        if (!result) return NULL;
+        result->ident = token->ident;  // The name already lives in the arena
+        result->slot = -1;  // Not bound until bind_variables()
+        *tokens = token + 1;
+    } else if (token->type == TOKEN_LPAR) {  // Handle parentheses
+        *tokens = token + 1;  // Skip the left parenthesis
+        result = parse_expr(tokens, arena, errors);  // Parse the expression inside the parentheses
+        if (!result) return NULL;
+        expect_closing(tokens, errors, token->position);  // Skip the right parenthesis
+    } else if (token->type == TOKEN_FUNC) {  // Handle function calls, resolved to the registry now
+        int function = find_function(token->ident);
+        if (function < 0) report(errors, token->position, "unknown function '%s'", token->ident);
+        result = new_node(arena, errors, FUNC_CALL, token->position);
+        if (!result) return NULL;
+        result->func_call.fname = token->ident;
+        result->func_call.function = function;
+        result->func_call.arg2 = NULL;
+        *tokens = token + 2;  // Skip the name and the left parenthesis
+        result->func_call.arg = parse_expr(tokens, arena, errors);
+        if (!result->func_call.arg) return NULL;
+        int arguments = 1, arity = function >= 0 ? functions[function].arity : 0;
+        while ((*tokens)->type == TOKEN_COMMA) {  // Parse every argument, even surplus ones, to check them too
+            *tokens = *tokens + 1;
+            Expr *arg = parse_expr(tokens, arena, errors);
+            if (!arg) return NULL;
+            if (++arguments == 2) result->func_call.arg2 = arg;
+        }
+        if (arity && arguments != arity) {
+            report(errors, token->position, "%s takes %d argument%s, not %d", token->ident, arity, arity == 1 ? "" : "s",
+                   arguments);
+        }
+        expect_closing(tokens, errors, token[1].position);
+        if (function < 0 || arguments != arity) result = placeholder(arena, errors, token->position);
+        else set_height(result, result->func_call.arg, result->func_call.arg2, errors);
+    } else {
+        char buffer[64];
+        report(errors, token->position, "expected a number, variable or '(' before %s",
+               describe_token(token, buffer, sizeof(buffer)));
+        result = placeholder(arena, errors, token->position);
+    }
+    return result;
+}
+
+// Parse powers (a factor, optionally raised with ^ to a power); binds tighter than * and / and groups to the right
+Expr *parse_power(const Token **tokens, Arena *arena, Diagnostics *errors) {
+    Expr *result = parse_factor(tokens, arena, errors);  // Parse the base
+    if (result && (*tokens)->type == TOKEN_OP && (*tokens)->op == '^') {
+        Expr *power = new_node(arena, errors, OP, (*tokens)->position);
+        if (!power) return NULL;
+        power->op.op = '^';
+        power->op.left = result;
+        *tokens = *tokens + 1;
+        power->op.right = parse_power(tokens, arena, errors);  // Recurse so 2^3^2 is 2^(3^2)
+        if (power->op.right) set_height(power, result, power->op.right, errors);
+        result = power->op.right ? power : NULL;
+    }
+    return result;
+}
+
+// Parse terms (powers separated by * or /)
+Expr *parse_term(const Token **tokens, Arena *arena, Diagnostics *errors) {
+    Expr *result = parse_power(tokens, arena, errors);  // Parse the first power
+    while (result && (*tokens)->type == TOKEN_OP && ((*tokens)->op == '*' || (*tokens)->op == '/')) {
+        const Token *token = *tokens;
+        Expr *new_result = new_node(arena, errors, OP, token->position);  // Allocate the new expression node from the arena
+        if (!new_result) return NULL;
+        new_result->op.op = token->op;  // Store the operator
+        new_result->op.left = result;  // The left operand is the current result
+        *tokens = token + 1;
+        new_result->op.right = parse_power(tokens, arena, errors);  // Parse the right operand (next power)
+        if (new_result->op.right) set_height(new_result, result, new_result->op.right, errors);
+        result = new_result->op.right ? new_result : NULL;  // Update the result to the new expression
+    }
+    return result;
+}
+
+// Parse expressions (terms separated by + or -)
+Expr *parse_expr(const Token **tokens, Arena *arena, Diagnostics *errors) {
+    Expr *result = parse_term(tokens, arena, errors);  // Parse the first term
+    while (result && (*tokens)->type == TOKEN_OP && ((*tokens)->op == '+' || (*tokens)->op == '-')) {
+        const Token *token = *tokens;
+        Expr *new_result = new_node(arena, errors, OP, token->position);  // Allocate the new expression node from the arena
+        if (!new_result) return NULL;
+        new_result->op.op = token->op;  // Store the operator
+        new_result->op.left = result;  // The left operand is the current result
+        *tokens = token + 1;
+        new_result->op.right = parse_term(tokens, arena, errors);  // Parse the right operand (next term)
+        if (new_result->op.right) set_height(new_result, result, new_result->op.right, errors);
+        result = new_result->op.right ? new_result : NULL;  // Update the result to the new expression
+    }
+    return result;
+}
+
+// Tokenize and parse a whole formula, recovering from errors to report as many as possible
+// Returns the tree, or NULL when errors->count is non-zero
+Expr *parse(const char *input, TokenArray *tokens, Arena *arena, Diagnostics *errors) {
+    errors->count = 0;
+    if (!tokenize(input, tokens, arena, errors) || !check_nesting(tokens->items, errors)) return NULL;
+    const Token *token = tokens->items;
+    Expr *expr = parse_expr(&token, arena, errors);
+    while (expr && token->type != TOKEN_END) {  // Something is left over after a complete expression
+        char buffer[64];
+        if (token->type == TOKEN_RPAR || token->type == TOKEN_COMMA) {
+            report(errors, token->position, "unexpected %s", describe_token(token, buffer, sizeof(buffer)));
+            token++;
+            if (token->type == TOKEN_OP) token++;  // Its operator belongs to the stray group, as in "(1+2))*3"
+            if (token->type == TOKEN_END) break;
+        } else {
+            report(errors, token->position, "expected an operator before %s", describe_token(token, buffer, sizeof(buffer)));
+        }
+        expr = parse_expr(&token, arena, errors);  // Parse on to find later errors
+    }
+    int kept = errors->count < MAX_DIAGNOSTICS ? errors->count : MAX_DIAGNOSTICS;
+    for (int i = 1; i < kept; i++) {  // Lexer errors come first; show everything in input order
+        Diagnostic diagnostic = errors->items[i];
+        int j = i;
+        for (; j > 0 && errors->items[j - 1].position > diagnostic.position; j--) errors->items[j] = errors->items[j - 1];
+        errors->items[j] = diagnostic;
+    }
+    return errors->count ? NULL : expr;
+}
+
+#define SPINE_BUFFER 64  // Spine entries a pass keeps on the C stack before it moves them to the heap
+
+// Operators down the left spine of a chain such as a+b-c, which parses as ((a+b)-c): the passes push the spine here,
+// handle its bottom operand and then pop the operators back up, so a chain's length costs no C stack
+typedef struct {
+    Expr **items;     // Starts as a SPINE_BUFFER array of the caller's
+    size_t count;     // Entries in use
+    size_t capacity;  // Entries allocated
+    int on_heap;      // Whether items has been moved to the heap
+} ExprStack;
+
+// Push one node, growing the stack when it is full; returns 0 when out of memory
+static int push_expr(ExprStack *stack, Expr *expr) {
+    if (stack->count == stack->capacity) {
+        size_t capacity = stack->capacity * 2;
+        Expr **items = stack->on_heap ? realloc(stack->items, capacity * sizeof(Expr *)) : malloc(capacity * sizeof(Expr *));
+        if (!items) return 0;
+        if (!stack->on_heap) memcpy(items, stack->items, stack->count * sizeof(Expr *));
+        stack->items = items;
+        stack->capacity = capacity;
+        stack->on_heap = 1;
+    }
+    stack->items[stack->count++] = expr;
+    return 1;
+}
+
+// Push expr and every operator below it on its left spine
+// Returns the operand at the bottom of the spine (never an operator), or NULL when out of memory
+static Expr *push_spine(ExprStack *stack, Expr *expr) {
+    for (; expr->type == OP; expr = expr->op.left) {
+        if (!push_expr(stack, expr)) return NULL;
+    }
+    return expr;
+}
+
+// Free the heap part of a stack
+static void free_stack(ExprStack *stack) {
+    if (stack->on_heap) free(stack->items);
+}
+
+// Bind one subtree; right operands are bound from the bottom of each spine up, so errors come in input order
+static int bind_node(Expr *expr, const Bindings *bindings, Diagnostics *errors, ExprStack *stack) {
+    size_t base = stack->count;
+    Expr *leaf = push_spine(stack, expr);
+    if (!leaf) {
+        stack->count = base;
+        report(errors, expr->position, "out of memory");
+        return 0;
+    }
+    int bound = 1;
+    switch (leaf->type) {
+        case IDENT:
+            bound = 0;
+            for (int i = 0; i < bindings->count && !bound; i++) {
+                if (strcmp(bindings->names[i], leaf->ident) == 0) {
+                    leaf->slot = i;
+                    bound = 1;
+                }
+            }
+            if (!bound) report(errors, leaf->position, "unknown variable '%s'", leaf->ident);
+            break;
+        case FUNC_CALL: {
+            int arg = bind_node(leaf->func_call.arg, bindings, errors, stack);
+            bound = (!leaf->func_call.arg2 || bind_node(leaf->func_call.arg2, bindings, errors, stack)) && arg;
+            break;
+        }
+        default:
+            break;
+    }
+    while (stack->count > base) {
+        Expr *node = stack->items[--stack->count];
+        bound = bind_node(node->op.right, bindings, errors, stack) && bound;
+    }
+    return bound;
+}
+
+// Give every identifier in the tree the slot of the input with the same name
+// Returns 0 if any is unbound; all of them are reported
+int bind_variables(Expr *expr, const Bindings *bindings, Diagnostics *errors) {
+    Expr *buffer[SPINE_BUFFER];
+    ExprStack stack = { buffer, 0, SPINE_BUFFER, 0 };
+    int bound = bind_node(expr, bindings, errors, &stack);
+    free_stack(&stack);
+    return bound;
+}
+
+// Evaluate one subtree: the bottom operand of its left spine, then each operator on the way back up
+static double eval_node(Expr *expr, const double *vars, ExprStack *stack) {
+    size_t base = stack->count;
+    Expr *leaf = push_spine(stack, expr);
+    if (!leaf) {
+        stack->count = base;
+        return NAN;  // Out of memory
+    }
+    double value;
+    switch (leaf->type) {
+        case NUMBER: value = leaf->number; break;  // Return the number if it's a number node
+        case IDENT: value = vars[leaf->slot]; break;  // Return the input bound to the variable
+        case FUNC_CALL: {
+            const Function *function = &functions[leaf->func_call.function];  // Resolved by the parser
+            double x = eval_node(leaf->func_call.arg, vars, stack);
+            value = function->scalar(x, function->arity == 2 ? eval_node(leaf->func_call.arg2, vars, stack) : 0);
+            break;
+        }
+        default: value = NAN; break;  // The parser builds no other node types
+    }
+    while (stack->count > base) {
+        Expr *node = stack->items[--stack->count];
+        double right = eval_node(node->op.right, vars, stack);  // Evaluate the right operand
+        switch (node->op.op) {  // Perform the operation based on the operator
+            case '+': value += right; break;
+            case '-': value -= right; break;
+            case '*': value *= right; break;
+            case '/': value /= right; break;
+            case '^': value = pow(value, right); break;  // Handle exponentiation
+            default: value = NAN; break;  // The parser builds no other operator
+        }
+    }
+    return value;
+}
+
+// Evaluate the expression tree; vars holds the value of each bound input slot
+double eval(Expr *expr, const double *vars) {
+    Expr *buffer[SPINE_BUFFER];
+    ExprStack stack = { buffer, 0, SPINE_BUFFER, 0 };
+    double value = eval_node(expr, vars, &stack);
+    free_stack(&stack);
+    return value;
+}
+
+// Table of the distinct nodes built by optimize(), keyed by their contents
+typedef struct {
+    Expr **slots;     // Open addressing, NULL when free
+    size_t capacity;  // Power of two
+    size_t count;     // Nodes stored
+} ConsTable;
+
+// Hash of a node's contents; children are already unique so their addresses stand for them
+static size_t hash_node(const Expr *expr) {
+    unsigned long long h = (unsigned long long)expr->type * 0x9E3779B97F4A7C15ULL, bits = 0;
+    switch (expr->type) {
+        case NUMBER: memcpy(&bits, &expr->number, sizeof(bits)); break;  // By bits, so -0 and 0 stay apart
+        case IDENT: bits = (unsigned long long)expr->slot; break;
+        case OP: bits = (unsigned long long)(size_t)expr->op.left * 31 + (size_t)expr->op.right * 17 + expr->op.op; break;
+        case FUNC_CALL:
+            bits = (unsigned long long)(size_t)expr->func_call.arg * 31 + (size_t)expr->func_call.arg2 * 17 + expr->func_call.function;
+            break;
+        default: bits = (unsigned long long)(size_t)expr; break;  // Never shared
+    }
+    h = (h ^ bits) * 0xBF58476D1CE4E5B9ULL;
+    return (size_t)(h ^ (h >> 31));
+}
+
+// Whether two nodes compute the same value from the same (unique) children
+static int same_node(const Expr *a, const Expr *b) {
+    if (a->type != b->type) return 0;
+    switch (a->type) {
+        case NUMBER: return memcmp(&a->number, &b->number, sizeof(double)) == 0;
+        case IDENT: return a->slot == b->slot && strcmp(a->ident, b->ident) == 0;
+        case OP: return a->op.op == b->op.op && a->op.left == b->op.left && a->op.right == b->op.right;
+        case FUNC_CALL:
+            return a->func_call.function == b->func_call.function && a->func_call.arg == b->func_call.arg &&
+                   a->func_call.arg2 == b->func_call.arg2;
+        default: return a == b;
+    }
+}
+
+// Return the unique node equal to node, copying it into the arena the first time it is seen
+static Expr *intern(ConsTable *table, Arena *arena, const Expr *node) {
+    if (table->count * 2 >= table->capacity) {  // Keep the table at most half full
+        size_t capacity = table->capacity ? table->capacity * 2 : 64;
+        Expr **slots = calloc(capacity, sizeof(Expr *));
+        if (!slots) return NULL;
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (!table->slots[i]) continue;
+            size_t j = hash_node(table->slots[i]) & (capacity - 1);
+            while (slots[j]) j = (j + 1) & (capacity - 1);
+            slots[j] = table->slots[i];
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->capacity = capacity;
+    }
+    size_t i = hash_node(node) & (table->capacity - 1);
+    for (; table->slots[i]; i = (i + 1) & (table->capacity - 1)) {
+        if (same_node(table->slots[i], node)) return table->slots[i];  // Already built: share it
+    }
+    Expr *copy = arena_alloc(arena, sizeof(Expr));
+    if (!copy) return NULL;
+    *copy = *node;
+    copy->uses = 0;
+    if (copy->type == OP) {  // Count the references to the children
+        copy->op.left->uses++;
+        copy->op.right->uses++;
+    } else if (copy->type == FUNC_CALL) {
+        copy->func_call.arg->uses++;
+        if (copy->func_call.arg2) copy->func_call.arg2->uses++;
+    }
+    table->slots[i] = copy;
+    table->count++;
+    return copy;
+}
+
+// Whether expr is the number value, compared by bits
+static int is_number(const Expr *expr, double value) {
+    return expr->type == NUMBER && memcmp(&expr->number, &value, sizeof(double)) == 0;
+}
+
+// Whether value is plus or minus a power of two, so that its reciprocal is exact
+static int is_power_of_two(double value) {
+    int exponent;
+    return value != 0 && isfinite(value) && fabs(frexp(value, &exponent)) == 0.5;
+}
+
+static Expr *simplify(ConsTable *table, Arena *arena, Expr *expr, ExprStack *stack);
+
+// Rebuild one function call, folding it when every argument is a constant
+static Expr *simplify_call(ConsTable *table, Arena *arena, Expr *expr, ExprStack *stack) {
+    const Function *function = &functions[expr->func_call.function];
+    Expr node = *expr;
+    node.func_call.arg = simplify(table, arena, expr->func_call.arg, stack);
+    if (!node.func_call.arg) return NULL;
+    if (node.func_call.arg2) {
+        node.func_call.arg2 = simplify(table, arena, expr->func_call.arg2, stack);
+        if (!node.func_call.arg2) return NULL;
+    }
+    if (node.func_call.arg->type == NUMBER && (!node.func_call.arg2 || node.func_call.arg2->type == NUMBER)) {
+        Expr folded = { .type = NUMBER };  // Fold with the scalar function eval() uses
+        folded.number = function->scalar(node.func_call.arg->number, node.func_call.arg2 ? node.func_call.arg2->number : 0);
+        return intern(table, arena, &folded);
+    }
+    return intern(table, arena, &node);
+}
+
+// Rebuild one operator node over its rebuilt operands: fold constants, apply exact identities and share equal nodes
+static Expr *simplify_op(ConsTable *table, Arena *arena, Expr *expr, Expr *left, Expr *right) {
+    char op = expr->op.op;
+    Expr node = *expr;
+    node.op.left = left;
+    node.op.right = right;
+
+    if (left->type == NUMBER && right->type == NUMBER) {  // Fold with the same operations eval() uses
+        double a = left->number, b = right->number;
+        node.type = NUMBER;
+        switch (op) {
+            case '+': node.number = a + b; break;
+            case '-': node.number = a - b; break;
+            case '*': node.number = a * b; break;
+            case '/': node.number = a / b; break;  // 1/0 and 0/0 fold to inf and NaN as they would evaluate
+            case '^': node.number = pow(a, b); break;
+            default: node.type = OP; break;
+        }
+        return intern(table, arena, &node);
+    }
+    // Only identities that give the same bits for every input, NaN, infinities and -0 included;
+    // x+0 (-0+0 is +0), x*0, x-x and x/x are deliberately left alone
+    if (op == '*' && is_number(right, 1.0)) return left;
+    if (op == '*' && is_number(left, 1.0)) return right;
+    if (op == '/' && is_number(right, 1.0)) return left;
+    if (op == '-' && is_number(right, 0.0)) return left;
+    if (op == '+' && is_number(right, -0.0)) return left;
+    if (op == '+' && is_number(left, -0.0)) return right;
+    if (op == '^' && is_number(right, 1.0)) return left;
+    if (op == '^' && (is_number(right, 0.0) || is_number(right, -0.0))) {  // pow(x, 0) is 1 even for NaN
+        Expr one = { .type = NUMBER, .number = 1.0 };
+        return intern(table, arena, &one);
+    }
+    if (op == '^' && is_number(right, 2.0)) {  // x*x is correctly rounded; pow() may differ by an ulp
+        node.op.op = '*';
+        node.op.right = left;
+    } else if (op == '/' && right->type == NUMBER && is_power_of_two(right->number) && isfinite(1 / right->number)) {
+        // Dividing by a power of two is the same as multiplying by its exact reciprocal
+        Expr reciprocal = { .type = NUMBER, .number = 1 / right->number };
+        node.op.op = '*';
+        node.op.right = intern(table, arena, &reciprocal);
+        if (!node.op.right) return NULL;
+    }
+    return intern(table, arena, &node);
+}
+
+// Rebuild one subtree: the bottom operand of its left spine, then each operator on the way back up
+static Expr *simplify(ConsTable *table, Arena *arena, Expr *expr, ExprStack *stack) {
+    size_t base = stack->count;
+    Expr *left = push_spine(stack, expr);
+    if (left && left->type == FUNC_CALL) left = simplify_call(table, arena, left, stack);
+    else if (left) left = intern(table, arena, left);
+    while (left && stack->count > base) {
+        Expr *node = stack->items[--stack->count];
+        Expr *right = simplify(table, arena, node->op.right, stack);
+        left = right ? simplify_op(table, arena, node, left, right) : NULL;
+    }
+    stack->count = base;
+    return left;
+}
+
+// Optimise an expression into a DAG: constant subtrees are folded, exact identities applied and identical
+// subexpressions built once, so compile() evaluates each of them a single time
+// Returns the new root (allocated in the arena, the old tree stays valid) or NULL when out of memory
+Expr *optimize(Expr *expr, Arena *arena) {
+    ConsTable table = { NULL, 0, 0 };
+    Expr *buffer[SPINE_BUFFER];
+    ExprStack stack = { buffer, 0, SPINE_BUFFER, 0 };
+    Expr *root = simplify(&table, arena, expr, &stack);
+    if (root) root->uses++;  // Referenced by the program itself
+    free_stack(&stack);
+    free(table.slots);
+    return root;
+}
+
+// Bytecode instructions of the expression VM (a stack machine that keeps the top of stack in a register)
+typedef enum {
+    OP_CONST,      // Push value
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,  // Pop right and left, push the result
+    OP_ADD_CONST, OP_SUB_CONST, OP_MUL_CONST, OP_DIV_CONST, OP_POW_CONST,  // Top = top <op> value
+    OP_VAR,        // Push the input in slot
+    OP_ADD_VAR, OP_SUB_VAR, OP_MUL_VAR, OP_DIV_VAR, OP_POW_VAR,  // Top = top <op> input in slot
+    OP_STORE,      // Save the top in temporary slot for later OP_LOADs
+    OP_LOAD,       // Push temporary slot
+    OP_SQRT, OP_ABS,  // Top = f(top); slot holds the function for run_batch() and run_gradient()
+    OP_MIN, OP_MAX,   // Pop right, top = f(top, right)
+    OP_CALL,       // Top = functions[slot](top)
+    OP_CALL2,      // Pop right, top = functions[slot](top, right)
+    OP_RETURN      // Stop and return the top
+} Opcode;
+
+// One instruction; constants are stored inline next to their opcode
+typedef struct {
+    int op;        // Opcode
+    int slot;      // Input slot of OP_VAR and the *_VAR forms, temporary of OP_STORE/OP_LOAD, function of the calls
+    double value;  // Operand of OP_CONST and the *_CONST forms
+} Instr;
+
+#define VM_STACK_SIZE 256  // Deepest operand stack a compiled program may use
+#define VM_MAX_TEMPS 256   // Shared subexpressions kept in temporaries; more are recomputed
+
+// Compiled form of an expression
+typedef struct {
+    Instr *code;      // Instructions ending in OP_RETURN
+    size_t count;     // Instructions in use
+    size_t capacity;  // Instructions allocated
+    int depth;        // Current stack depth while compiling
+    int max_depth;    // Deepest stack the program reaches
+    int temps;        // Temporaries in use, one per shared subexpression
+    Expr *shared[VM_MAX_TEMPS];  // Shared node held by each temporary
+} Program;
+
+// Append one instruction to the program
+static int emit(Program *program, int op, int slot, double value) {
+    if (program->count == program->capacity) {
+        size_t capacity = program->capacity ? program->capacity * 2 : 32;
+        Instr *code = realloc(program->code, capacity * sizeof(Instr));
+        if (!code) return 0;
+        program->code = code;
+        program->capacity = capacity;
+    }
+    program->code[program->count].op = op;
+    program->code[program->count].slot = slot;
+    program->code[program->count].value = value;
+    program->count++;
+    return 1;
+}
+
+// Make room for one more value on the VM stack; returns 0 when the program would overflow it
+static int push_depth(Program *program) {
+    if (++program->depth > VM_STACK_SIZE) return 0;  // Too deep for the VM stack
+    if (program->depth > program->max_depth) program->max_depth = program->depth;
+    return 1;
+}
+
+// Temporary already holding the value of a shared subexpression, or -1
+static int find_temp(const Program *program, const Expr *expr) {
+    if (expr->uses > 1) {
+        for (int i = 0; i < program->temps; i++) {
+            if (program->shared[i] == expr) return i;
+        }
+    }
+    return -1;
+}
+
+// Keep the value just computed for a shared subexpression in a temporary, while there are free ones, for its later uses
+static int store_shared(Program *program, Expr *expr) {
+    if (expr->uses <= 1 || program->temps == VM_MAX_TEMPS) return 1;  // Not shared, or recomputed from here on
+    program->shared[program->temps] = expr;
+    return emit(program, OP_STORE, program->temps++, 0);
+}
+
+static int compile_node(Program *program, Expr *expr, ExprStack *stack);
+
+// Emit the code of a function call and its arguments
+static int compile_call(Program *program, Expr *expr, ExprStack *stack) {
+    int function = expr->func_call.function, op;
+    switch (function) {  // The cheap functions get their own opcode, the rest go through the registry
+        case FN_SQRT: op = OP_SQRT; break;
+        case FN_ABS: op = OP_ABS; break;
+        case FN_MIN: op = OP_MIN; break;
+        case FN_MAX: op = OP_MAX; break;
+        default: op = functions[function].arity == 2 ? OP_CALL2 : OP_CALL; break;
+    }
+    if (!compile_node(program, expr->func_call.arg, stack)) return 0;
+    if (expr->func_call.arg2) {
+        if (!compile_node(program, expr->func_call.arg2, stack)) return 0;
+        program->depth--;
+    }
+    return emit(program, op, function, 0);
+}
+
+// Emit the right operand and the instruction of one operator whose left operand is already on the stack
+static int compile_operation(Program *program, Expr *expr, ExprStack *stack) {
+    int op;
+    switch (expr->op.op) {  // Map the operator to its opcode
+        case '+': op = OP_ADD; break;
+        case '-': op = OP_SUB; break;
+        case '*': op = OP_MUL; break;
+        case '/': op = OP_DIV; break;
+        case '^': op = OP_POW; break;
+        default: return 0;
+    }
+    if (expr->op.right->type == NUMBER) {  // Fold the constant into the instruction
+        return emit(program, op - OP_ADD + OP_ADD_CONST, 0, expr->op.right->number);
+    }
+    if (expr->op.right->type == IDENT) {  // Read the input straight from its slot
+        return expr->op.right->slot >= 0 && emit(program, op - OP_ADD + OP_ADD_VAR, expr->op.right->slot, 0);
+    }
+    if (!compile_node(program, expr->op.right, stack)) return 0;
+    program->depth--;  // Two operands become one result
+    return emit(program, op, 0, 0);
+}
+
+// Emit the code of one subtree in postfix order; a constant or variable right operand is fused into the instruction
+// Operators down the left spine are pushed until one already held in a temporary, and emitted on the way back up
+static int compile_node(Program *program, Expr *expr, ExprStack *stack) {
+    size_t base = stack->count;
+    int ok = 1;
+    while (ok && expr->type == OP && find_temp(program, expr) < 0) {
+        ok = push_expr(stack, expr);
+        expr = expr->op.left;
+    }
+    if (!ok) {
+        stack->count = base;
+        return 0;  // Out of memory
+    }
+    int temp = find_temp(program, expr);
+    if (temp >= 0) {  // Shared subexpression computed before: reload it
+        ok = push_depth(program) && emit(program, OP_LOAD, temp, 0);
+    } else if (expr->type == NUMBER || expr->type == IDENT) {
+        ok = push_depth(program);
+        if (ok && expr->type == IDENT) ok = expr->slot >= 0 && emit(program, OP_VAR, expr->slot, 0);
+        else if (ok) ok = emit(program, OP_CONST, 0, expr->number);
+    } else if (expr->type == FUNC_CALL) {
+        ok = compile_call(program, expr, stack) && store_shared(program, expr);
+    } else {
+        ok = 0;  // Not supported by the VM; the caller keeps using eval()
+    }
+    while (ok && stack->count > base) {
+        Expr *node = stack->items[--stack->count];
+        ok = compile_operation(program, node, stack) && store_shared(program, node);
+    }
+    stack->count = base;
+    return ok;
+}
+
+// Compile an expression tree or optimised DAG into bytecode; returns 0 if it cannot be compiled
+int compile(Expr *expr, Program *program) {
+    Expr *buffer[SPINE_BUFFER];
+    ExprStack stack = { buffer, 0, SPINE_BUFFER, 0 };
+    program->count = 0;  // Reuse the storage of a previous program
+    program->depth = program->max_depth = program->temps = 0;
+    int ok = compile_node(program, expr, &stack) && emit(program, OP_RETURN, 0, 0);
+    free_stack(&stack);
+    return ok;
+}
+
+// Free the memory used by a program
+void free_program(Program *program) {
+    free(program->code);
+    program->code = NULL;
+    program->count = program->capacity = 0;
+}
+
+// Run a compiled program with the given inputs; dispatch jumps straight from one handler to the next
+double run(const Program *program, const double *vars) {
+    double stack[VM_STACK_SIZE];  // Operands below the top
+    double *sp = stack;           // Next free slot
+    double top = 0;               // Top of stack, kept in a register
+    double temps[VM_MAX_TEMPS];   // Values of shared subexpressions
+    const Instr *ip = program->code;
+#if defined(__GNUC__)
+    static void *const handlers[] = {
+        &&do_const, &&do_add, &&do_sub, &&do_mul, &&do_div, &&do_pow,
+        &&do_add_const, &&do_sub_const, &&do_mul_const, &&do_div_const, &&do_pow_const,
+        &&do_var, &&do_add_var, &&do_sub_var, &&do_mul_var, &&do_div_var, &&do_pow_var,
+        &&do_store, &&do_load,
+        &&do_sqrt, &&do_abs, &&do_min, &&do_max, &&do_call, &&do_call2,
+        &&do_return
+    };
+#define DISPATCH() goto *handlers[ip->op]
+#define HANDLER(name, opcode) do_##name
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+    DISPATCH();
+#else
+#define HANDLER(name, opcode) case opcode
+#define NEXT() do { ip++; goto dispatch; } while (0)
+dispatch:
+    switch (ip->op) {
+#endif
+    HANDLER(const, OP_CONST): *sp++ = top; top = ip->value; NEXT();
+    HANDLER(add, OP_ADD): top = *--sp + top; NEXT();
+    HANDLER(sub, OP_SUB): top = *--sp - top; NEXT();
+    HANDLER(mul, OP_MUL): top = *--sp * top; NEXT();
+    HANDLER(div, OP_DIV): top = *--sp / top; NEXT();
+    HANDLER(pow, OP_POW): top = pow(*--sp, top); NEXT();
+    HANDLER(add_const, OP_ADD_CONST): top = top + ip->value; NEXT();
+    HANDLER(sub_const, OP_SUB_CONST): top = top - ip->value; NEXT();
+    HANDLER(mul_const, OP_MUL_CONST): top = top * ip->value; NEXT();
+    HANDLER(div_const, OP_DIV_CONST): top = top / ip->value; NEXT();
+    HANDLER(pow_const, OP_POW_CONST): top = pow(top, ip->value); NEXT();
+    HANDLER(var, OP_VAR): *sp++ = top; top = vars[ip->slot]; NEXT();
+    HANDLER(add_var, OP_ADD_VAR): top = top + vars[ip->slot]; NEXT();
+    HANDLER(sub_var, OP_SUB_VAR): top = top - vars[ip->slot]; NEXT();
+    HANDLER(mul_var, OP_MUL_VAR): top = top * vars[ip->slot]; NEXT();
+    HANDLER(div_var, OP_DIV_VAR): top = top / vars[ip->slot]; NEXT();
+    HANDLER(pow_var, OP_POW_VAR): top = pow(top, vars[ip->slot]); NEXT();
+    HANDLER(store, OP_STORE): temps[ip->slot] = top; NEXT();
+    HANDLER(load, OP_LOAD): *sp++ = top; top = temps[ip->slot]; NEXT();
+    HANDLER(sqrt, OP_SQRT): top = sqrt(top); NEXT();
+    HANDLER(abs, OP_ABS): top = fabs(top); NEXT();
+    HANDLER(min, OP_MIN): { double left = *--sp; top = left < top ? left : top; } NEXT();
+    HANDLER(max, OP_MAX): { double left = *--sp; top = left > top ? left : top; } NEXT();
+    HANDLER(call, OP_CALL): top = functions[ip->slot].scalar(top, 0); NEXT();
+    HANDLER(call2, OP_CALL2): { double left = *--sp; top = functions[ip->slot].scalar(left, top); } NEXT();
+    HANDLER(return, OP_RETURN): return top;
+#if !defined(__GNUC__)
+    }
+    return top;
+#endif
+#undef DISPATCH
+#undef HANDLER
+#undef NEXT
+}
+
+// Apply one binary operator to a whole block: a[i] = a[i] <op> b[i]
+// The trip count is the constant BATCH_BLOCK so the compiler vectorises these loops even at -O2
+static void block_op(int op, double *restrict a, const double *restrict b) {
+    switch (op) {
+        case OP_ADD: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] + b[i]; break;
+        case OP_SUB: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] - b[i]; break;
+        case OP_MUL: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] * b[i]; break;
+        case OP_DIV: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] / b[i]; break;
+        default: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = pow(a[i], b[i]); break;
+    }
+}
+
+// Same as block_op() with a constant right operand
+static void block_op_const(int op, double *restrict a, double b) {
+    switch (op) {
+        case OP_ADD: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] + b; break;
+        case OP_SUB: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] - b; break;
+        case OP_MUL: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] * b; break;
+        case OP_DIV: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = a[i] / b; break;
+        default: for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = pow(a[i], b); break;
+    }
+}
+
+// Apply a built-in function to a whole block, with its vector kernel when it has one; b is NULL for one argument
+static void call_block(const Function *function, double *restrict a, const double *restrict b) {
+    if (function->block) {
+        function->block(a, b);
+    } else if (b) {
+        for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = function->scalar(a[i], b[i]);
+    } else {
+        for (size_t i = 0; i < BATCH_BLOCK; i++) a[i] = function->scalar(a[i], 0);
+    }
+}
+
+// Evaluate a program for rows [0, rows): columns[slot][row] is the input, out[row] receives the result
+// Each instruction runs over BATCH_BLOCK rows before the next one, so dispatch is paid once per block
+int run_batch(const Program *program, const double *const *columns, size_t rows, double *out) {
+    int slots = 0;  // Inputs the program reads
+    for (const Instr *ip = program->code; ip->op != OP_RETURN; ip++) {
+        if (ip->op >= OP_VAR && ip->op <= OP_POW_VAR && ip->slot >= slots) slots = ip->slot + 1;
+    }
+    // One block per stack level, per temporary and for a zero-padded copy of each input for the last, partial block
+    size_t blocks = (size_t)program->max_depth + 1 + program->temps + slots;
+    double *stack = malloc(blocks * BATCH_BLOCK * sizeof(double));
+    if (!stack) return 0;
+    double *temps = stack + (size_t)(program->max_depth + 1) * BATCH_BLOCK;
+    double *tail = temps + (size_t)program->temps * BATCH_BLOCK;
+    const double *inputs[MAX_VARIABLES];  // Current block of each input
+
+    for (size_t base = 0; base < rows; base += BATCH_BLOCK) {
+        size_t n = rows - base < BATCH_BLOCK ? rows - base : BATCH_BLOCK;
+        for (int s = 0; s < slots; s++) {
+            if (n == BATCH_BLOCK) {
+                inputs[s] = columns[s] + base;
+            } else {
+                memcpy(tail + s * BATCH_BLOCK, columns[s] + base, n * sizeof(double));
+                memset(tail + s * BATCH_BLOCK + n, 0, (BATCH_BLOCK - n) * sizeof(double));
+                inputs[s] = tail + s * BATCH_BLOCK;
+            }
+        }
+        double *top = stack;  // Block at the top of the stack; stack[0] stays a scratch block below it
+        for (const Instr *ip = program->code; ip->op != OP_RETURN; ip++) {
+            switch (ip->op) {
+                case OP_CONST:
+                    top += BATCH_BLOCK;
+                    for (size_t i = 0; i < BATCH_BLOCK; i++) top[i] = ip->value;
+                    break;
+                case OP_VAR:
+                    top += BATCH_BLOCK;
+                    memcpy(top, inputs[ip->slot], BATCH_BLOCK * sizeof(double));
+                    break;
+                case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+                    top -= BATCH_BLOCK;
+                    block_op(ip->op, top, top + BATCH_BLOCK);
+                    break;
+                case OP_ADD_CONST: case OP_SUB_CONST: case OP_MUL_CONST: case OP_DIV_CONST: case OP_POW_CONST:
+                    block_op_const(ip->op - OP_ADD_CONST + OP_ADD, top, ip->value);
+                    break;
+                case OP_STORE:
+                    memcpy(temps + ip->slot * BATCH_BLOCK, top, BATCH_BLOCK * sizeof(double));
+                    break;
+                case OP_LOAD:
+                    top += BATCH_BLOCK;
+                    memcpy(top, temps + ip->slot * BATCH_BLOCK, BATCH_BLOCK * sizeof(double));
+                    break;
+                case OP_SQRT: case OP_ABS: case OP_CALL:
+                    call_block(&functions[ip->slot], top, NULL);
+                    break;
+                case OP_MIN: case OP_MAX: case OP_CALL2:
+                    top -= BATCH_BLOCK;
+                    call_block(&functions[ip->slot], top, top + BATCH_BLOCK);
+                    break;
+                default:  // The *_VAR forms
+                    block_op(ip->op - OP_ADD_VAR + OP_ADD, top, inputs[ip->slot]);
+                    break;
+            }
+        }
+        memcpy(out + base, top, n * sizeof(double));
+    }
+    free(stack);
+    return 1;
+}
+
+#define GRADIENT_LOCAL 2048  // Doubles of dual-number workspace run_gradient() keeps on the stack
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+// product, or +0 when tangent is zero, so an input that does not reach an operand (a constant exponent, the unused
+// side of min) cannot poison the derivative with an infinite or NaN partial; a bit mask rather than a branch, as
+// the zero pattern changes from one instruction to the next
+static ALWAYS_INLINE double unless_zero(double tangent, double product) {
+    return bits_double(double_bits(product) & (0 - (unsigned long long)(tangent != 0)));
+}
+
+// Value and partials of a binary opcode (OP_ADD..OP_POW, OP_MIN, OP_MAX, OP_CALL2), computed exactly as run() does
+static ALWAYS_INLINE double dual_binary(const Instr *ip, int op, double x, double y, double *dx, double *dy) {
+    double value;
+    switch (op) {
+        case OP_ADD: value = x + y; *dx = 1; *dy = 1; break;
+        case OP_SUB: value = x - y; *dx = 1; *dy = -1; break;
+        case OP_MUL: value = x * y; *dx = y; *dy = x; break;
+        case OP_DIV: value = x / y; *dx = 1 / y; *dy = -value / y; break;
+        case OP_POW: value = pow(x, y); partials_pow(x, y, value, dx, dy); break;
+        case OP_MIN: value = x < y ? x : y; partials_min(x, y, value, dx, dy); break;
+        case OP_MAX: value = x > y ? x : y; partials_max(x, y, value, dx, dy); break;
+        default: value = functions[ip->slot].scalar(x, y); functions[ip->slot].partials(x, y, value, dx, dy); break;
+    }
+    return value;
+}
+
+#define GRADIENT_WIDTH 8  // Tangent lanes kept in registers; more inputs take the general path
+
+// One dual-number pass over the program, shaped like run(): the top value and its tangent (width lanes, at least
+// one per input) stay in locals while the levels below live in separate value and tangent stacks
+// Inlined with a constant width so the lane loops unroll; returns the value and leaves the gradient in gradient
+static ALWAYS_INLINE double gradient_pass(const Program *program, const double *vars, double *values, double *tangents,
+                                          size_t width, double *gradient) {
+    double *temp_values = values + program->max_depth + 1, *temp_tangents = tangents + ((size_t)program->max_depth + 1) * width;
+    double value = 0, tangent[GRADIENT_WIDTH] = { 0 }, *top = width <= GRADIENT_WIDTH ? tangent : gradient;
+    size_t level = 0;  // Levels below the top in use
+    for (const Instr *ip = program->code; ip->op != OP_RETURN; ip++) {
+        int op = ip->op;
+        double dx, dy;
+        switch (op) {
+            case OP_CONST: case OP_VAR: case OP_LOAD:  // Push: the old top goes down a level
+                values[level] = value;
+                for (size_t i = 0; i < width; i++) tangents[level * width + i] = top[i];
+                level++;
+                if (op == OP_LOAD) {
+                    value = temp_values[ip->slot];
+                    for (size_t i = 0; i < width; i++) top[i] = temp_tangents[ip->slot * width + i];
+                } else {
+                    value = op == OP_CONST ? ip->value : vars[ip->slot];
+                    int slot = op == OP_CONST ? -1 : ip->slot;
+                    for (size_t i = 0; i < width; i++) top[i] = (int)i == slot;  // Unit tangent of an input
+                }
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+            case OP_MIN: case OP_MAX: case OP_CALL2: {
+                level--;
+                const double *left = tangents + level * width;
+                value = dual_binary(ip, op, values[level], value, &dx, &dy);
+                for (size_t i = 0; i < width; i++) top[i] = unless_zero(left[i], dx * left[i]) + unless_zero(top[i], dy * top[i]);
+                break;
+            }
+            case OP_ADD_CONST: case OP_SUB_CONST: case OP_MUL_CONST: case OP_DIV_CONST: case OP_POW_CONST:
+                value = dual_binary(ip, op - OP_ADD_CONST + OP_ADD, value, ip->value, &dx, &dy);
+                for (size_t i = 0; i < width; i++) top[i] = unless_zero(top[i], dx * top[i]);
+                break;
+            case OP_ADD_VAR: case OP_SUB_VAR: case OP_MUL_VAR: case OP_DIV_VAR: case OP_POW_VAR:
+                value = dual_binary(ip, op - OP_ADD_VAR + OP_ADD, value, vars[ip->slot], &dx, &dy);
+                for (size_t i = 0; i < width; i++) {  // The input's tangent is the unit vector of its slot
+                    top[i] = unless_zero(top[i], dx * top[i]) + ((int)i == ip->slot ? dy : 0);
+                }
+                break;
+            case OP_STORE:
+                temp_values[ip->slot] = value;
+                for (size_t i = 0; i < width; i++) temp_tangents[ip->slot * width + i] = top[i];
+                break;
+            default: {  // OP_SQRT, OP_ABS, OP_CALL: unary, the function is in slot
+                const Function *function = &functions[ip->slot];
+                double x = value;
+                value = function->scalar(x, 0);
+                function->partials(x, 0, value, &dx, &dy);
+                for (size_t i = 0; i < width; i++) top[i] = unless_zero(top[i], dx * top[i]);
+                break;
+            }
+        }
+    }
+    if (top != gradient) memcpy(gradient, top, width * sizeof(double));
+    return value;
+}
+
+// Run a program on dual numbers: the value and its partial derivatives with respect to inputs 0..count-1 in one
+// pass, exact up to rounding instead of finite-difference estimates; value is bit-identical to run()
+// Returns 0 when out of memory
+int run_gradient(const Program *program, const double *vars, int count, double *value, double *gradient) {
+    size_t width = count <= 4 ? 4 : count <= GRADIENT_WIDTH ? GRADIENT_WIDTH : (size_t)count;
+    size_t slots = (size_t)program->max_depth + 1 + program->temps;
+    size_t needed = slots * (width + 1) + (width > GRADIENT_WIDTH ? width : 0);  // Wide gradients keep the top here too
+    double local[GRADIENT_LOCAL];
+    double *values = needed <= GRADIENT_LOCAL ? local : malloc(needed * sizeof(double));
+    if (!values) return 0;
+    double *tangents = values + slots, *top = tangents + slots * width;
+    double result[GRADIENT_WIDTH];
+    if (width == 4) {
+        *value = gradient_pass(program, vars, values, tangents, 4, result);
+    } else if (width == GRADIENT_WIDTH) {
+        *value = gradient_pass(program, vars, values, tangents, GRADIENT_WIDTH, result);
+    } else {
+        *value = gradient_pass(program, vars, values, tangents, width, top);
+    }
+    memcpy(gradient, width <= GRADIENT_WIDTH ? result : top, (size_t)count * sizeof(double));
+    if (values != local) free(values);
+    return 1;
+}
+
+// Native code for a compiled program, so hot formulas skip dispatch altogether
+typedef double (*JitFunction)(const double *vars);
+
+typedef struct {
+    unsigned char *code;    // Executable mapping: constant pool, then the machine code
+    size_t size;            // Bytes mapped
+    size_t used;            // Bytes written while compiling
+    JitFunction function;   // Entry point, NULL when the program could not be compiled
+} Jit;
+
+#define JIT_REGISTERS 16    // xmm0-xmm15; stack level d lives in xmm(d - 1)
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_AVAILABLE 1
+#define JIT_MAX_BYTES 400   // Longest code emitted for one instruction (a call spilling 15 registers)
+
+// Operand kinds of jit_sse()
+enum { JIT_REG, JIT_VARS, JIT_FRAME, JIT_POOL };
+
+static void jit_byte(Jit *jit, int byte) { jit->code[jit->used++] = (unsigned char)byte; }
+
+static void jit_int32(Jit *jit, long long value) {
+    for (int i = 0; i < 4; i++) jit_byte(jit, (int)((unsigned long long)value >> (8 * i)));
+}
+
+// Emit one SSE2 instruction prefix 0F opcode xmm(reg), operand where the operand is xmm(index) (JIT_REG), the input
+// at vars[index] (JIT_VARS, base rbx), frame slot index (JIT_FRAME, base rsp) or the pool byte at index (JIT_POOL)
+static void jit_sse(Jit *jit, int prefix, int opcode, int reg, int kind, int index) {
+    jit_byte(jit, prefix);
+    int rex = (reg >> 3) << 2 | (kind == JIT_REG ? index >> 3 : 0);
+    if (rex) jit_byte(jit, 0x40 | rex);
+    jit_byte(jit, 0x0F);
+    jit_byte(jit, opcode);
+    switch (kind) {
+        case JIT_REG: jit_byte(jit, 0xC0 | (reg & 7) << 3 | (index & 7)); break;
+        case JIT_VARS: jit_byte(jit, 0x83 | (reg & 7) << 3); jit_int32(jit, 8LL * index); break;  // [rbx + disp32]
+        case JIT_FRAME:
+            jit_byte(jit, 0x84 | (reg & 7) << 3);  // [rsp + disp32] needs a SIB byte
+            jit_byte(jit, 0x24);
+            jit_int32(jit, 8LL * index);
+            break;
+        default: jit_byte(jit, 0x05 | (reg & 7) << 3); jit_int32(jit, (long long)index - (long long)(jit->used + 4)); break;  // [rip + disp32]
+    }
+}
+
+#define SSE_SD 0xF2         // Scalar double prefix
+#define SSE_PD 0x66         // Packed double prefix
+#define SSE_LOAD 0x10       // movsd xmm, m64 / movsd xmm, xmm
+#define SSE_STORE 0x11      // movsd m64, xmm
+#define SSE_MOVE 0x28       // movapd xmm, xmm
+#define SSE_SQRT 0x51
+#define SSE_AND 0x54
+#define SSE_XOR 0x57
+
+// Call fn(xmm0, xmm1) for the operand(s) at the top of a stack of the given depth; the result replaces them
+// Every xmm register is caller-saved, so the levels below are spilled around the call
+static void jit_call(Jit *jit, double (*fn)(double, double), int depth, int arity, int spill) {
+    int result = depth - arity;  // Register of the first operand and of the result
+    for (int r = 0; r < result; r++) jit_sse(jit, SSE_SD, SSE_STORE, r, JIT_FRAME, spill + r);
+    if (result != 0) jit_sse(jit, SSE_PD, SSE_MOVE, 0, JIT_REG, result);
+    if (arity == 2) {
+        if (result != 0) jit_sse(jit, SSE_PD, SSE_MOVE, 1, JIT_REG, result + 1);  // Otherwise already in xmm1
+    } else {
+        jit_sse(jit, SSE_PD, SSE_XOR, 1, JIT_REG, 1);  // The unused second argument is 0, as in eval()
+    }
+    jit_byte(jit, 0x48);  // mov rax, imm64
+    jit_byte(jit, 0xB8);
+    unsigned long long address = (unsigned long long)(size_t)fn;
+    for (int i = 0; i < 8; i++) jit_byte(jit, (int)(address >> (8 * i)));
+    jit_byte(jit, 0xFF);  // call rax
+    jit_byte(jit, 0xD0);
+    if (result != 0) jit_sse(jit, SSE_PD, SSE_MOVE, result, JIT_REG, 0);
+    for (int r = 0; r < result; r++) jit_sse(jit, SSE_SD, SSE_LOAD, r, JIT_FRAME, spill + r);
+}
+
+static double call_pow2(double x, double y) { return pow(x, y); }  // pow() through the registry signature
+
+// Translate a program into x86-64 SSE2 code: every stack level gets its own xmm register, temporaries and spills
+// live in the frame, constants in a pool in front of the code; returns 0 when the program needs more registers
+int jit_compile(const Program *program, Jit *jit) {
+    static const unsigned long long abs_mask[2] = { 0x7FFFFFFFFFFFFFFFULL, 0x7FFFFFFFFFFFFFFFULL };
+    static const unsigned char arithmetic[] = { 0x58, 0x5C, 0x59, 0x5E };  // addsd, subsd, mulsd, divsd
+    jit->function = NULL;
+    if (program->max_depth >= JIT_REGISTERS) return 0;  // One register stays free for the exponent of OP_POW_CONST
+    size_t constants = 0;
+    for (size_t i = 0; i < program->count; i++) constants += program->code[i].op == OP_CONST ||
+                                                             (program->code[i].op >= OP_ADD_CONST && program->code[i].op <= OP_POW_CONST);
+    size_t pool = (sizeof(abs_mask) + constants * sizeof(double) + 15) & ~(size_t)15;  // Code starts 16-byte aligned
+    size_t size = pool + program->count * JIT_MAX_BYTES + 64;
+    size = (size + 4095) & ~(size_t)4095;
+    unsigned char *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) return 0;
+    jit->code = code;
+    jit->size = size;
+    memcpy(code, abs_mask, sizeof(abs_mask));  // The andpd operand must be 16-byte aligned
+    size_t next_constant = sizeof(abs_mask);
+    jit->used = pool;
+
+    int spill = program->temps;  // Frame: temporaries, then one spill slot per register
+    int frame = ((spill + JIT_REGISTERS) * 8 + 15) & ~15;
+    jit_byte(jit, 0x53);  // push rbx; the stack is now 16-byte aligned for calls
+    jit_byte(jit, 0x48);  // mov rbx, rdi: inputs stay in rbx across calls
+    jit_byte(jit, 0x89);
+    jit_byte(jit, 0xFB);
+    jit_byte(jit, 0x48);  // sub rsp, frame
+    jit_byte(jit, 0x81);
+    jit_byte(jit, 0xEC);
+    jit_int32(jit, frame);
+
+    int depth = 0;
+    for (const Instr *ip = program->code;; ip++) {
+        int top = depth - 1;
+        int op = ip->op, kind = JIT_REG, index = depth - 1;
+        if (op == OP_CONST || (op >= OP_ADD_CONST && op <= OP_POW_CONST)) {
+            memcpy(code + next_constant, &ip->value, sizeof(double));
+            kind = JIT_POOL;
+            index = (int)next_constant;
+            next_constant += sizeof(double);
+        } else if (op == OP_VAR || (op >= OP_ADD_VAR && op <= OP_POW_VAR)) {
+            kind = JIT_VARS;
+            index = ip->slot;
+        }
+        switch (op) {
+            case OP_CONST: case OP_VAR:
+                jit_sse(jit, SSE_SD, SSE_LOAD, depth++, kind, index);
+                break;
+            case OP_LOAD:
+                jit_sse(jit, SSE_SD, SSE_LOAD, depth++, JIT_FRAME, ip->slot);
+                break;
+            case OP_STORE:
+                jit_sse(jit, SSE_SD, SSE_STORE, top, JIT_FRAME, ip->slot);
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+                jit_sse(jit, SSE_SD, arithmetic[op - OP_ADD], top - 1, JIT_REG, top);
+                depth--;
+                break;
+            case OP_ADD_CONST: case OP_SUB_CONST: case OP_MUL_CONST: case OP_DIV_CONST:
+                jit_sse(jit, SSE_SD, arithmetic[op - OP_ADD_CONST], top, kind, index);
+                break;
+            case OP_ADD_VAR: case OP_SUB_VAR: case OP_MUL_VAR: case OP_DIV_VAR:
+                jit_sse(jit, SSE_SD, arithmetic[op - OP_ADD_VAR], top, kind, index);
+                break;
+            case OP_POW:
+                jit_call(jit, call_pow2, depth--, 2, spill);
+                break;
+            case OP_POW_CONST: case OP_POW_VAR:  // Push the exponent, then call as OP_POW
+                jit_sse(jit, SSE_SD, SSE_LOAD, depth, kind, index);
+                jit_call(jit, call_pow2, depth + 1, 2, spill);
+                break;
+            case OP_SQRT:
+                jit_sse(jit, SSE_SD, SSE_SQRT, top, JIT_REG, top);
+                break;
+            case OP_ABS:
+                jit_sse(jit, SSE_PD, SSE_AND, top, JIT_POOL, 0);
+                break;
+            case OP_MIN: case OP_MAX:  // minsd/maxsd return the second operand unless the first compares less/greater,
+                jit_sse(jit, SSE_SD, op == OP_MIN ? 0x5D : 0x5F, top - 1, JIT_REG, top);  // exactly like call_min/max
+                depth--;
+                break;
+            case OP_CALL:
+                jit_call(jit, functions[ip->slot].scalar, depth, 1, spill);
+                break;
+            case OP_CALL2:
+                jit_call(jit, functions[ip->slot].scalar, depth--, 2, spill);
+                break;
+            case OP_RETURN:  // The result is already in xmm0
+                jit_byte(jit, 0x48);  // add rsp, frame
+                jit_byte(jit, 0x81);
+                jit_byte(jit, 0xC4);
+                jit_int32(jit, frame);
+                jit_byte(jit, 0x5B);  // pop rbx
+                jit_byte(jit, 0xC3);  // ret
+                break;
+            default:  // Unknown opcode: keep interpreting
+                munmap(code, size);
+                jit->code = NULL;
+                return 0;
+        }
+        if (op == OP_RETURN) break;
+    }
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {  // Never writable and executable at once
+        munmap(code, size);
+        jit->code = NULL;
+        return 0;
+    }
+    unsigned char *entry = code + pool;
+    memcpy(&jit->function, &entry, sizeof(jit->function));  // Object to function pointer, as with dlsym()
+    return 1;
+}
+
+// Release the executable mapping
+void jit_free(Jit *jit) {
+    if (jit->code) munmap(jit->code, jit->size);
+    jit->code = NULL;
+    jit->function = NULL;
+}
+#else
+#define JIT_AVAILABLE 0
+
+// No code generator for this target; callers keep using run()
+int jit_compile(const Program *program, Jit *jit) {
+    (void)program;
+    jit->code = NULL;
+    jit->function = NULL;
+    return 0;
+}
+
+void jit_free(Jit *jit) {
+    jit->function = NULL;
+}
+#endif
+
+// Free the memory used by the token array (identifiers live in the arena)
+void free_tokens(TokenArray *tokens) {
+    free(tokens->items);
+    tokens->items = NULL;
+    tokens->count = tokens->capacity = 0;
+}
+
+// Parse, bind and evaluate one formula with the given inputs
+// Returns 0, with every problem found in errors, when it cannot be evaluated
+int evaluate_formula(const char *input, const Bindings *bindings, const double *vars, double *result, Diagnostics *errors) {
+    Arena arena = { NULL };  // Owns the identifiers and expression nodes
+    TokenArray tokens = { NULL, 0, 0 };
+    Expr *expr = parse(input, &tokens, &arena, errors);  // Parse the input into an expression tree
+    int ok = expr && bind_variables(expr, bindings, errors);
+    if (ok) *result = eval(expr, vars);  // Evaluate the expression tree
+    arena_free(&arena);  // Free every expression node at once
+    free_tokens(&tokens);  // Free the memory used by the token array
+    return ok;
+}
+
+// Parse an expression and time repeated evaluation with eval() and with the compiled bytecode
+int bench_vm(const char *input, long iterations) {
+    Arena arena = { NULL };
+    TokenArray tokens = { NULL, 0, 0 };
+    Program program = { 0 };
+    Diagnostics errors;
+    Expr *expr = parse(input, &tokens, &arena, &errors);
+    Bindings no_inputs = { { NULL }, 0 };  // The benchmark formula is constant
+    if (!expr || !bind_variables(expr, &no_inputs, &errors) || !compile(expr, &program)) {
+        if (errors.count) print_diagnostics(stderr, input, &errors);
+        fprintf(stderr, "Expression cannot be compiled.\n");
+        free_program(&program);
+        free_tokens(&tokens);
+        arena_free(&arena);
+        return 1;
+    }
+
+    // Calls go through volatile pointers so the compiler cannot hoist them out of the loops
+    double (*volatile tree_walk)(Expr *, const double *) = eval;
+    double (*volatile vm)(const Program *, const double *) = run;
+    double tree_sum = 0, vm_sum = 0;
+    clock_t start = clock();
+    for (long i = 0; i < iterations; i++) tree_sum += tree_walk(expr, NULL);
+    double tree_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (long i = 0; i < iterations; i++) vm_sum += vm(&program, NULL);
+    double vm_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("Expression: %s\n", input);
+    printf("Bytecode: %zu instructions\n", program.count);
+    printf("eval():  %8.1f ns per evaluation\n", tree_time / iterations * 1e9);
+    printf("VM:      %8.1f ns per evaluation (%.1fx)\n", vm_time / iterations * 1e9, tree_time / vm_time);
+    printf("Results %s (%g)\n", tree_sum == vm_sum ? "match" : "DIFFER", eval(expr, NULL));
+
+    free_program(&program);
+    free_tokens(&tokens);
+    arena_free(&arena);
+    return tree_sum != vm_sum;
+}
+
+// Parse a formula and bind its variables to the given inputs; NULL if it does not parse or uses other names
+static Expr *parse_formula(const char *input, const Bindings *bindings, TokenArray *tokens, Arena *arena) {
+    Diagnostics errors;
+    Expr *expr = parse(input, tokens, arena, &errors);
+    if (expr && bind_variables(expr, bindings, &errors)) return expr;
+    print_diagnostics(stderr, input, &errors);
+    return NULL;
+}
+
+// Distance between two doubles in units in the last place; 0 when the bits are identical
+static unsigned long long ulp_distance(double a, double b) {
+    long long x, y;
+    memcpy(&x, &a, sizeof(x));
+    memcpy(&y, &b, sizeof(y));
+    if (x == y || (isnan(a) && isnan(b))) return 0;
+    if (x < 0) x = (long long)(0x8000000000000000ULL - (unsigned long long)x);  // Map to a monotonic integer line
+    if (y < 0) y = (long long)(0x8000000000000000ULL - (unsigned long long)y);
+    return x > y ? (unsigned long long)x - (unsigned long long)y : (unsigned long long)y - (unsigned long long)x;
+}
+
+// Time one formula over columns of random inputs: eval() per row, run() per row and run_batch()
+int bench_batch(const char *input, long rows) {
+    Bindings bindings = { { "x", "y", "z" }, 3 };
+    Arena arena = { NULL };
+    TokenArray tokens = { NULL, 0, 0 };
+    Program program = { 0 };
+    double *columns[3], *tree_out = malloc(rows * sizeof(double));
+    double *vm_out = malloc(rows * sizeof(double)), *batch_out = malloc(rows * sizeof(double));
+    for (int c = 0; c < 3; c++) {
+        columns[c] = malloc(rows * sizeof(double));
+        for (long i = 0; columns[c] && i < rows; i++) columns[c][i] = rand() / (double)RAND_MAX * 100 - 50;
+    }
+    Expr *expr = parse_formula(input, &bindings, &tokens, &arena);
+    int ok = expr && compile(expr, &program) && tree_out && vm_out && batch_out && columns[0] && columns[1] && columns[2];
+
+    if (ok) {
+        clock_t start = clock();
+        for (long i = 0; i < rows; i++) {
+            double vars[3] = { columns[0][i], columns[1][i], columns[2][i] };  // Gather the row
+            tree_out[i] = eval(expr, vars);
+        }
+        double tree_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        start = clock();
+        for (long i = 0; i < rows; i++) {
+            double vars[3] = { columns[0][i], columns[1][i], columns[2][i] };
+            vm_out[i] = run(&program, vars);
+        }
+        double vm_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        start = clock();
+        ok = run_batch(&program, (const double *const *)columns, rows, batch_out);
+        double batch_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        int approximate = 0;  // Whether run_batch() uses a kernel that may differ from libm in the last bits
+        for (const Instr *ip = program.code; ip->op != OP_RETURN; ip++) {
+            if (ip->op >= OP_SQRT && ip->op <= OP_CALL2 && functions[ip->slot].block) approximate |= functions[ip->slot].ulps > 0;
+        }
+        long mismatches = 0;
+        unsigned long long worst = 0;
+        for (long i = 0; i < rows; i++) {
+            unsigned long long distance = ulp_distance(tree_out[i], batch_out[i]);
+            if (distance > worst) worst = distance;
+            mismatches += memcmp(&tree_out[i], &vm_out[i], sizeof(double)) != 0 ||  // Bit-exact, NaN included
+                          (!approximate && memcmp(&tree_out[i], &batch_out[i], sizeof(double)) != 0);
+        }
+        printf("Expression: %s over %ld rows of x, y, z\n", input, rows);
+        printf("eval() per row:  %8.2f ns per row\n", tree_time / rows * 1e9);
+        printf("run() per row:   %8.2f ns per row (%.1fx)\n", vm_time / rows * 1e9, tree_time / vm_time);
+        printf("run_batch():     %8.2f ns per row (%.1fx)\n", batch_time / rows * 1e9, tree_time / batch_time);
+        printf("Mismatches: %ld\n", mismatches);
+        if (approximate) printf("run_batch() uses vector kernels: largest difference %llu ulp\n", worst);
+        ok = ok && mismatches == 0;
+    } else {
+        fprintf(stderr, "Cannot set up the benchmark.\n");
+    }
+
+    for (int c = 0; c < 3; c++) free(columns[c]);
+    free(tree_out);
+    free(vm_out);
+    free(batch_out);
+    free_program(&program);
+    free_tokens(&tokens);
+    arena_free(&arena);
+    return !ok;
+}
+
+// Time a formula of x and y as parsed and after optimize(), with eval() and with the VM, and check that
+// the optimised program agrees with eval() on the original tree, special values included
+int bench_optimize(const char *input, long iterations) {
+    static const double samples[][2] = {
+        { 1.5, -2.25 }, { 0.0, -0.0 }, { -0.0, 0.0 }, { 1e308, 1e308 }, { -1e-310, 3.0 },
+        { NAN, 1.0 }, { INFINITY, -INFINITY }, { 7.0, NAN }, { -3.75, 1e-300 }, { 42.0, 0.5 },
+    };
+    const int sample_count = sizeof(samples) / sizeof(samples[0]);
+    Bindings bindings = { { "x", "y" }, 2 };
+    Arena arena = { NULL };
+    TokenArray tokens = { NULL, 0, 0 };
+    Program plain = { 0 }, optimised = { 0 };
+    Expr *expr = parse_formula(input, &bindings, &tokens, &arena);
+    Expr *dag = expr ? optimize(expr, &arena) : NULL;
+    int ok = dag && compile(expr, &plain) && compile(dag, &optimised);
+
+    if (ok) {
+        unsigned long long worst = 0;
+        for (int s = 0; s < sample_count; s++) {  // Agreement with the reference first
+            unsigned long long a = ulp_distance(eval(expr, samples[s]), run(&optimised, samples[s]));
+            unsigned long long b = ulp_distance(eval(expr, samples[s]), eval(dag, samples[s]));
+            if (a > worst) worst = a;
+            if (b > worst) worst = b;
+        }
+        double (*volatile tree_walk)(Expr *, const double *) = eval;
+        double (*volatile vm)(const Program *, const double *) = run;
+        double times[4];
+        for (int k = 0; k < 4; k++) {
+            clock_t start = clock();
+            for (long i = 0; i < iterations; i++) {
+                const double *vars = samples[i % sample_count];
+                if (k < 2) tree_walk(k == 0 ? expr : dag, vars);  // Results were checked above
+                else vm(k == 2 ? &plain : &optimised, vars);
+            }
+            times[k] = (double)(clock() - start) / CLOCKS_PER_SEC / iterations * 1e9;
+        }
+        printf("Expression: %s\n", input);
+        printf("Bytecode: %zu instructions as written, %zu optimised (%d shared)\n", plain.count, optimised.count,
+               optimised.temps);
+        printf("eval() as written: %8.1f ns\n", times[0]);
+        printf("eval() optimised:  %8.1f ns\n", times[1]);
+        printf("VM as written:     %8.1f ns\n", times[2]);
+        printf("VM optimised:      %8.1f ns (%.1fx vs VM as written)\n", times[3], times[2] / times[3]);
+        printf("Largest difference from eval(): %llu ulp\n", worst);
+        ok = worst <= 1;  // Only x^2 -> x*x may move a result, by at most one ulp
+    } else {
+        fprintf(stderr, "Cannot set up the benchmark.\n");
+    }
+    free_program(&plain);
+    free_program(&optimised);
+    free_tokens(&tokens);
+    arena_free(&arena);
+    return !ok;
+}
+
+// Time every built-in function with a vector kernel against its scalar version over random inputs and report
+// the worst difference, special values included
+int bench_functions(long rows) {
+    static const double specials[] = { 0.0, -0.0, 1.0, -1.0, 0x1p-1074, 0x1p-1022, 1e300, -1e300, 709.8, -745.2,
+                                       1e6, 0x1p19, 3.14159265358979311600, 1.57079632679489655800, INFINITY, -INFINITY, NAN };
+    size_t count = sizeof(specials) / sizeof(specials[0]);
+    rows = (rows + BATCH_BLOCK - 1) / BATCH_BLOCK * BATCH_BLOCK;  // Whole blocks only
+    if (rows < BATCH_BLOCK) rows = BATCH_BLOCK;
+    double *x = malloc(rows * sizeof(double)), *y = malloc(rows * sizeof(double));
+    double *expected = malloc(rows * sizeof(double)), *actual = malloc(rows * sizeof(double));
+    int ok = x && y && expected && actual;
+    if (!ok) fprintf(stderr, "Cannot set up the benchmark.\n");
+
+    for (size_t f = 0; ok && f < sizeof(functions) / sizeof(functions[0]); f++) {
+        const Function *function = &functions[f];
+        if (!function->block) continue;
+        double scale = f == FN_EXP ? 1400 : f == FN_SIN || f == FN_COS ? 200 : 2000;  // exp over its finite range
+        for (long i = 0; i < rows; i++) {
+            x[i] = (rand() / (double)RAND_MAX - 0.5) * scale;
+            y[i] = (rand() / (double)RAND_MAX - 0.5) * scale;
+            if (f == FN_LOG || f == FN_SQRT) x[i] = exp(x[i] / 20);  // Positive, over many binades
+        }
+        for (size_t s = 0; s < count && (long)s < rows; s++) x[s] = specials[s];
+
+        clock_t start = clock();
+        for (long i = 0; i < rows; i++) expected[i] = function->scalar(x[i], y[i]);
+        double scalar_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        memcpy(actual, x, rows * sizeof(double));
+        start = clock();
+        for (long i = 0; i < rows; i += BATCH_BLOCK) function->block(actual + i, y + i);
+        double block_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        unsigned long long worst = 0;
+        for (long i = 0; i < rows; i++) {
+            unsigned long long distance = ulp_distance(expected[i], actual[i]);
+            if (distance > worst) worst = distance;
+        }
+        printf("%-5s libm %6.2f ns, vector %6.2f ns per value (%.1fx), worst %llu ulp\n", function->name,
+               scalar_time / rows * 1e9, block_time / rows * 1e9, scalar_time / block_time, worst);
+        ok = worst <= (unsigned long long)function->ulps;
+    }
+
+    free(x);
+    free(y);
+    free(expected);
+    free(actual);
+    return !ok;
+}
+
+// Inputs of x, y and z the JIT is checked on: ordinary values, signed zeros, subnormals, infinities and NaN
+static const double jit_samples[][3] = {
+    { 1.5, -2.25, 3.0 }, { 0.0, -0.0, 1.0 }, { -0.0, 0.0, -1.0 }, { 1e308, 1e308, 2.0 }, { -1e-310, 3.0, 0.5 },
+    { NAN, 1.0, 2.0 }, { INFINITY, -INFINITY, 0.0 }, { 7.0, NAN, -3.0 }, { -3.75, 1e-300, 100.0 }, { 42.0, 0.5, -0.25 },
+};
+
+// Number of jit_samples on which the native code and run() differ from eval() in any bit
+static int jit_mismatches(Expr *expr, const Program *program, const Jit *jit) {
+    int mismatches = 0;
+    for (size_t s = 0; s < sizeof(jit_samples) / sizeof(jit_samples[0]); s++) {
+        double expected = eval(expr, jit_samples[s]), vm = run(program, jit_samples[s]);
+        double native = jit->function(jit_samples[s]);
+        mismatches += memcmp(&expected, &native, sizeof(double)) != 0 || memcmp(&expected, &vm, sizeof(double)) != 0;
+    }
+    return mismatches;
+}
+
+// Time a formula of x, y and z with eval(), the VM and the native code, after checking they agree bit for bit
+int bench_jit(const char *input, long iterations) {
+    Bindings bindings = { { "x", "y", "z" }, 3 };
+    Arena arena = { NULL };
+    TokenArray tokens = { NULL, 0, 0 };
+    Program program = { 0 };
+    Jit jit = { NULL, 0, 0, NULL };
+    Expr *expr = parse_formula(input, &bindings, &tokens, &arena);
+    Expr *dag = expr ? optimize(expr, &arena) : NULL;
+    int ok = dag && compile(dag, &program);
+    if (!ok) fprintf(stderr, "Expression cannot be compiled.\n");
+
+    if (ok && !jit_compile(&program, &jit)) {
+        printf("No native code for this formula%s; run() is used\n", JIT_AVAILABLE ? " (stack too deep)" : " on this target");
+    } else if (ok) {
+        int mismatches = jit_mismatches(expr, &program, &jit);
+        double vars[3] = { 1.25, -0.5, 3.0 };
+        double (*volatile tree_walk)(Expr *, const double *) = eval;
+        double (*volatile vm)(const Program *, const double *) = run;
+        JitFunction volatile native = jit.function;
+        double tree_sum = 0, vm_sum = 0, native_sum = 0;
+        clock_t start = clock();
+        for (long i = 0; i < iterations; i++) {
+            vars[0] = (double)i;  // Vary an input so nothing is computed once
+            tree_sum += tree_walk(expr, vars);
+        }
+        double tree_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        start = clock();
+        for (long i = 0; i < iterations; i++) {
+            vars[0] = (double)i;
+            vm_sum += vm(&program, vars);
+        }
+        double vm_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        start = clock();
+        for (long i = 0; i < iterations; i++) {
+            vars[0] = (double)i;
+            native_sum += native(vars);
+        }
+        double native_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("Expression: %s\n", input);
+        printf("Bytecode: %zu instructions, native code: %zu bytes\n", program.count, jit.used);
+        printf("eval():  %8.1f ns per evaluation\n", tree_time / iterations * 1e9);
+        printf("VM:      %8.1f ns per evaluation (%.1fx)\n", vm_time / iterations * 1e9, tree_time / vm_time);
+        printf("Native:  %8.1f ns per evaluation (%.1fx)\n", native_time / iterations * 1e9, tree_time / native_time);
+        int same = memcmp(&tree_sum, &native_sum, sizeof(double)) == 0 && memcmp(&tree_sum, &vm_sum, sizeof(double)) == 0;
+        printf("Mismatches on special values: %d, sums %s\n", mismatches, same ? "match" : "DIFFER");
+        ok = mismatches == 0 && same;
+    }
+
+    jit_free(&jit);
+    free_program(&program);
+    free_tokens(&tokens);
+    arena_free(&arena);
+    return !ok;
+}
+
+// Compile formulas covering every opcode to native code and compare them with eval(); formulas too deep for the
+// registers must fall back to run()
+int check_jit(void) {
+    static const char *const formulas[] = {
+        "x+y*z-x/y", "2.5*x+y-3/z", "x^y+x^2.5+2^z+y^x", "x-(y-(z-(x-(y-z))))",
+        "sqrt(x)+abs(y)-abs(z*x)", "min(x,y)+max(y,z)*min(z,max(x,1))", "sin(x)+cos(y)*tan(z)",
+        "exp(x/100)-log(abs(y))+floor(z)+ceil(x)", "pow(x,y)+pow(2,z)", "(x+y)*(x+y)+(x+y)/((x+y)*(x+y)+1)",
+        "sin(x+y)*(1+(2+(3+(4+(5+(6+(7+(8+(9+(10+(11+(12+(13+z)))))))))))))",
+        "1+(2+(3+(4+(5+(6+(7+(8+(9+(10+(11+(12+(13+(14+(15+(16+(17+x))))))))))))))))",
+        "x*(y+(z-(x/(y+(pow(z,x)+min(y,sin(x)+y^3))))))",  // Calls with live registers below them
+    };
+    Bindings bindings = { { "x", "y", "z" }, 3 };
+    int failures = 0;
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++) {
+        Arena arena = { NULL };
+        TokenArray tokens = { NULL, 0, 0 };
+        Program program = { 0 };
+        Jit jit = { NULL, 0, 0, NULL };
+        Expr *expr = parse_formula(formulas[f], &bindings, &tokens, &arena);
+        Expr *dag = expr ? optimize(expr, &arena) : NULL;
+        const char *result;
+        if (!dag || !compile(dag, &program)) {
+            result = "not compiled";
+            failures++;
+        } else if (!jit_compile(&program, &jit)) {
+            int fallback = !JIT_AVAILABLE || program.max_depth >= JIT_REGISTERS;
+            result = fallback ? "run() fallback" : "FAILED to compile";
+            failures += !fallback;
+        } else {
+            int mismatches = jit_mismatches(expr, &program, &jit);
+            result = mismatches ? "MISMATCH" : "ok";
+            failures += mismatches != 0;
+        }
+        printf("%-18s %s\n", result, formulas[f]);
+        jit_free(&jit);
+        free_program(&program);
+        free_tokens(&tokens);
+        arena_free(&arena);
+    }
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
+
+// Check run_gradient() against central differences at a few points of x, y and z, then time it against the
+// forward differences it replaces (one run() per input plus one)
+int bench_gradient(const char *input, long iterations) {
+    static const double points[][3] = { { 1.5, -2.25, 3.0 }, { 0.3, 0.7, -0.2 }, { -4.0, 2.5, 10.0 }, { 12.0, -0.1, 0.5 } };
+    Bindings bindings = { { "x", "y", "z" }, 3 };
+    Arena arena = { NULL };
+    TokenArray tokens = { NULL, 0, 0 };
+    Program program = { 0 };
+    Expr *expr = parse_formula(input, &bindings, &tokens, &arena);
+    Expr *dag = expr ? optimize(expr, &arena) : NULL;
+    int ok = dag && compile(dag, &program);
+    if (!ok) fprintf(stderr, "Expression cannot be compiled.\n");
+
+    double worst = 0;  // Largest relative difference from central differences
+    for (size_t p = 0; ok && p < sizeof(points) / sizeof(points[0]); p++) {
+        double value, gradient[3];
+        ok = run_gradient(&program, points[p], 3, &value, gradient);
+        ok = ok && memcmp(&value, &(double){ run(&program, points[p]) }, sizeof(double)) == 0;
+        for (int i = 0; ok && i < 3; i++) {
+            double up[3], down[3], h = 1e-5 * fmax(1, fabs(points[p][i]));
+            memcpy(up, points[p], sizeof(up));
+            memcpy(down, points[p], sizeof(down));
+            up[i] += h;
+            down[i] -= h;
+            double estimate = (run(&program, up) - run(&program, down)) / (2 * h);
+            double difference = fabs(estimate - gradient[i]) / fmax(1, fabs(gradient[i]));
+            if (!(difference <= worst)) worst = difference;  // NaN counts as a failure
+        }
+    }
+
+    if (ok) {
+        double (*volatile vm)(const Program *, const double *) = run;
+        int (*volatile dual)(const Program *, const double *, int, double *, double *) = run_gradient;
+        double vars[3] = { 1.5, -2.25, 3.0 }, value, gradient[3];
+        volatile double sum = 0;  // Keeps the results live
+        clock_t start = clock();
+        for (long i = 0; i < iterations; i++) {  // Forward differences: N + 1 evaluations
+            vars[0] = 1.5 + i * 1e-9;
+            double base = vm(&program, vars);
+            for (int v = 0; v < 3; v++) {
+                vars[v] += 1e-7;
+                gradient[v] = (vm(&program, vars) - base) / 1e-7;
+                vars[v] -= 1e-7;
+            }
+            sum += gradient[0];
+        }
+        double difference_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        start = clock();
+        for (long i = 0; i < iterations; i++) {
+            vars[0] = 1.5 + i * 1e-9;
+            dual(&program, vars, 3, &value, gradient);
+            sum += gradient[0];
+        }
+        double dual_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        start = clock();
+        for (long i = 0; i < iterations; i++) {
+            vars[0] = 1.5 + i * 1e-9;
+            sum += vm(&program, vars);
+        }
+        double value_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("Expression: %s\n", input);
+        printf("run(), value only:        %8.1f ns\n", value_time / iterations * 1e9);
+        printf("Forward differences (4x): %8.1f ns (%.1f evaluations)\n", difference_time / iterations * 1e9,
+               difference_time / value_time);
+        printf("run_gradient():           %8.1f ns (%.1f evaluations, %.1fx faster)\n", dual_time / iterations * 1e9,
+               dual_time / value_time, difference_time / dual_time);
+        printf("Largest relative difference from central differences: %.2g\n", worst);
+        ok = worst < 1e-6;
+    }
+
+    free_program(&program);
+    free_tokens(&tokens);
+    arena_free(&arena);
+    return !ok;
+}
+
+#define FUZZ_ROWS BATCH_BLOCK  // Inputs every random expression is evaluated on: the jit_samples, then random values
+#define FUZZ_REPORTED 5        // Disagreements printed in full; later ones are only counted
+
+// Growable text of one random expression
+typedef struct {
+    char *text;
+    size_t length, capacity;
+} FuzzText;
+
+// Append formatted text, growing the buffer as needed; returns 0 when out of memory
+static int fuzz_append(FuzzText *out, const char *format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(out->text ? out->text + out->length : NULL, out->capacity - out->length, format, args);
+        va_end(args);
+        if (length < 0) return 0;
+        if (out->length + length < out->capacity) {
+            out->length += length;
+            return 1;
+        }
+        size_t capacity = out->capacity ? out->capacity * 2 : 256;
+        while (capacity <= out->length + length) capacity *= 2;
+        char *text = realloc(out->text, capacity);
+        if (!text) return 0;
+        out->text = text;
+        out->capacity = capacity;
+    }
+}
+
+// Write a random expression of x, y and z at most depth levels deep: ordinary and awkward numbers, every operator
+// and every built-in function; operators are bracketed only half the time so precedence and grouping get exercised
+static int random_expression(FuzzText *out, int depth) {
+    static const char *const numbers[] = { "0", "1", "2", "0.5", "3", "10", "0.1", "1e308", "1e-310" };
+    int choice = rand() % 8;
+    if (depth <= 0 || choice == 0) {  // Leaf
+        int leaf = rand() % 4;
+        if (leaf < 2) return fuzz_append(out, "%c", "xyz"[rand() % 3]);
+        if (leaf == 2) return fuzz_append(out, "%s", numbers[rand() % (sizeof(numbers) / sizeof(numbers[0]))]);
+        return fuzz_append(out, "%.17g", rand() / (double)RAND_MAX * 100);
+    }
+    if (choice <= 2) {  // Function call
+        const Function *function = &functions[rand() % (sizeof(functions) / sizeof(functions[0]))];
+        return fuzz_append(out, "%s(", function->name) && random_expression(out, depth - 1) &&
+               (function->arity < 2 || (fuzz_append(out, ",") && random_expression(out, depth - 1))) &&
+               fuzz_append(out, ")");
+    }
+    int bracket = rand() % 2;
+    return (!bracket || fuzz_append(out, "(")) && random_expression(out, depth - 1) &&
+           fuzz_append(out, "%c", "+-*/^"[rand() % 5]) && random_expression(out, depth - 1) &&
+           (!bracket || fuzz_append(out, ")"));
+}
+
+// Evaluation backends compared by bench_fuzz(), each against the reference named in fuzz_references
+enum { FUZZ_EVAL, FUZZ_EVAL_OPTIMISED, FUZZ_VM, FUZZ_VM_OPTIMISED, FUZZ_BATCH, FUZZ_JIT, FUZZ_GRADIENT, FUZZ_BACKENDS };
+static const char *const fuzz_names[FUZZ_BACKENDS] = {
+    "eval()", "eval() optimised", "run()", "run() optimised", "run_batch() optimised", "JIT optimised", "run_gradient()",
+};
+static const int fuzz_references[FUZZ_BACKENDS] = {
+    FUZZ_EVAL, FUZZ_EVAL, FUZZ_EVAL, FUZZ_EVAL_OPTIMISED, FUZZ_EVAL_OPTIMISED, FUZZ_EVAL_OPTIMISED, FUZZ_VM,
+};
+
+// Same result: identical bits, except that any NaN matches any other
+static int same_result(double a, double b) {
+    return memcmp(&a, &b, sizeof(double)) == 0 || (isnan(a) && isnan(b));
+}
+
+// Differential fuzz and phase benchmark: generate random expressions, time tokenize(), parsing, optimize(),
+// compile() and jit_compile() over all of them, then evaluate each one on FUZZ_ROWS inputs with every backend,
+// timing each backend and checking it against its reference bit for bit (the vector kernels of run_batch() only
+// up to their ulp bound, so there the largest difference is reported instead)
+int bench_fuzz(long trees, int depth, unsigned seed) {
+    if (trees < 1 || depth < 0) {
+        fprintf(stderr, "Need at least one expression and a depth of 0 or more.\n");
+        return 1;
+    }
+    Bindings bindings = { { "x", "y", "z" }, 3 };
+    Arena arena = { NULL };
+    Diagnostics errors = { .count = 0 };
+    double rows[FUZZ_ROWS][3], columns[3][FUZZ_ROWS];
+    const double *column_pointers[3] = { columns[0], columns[1], columns[2] };
+    srand(seed);
+    for (int r = 0; r < FUZZ_ROWS; r++) {
+        for (int c = 0; c < 3; c++) {
+            double sample = (size_t)r < sizeof(jit_samples) / sizeof(jit_samples[0]) ? jit_samples[r][c]
+                                                                                     : rand() / (double)RAND_MAX * 20 - 10;
+            rows[r][c] = columns[c][r] = sample;
+        }
+    }
+
+    FuzzText *texts = calloc(trees, sizeof(FuzzText));
+    TokenArray *tokens = calloc(trees, sizeof(TokenArray));
+    Expr **exprs = calloc(trees, sizeof(Expr *)), **dags = calloc(trees, sizeof(Expr *));
+    Program *plain = calloc(trees, sizeof(Program)), *optimised = calloc(trees, sizeof(Program));
+    Jit *jits = calloc(trees, sizeof(Jit));
+    double *out[FUZZ_BACKENDS];
+    int ok = texts && tokens && exprs && dags && plain && optimised && jits;
+    for (int b = 0; b < FUZZ_BACKENDS; b++) {
+        out[b] = malloc(trees * FUZZ_ROWS * sizeof(double));
+        ok = ok && out[b];
+    }
+    for (long t = 0; ok && t < trees; t++) ok = random_expression(&texts[t], depth);
+    if (!ok) fprintf(stderr, "Cannot set up the benchmark.\n");
+
+    double phases[5] = { 0 };  // Seconds in tokenize(), parsing and binding, optimize(), compile(), jit_compile()
+    long token_count = 0, instruction_count = 0, native = 0;
+    clock_t start = clock();
+    long failed = 0;  // Expression a phase stopped at
+    for (long t = 0; ok && t < trees; t++) ok = tokenize(texts[failed = t].text, &tokens[t], &arena, &errors);
+    phases[0] = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (long t = 0; ok && t < trees; t++) {
+        const Token *token = tokens[failed = t].items;
+        exprs[t] = parse_expr(&token, &arena, &errors);
+        ok = exprs[t] && token->type == TOKEN_END && errors.count == 0 && bind_variables(exprs[t], &bindings, &errors);
+    }
+    phases[1] = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (long t = 0; ok && t < trees; t++) ok = (dags[failed = t] = optimize(exprs[t], &arena)) != NULL;
+    phases[2] = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (long t = 0; ok && t < trees; t++) ok = compile(exprs[failed = t], &plain[t]) && compile(dags[t], &optimised[t]);
+    phases[3] = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (long t = 0; ok && t < trees; t++) native += jit_compile(&optimised[t], &jits[t]);
+    phases[4] = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if (!ok && texts && texts[failed].text) {
+        fprintf(stderr, "Cannot tokenize, parse or compile expression %ld: %s\n", failed, texts[failed].text);
+        print_diagnostics(stderr, texts[failed].text, &errors);
+    }
+
+    double times[FUZZ_BACKENDS] = { 0 };  // Seconds spent evaluating with each backend
+    for (int b = 0; ok && b < FUZZ_BACKENDS; b++) {
+        start = clock();
+        for (long t = 0; ok && t < trees; t++) {
+            double *results = out[b] + t * FUZZ_ROWS, gradient[3];
+            if (b == FUZZ_BATCH) ok = run_batch(&optimised[t], column_pointers, FUZZ_ROWS, results);
+            for (int r = 0; b != FUZZ_BATCH && ok && r < FUZZ_ROWS; r++) {
+                switch (b) {
+                    case FUZZ_EVAL: results[r] = eval(exprs[t], rows[r]); break;
+                    case FUZZ_EVAL_OPTIMISED: results[r] = eval(dags[t], rows[r]); break;
+                    case FUZZ_VM: results[r] = run(&plain[t], rows[r]); break;
+                    case FUZZ_VM_OPTIMISED: results[r] = run(&optimised[t], rows[r]); break;
+                    case FUZZ_JIT:  // Programs too deep for the registers are left to run()
+                        results[r] = jits[t].function ? jits[t].function(rows[r]) : run(&optimised[t], rows[r]);
+                        break;
+                    default: ok = run_gradient(&plain[t], rows[r], 3, &results[r], gradient); break;
+                }
+            }
+        }
+        times[b] = (double)(clock() - start) / CLOCKS_PER_SEC;
+    }
+
+    if (ok) {
+        long mismatches[FUZZ_BACKENDS] = { 0 }, approximate_trees = 0, approximate_rows = 0, reported = 0;
+        unsigned long long worst[FUZZ_BACKENDS] = { 0 };  // Over the results that must be bit-exact
+        for (long t = 0; t < trees; t++) {
+            token_count += tokens[t].count - 1;
+            instruction_count += optimised[t].count;
+            int approximate = 0;  // Whether run_batch() uses a kernel that may differ from libm in the last bits
+            for (const Instr *ip = optimised[t].code; ip->op != OP_RETURN; ip++) {
+                if (ip->op >= OP_SQRT && ip->op <= OP_CALL2 && functions[ip->slot].block) {
+                    approximate |= functions[ip->slot].ulps > 0;
+                }
+            }
+            approximate_trees += approximate;
+            for (int b = 1; b < FUZZ_BACKENDS; b++) {
+                for (int r = 0; r < FUZZ_ROWS; r++) {
+                    double got = out[b][t * FUZZ_ROWS + r], expected = out[fuzz_references[b]][t * FUZZ_ROWS + r];
+                    if (same_result(got, expected)) continue;
+                    if (b == FUZZ_BATCH && approximate) {  // Errors within the kernel bound can grow without limit
+                        approximate_rows++;                // under cancellation, so these are only counted
+                        continue;
+                    }
+                    unsigned long long distance = ulp_distance(got, expected);
+                    if (distance > worst[b]) worst[b] = distance;
+                    mismatches[b]++;
+                    if (reported++ < FUZZ_REPORTED) {
+                        printf("%s differs from %s: %.17g instead of %.17g at x=%.17g y=%.17g z=%.17g in\n    %s\n",
+                               fuzz_names[b], fuzz_names[fuzz_references[b]], got, expected, rows[r][0], rows[r][1],
+                               rows[r][2], texts[t].text);
+                    }
+                }
+            }
+        }
+
+        const char *phase_names[5] = { "tokenize()", "parse + bind", "optimize()", "compile() x2", "jit_compile()" };
+        printf("%ld random expressions of depth <= %d (seed %u): %.1f tokens, %.1f optimised instructions on average\n",
+               trees, depth, seed, (double)token_count / trees, (double)instruction_count / trees);
+        for (int p = 0; p < 5; p++) printf("%-22s %10.2f us per expression\n", phase_names[p], phases[p] / trees * 1e6);
+        printf("Native code for %ld of %ld expressions; %ld use approximate vector kernels, which change %ld of their "
+               "%ld run_batch() results\n", native, trees, approximate_trees, approximate_rows, approximate_trees * FUZZ_ROWS);
+        printf("%-22s %10s %12s %12s  %s\n", "Backend", "ns/eval", "mismatches", "largest ulp", "checked against");
+        for (int b = 0; b < FUZZ_BACKENDS; b++) {
+            printf("%-22s %10.1f %12ld %12llu  %s\n", fuzz_names[b], times[b] / ((double)trees * FUZZ_ROWS) * 1e9,
+                   mismatches[b], worst[b], b == FUZZ_EVAL ? "(reference)" : fuzz_names[fuzz_references[b]]);
+            ok = ok && mismatches[b] == 0;
+        }
+    }
+
+    for (long t = 0; t < trees; t++) {
+        if (texts) free(texts[t].text);
+        if (tokens) free_tokens(&tokens[t]);
+        if (plain) free_program(&plain[t]);
+        if (optimised) free_program(&optimised[t]);
+        if (jits) jit_free(&jits[t]);
+    }
+    for (int b = 0; b < FUZZ_BACKENDS; b++) free(out[b]);
+    free(texts);
+    free(tokens);
+    free(exprs);
+    free(dags);
+    free(plain);
+    free(optimised);
+    free(jits);
+    arena_free(&arena);
+    return !ok;
+}
+
+// Append a value to a growable column
+static int push_value(double **column, size_t *capacity, size_t count, double value) {
+    if (count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+        double *grown = realloc(*column, new_capacity * sizeof(double));
+        if (!grown) return 0;
+        *column = grown;
+        *capacity = new_capacity;
+    }
+    (*column)[count] = value;
+    return 1;
+}
+
+// Evaluate a formula for every row of a CSV file whose header names the variables; prints one result per row
+int evaluate_columns(const char *input, FILE *data, int gradient) {
+    Arena arena = { NULL };
+    TokenArray tokens = { NULL, 0, 0 };
+    Program program = { 0 };
+    Bindings bindings = { { NULL }, 0 };
+    double *columns[MAX_VARIABLES] = { NULL }, *out = NULL;
+    size_t capacity[MAX_VARIABLES] = { 0 }, rows = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    int ok = 1;
+
+    if (getline(&line, &line_capacity, data) > 0) {  // Header: one variable name per column
+        for (char *name = strtok(line, ", \t\r\n"); name && ok; name = strtok(NULL, ", \t\r\n")) {
+            ok = bindings.count < MAX_VARIABLES;
+            if (ok) bindings.names[bindings.count++] = arena_strndup(&arena, name, strlen(name));
+        }
+    }
+    while (ok && getline(&line, &line_capacity, data) > 0) {  // Rows: missing or malformed fields become NaN
+        char *field = line;
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;  // Skip blank lines
+        for (int c = 0; c < bindings.count && ok; c++) {
+            char *end;
+            double value = strtod(field, &end);
+            if (end == field) value = NAN;
+            ok = push_value(&columns[c], &capacity[c], rows, value);
+            field = strchr(end, ',');
+            field = field ? field + 1 : end;
+        }
+        rows++;
+    }
+    free(line);
+
+    Expr *expr = ok ? parse_formula(input, &bindings, &tokens, &arena) : NULL;
+    if (expr) expr = optimize(expr, &arena);  // The formula runs once per row: worth simplifying first
+    out = malloc((rows ? rows : 1) * sizeof(double));
+    ok = expr && out;
+    if (ok && gradient) {  // Value and partial derivatives per row, one pass each
+        static char buffer[1 << 16];
+        setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+        ok = compile(expr, &program);
+        printf("value");
+        for (int c = 0; c < bindings.count; c++) printf(",d/d%s", bindings.names[c]);
+        printf("\n");
+        for (size_t i = 0; ok && i < rows; i++) {
+            double vars[MAX_VARIABLES], partials[MAX_VARIABLES], value;
+            for (int c = 0; c < bindings.count; c++) vars[c] = columns[c][i];
+            ok = run_gradient(&program, vars, bindings.count, &value, partials);
+            printf("%.17g", value);
+            for (int c = 0; ok && c < bindings.count; c++) printf(",%.17g", partials[c]);
+            printf("\n");
+        }
+        fflush(stdout);
+        if (!ok) fprintf(stderr, "Expression cannot be compiled.\n");
+    } else if (ok && rows > 0) {
+        if (compile(expr, &program) && run_batch(&program, (const double *const *)columns, rows, out)) {
+            // Done in blocks
+        } else {
+            double vars[MAX_VARIABLES];  // Fall back to the tree walker one row at a time
+            for (size_t i = 0; i < rows; i++) {
+                for (int c = 0; c < bindings.count; c++) vars[c] = columns[c][i];
+                out[i] = eval(expr, vars);
+            }
+        }
+        static char buffer[1 << 16];  // Write results in large chunks
+        setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+        for (size_t i = 0; i < rows; i++) printf("%.17g\n", out[i]);
+        fflush(stdout);
+    }
+
+    for (int c = 0; c < MAX_VARIABLES; c++) free(columns[c]);
+    free(out);
+    free_program(&program);
+    free_tokens(&tokens);
+    arena_free(&arena);
+    return !ok;
+}
+
+#define STREAM_CHUNK_SIZE (1 << 20)  // Bytes read per chunk in streaming mode
+#define STREAM_QUEUE_DEPTH 8         // Chunks in flight between reader, workers and writer
+#define STREAM_MAX_WORKERS 16        // Upper bound on evaluation threads
+#define STREAM_CACHE_ENTRIES 1024    // Compiled expressions each worker keeps
+
+// One compiled expression in a worker's cache, linked into its hash chain and its recency list
+typedef struct {
+    char *text;          // Expression as written, the key
+    size_t length;
+    size_t hash;
+    Program program;     // Optimised bytecode, run without inputs
+    int compiled;        // 0 when the expression does not evaluate (it is cached as an error)
+    Diagnostic error;    // First problem found, when not compiled
+    int chain;           // Next entry in the same bucket, or -1
+    int newer, older;    // Neighbours in the recency list, or -1
+} StreamEntry;
+
+// Least recently used cache of compiled expressions keyed by their text; each worker owns one, so no locks
+typedef struct {
+    StreamEntry entries[STREAM_CACHE_ENTRIES];
+    int buckets[STREAM_CACHE_ENTRIES * 2];  // First entry of each chain, or -1
+    int count;                              // Entries in use
+    int newest, oldest;                     // Ends of the recency list
+    TokenArray tokens;                      // Scratch for compiling misses
+    Arena arena;
+} StreamCache;
+
+// One chunk of input travelling from the reader through a worker to the writer
+typedef struct {
+    enum { CHUNK_EMPTY, CHUNK_READ, CHUNK_EVALUATING, CHUNK_EVALUATED } state;
+    size_t seq;          // Position of the chunk in the input
+    char *data;          // Whole lines
+    size_t length;
+    size_t capacity;
+    char *out;           // Formatted results, in line order
+    size_t out_length;
+    size_t out_capacity;
+    size_t lines, hits, errors;
+} StreamChunk;
+
+// Shared state of one streaming run
+typedef struct {
+    FILE *input;
+    StreamChunk chunks[STREAM_QUEUE_DEPTH];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t chunks_read;  // Chunks handed to the workers so far
+    size_t bytes_read;
+    int reader_done;     // Set once the reader reached end of input
+    int failed;          // Set on allocation, read or write failure, stops every stage
+    int read_failed;     // Set when the failure was an error reading the input
+} StreamPipeline;
+
+// Wall-clock seconds, for throughput across threads
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// FNV-1a hash of an expression's text
+static size_t hash_text(const char *text, size_t length) {
+    unsigned long long h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < length; i++) h = (h ^ (unsigned char)text[i]) * 0x100000001B3ULL;
+    return (size_t)h;
+}
+
+// Remove an entry from the recency list
+static void cache_unlink(StreamCache *cache, int index) {
+    StreamEntry *entry = &cache->entries[index];
+    if (entry->newer >= 0) cache->entries[entry->newer].older = entry->older; else cache->newest = entry->older;
+    if (entry->older >= 0) cache->entries[entry->older].newer = entry->newer; else cache->oldest = entry->newer;
+}
+
+// Put an entry at the front of the recency list
+static void cache_push(StreamCache *cache, int index) {
+    cache->entries[index].newer = -1;
+    cache->entries[index].older = cache->newest;
+    if (cache->newest >= 0) cache->entries[cache->newest].newer = index; else cache->oldest = index;
+    cache->newest = index;
+}
+
+// Parse, optimise and compile an expression into a free cache entry; returns 0 when out of memory
+static int cache_fill(StreamCache *cache, StreamEntry *entry, const char *text, size_t length) {
+    static const Bindings no_inputs = { { NULL }, 0 };  // Streamed expressions have no variables
+    entry->text = malloc(length + 1);
+    if (!entry->text) return 0;
+    memcpy(entry->text, text, length);
+    entry->text[length] = '\0';
+    entry->length = length;
+    Diagnostics errors;
+    Expr *expr = parse(entry->text, &cache->tokens, &cache->arena, &errors);
+    Expr *dag = expr && bind_variables(expr, &no_inputs, &errors) ? optimize(expr, &cache->arena) : NULL;
+    entry->compiled = dag && compile(dag, &entry->program);
+    if (errors.count) {
+        entry->error = errors.items[0];
+    } else if (!entry->compiled) {
+        entry->error.position = 0;
+        snprintf(entry->error.message, sizeof(entry->error.message), dag ? "too deep to compile" : "out of memory");
+    }
+    arena_reset(&cache->arena);  // The program does not point into the tree
+    return 1;
+}
+
+// Find the compiled form of an expression, compiling it (and evicting the least recently used entry) on a miss
+static StreamEntry *cache_lookup(StreamCache *cache, const char *text, size_t length, int *hit) {
+    size_t hash = hash_text(text, length);
+    int *bucket = &cache->buckets[hash & (STREAM_CACHE_ENTRIES * 2 - 1)];
+    for (int i = *bucket; i >= 0; i = cache->entries[i].chain) {
+        StreamEntry *entry = &cache->entries[i];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->text, text, length) == 0) {
+            cache_unlink(cache, i);
+            cache_push(cache, i);
+            *hit = 1;
+            return entry;
+        }
+    }
+    *hit = 0;
+
+    int index;
+    if (cache->count < STREAM_CACHE_ENTRIES) {
+        index = cache->count++;
+        cache->entries[index].program = (Program){ 0 };
+    } else {  // Evict the least recently used entry
+        index = cache->oldest;
+        StreamEntry *victim = &cache->entries[index];
+        int *link = &cache->buckets[victim->hash & (STREAM_CACHE_ENTRIES * 2 - 1)];
+        while (*link != index) link = &cache->entries[*link].chain;
+        *link = victim->chain;
+        cache_unlink(cache, index);
+        free(victim->text);
+    }
+    StreamEntry *entry = &cache->entries[index];
+    entry->text = NULL;
+    if (!cache_fill(cache, entry, text, length)) return NULL;  // The stream stops; the entry is only freed
+    entry->hash = hash;
+    entry->chain = *bucket;
+    *bucket = index;
+    cache_push(cache, index);
+    return entry;
+}
+
+// Evaluate every line of a chunk into its output buffer (runs on a worker thread)
+static int evaluate_chunk(StreamCache *cache, StreamChunk *chunk) {
+    char *cursor = chunk->data, *limit = chunk->data + chunk->length;
+    chunk->out_length = chunk->lines = chunk->hits = chunk->errors = 0;
+    while (cursor < limit) {
+        char *line = cursor;
+        char *end = memchr(cursor, '\n', limit - cursor);
+        if (!end) end = limit;
+        cursor = end + 1;
+        while (end > line && isspace((unsigned char)end[-1])) end--;  // Also drops \r
+        while (line < end && isspace((unsigned char)*line)) line++;
+        if (line == end) continue;  // Blank line
+        *end = '\0';  // The tokenizer reads up to the terminator
+
+        if (chunk->out_capacity - chunk->out_length < 128) {  // Room for one result or error message
+            size_t capacity = chunk->out_capacity ? chunk->out_capacity * 2 : 1 << 16;
+            char *out = realloc(chunk->out, capacity);
+            if (!out) return 0;
+            chunk->out = out;
+            chunk->out_capacity = capacity;
+        }
+        int hit;
+        StreamEntry *entry = cache_lookup(cache, line, (size_t)(end - line), &hit);
+        if (!entry) return 0;
+        chunk->lines++;
+        chunk->hits += hit;
+        if (entry->compiled) {
+            chunk->out_length += snprintf(chunk->out + chunk->out_length, 32, "%.17g\n", run(&entry->program, NULL));
+        } else {
+            chunk->out_length += snprintf(chunk->out + chunk->out_length, 128, "error: column %d: %s\n",
+                                          entry->error.position + 1, entry->error.message);
+            chunk->errors++;
+        }
+    }
+    return 1;
+}
+
+// Reader stage: fill free chunk slots with whole lines of the input; a line longer than a chunk grows the next one
+static void *stream_reader(void *arg) {
+    StreamPipeline *pipeline = arg;
+    char *carry = NULL;  // Partial line left over from the previous read
+    size_t carry_length = 0;
+    int eof = 0;
+
+    for (size_t seq = 0; !eof; seq++) {
+        StreamChunk *chunk = &pipeline->chunks[seq % STREAM_QUEUE_DEPTH];
+        pthread_mutex_lock(&pipeline->lock);
+        while (chunk->state != CHUNK_EMPTY && !pipeline->failed) pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        int failed = pipeline->failed;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (failed) break;
+
+        size_t needed = carry_length + STREAM_CHUNK_SIZE, length = 0;
+        if (chunk->capacity < needed) {
+            char *data = realloc(chunk->data, needed + 1);  // +1 for a terminator after the last line
+            if (data) {
+                chunk->data = data;
+                chunk->capacity = needed;
+            }
+            failed = !data;
+        }
+        if (!failed) {
+            if (carry_length) memcpy(chunk->data, carry, carry_length);
+            size_t got = fread(chunk->data + carry_length, 1, chunk->capacity - carry_length, pipeline->input);
+            length = carry_length + got;
+            eof = got == 0 || feof(pipeline->input);
+            failed = ferror(pipeline->input);  // Not the end of the input: the rest of it would be lost silently
+        }
+
+        size_t cut = length;  // Cut after the last newline and carry the rest
+        if (!failed && !eof) {
+            while (cut > 0 && chunk->data[cut - 1] != '\n') cut--;
+        }
+        size_t remainder = length - cut;
+        if (!failed && remainder) {
+            char *grown = realloc(carry, remainder);
+            if (grown) {
+                carry = grown;
+                memcpy(carry, chunk->data + cut, remainder);
+            }
+            failed = !grown;
+        }
+        carry_length = remainder;
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (failed) {
+            pipeline->failed = 1;
+            pipeline->read_failed = ferror(pipeline->input) != 0;
+        } else if (cut > 0) {
+            chunk->seq = pipeline->chunks_read++;
+            chunk->length = cut;
+            chunk->state = CHUNK_READ;
+            pipeline->bytes_read += cut;
+        } else {
+            seq--;  // No complete line yet; read into the same slot again
+        }
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+        if (failed) break;
+    }
+
+    free(carry);
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->reader_done = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+// Arguments of one worker thread
+typedef struct {
+    StreamPipeline *pipeline;
+    StreamCache *cache;
+} StreamWorker;
+
+// Evaluation stage: pick up read chunks in any order and evaluate them with this worker's cache
+static void *stream_worker(void *arg) {
+    StreamWorker *worker = arg;
+    StreamPipeline *pipeline = worker->pipeline;
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        StreamChunk *chunk = NULL;
+        if (pipeline->failed) break;
+        for (int i = 0; i < STREAM_QUEUE_DEPTH && !chunk; i++) {
+            if (pipeline->chunks[i].state == CHUNK_READ) chunk = &pipeline->chunks[i];
+        }
+        if (!chunk) {
+            if (pipeline->reader_done || pipeline->failed) break;
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+            continue;
+        }
+        chunk->state = CHUNK_EVALUATING;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        int ok = evaluate_chunk(worker->cache, chunk);
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->state = CHUNK_EVALUATED;
+        if (!ok) pipeline->failed = 1;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+// Evaluate a stream of expressions, one per line, writing one result per line in input order
+// Lines are read in large chunks, evaluated on worker threads that each cache compiled expressions, and
+// written in chunk order; throughput and the cache hit rate go to stderr at the end
+int evaluate_stream(FILE *input, FILE *output, int worker_count) {
+    StreamPipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.input = input;
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+    setvbuf(input, NULL, _IONBF, 0);  // The reader does its own large reads
+    if (worker_count < 1) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cpus > 1 ? (int)cpus - 1 : 1;
+    }
+    if (worker_count > STREAM_MAX_WORKERS) worker_count = STREAM_MAX_WORKERS;
+
+    StreamWorker workers[STREAM_MAX_WORKERS];
+    pthread_t threads[STREAM_MAX_WORKERS], reader;
+    int started = 0;
+    for (; started < worker_count; started++) {
+        StreamCache *cache = malloc(sizeof(StreamCache));
+        if (!cache) break;
+        memset(cache->buckets, -1, sizeof(cache->buckets));
+        cache->count = 0;
+        cache->newest = cache->oldest = -1;
+        cache->tokens = (TokenArray){ NULL, 0, 0 };
+        cache->arena = (Arena){ NULL };
+        workers[started].pipeline = &pipeline;
+        workers[started].cache = cache;
+    }
+    double start = monotonic_seconds();
+    if (started > 0) {
+        pthread_create(&reader, NULL, stream_reader, &pipeline);
+        for (int i = 0; i < started; i++) pthread_create(&threads[i], NULL, stream_worker, &workers[i]);
+    }
+
+    // Writer stage: runs on the calling thread, strictly in chunk order, one write per chunk
+    size_t lines = 0, hits = 0, errors = 0;
+    int write_failed = 0;
+    for (size_t seq = 0; started > 0; seq++) {
+        StreamChunk *chunk = &pipeline.chunks[seq % STREAM_QUEUE_DEPTH];
+        pthread_mutex_lock(&pipeline.lock);
+        while (!pipeline.failed && !(chunk->state == CHUNK_EVALUATED && chunk->seq == seq) &&
+               !(pipeline.reader_done && seq >= pipeline.chunks_read)) {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+        }
+        int finished = pipeline.failed || (pipeline.reader_done && seq >= pipeline.chunks_read);
+        pthread_mutex_unlock(&pipeline.lock);
+        if (finished) break;
+
+        write_failed |= fwrite(chunk->out, 1, chunk->out_length, output) != chunk->out_length;
+        lines += chunk->lines;
+        hits += chunk->hits;
+        errors += chunk->errors;
+
+        pthread_mutex_lock(&pipeline.lock);
+        chunk->state = CHUNK_EMPTY;
+        if (write_failed) pipeline.failed = 1;
+        pthread_cond_broadcast(&pipeline.changed);
+        pthread_mutex_unlock(&pipeline.lock);
+    }
+    fflush(output);
+    double seconds = monotonic_seconds() - start;
+
+    if (started > 0) {
+        pthread_join(reader, NULL);
+        for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        StreamCache *cache = workers[i].cache;
+        for (int e = 0; e < cache->count; e++) {
+            free(cache->entries[e].text);
+            free_program(&cache->entries[e].program);
+        }
+        free_tokens(&cache->tokens);
+        arena_free(&cache->arena);
+        free(cache);
+    }
+    for (int i = 0; i < STREAM_QUEUE_DEPTH; i++) {
+        free(pipeline.chunks[i].data);
+        free(pipeline.chunks[i].out);
+    }
+    int failed = pipeline.failed || started == 0;
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.changed);
+
+    fprintf(stderr, "%zu expressions (%.1f MB) in %.3f s: %.0f expressions/s, %.1f MB/s, %d workers\n", lines,
+            pipeline.bytes_read / 1e6, seconds, lines / seconds, pipeline.bytes_read / 1e6 / seconds, started);
+    fprintf(stderr, "Cache hit rate %.1f%% (%zu hits, %zu compiled), %zu errors\n",
+            lines ? 100.0 * hits / lines : 0.0, hits, lines - hits, errors);
+    if (failed) {
+        fprintf(stderr, "Streaming stopped early: %s\n",
+                write_failed ? "write error" : pipeline.read_failed ? "read error" : "out of memory");
+    }
+    return failed;
+}
+
+// Entry point of the program
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench-vm") == 0) {  // Benchmark mode: trac --bench-vm [EXPR] [ITERATIONS]
+        return bench_vm(argc > 2 ? argv[2] : "(1.5+2.25)*(3-0.5)/(4+1)-2*3+(7-1)/(2+1)*1.5",
+                        argc > 3 ? atol(argv[3]) : 10000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-batch") == 0) {  // Benchmark mode: trac --bench-batch [EXPR] [ROWS]
+        return bench_batch(argc > 2 ? argv[2] : "(x*2.5+y)*(x-y)/(z+1.5)-x*y+(z-x)*(y+3)",
+                           argc > 3 ? atol(argv[3]) : 4000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-opt") == 0) {  // Benchmark mode: trac --bench-opt [EXPR] [ITERATIONS]
+        return bench_optimize(argc > 2 ? argv[2] : "(2*3)+x*(2*3)+(x+y)*(x+y)/((x+y)*(x+y)+1)-(x+y)/4+y*1-0",
+                              argc > 3 ? atol(argv[3]) : 10000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-jit") == 0) {  // Benchmark mode: trac --bench-jit [EXPR] [ITERATIONS]
+        return bench_jit(argc > 2 ? argv[2] : "(x*2.5+y)*(x-y)/(z+1.5)-x*y+(z-x)*(y+3)+sqrt(abs(x))",
+                         argc > 3 ? atol(argv[3]) : 10000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--check-jit") == 0) {  // Check mode: trac --check-jit
+        return check_jit();
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-functions") == 0) {  // Benchmark mode: trac --bench-functions [ROWS]
+        return bench_functions(argc > 2 ? atol(argv[2]) : 4000000);
+    }
+    if (argc > 2 && strcmp(argv[1], "--columns") == 0) {  // Batch mode: trac --columns EXPR [FILE.csv]
+        FILE *data = argc > 3 ? fopen(argv[3], "r") : stdin;
+        if (!data) {
+            fprintf(stderr, "Cannot open %s\n", argv[3]);
+            return 1;
+        }
+        int status = evaluate_columns(argv[2], data, 0);
+        if (data != stdin) fclose(data);
+        return status;
+    }
+    if (argc > 2 && strcmp(argv[1], "--gradient") == 0) {  // Batch mode with derivatives: trac --gradient EXPR [FILE.csv]
+        FILE *data = argc > 3 ? fopen(argv[3], "r") : stdin;
+        if (!data) {
+            fprintf(stderr, "Cannot open %s\n", argv[3]);
+            return 1;
+        }
+        int status = evaluate_columns(argv[2], data, 1);
+        if (data != stdin) fclose(data);
+        return status;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-gradient") == 0) {  // Benchmark mode: trac --bench-gradient [EXPR] [ITERATIONS]
+        return bench_gradient(argc > 2 ? argv[2] : "x*y*z+sin(x)*exp(y/4)-sqrt(x*x+y*y+1)/(z+3)+max(x,z)^2+log(abs(y)+1)",
+                              argc > 3 ? atol(argv[3]) : 2000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-fuzz") == 0) {  // Benchmark and check mode: trac --bench-fuzz [TREES] [DEPTH] [SEED]
+        return bench_fuzz(argc > 2 ? atol(argv[2]) : 2000, argc > 3 ? atoi(argv[3]) : 6,
+                          argc > 4 ? (unsigned)strtoul(argv[4], NULL, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--stream") == 0) {  // Streaming mode: trac --stream [FILE|-] [WORKERS]
+        FILE *input = argc > 2 && strcmp(argv[2], "-") != 0 ? fopen(argv[2], "r") : stdin;
+        if (!input) {
+            fprintf(stderr, "Cannot open %s\n", argv[2]);
+            return 1;
+        }
+        int status = evaluate_stream(input, stdout, argc > 3 ? atoi(argv[3]) : 0);
+        if (input != stdin) fclose(input);
+        return status;
+    }
+
+    char input[256];  // Buffer for the input string
+    printf("Enter an expression: ");
+    fgets(input, sizeof(input), stdin);  // Read input from the user
+
+    Bindings no_inputs = { { NULL }, 0 };  // Interactive expressions have no variables
+    Diagnostics errors;
+    double result;
+    if (!evaluate_formula(input, &no_inputs, NULL, &result, &errors)) {  // Parse and evaluate the expression
+        print_diagnostics(stderr, input, &errors);
+        return 1;
+    }
+
+    printf("Result: %f\n", result);  // Print the result
+
+    return 0;
+}
@@ -0,0 +1,399 @@
+// Pythagorean triple generator
+//
+// Produces every triple (a, b, c) with a < b < c <= N and a^2 + b^2 == c^2, the
+// same set as pythagoreanTriplets in test.hs, in time proportional to the
+// output instead of the N^3 of trying every (a, b, c).
+//
+//   triples N                 print every triple, one "a b c" per line
+//   triples --sorted N        print them in the order of test.hs (by a, then
+//                             b); holds all in memory
+//   triples --count N         count triples and primitive triples without
+//                             printing them
+//   triples --bench [N]       time the naive search, the Berggren tree and
+//                             Euclid's formula for N = 10, 100, ... up to N
+//                             (default 10^8)
+//   --threads T               worker threads (default: one per hardware thread)
+//
+// Primitive triples come from Euclid's formula: for coprime m > k of opposite
+// parity, (m^2 - k^2, 2mk, m^2 + k^2) is primitive and every primitive triple
+// arises exactly once. Coprimality is sieved per m from the odd primes of m.
+// Each primitive with hypotenuse c <= N is followed by its multiples up to N.
+// Work is split across threads by m, handed out in increasing order because
+// small m carry most of the multiples. Each thread formats into its own buffer,
+// so without --sorted the lines of different threads interleave in blocks. The
+// Berggren tree (three matrices that map a primitive triple to three larger
+// ones, rooted at 3 4 5) is an independent second generator used by --bench to
+// cross-check the count and checksum.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ======================
+// Limits
+// ======================
+const uint64_t MAX_LIMIT = 1ull << 62;     // Largest N; keeps multiples of c and 2mk within 64 bits
+const uint64_t DEFAULT_BENCH_LIMIT = 100000000;
+const size_t WRITE_BUFFER_BYTES = 1 << 20; // Per-thread output buffer
+const double NAIVE_BUDGET_MS = 3000;       // Naive runs predicted to take longer are only estimated
+
+struct Triple {
+  uint64_t a, b, c;
+  bool operator<(const Triple &other) const {
+    if (a != other.a) return a < other.a;
+    return b < other.b;
+  }
+};
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int hardwareThreads() {
+  return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// Runs work(0) .. work(count - 1) on their own threads and waits for them
+template <class Work>
+static void runParallel(int count, Work work) {
+  if (count == 1) {
+    work(0);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int index = 0; index < count; index++) threads.emplace_back(work, index);
+  for (std::thread &thread : threads) thread.join();
+}
+
+// ======================
+// Euclid's formula
+// ======================
+// Largest x with x^2 + base <= limit
+static uint64_t rootBelow(uint64_t limit, uint64_t base) {
+  if (base > limit) return 0;
+  uint64_t x = (uint64_t)std::sqrt((double)(limit - base));
+  while (x && x * x + base > limit) x--;
+  while ((x + 1) * (x + 1) + base <= limit) x++;
+  return x;
+}
+
+// Largest m with a primitive triple under limit (m^2 + 1 <= limit)
+static uint64_t maxM(uint64_t limit) {
+  return rootBelow(limit, 1);
+}
+
+// Marks the k <= kMax that share an odd prime factor with m. k has the opposite
+// parity of m, so 2 is never shared and only the odd primes of m need sieving;
+// this is cheaper than a gcd per k. The marks live in a per-thread buffer.
+static const std::vector<uint8_t> &sharedFactors(uint64_t m, uint64_t kMax) {
+  thread_local std::vector<uint8_t> shared;
+  shared.assign(kMax + 1, 0);
+  uint64_t rest = m >> __builtin_ctzll(m);
+  for (uint64_t p = 3; p * p <= rest; p += 2) {
+    if (rest % p) continue;
+    while (rest % p == 0) rest /= p;
+    for (uint64_t k = p; k <= kMax; k += p) shared[k] = 1;
+  }
+  if (rest > 1)
+    for (uint64_t k = rest; k <= kMax; k += rest) shared[k] = 1;
+  return shared;
+}
+
+// Calls visit(a, b, c) for every triple whose primitive has Euclid parameter m
+template <class Visit>
+static void triplesForM(uint64_t limit, uint64_t m, Visit &visit) {
+  uint64_t mm = m * m, kMax = std::min(m - 1, rootBelow(limit, mm));
+  const std::vector<uint8_t> &shared = sharedFactors(m, kMax);
+  for (uint64_t k = (m & 1) ? 2 : 1; k <= kMax; k += 2) {
+    if (shared[k]) continue;
+    uint64_t a = mm - k * k, b = 2 * m * k, c = mm + k * k;
+    if (a > b) std::swap(a, b);
+    for (uint64_t ta = a, tb = b, tc = c; tc <= limit; ta += a, tb += b, tc += c) visit(ta, tb, tc);
+  }
+}
+
+// Counts the primitives with parameter m and all their multiples without visiting them
+static void countForM(uint64_t limit, uint64_t m, uint64_t &primitives, uint64_t &triples) {
+  uint64_t mm = m * m, kMax = std::min(m - 1, rootBelow(limit, mm));
+  const std::vector<uint8_t> &shared = sharedFactors(m, kMax);
+  for (uint64_t k = (m & 1) ? 2 : 1; k <= kMax; k += 2) {
+    if (shared[k]) continue;
+    primitives++;
+    triples += limit / (mm + k * k);
+  }
+}
+
+// Runs body(worker, m) for every m from 2 to maxM(limit), m handed out one at a time
+template <class Body>
+static void forEachM(uint64_t limit, int threads, Body body) {
+  uint64_t last = maxM(limit);
+  std::atomic<uint64_t> next{2};
+  runParallel(threads, [&](int worker) {
+    for (uint64_t m; (m = next.fetch_add(1, std::memory_order_relaxed)) <= last;) body(worker, m);
+  });
+}
+
+// ======================
+// Berggren tree
+// ======================
+// Calls visit(a, b, c) for every triple, walking the primitive tree depth-first
+template <class Visit>
+static void berggrenTriples(uint64_t limit, Visit &visit) {
+  if (limit < 5) return;
+  std::vector<Triple> stack = {{3, 4, 5}};
+  while (!stack.empty()) {
+    Triple t = stack.back();
+    stack.pop_back();
+    uint64_t a = std::min(t.a, t.b), b = std::max(t.a, t.b);
+    for (uint64_t ta = a, tb = b, tc = t.c; tc <= limit; ta += a, tb += b, tc += t.c) visit(ta, tb, tc);
+    int64_t x = t.a, y = t.b, z = t.c;
+    const Triple children[3] = {
+        {(uint64_t)(x - 2 * y + 2 * z), (uint64_t)(2 * x - y + 2 * z), (uint64_t)(2 * x - 2 * y + 3 * z)},
+        {(uint64_t)(x + 2 * y + 2 * z), (uint64_t)(2 * x + y + 2 * z), (uint64_t)(2 * x + 2 * y + 3 * z)},
+        {(uint64_t)(-x + 2 * y + 2 * z), (uint64_t)(-2 * x + y + 2 * z), (uint64_t)(-2 * x + 2 * y + 3 * z)}};
+    for (const Triple &child : children)
+      if (child.c <= limit) stack.push_back(child);
+  }
+}
+
+// ======================
+// Naive search
+// ======================
+// The comprehension of test.hs as written: every a <= b <= c <= limit
+template <class Visit>
+static void naiveTriples(uint64_t limit, Visit &visit) {
+  for (uint64_t a = 1; a <= limit; a++)
+    for (uint64_t b = a; b <= limit; b++)
+      for (uint64_t c = b; c <= limit; c++)
+        if (a * a + b * b == c * c) visit(a, b, c);
+}
+
+// ======================
+// Output
+// ======================
+// Formats triples into a buffer and writes it out whole, under a lock shared by the threads
+class TripleWriter {
+ public:
+  TripleWriter(FILE *file, std::mutex &lock) : file_(file), lock_(lock), buffer_(WRITE_BUFFER_BYTES) {}
+  ~TripleWriter() { flush(); }
+
+  void operator()(uint64_t a, uint64_t b, uint64_t c) {
+    if (used_ + 3 * 21 > buffer_.size()) flush();
+    char *at = buffer_.data() + used_, *end = buffer_.data() + buffer_.size();
+    at = std::to_chars(at, end, a).ptr;
+    *at++ = ' ';
+    at = std::to_chars(at, end, b).ptr;
+    *at++ = ' ';
+    at = std::to_chars(at, end, c).ptr;
+    *at++ = '\n';
+    used_ = at - buffer_.data();
+  }
+
+  void flush() {
+    if (used_ == 0) return;
+    std::lock_guard<std::mutex> guard(lock_);
+    fwrite(buffer_.data(), 1, used_, file_);
+    used_ = 0;
+  }
+
+ private:
+  FILE *file_;
+  std::mutex &lock_;
+  std::vector<char> buffer_;
+  size_t used_ = 0;
+};
+
+// Order-independent digest of a set of triples, so generators can be compared
+struct Digest {
+  uint64_t count = 0, sum = 0;
+  void operator()(uint64_t a, uint64_t b, uint64_t c) {
+    count++;
+    sum += (a * 0x9E3779B97F4A7C15ull) ^ (b * 0xC2B2AE3D27D4EB4Full) ^ (c * 0x165667B19E3779F9ull);
+  }
+  void add(const Digest &other) {
+    count += other.count;
+    sum += other.sum;
+  }
+  bool operator==(const Digest &other) const { return count == other.count && sum == other.sum; }
+};
+
+static void printTriples(uint64_t limit, int threads) {
+  std::mutex lock;
+  std::vector<std::unique_ptr<TripleWriter>> writers(threads);
+  forEachM(limit, threads, [&](int worker, uint64_t m) {
+    if (!writers[worker]) writers[worker].reset(new TripleWriter(stdout, lock));
+    triplesForM(limit, m, *writers[worker]);
+  });
+  writers.clear();
+  fflush(stdout);
+}
+
+static void printSorted(uint64_t limit, int threads) {
+  std::vector<std::vector<Triple>> found(threads);
+  forEachM(limit, threads, [&](int worker, uint64_t m) {
+    auto keep = [&](uint64_t a, uint64_t b, uint64_t c) { found[worker].push_back({a, b, c}); };
+    triplesForM(limit, m, keep);
+  });
+  std::vector<Triple> all;
+  for (std::vector<Triple> &part : found) {
+    all.insert(all.end(), part.begin(), part.end());
+    std::vector<Triple>().swap(part);
+  }
+  std::sort(all.begin(), all.end());
+  std::mutex lock;
+  TripleWriter out(stdout, lock);
+  for (const Triple &t : all) out(t.a, t.b, t.c);
+  out.flush();
+  fflush(stdout);
+}
+
+static void countTriples(uint64_t limit, int threads, uint64_t &primitives, uint64_t &triples) {
+  std::vector<uint64_t> primitiveCounts(threads), tripleCounts(threads);
+  forEachM(limit, threads, [&](int worker, uint64_t m) {
+    countForM(limit, m, primitiveCounts[worker], tripleCounts[worker]);
+  });
+  primitives = triples = 0;
+  for (int worker = 0; worker < threads; worker++) {
+    primitives += primitiveCounts[worker];
+    triples += tripleCounts[worker];
+  }
+}
+
+// ======================
+// Benchmark
+// ======================
+static Digest euclidDigest(uint64_t limit, int threads) {
+  std::vector<Digest> digests(threads);
+  forEachM(limit, threads, [&](int worker, uint64_t m) { triplesForM(limit, m, digests[worker]); });
+  Digest total;
+  for (const Digest &digest : digests) total.add(digest);
+  return total;
+}
+
+// Times every generator for limit = 10, 100, ... up to maxLimit; the naive search is
+// extrapolated as N^3 once a run would exceed NAIVE_BUDGET_MS
+static int runBench(uint64_t maxLimit, int threads) {
+  printf("%12s %12s %11s %14s %12s %12s %12s %10s\n", "N", "triples", "primitive", "naive ms", "Berggren ms",
+         "Euclid ms", "count ms", "speedup");
+  double naiveMs = 0;
+  uint64_t naiveLimit = 0;
+  bool agree = true;
+  for (uint64_t limit = 10; limit <= maxLimit; limit *= 10) {
+    auto start = std::chrono::steady_clock::now();
+    Digest euclid = euclidDigest(limit, threads);
+    double euclidMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    Digest berggren;
+    berggrenTriples(limit, berggren);
+    double berggrenMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    uint64_t primitives, triples;
+    countTriples(limit, threads, primitives, triples);
+    double countMs = millisecondsSince(start);
+
+    bool estimated = true;
+    double predicted = naiveLimit ? naiveMs * std::pow((double)limit / naiveLimit, 3) : 0;
+    if (predicted <= NAIVE_BUDGET_MS) {
+      start = std::chrono::steady_clock::now();
+      Digest naive;
+      naiveTriples(limit, naive);
+      naiveMs = millisecondsSince(start);
+      naiveLimit = limit;
+      estimated = false;
+      if (!(naive == euclid)) {
+        printf("N=%llu: naive search found %llu triples, Euclid %llu\n", (unsigned long long)limit,
+               (unsigned long long)naive.count, (unsigned long long)euclid.count);
+        agree = false;
+      }
+    }
+    double shownNaiveMs = estimated ? predicted : naiveMs;
+    if (!(berggren == euclid) || triples != euclid.count) {
+      printf("N=%llu: Berggren found %llu triples, Euclid %llu, counted %llu\n", (unsigned long long)limit,
+             (unsigned long long)berggren.count, (unsigned long long)euclid.count, (unsigned long long)triples);
+      agree = false;
+    }
+    char naiveText[32];
+    snprintf(naiveText, sizeof naiveText, "%s%.4g", estimated ? "~" : "", shownNaiveMs);
+    printf("%12llu %12llu %11llu %14s %12.3f %12.3f %12.3f %9.3gx\n", (unsigned long long)limit,
+           (unsigned long long)euclid.count, (unsigned long long)primitives, naiveText, berggrenMs, euclidMs,
+           countMs, shownNaiveMs / std::max(euclidMs, 1e-3));
+    fflush(stdout);
+    if (limit > maxLimit / 10) break;
+  }
+  printf("(~ = naive time extrapolated as N^3; %d thread%s)\n", threads, threads == 1 ? "" : "s");
+  return agree ? 0 : 1;
+}
+
+// ======================
+// Main
+// ======================
+static bool parseLimit(const char *text, uint64_t &limit) {
+  char *end;
+  errno = 0;
+  double value = strtod(text, &end);
+  if (*end || errno || value < 1 || value > (double)MAX_LIMIT || value != std::floor(value)) return false;
+  limit = (uint64_t)value;
+  return true;
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: triples [--threads T] N\n"
+          "       triples [--threads T] --sorted N\n"
+          "       triples [--threads T] --count N\n"
+          "       triples [--threads T] --bench [N]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  int threads = hardwareThreads();
+  std::vector<const char *> args;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--threads")) {
+      if (++i == argc || (threads = atoi(argv[i])) < 1) return usage();
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.empty()) return usage();
+  std::string mode = args[0][0] == '-' ? args[0] : "";
+  size_t limitArg = mode.empty() ? 0 : 1;
+  uint64_t limit = DEFAULT_BENCH_LIMIT;
+  if (args.size() > limitArg + 1) return usage();
+  if (args.size() == limitArg + 1 && !parseLimit(args[limitArg], limit)) {
+    fprintf(stderr, "triples: N must be a whole number from 1 to %llu, not %s\n", (unsigned long long)MAX_LIMIT,
+            args[limitArg]);
+    return 2;
+  }
+  if (mode == "--bench") return runBench(limit, threads);
+  if (args.size() != limitArg + 1) return usage();
+  if (mode == "--count") {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t primitives, triples;
+    countTriples(limit, threads, primitives, triples);
+    printf("%llu triples with c <= %llu, %llu primitive (%.3f ms)\n", (unsigned long long)triples,
+           (unsigned long long)limit, (unsigned long long)primitives, millisecondsSince(start));
+    return 0;
+  }
+  if (mode == "--sorted") {
+    printSorted(limit, threads);
+    return 0;
+  }
+  if (!mode.empty()) return usage();
+  printTriples(limit, threads);
+  return 0;
+}